@@ -13,8 +13,8 @@
 #define BUFFER_OFFSET(x)  ((const void*) (x))
 
 // File Scope Globals
-static enum Buffer_IDs {ArrayBuffer, NumBuffers};
-static enum Attrib_IDs {vPosition = 0};
+enum Buffer_IDs {ArrayBuffer, NumBuffers};
+enum Attrib_IDs {vPosition = 0};
 static GLuint Buffers[NumBuffers];
 static const GLuint NumVertices = 6;
 static GLuint program;
@@ -8,9 +8,16 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <GL/glew.h>
 #include <GL/freeglut.h>
+#include <iostream>
+#include "FramePipeline.h"
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "Platform.h"
+#include "Profiler.h"
 #include "ShaderUtil.h"
 #include "vmath.h"
-#include "VBObject.h"
+#include "MeshCache.h"
+#include "RenderQueue.h"
 using namespace vmath;
 
 #define BUFFER_OFFSET(x)  ((const GLvoid*) (x))
@@ -18,14 +25,129 @@ using namespace vmath;
 // File Scope Globals
 static float aspect = 1.0;
 static GLuint color_buffer;
-static GLuint model_matrix_buffer;
 static GLuint shader_prog;
 static GLint view_matrix_loc;
 static GLint projection_matrix_loc;
-static VBObject object;
+static GLint transform_loc;
+static GLint normal_matrix_loc;
+static MeshCache mesh_cache;
+static VBObject *object;
+static RenderQueue render_queue;
+static FramePipeline *frame_pipeline;
 
 static const int INSTANCE_COUNT = 100;
 
+// Define one of these to upload each instance's transformation as a
+// vmath::trs (rotation quaternion, translation and uniform scale, 32 bytes;
+// instancing_trs.vs.glsl rebuilds the matrix) or a vmath::mat3x4 (the rows
+// of the affine matrix, 48 bytes) instead of a 64-byte mat4
+// #define USE_TRS_INSTANCES
+// #define USE_AFFINE_INSTANCES
+
+#if defined(USE_TRS_INSTANCES)
+typedef trs instance_transform;
+static const char VERTEX_SHADER[] = "../../shaders/instancing_trs.vs.glsl";
+static const char TRANSFORM_ATTRIBUTE[] = "model_rotation";
+#elif defined(USE_AFFINE_INSTANCES)
+typedef mat3x4 instance_transform;
+static const char VERTEX_SHADER[] = "../../shaders/instancing_affine.vs.glsl";
+static const char TRANSFORM_ATTRIBUTE[] = "model_rows";
+#else
+typedef mat4 instance_transform;
+static const char VERTEX_SHADER[] = "../../shaders/instancing.vs.glsl";
+static const char TRANSFORM_ATTRIBUTE[] = "model_matrix";
+#endif
+
+// The transformation takes one vec4 attribute location per 16 bytes
+static const int TRANSFORM_LOCATIONS = sizeof(instance_transform) / sizeof(vec4);
+
+// A mat4 or mat3x4 may scale unevenly, so each instance also gets a normal
+// matrix, uploaded after all the transformations. The scale of a trs is
+// uniform and its shader transforms normals by the rotation alone.
+#if !defined(USE_TRS_INSTANCES)
+#define USE_NORMAL_MATRICES
+static const size_t INSTANCE_UPLOAD_SIZE = sizeof(instance_transform) + sizeof(mat3);
+#else
+static const size_t INSTANCE_UPLOAD_SIZE = sizeof(instance_transform);
+#endif
+
+// How many frames the GPU may run behind the CPU. The model matrices of a
+// frame are computed on a job thread while the previous frame is drawn.
+static const unsigned int FRAMES_IN_FLIGHT = 2;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: prepare_frame
+//
+// Purpose: FramePipeline callback. Computes the model transformations of a
+//          frame; runs on a job thread, one frame ahead of display.
+// 
+// INPUTS: user         - unused
+//         frame        - unused; the animation follows the time
+//         milliseconds - the time of the frame
+//         upload       - receives INSTANCE_COUNT instance_transforms, then
+//                        as many normal matrices
+//         extra        - receives the animation time, for the view matrix
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void prepare_frame(void *user, unsigned long long frame, unsigned int milliseconds,
+                          void *upload, void *extra)
+{
+    (void)user;
+    (void)frame;
+    PROFILE_ZONE("prepare_frame");
+    float t = float(milliseconds & 0x3FFF) / float(0x3FFF);
+    instance_transform *transforms = (instance_transform *)upload;
+#ifdef USE_NORMAL_MATRICES
+    mat3 *normal_matrices = (mat3 *)(transforms + INSTANCE_COUNT);
+#endif
+
+    vec3 angles[INSTANCE_COUNT];
+    vec3 translations[INSTANCE_COUNT];
+
+    for (int n = 0; n < INSTANCE_COUNT; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        angles[n] = vec3(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f);
+        translations[n] = vec3(10.0f + a, 40.0f + b, 50.0f + c);
+    }
+
+#if defined(USE_TRS_INSTANCES)
+    // The same transformation as below: the rotations combine into one
+    // quaternion, and the translation moves in front of them
+    for (int n = 0; n < INSTANCE_COUNT; ++n)
+    {
+        quat rotation = quat_rotate(angles[n][0], 1.0f, 0.0f, 0.0f) *
+                        quat_rotate(angles[n][1], 0.0f, 1.0f, 0.0f) *
+                        quat_rotate(angles[n][2], 0.0f, 0.0f, 1.0f);
+        transforms[n] = trs(rotation, rotate(rotation, translations[n]));
+    }
+#elif defined(USE_AFFINE_INSTANCES)
+    // As below, leaving out the constant last row
+    euler_to_mat3x4_array(angles, translations, transforms, INSTANCE_COUNT, SINCOS_FAST);
+#else
+    // rotate(angles[n][0], 1.0f, 0.0f, 0.0f) *
+    // rotate(angles[n][1], 0.0f, 1.0f, 0.0f) *
+    // rotate(angles[n][2], 0.0f, 0.0f, 1.0f) *
+    // translate(translations[n]), in one step for every instance, with
+    // the sines and cosines of 16 instances at a time. At this scene's
+    // distances the fast tier's error is a small fraction of a pixel.
+    euler_to_mat4_array(angles, translations, transforms, INSTANCE_COUNT, SINCOS_FAST);
+#endif
+#ifdef USE_NORMAL_MATRICES
+    for (int n = 0; n < INSTANCE_COUNT; ++n)
+        normal_matrices[n] = normal_matrix(transforms[n]);
+#endif
+
+    *(float *)extra = t;
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,37 +162,41 @@ static const int INSTANCE_COUNT = 100;
 ///////////////////////////////////////////////////////////////////////////////
 void display()
 {
-    float t = float(GetTickCount() & 0x3FFF) / float(0x3FFF);
+    PROFILE_ZONE("display");
+    GL_CALL_SITE("display");
+    GLStateCache& state = GLStateCache::Current();
+
+    // Wait for this frame's matrices and upload them to a part of the
+    // buffer the GPU is no longer reading
+    const PIPELINE_FRAME& frame = frame_pipeline->BeginFrame();
+    float t = *(const float *)frame.extra;
 
     // Clear
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Setup
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-
-    // Bind the model matrix VBO and change its data
-    glBindBuffer(GL_ARRAY_BUFFER, model_matrix_buffer);
+    // Setup. Nothing else changes this state, so after the first frame the
+    // state cache drops these calls (and the ones below) without calling GL.
+    state.DepthFunc(GL_LEQUAL);
 
-    // Set model matrices for each instance
-    mat4 * matrices = (mat4 *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-
-    for (int n = 0; n < INSTANCE_COUNT; ++n)
+    // Point the instanced transformation attributes at that part of the
+    // buffer, which BeginFrame left bound
+    state.BindVertexArray(object->GetVertexArray());
+    for (int i = 0; i < TRANSFORM_LOCATIONS; i++)
     {
-        float a = 50.0f * float(n) / 4.0f;
-        float b = 50.0f * float(n) / 5.0f;
-        float c = 50.0f * float(n) / 6.0f;
-
-        matrices[n] = rotate(a + t * 360.0f, 1.0f, 0.0f, 0.0f) *
-                      rotate(b + t * 360.0f, 0.0f, 1.0f, 0.0f) *
-                      rotate(c + t * 360.0f, 0.0f, 0.0f, 1.0f) *
-                      translate(10.0f + a, 40.0f + b, 50.0f + c);
+        glVertexAttribPointer(transform_loc + i, 4, GL_FLOAT, GL_FALSE, sizeof(instance_transform),
+                              BUFFER_OFFSET(frame.offset + sizeof(vec4) * i));
     }
-
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+#ifdef USE_NORMAL_MATRICES
+    for (int i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(normal_matrix_loc + i, 3, GL_FLOAT, GL_FALSE, sizeof(mat3),
+                              BUFFER_OFFSET(frame.offset + INSTANCE_COUNT * sizeof(instance_transform) +
+                                            sizeof(vec3) * i));
+    }
+#endif
 
     // Activate instancing program
-    glUseProgram(shader_prog);
+    state.UseProgram(shader_prog);
 
     // Set up the view and projection matrices
     mat4 view_matrix(translate(0.0f, 0.0f, -1500.0f) * rotate(t * 360.0f * 2.0f, 0.0f, 1.0f, 0.0f));
@@ -79,13 +205,25 @@ void display()
     glUniformMatrix4fv(view_matrix_loc, 1, GL_FALSE, view_matrix);
     glUniformMatrix4fv(projection_matrix_loc, 1, GL_FALSE, projection_matrix);
 
-    // Render INSTANCE_COUNT objects
-    object.Render(0, INSTANCE_COUNT);
+    // Render INSTANCE_COUNT objects. The queue binds the program and the
+    // depth state the item asks for, in sorted order with any other items
+    // of the frame.
+    RENDER_ITEM item;
+    RenderQueue::InitItem(item, shader_prog, object, INSTANCE_COUNT);
+
+    render_queue.Clear();
+    render_queue.Add(item);
+    render_queue.Submit();
 
-    glUseProgram(0);
-    glDisable(GL_DEPTH_TEST);
+    frame_pipeline->EndFrame();
 
     glutSwapBuffers();
+
+    // Pick up the zones recorded since the last frame, and the GPU zones of
+    // earlier frames that have finished. This frame's display zone ends
+    // after the call and is collected with the next frame.
+    Profiler::Collect();
+    GLIntercept::EndFrame();
 }
 
 
@@ -102,11 +240,19 @@ void display()
 ///////////////////////////////////////////////////////////////////////////////
 void initialize()
 {
+#ifdef _DEBUG
+    // Record the profiler zones; finalize prints them and saves a trace
+    Profiler::SetEnabled(true);
+
+    // Count the GL calls of each frame; finalize prints the last one
+    GLIntercept::Install();
+#endif /* DEBUG */
+
     ShaderUtil su;
 
     static ShaderInfo shader_info[] =
     {
-        { GL_VERTEX_SHADER, "../../shaders/instancing.vs.glsl", 0 },
+        { GL_VERTEX_SHADER, VERTEX_SHADER, 0 },
         { GL_FRAGMENT_SHADER, "../../shaders/instancing.fs.glsl", 0 },
         { GL_NONE, NULL, 0 }
     };
@@ -124,16 +270,18 @@ void initialize()
     // more concise by assuming the vertex attributes are where we asked
     // the compiler to put them.
     int color_loc       = glGetAttribLocation(shader_prog, "color");
-    int matrix_loc      = glGetAttribLocation(shader_prog, "model_matrix");
+    transform_loc       = glGetAttribLocation(shader_prog, TRANSFORM_ATTRIBUTE);
+    normal_matrix_loc   = glGetAttribLocation(shader_prog, "normal_matrix");
 
-    // Load the object
-    object.LoadFromVBM("../../media/armadillo_low.vbm", 
+    // Load the object, or share it if another part of the program already
+    // loaded the same mesh
+    object = mesh_cache.Acquire("../../media/armadillo_low.vbm", 
         glGetAttribLocation(shader_prog, "position"), 
         glGetAttribLocation(shader_prog, "normal"),
         -1);  // our shader doesn't use texture coordinates
 
     // Bind its vertex array object so that we can append the instanced attributes
-    object.BindVertexArray();
+    object->BindVertexArray();
 
     // Configure the regular vertex attribute arrays - position and color.
     /*
@@ -147,9 +295,10 @@ void initialize()
     glEnableVertexAttribArray(normal_loc);
     */
 
-    // Generate the colors of the objects
+    // Generate the colors of the objects. The vmath constructors are
+    // constexpr, so the table is built by the compiler, not at startup.
     const int NUM_COLORS = 7;
-    vec4 color_table[NUM_COLORS] = {
+    static const vec4 color_table[NUM_COLORS] = {
         vec4(1.0, 0.0, 0.0, 1.0),
         vec4(0.0, 1.0, 0.0, 1.0),
         vec4(1.0, 1.0, 0.0, 1.0),
@@ -166,7 +315,7 @@ void initialize()
     }
 
     glGenBuffers(1, &color_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, color_buffer);
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, color_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(colors), colors, GL_DYNAMIC_DRAW);
 
     // Now we set up the color array. We want each instance of our geometry
@@ -182,29 +331,41 @@ void initialize()
     // Likewise, we can do the same with the model matrix. Note that a
     // matrix input to the vertex shader consumes N consecutive input
     // locations, where N is the number of columns in the matrix. So...
-    // we have four vertex attributes to set up.
-    glGenBuffers(1, &model_matrix_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, model_matrix_buffer);
-    glBufferData(GL_ARRAY_BUFFER, INSTANCE_COUNT * sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    // we have four vertex attributes to set up (two for a trs, three for a
+    // mat3x4). The transformations live in the frame pipeline's buffer, one
+    // copy per frame in flight; display points the attributes at the
+    // current copy.
+    frame_pipeline = new FramePipeline(FRAMES_IN_FLIGHT, INSTANCE_COUNT * INSTANCE_UPLOAD_SIZE,
+                                       sizeof(float), prepare_frame, NULL);
 
 
     // Set up the vertex attribute
     // Loop over each column of the matrix...
-    for (int i = 0; i < 4; i++)
+    for (int i = 0; i < TRANSFORM_LOCATIONS; i++)
     {
         // Set up the vertex attribute
-        glVertexAttribPointer(matrix_loc + i,              // Location
+        glVertexAttribPointer(transform_loc + i,              // Location
                               4, GL_FLOAT, GL_FALSE,       // vec4
-                              sizeof(mat4),                // Stride
+                              sizeof(instance_transform),  // Stride
                               (void *)(sizeof(vec4) * i)); // Start offset
         // Enable it
-        glEnableVertexAttribArray(matrix_loc + i);
+        glEnableVertexAttribArray(transform_loc + i);
         // Make it instanced
-        glVertexAttribDivisor(matrix_loc + i, 1);
+        glVertexAttribDivisor(transform_loc + i, 1);
+    }
+
+#ifdef USE_NORMAL_MATRICES
+    // The normal matrix is a mat3: three vec3 columns. display sets their
+    // pointers, after the transformations of the frame.
+    for (int i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(normal_matrix_loc + i);
+        glVertexAttribDivisor(normal_matrix_loc + i, 1);
     }
+#endif
 
     // Done (unbind the object's VAO)
-    glBindVertexArray(0);
+    GLStateCache::Current().BindVertexArray(0);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 }
@@ -223,10 +384,36 @@ void initialize()
 ///////////////////////////////////////////////////////////////////////////////
 void finalize()
 {
-    glUseProgram(0);
-    glDeleteProgram(shader_prog);
-    glDeleteBuffers(1, &color_buffer);
-    glDeleteBuffers(1, &model_matrix_buffer);
+    GLStateCache& state = GLStateCache::Current();
+
+#ifdef _DEBUG
+    const GL_STATE_STATS& stats = state.GetStats();
+    std::cerr << "GL state calls: " << stats.total_issued << " issued, "
+              << stats.total_skipped << " skipped" << std::endl;
+
+    const RENDER_QUEUE_STATS& queue = render_queue.GetStats();
+    std::cerr << "Last frame: " << queue.draws << " draws, sort " << queue.sort_ms
+              << " ms, submit " << queue.submit_ms << " ms" << std::endl;
+
+    FRAME_PIPELINE_STATS pipeline = frame_pipeline->GetStats();
+    std::cerr << "Frames: " << pipeline.frames << ", " << pipeline.frame_ms
+              << " ms per frame, " << pipeline.latency_ms << " ms latency" << std::endl;
+
+    Profiler::Collect();
+    Profiler::PrintStats(std::cerr);
+    Profiler::WriteChromeTrace("instancing_profile.json");
+
+    std::cerr << "GL calls of the last frame:" << std::endl;
+    GLIntercept::PrintReport(std::cerr, GLIntercept::GetFrameReport());
+#endif /* DEBUG */
+
+    state.UseProgram(0);
+    state.DeleteProgram(shader_prog);
+    state.DeleteBuffers(1, &color_buffer);
+    delete frame_pipeline;
+    mesh_cache.Release(object);
+    Profiler::Shutdown();
+    GLIntercept::Uninstall();
 }
 
 
@@ -8,9 +8,15 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <GL/glew.h>
 #include <GL/freeglut.h>
+#include <iostream>
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "Platform.h"
+#include "Profiler.h"
 #include "ShaderUtil.h"
 #include "vmath.h"
-#include "VBObject.h"
+#include "MeshCache.h"
+#include "RenderQueue.h"
 using namespace vmath;
 
 #define BUFFER_OFFSET(x)  ((const GLvoid*) (x))
@@ -26,10 +32,25 @@ static GLint view_matrix_loc;
 static GLint projection_matrix_loc;
 static GLuint color_tbo_loc;
 static GLuint model_matrix_tbo_loc;
-static VBObject object;
+static MeshCache mesh_cache;
+static VBObject *object;
+static RenderQueue render_queue;
 
 static const int INSTANCE_COUNT = 100;
 
+// Define to store each model matrix as a vmath::mat3x4, the rows of the
+// affine matrix: 48 bytes and three texelFetch per instance instead of 64
+// and four
+// #define USE_AFFINE_INSTANCES
+
+#ifdef USE_AFFINE_INSTANCES
+typedef mat3x4 model_matrix_type;
+static const char VERTEX_SHADER[] = "../../shaders/instancing_tbo_affine.vs.glsl";
+#else
+typedef mat4 model_matrix_type;
+static const char VERTEX_SHADER[] = "../../shaders/instancing_tbo.vs.glsl";
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Function Name: display
@@ -43,40 +64,47 @@ static const int INSTANCE_COUNT = 100;
 ///////////////////////////////////////////////////////////////////////////////
 void display()
 {
-    float t = float(GetTickCount() & 0x3FFF) / float(0x3FFF);
+    PROFILE_ZONE("display");
+    GL_CALL_SITE("display");
+    float t = float(GetMilliseconds() & 0x3FFF) / float(0x3FFF);
+    GLStateCache& state = GLStateCache::Current();
 
     // Set model matrices for each instance
-    mat4 matrices[INSTANCE_COUNT];
+    model_matrix_type matrices[INSTANCE_COUNT];
 
-    for (int n = 0; n < INSTANCE_COUNT; ++n)
     {
-        float a = 50.0f * float(n) / 4.0f;
-        float b = 50.0f * float(n) / 5.0f;
-        float c = 50.0f * float(n) / 6.0f;
-
-        matrices[n] = rotate(a + t * 360.0f, 1.0f, 0.0f, 0.0f) *
-                      rotate(b + t * 360.0f, 0.0f, 1.0f, 0.0f) *
-                      rotate(c + t * 360.0f, 0.0f, 0.0f, 1.0f) *
-                      translate(10.0f + a, 40.0f + b, 50.0f + c);
+        PROFILE_ZONE("model matrices");
+
+        for (int n = 0; n < INSTANCE_COUNT; ++n)
+        {
+            float a = 50.0f * float(n) / 4.0f;
+            float b = 50.0f * float(n) / 5.0f;
+            float c = 50.0f * float(n) / 6.0f;
+
+            // The three rotations and the translation in one step
+#ifdef USE_AFFINE_INSTANCES
+            matrices[n] = euler_to_mat3x4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                                          vec3(10.0f + a, 40.0f + b, 50.0f + c));
+#else
+            matrices[n] = euler_to_mat4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                                        vec3(10.0f + a, 40.0f + b, 50.0f + c));
+#endif
+        }
     }
 
     // Bind the model matrix VBO and change its data
-    glBindBuffer(GL_TEXTURE_BUFFER, model_matrix_buffer);
+    state.BindBuffer(GL_TEXTURE_BUFFER, model_matrix_buffer);
     glBufferData(GL_TEXTURE_BUFFER, sizeof(matrices), matrices, GL_DYNAMIC_DRAW);
 
     // Clear
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Setup
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
+    // Setup. Nothing else changes this state, so after the first frame the
+    // state cache drops these calls without calling GL.
+    state.DepthFunc(GL_LEQUAL);
 
     // Activate instancing program
-    glUseProgram(shader_prog);
-
-    // Set the TBO samplers to the right texture unit indices
-    glUniform1i(color_tbo_loc, 0);
-    glUniform1i(model_matrix_tbo_loc, 1);
+    state.UseProgram(shader_prog);
 
     // Set up the view and projection matrices
     mat4 view_matrix(translate(0.0f, 0.0f, -1500.0f) * rotate(t * 360.0f * 2.0f, 0.0f, 1.0f, 0.0f));
@@ -85,13 +113,26 @@ void display()
     glUniformMatrix4fv(view_matrix_loc, 1, GL_FALSE, view_matrix);
     glUniformMatrix4fv(projection_matrix_loc, 1, GL_FALSE, projection_matrix);
 
-    // Render INSTANCE_COUNT objects
-    object.Render(0, INSTANCE_COUNT);
+    // Render INSTANCE_COUNT objects. The queue binds the program, the TBOs
+    // and the depth state the item asks for, in sorted order with any
+    // other items of the frame.
+    RENDER_ITEM item;
+    RenderQueue::InitItem(item, shader_prog, object, INSTANCE_COUNT);
+    item.texture_targets[0] = GL_TEXTURE_BUFFER;
+    item.textures[0] = color_tbo;
+    item.texture_targets[1] = GL_TEXTURE_BUFFER;
+    item.textures[1] = model_matrix_tbo;
 
-    glUseProgram(0);
-    glDisable(GL_DEPTH_TEST);
+    render_queue.Clear();
+    render_queue.Add(item);
+    render_queue.Submit();
 
     glutSwapBuffers();
+
+    // Pick up the zones recorded since the last frame, and the GPU zones of
+    // earlier frames that have finished
+    Profiler::Collect();
+    GLIntercept::EndFrame();
 }
 
 
@@ -108,11 +149,19 @@ void display()
 ///////////////////////////////////////////////////////////////////////////////
 void initialize()
 {
+#ifdef _DEBUG
+    // Record the profiler zones; finalize prints them and saves a trace
+    Profiler::SetEnabled(true);
+
+    // Count the GL calls of each frame; finalize prints the last one
+    GLIntercept::Install();
+#endif /* DEBUG */
+
     ShaderUtil su;
 
     static ShaderInfo shader_info[] =
     {
-        { GL_VERTEX_SHADER, "../../shaders/instancing_tbo.vs.glsl", 0 },
+        { GL_VERTEX_SHADER, VERTEX_SHADER, 0 },
         { GL_FRAGMENT_SHADER, "../../shaders/instancing.fs.glsl", 0 },
         { GL_NONE, NULL, 0 }
     };
@@ -127,8 +176,16 @@ void initialize()
     color_tbo_loc = glGetUniformLocation(shader_prog, "color_tbo");
     model_matrix_tbo_loc = glGetUniformLocation(shader_prog, "model_matrix_tbo");
 
-    // Load the object
-    object.LoadFromVBM("../../media/armadillo_low.vbm", 
+    // Point them at the right texture units. This is program state, so it
+    // only needs doing once rather than every frame.
+    GLStateCache& state = GLStateCache::Current();
+    state.UseProgram(shader_prog);
+    glUniform1i(color_tbo_loc, 0);
+    glUniform1i(model_matrix_tbo_loc, 1);
+
+    // Load the object, or share it if another part of the program already
+    // loaded the same mesh
+    object = mesh_cache.Acquire("../../media/armadillo_low.vbm", 
         glGetAttribLocation(shader_prog, "position"), 
         glGetAttribLocation(shader_prog, "normal"), 
         -1);  // our shader doesn't use texture coordinates
@@ -161,11 +218,12 @@ void initialize()
 
     // Create the TBO to store colors
     glGenTextures(1, &color_tbo);
-    glBindTexture(GL_TEXTURE_BUFFER, color_tbo);
+    state.BindTexture(0, GL_TEXTURE_BUFFER, color_tbo);
 
-    // Generate the colors of the objects
+    // Generate the colors of the objects. The vmath constructors are
+    // constexpr, so the table is built by the compiler, not at startup.
     const int NUM_COLORS = 7;
-    vec4 color_table[NUM_COLORS] = {
+    static const vec4 color_table[NUM_COLORS] = {
         vec4(1.0, 0.0, 0.0, 1.0),
         vec4(0.0, 1.0, 0.0, 1.0),
         vec4(1.0, 1.0, 0.0, 1.0),
@@ -184,18 +242,17 @@ void initialize()
     // Create the buffer, put color data in it, attach it to the TBO 
     // and initialize its format
     glGenBuffers(1, &color_buffer);
-    glBindBuffer(GL_TEXTURE_BUFFER, color_buffer);
+    state.BindBuffer(GL_TEXTURE_BUFFER, color_buffer);
     glBufferData(GL_TEXTURE_BUFFER, sizeof(colors), colors, GL_STATIC_DRAW);
     glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, color_buffer);
 
     // Now do the same thing with a TBO for the model matrices. The buffer object
-    // (model_matrix_buffer) is created and sized to store one mat4 per instance.
+    // (model_matrix_buffer) is created and sized to store one matrix per instance.
     glGenTextures(1, &model_matrix_tbo);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_BUFFER, model_matrix_tbo);
+    state.BindTexture(1, GL_TEXTURE_BUFFER, model_matrix_tbo);
     glGenBuffers(1, &model_matrix_buffer);
-    glBindBuffer(GL_TEXTURE_BUFFER, model_matrix_buffer);
-    glBufferData(GL_TEXTURE_BUFFER, INSTANCE_COUNT * sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    state.BindBuffer(GL_TEXTURE_BUFFER, model_matrix_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, INSTANCE_COUNT * sizeof(model_matrix_type), NULL, GL_DYNAMIC_DRAW);
     glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, model_matrix_buffer);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -215,10 +272,34 @@ void initialize()
 ///////////////////////////////////////////////////////////////////////////////
 void finalize()
 {
-    glUseProgram(0);
-    glDeleteProgram(shader_prog);
-    glDeleteBuffers(1, &color_buffer);
-    glDeleteBuffers(1, &model_matrix_buffer);
+    GLStateCache& state = GLStateCache::Current();
+
+#ifdef _DEBUG
+    const GL_STATE_STATS& stats = state.GetStats();
+    std::cerr << "GL state calls: " << stats.total_issued << " issued, "
+              << stats.total_skipped << " skipped" << std::endl;
+
+    const RENDER_QUEUE_STATS& queue = render_queue.GetStats();
+    std::cerr << "Last frame: " << queue.draws << " draws, sort " << queue.sort_ms
+              << " ms, submit " << queue.submit_ms << " ms" << std::endl;
+
+    Profiler::Collect();
+    Profiler::PrintStats(std::cerr);
+    Profiler::WriteChromeTrace("instancing_tbo_profile.json");
+
+    std::cerr << "GL calls of the last frame:" << std::endl;
+    GLIntercept::PrintReport(std::cerr, GLIntercept::GetFrameReport());
+#endif /* DEBUG */
+
+    state.UseProgram(0);
+    state.DeleteProgram(shader_prog);
+    state.DeleteBuffers(1, &color_buffer);
+    state.DeleteBuffers(1, &model_matrix_buffer);
+    state.DeleteTextures(1, &color_tbo);
+    state.DeleteTextures(1, &model_matrix_tbo);
+    mesh_cache.Release(object);
+    Profiler::Shutdown();
+    GLIntercept::Uninstall();
 }
 
 
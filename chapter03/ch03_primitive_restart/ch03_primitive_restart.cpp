@@ -9,6 +9,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <GL/glew.h>
 #include <GL/freeglut.h>
+#include "Platform.h"
 #include "ShaderUtil.h"
 #include "vmath.h"
 
@@ -38,7 +39,7 @@ static GLint projection_matrix_loc;
 ///////////////////////////////////////////////////////////////////////////////
 void display()
 {
-    float t = float(GetTickCount() & 0x1FFF) / float(0x1FFF);
+    float t = float(GetMilliseconds() & 0x1FFF) / float(0x1FFF);
     const vmath::vec3 Y(0.0f, 1.0f, 0.0f);
     const vmath::vec3 Z(0.0f, 0.0f, 1.0f);
 
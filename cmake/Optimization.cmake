@@ -0,0 +1,137 @@
+###############################################################################
+#
+# File Name: Optimization.cmake
+#
+# Purpose: The optimization options of the build, applied to each target by
+#          ogl_optimize(). All of them are cache variables, so a build can be
+#          reproduced from its CMakeCache.txt or from a preset:
+#
+#          OGL_SIMD    - DEFAULT (the compiler's baseline, SSE2 on x86-64),
+#                        AVX2, NATIVE (the build machine) or NONE (defines
+#                        VMATH_NO_SIMD for the scalar vmath paths)
+#          OGL_MARCH   - a GCC/Clang -march value such as x86-64-v3; it
+#                        replaces OGL_SIMD's flags and is the way to tune
+#                        for a fleet rather than the build machine
+#          OGL_LTO     - link time optimization
+#          OGL_PGO     - OFF, GENERATE (instrumented build) or USE (build
+#                        with the profiles written by a GENERATE build)
+#          OGL_PGO_DIR - where the profiles are written and read
+#          OGL_BOLT    - links executables with --emit-relocs, so that
+#                        llvm-bolt can reorder them after linking
+#
+#          GCC names its profiles after the object files, so the GENERATE
+#          and USE builds must share a build directory. Clang's raw profiles
+#          must be merged into OGL_PGO_DIR/default.profdata with
+#          llvm-profdata before the USE build.
+#
+###############################################################################
+
+set(OGL_SIMD DEFAULT CACHE STRING "SIMD level of the vmath paths: DEFAULT, AVX2, NATIVE or NONE")
+set_property(CACHE OGL_SIMD PROPERTY STRINGS DEFAULT AVX2 NATIVE NONE)
+set(OGL_MARCH "" CACHE STRING "GCC/Clang -march value, overriding OGL_SIMD (for example x86-64-v3)")
+option(OGL_LTO "Build with link time optimization" OFF)
+set(OGL_PGO OFF CACHE STRING "Profile guided optimization: OFF, GENERATE or USE")
+set_property(CACHE OGL_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(OGL_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH "Directory of the PGO profiles")
+option(OGL_BOLT "Link executables with relocations for llvm-bolt" OFF)
+
+if(NOT OGL_SIMD MATCHES "^(DEFAULT|AVX2|NATIVE|NONE)$")
+    message(FATAL_ERROR "OGL_SIMD must be DEFAULT, AVX2, NATIVE or NONE, not '${OGL_SIMD}'")
+endif()
+if(NOT OGL_PGO MATCHES "^(OFF|GENERATE|USE)$")
+    message(FATAL_ERROR "OGL_PGO must be OFF, GENERATE or USE, not '${OGL_PGO}'")
+endif()
+
+if(OGL_LTO)
+    include(CheckIPOSupported)
+    check_ipo_supported(RESULT OGL_LTO_SUPPORTED OUTPUT OGL_LTO_ERROR)
+    if(NOT OGL_LTO_SUPPORTED)
+        message(FATAL_ERROR "OGL_LTO: link time optimization is not supported: ${OGL_LTO_ERROR}")
+    endif()
+endif()
+
+set(OGL_GNU_LIKE FALSE)
+if(CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+    set(OGL_GNU_LIKE TRUE)
+endif()
+
+if(OGL_PGO STREQUAL "USE" AND CMAKE_CXX_COMPILER_ID MATCHES "Clang" AND
+   NOT EXISTS "${OGL_PGO_DIR}/default.profdata")
+    message(WARNING "OGL_PGO=USE: ${OGL_PGO_DIR}/default.profdata does not exist; merge the raw "
+                    "profiles with llvm-profdata merge -o default.profdata *.profraw")
+endif()
+
+message(STATUS "Optimization: ${CMAKE_BUILD_TYPE}${CMAKE_CONFIGURATION_TYPES}, SIMD ${OGL_SIMD}"
+               ", march '${OGL_MARCH}', LTO ${OGL_LTO}, PGO ${OGL_PGO}, BOLT ${OGL_BOLT}")
+
+
+###############################################################################
+# Function Name: ogl_optimize
+#
+# Purpose: Applies the optimization options to one target.
+#
+# INPUTS: target - an executable or library target
+#
+###############################################################################
+function(ogl_optimize target)
+    if(OGL_SIMD STREQUAL "NONE")
+        target_compile_definitions(${target} PRIVATE VMATH_NO_SIMD)
+    endif()
+
+    if(OGL_GNU_LIKE)
+        if(OGL_MARCH)
+            target_compile_options(${target} PRIVATE -march=${OGL_MARCH})
+        elseif(OGL_SIMD STREQUAL "AVX2")
+            target_compile_options(${target} PRIVATE -mavx2)
+        elseif(OGL_SIMD STREQUAL "NATIVE")
+            target_compile_options(${target} PRIVATE -march=native)
+        endif()
+    elseif(MSVC)
+        if(OGL_SIMD STREQUAL "AVX2")
+            target_compile_options(${target} PRIVATE /arch:AVX2)
+        endif()
+    endif()
+
+    if(OGL_LTO)
+        set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+    endif()
+
+    get_target_property(type ${target} TYPE)
+    if(OGL_BOLT AND OGL_GNU_LIKE AND type STREQUAL "EXECUTABLE")
+        target_link_options(${target} PRIVATE -Wl,--emit-relocs)
+    endif()
+
+    if(OGL_PGO STREQUAL "OFF")
+        return()
+    endif()
+
+    if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        if(OGL_PGO STREQUAL "GENERATE")
+            # The job system's workers update the counters concurrently
+            target_compile_options(${target} PRIVATE -fprofile-generate=${OGL_PGO_DIR} -fprofile-update=atomic)
+            target_link_options(${target} PRIVATE -fprofile-generate=${OGL_PGO_DIR})
+        else()
+            target_compile_options(${target} PRIVATE -fprofile-use=${OGL_PGO_DIR} -fprofile-partial-training
+                                   -Wno-missing-profile)
+            target_link_options(${target} PRIVATE -fprofile-use=${OGL_PGO_DIR})
+        endif()
+    elseif(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+        if(OGL_PGO STREQUAL "GENERATE")
+            target_compile_options(${target} PRIVATE -fprofile-generate=${OGL_PGO_DIR})
+            target_link_options(${target} PRIVATE -fprofile-generate=${OGL_PGO_DIR})
+        else()
+            target_compile_options(${target} PRIVATE -fprofile-use=${OGL_PGO_DIR}/default.profdata
+                                   -Wno-profile-instr-unprofiled)
+            target_link_options(${target} PRIVATE -fprofile-use=${OGL_PGO_DIR}/default.profdata)
+        endif()
+    elseif(MSVC)
+        target_compile_options(${target} PRIVATE /GL)
+        if(type STREQUAL "EXECUTABLE")
+            if(OGL_PGO STREQUAL "GENERATE")
+                target_link_options(${target} PRIVATE /LTCG /GENPROFILE:PGD=${OGL_PGO_DIR}/${target}.pgd)
+            else()
+                target_link_options(${target} PRIVATE /LTCG /USEPROFILE:PGD=${OGL_PGO_DIR}/${target}.pgd)
+            endif()
+        endif()
+    endif()
+endfunction()
@@ -0,0 +1,376 @@
+###############################################################################
+#
+# File Name: PGOWorkflow.cmake
+#
+# Purpose: Builds the tree three times and reports what profile guided
+#          optimization gains on the benchmarks:
+#
+#          1. baseline - Release with LTO; the workloads are run and their
+#                        results kept as the "before" report
+#          2. pgo      - the same, instrumented (OGL_PGO=GENERATE); the
+#                        workloads are run again as the training set
+#          3. pgo      - rebuilt with the profiles (OGL_PGO=USE) and run
+#                        for the "after" report
+#          4. bolt     - optional: the executables of step 3 reordered by
+#                        llvm-bolt from an instrumented run, and run again
+#
+#          The workloads are the headless benchmarks: pipebench (the
+#          instancing sample's per-instance loop at INSTANCES instances,
+#          as mat4 and affine), microbench --gl (VBM loading, shader
+#          compilation and linking, vmath), jobbench and vmathbench. The
+#          samples are interactive, so they are not run; they share the
+#          profiled common library. Without GLEW/GLUT only jobbench and
+#          vmathbench are built and run.
+#
+#          Run it from the top of the tree:
+#
+#          cmake -P cmake/PGOWorkflow.cmake
+#          cmake -DBOLT=ON -DRUN_PREFIX="xvfb-run;-a" -P cmake/PGOWorkflow.cmake
+#
+#          Variables (all optional):
+#
+#          BUILD_DIR   - default build/pgo-workflow
+#          CONFIG_ARGS - extra configure arguments, as a list, for example
+#                        "-DOGL_MARCH=x86-64-v3;-G;Ninja"
+#          RUN_PREFIX  - a command the GL workloads are run under, as a
+#                        list, such as "xvfb-run;-a" on a machine without
+#                        a display
+#          INSTANCES   - pipebench instances (default 20000)
+#          FRAMES      - pipebench frames per depth (default 200)
+#          BOLT        - ON to add step 4 (needs llvm-bolt)
+#
+#          The reports are in BUILD_DIR/report: the output of every
+#          workload per step, and summary.md with the microbench, jobbench
+#          and vmathbench cases side by side, in nanoseconds.
+#
+###############################################################################
+cmake_minimum_required(VERSION 3.19)
+
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if(NOT BUILD_DIR)
+    set(BUILD_DIR "${SOURCE_DIR}/build/pgo-workflow")
+endif()
+get_filename_component(BUILD_DIR "${BUILD_DIR}" ABSOLUTE BASE_DIR "${SOURCE_DIR}")
+if(NOT INSTANCES)
+    set(INSTANCES 20000)
+endif()
+if(NOT FRAMES)
+    set(FRAMES 200)
+endif()
+if(NOT BOLT)
+    set(BOLT OFF)
+endif()
+
+set(REPORT_DIR "${BUILD_DIR}/report")
+set(PROFILE_DIR "${BUILD_DIR}/profiles")
+file(MAKE_DIRECTORY "${REPORT_DIR}")
+
+
+###############################################################################
+# Function Name: run_checked
+#
+# Purpose: Runs a command and stops the workflow if it fails.
+#
+# INPUTS: ARGN - the command and its arguments
+#
+###############################################################################
+function(run_checked)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        string(REPLACE ";" " " command "${ARGN}")
+        message(FATAL_ERROR "PGO workflow: '${command}' failed (${result})")
+    endif()
+endfunction()
+
+
+###############################################################################
+# Function Name: build_tree
+#
+# Purpose: Configures and builds one tree with LTO and the given options.
+#
+# INPUTS: dir  - the build directory
+#         ARGN - extra cache arguments
+#
+###############################################################################
+function(build_tree dir)
+    message(STATUS "PGO workflow: building ${dir} ${ARGN}")
+    run_checked("${CMAKE_COMMAND}" -S "${SOURCE_DIR}" -B "${dir}" -DCMAKE_BUILD_TYPE=Release -DOGL_LTO=ON
+                "-DOGL_PGO_DIR=${PROFILE_DIR}" ${CONFIG_ARGS} ${ARGN})
+    run_checked("${CMAKE_COMMAND}" --build "${dir}" --config Release --parallel)
+endfunction()
+
+
+###############################################################################
+# Function Name: find_tool
+#
+# Purpose: Finds a tool executable in a build tree.
+#
+# INPUTS: var  - receives the path, or is cleared if the tool was not built
+#         dir  - the build directory
+#         name - the target name
+#
+###############################################################################
+function(find_tool var dir name)
+    foreach(candidate "${dir}/tools/${name}" "${dir}/tools/${name}.exe"
+                      "${dir}/tools/Release/${name}.exe")
+        if(EXISTS "${candidate}")
+            set(${var} "${candidate}" PARENT_SCOPE)
+            return()
+        endif()
+    endforeach()
+    unset(${var} PARENT_SCOPE)
+endfunction()
+
+
+###############################################################################
+# Function Name: run_workloads
+#
+# Purpose: Runs every workload built in a tree, writing its output to
+#          REPORT_DIR/<step>-<workload>.txt, and the timings of microbench,
+#          jobbench and vmathbench to REPORT_DIR/<step>-<workload>.json.
+#
+# INPUTS: dir  - the build directory
+#         step - the name of the step, for the report files
+#         ARGN - optionally SUFFIX and a suffix of the executables to run
+#                (the BOLT step runs <tool>.bolt or <tool>.instrumented)
+#
+###############################################################################
+function(run_workloads dir step)
+    cmake_parse_arguments(RUN "" "SUFFIX" "" ${ARGN})
+    message(STATUS "PGO workflow: running the ${step} workloads")
+
+    find_tool(pipebench "${dir}" pipebench)
+    find_tool(microbench "${dir}" microbench)
+    find_tool(jobbench "${dir}" jobbench)
+    find_tool(vmathbench "${dir}" vmathbench)
+
+    if(pipebench)
+        foreach(mode mat4 affine)
+            run_checked(${RUN_PREFIX} "${pipebench}${RUN_SUFFIX}" ${INSTANCES} ${FRAMES} ${mode}
+                        WORKING_DIRECTORY "${SOURCE_DIR}/tools/pipebench"
+                        OUTPUT_FILE "${REPORT_DIR}/${step}-pipebench-${mode}.txt")
+        endforeach()
+    endif()
+    if(microbench)
+        run_checked(${RUN_PREFIX} "${microbench}${RUN_SUFFIX}" --gl "--root=${SOURCE_DIR}"
+                    "--json=${REPORT_DIR}/${step}-microbench.json"
+                    OUTPUT_FILE "${REPORT_DIR}/${step}-microbench.txt")
+    endif()
+    if(jobbench)
+        run_checked("${jobbench}${RUN_SUFFIX}" 1000000 20 "--json=${REPORT_DIR}/${step}-jobbench.json"
+                    OUTPUT_FILE "${REPORT_DIR}/${step}-jobbench.txt")
+    endif()
+    if(vmathbench)
+        run_checked("${vmathbench}${RUN_SUFFIX}" 100000 20 "--json=${REPORT_DIR}/${step}-vmathbench.json"
+                    OUTPUT_FILE "${REPORT_DIR}/${step}-vmathbench.txt")
+    endif()
+endfunction()
+
+
+###############################################################################
+# Function Name: bolt_tools
+#
+# Purpose: Instruments the workload executables of a tree with llvm-bolt,
+#          trains them, and writes <tool>.bolt next to each.
+#
+# INPUTS: dir - the build directory
+#
+###############################################################################
+function(bolt_tools dir)
+    find_program(LLVM_BOLT llvm-bolt)
+    if(NOT LLVM_BOLT)
+        message(FATAL_ERROR "PGO workflow: BOLT=ON needs llvm-bolt")
+    endif()
+
+    set(tools)
+    foreach(name pipebench microbench jobbench vmathbench)
+        find_tool(path "${dir}" ${name})
+        if(path)
+            file(REMOVE "${PROFILE_DIR}/${name}.fdata")
+            run_checked("${LLVM_BOLT}" "${path}" -instrument "-instrumentation-file=${PROFILE_DIR}/${name}.fdata"
+                        -o "${path}.instrumented")
+            list(APPEND tools "${path}")
+        endif()
+    endforeach()
+
+    run_workloads("${dir}" bolt-training SUFFIX .instrumented)
+
+    foreach(path ${tools})
+        get_filename_component(name "${path}" NAME_WE)
+        run_checked("${LLVM_BOLT}" "${path}" "-data=${PROFILE_DIR}/${name}.fdata" -o "${path}.bolt"
+                    -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions -split-all-cold)
+    endforeach()
+endfunction()
+
+
+###############################################################################
+# Function Name: to_thousandths
+#
+# Purpose: Converts a decimal such as 12.5 to an integer in thousandths
+#          (12500), for math(EXPR), and to the text of the decimal with two
+#          places (12.50), for the report.
+#
+# INPUTS: var   - the variable to set to the thousandths; <var>_text is set
+#                 to the text
+#         value - the decimal
+#
+# NOTES: string(JSON) gives the values back with all their digits, such
+#        as 36.052999999999997; the places past the third are dropped.
+#
+###############################################################################
+function(to_thousandths var value)
+    string(REGEX MATCH "^([0-9]*)\\.?([0-9]*)" ignored "${value}")
+    set(whole "${CMAKE_MATCH_1}")
+    string(SUBSTRING "${CMAKE_MATCH_2}000" 0 3 fraction)
+    if(whole STREQUAL "")
+        set(whole 0)
+    endif()
+    string(REGEX REPLACE "^0+([0-9])" "\\1" fraction "${fraction}")
+    math(EXPR result "${whole} * 1000 + ${fraction}")
+    math(EXPR hundredths "${result} % 1000 / 10")
+    if(hundredths LESS 10)
+        set(hundredths "0${hundredths}")
+    endif()
+    set(${var} ${result} PARENT_SCOPE)
+    set(${var}_text "${whole}.${hundredths}" PARENT_SCOPE)
+endfunction()
+
+
+###############################################################################
+# Function Name: append_table
+#
+# Purpose: Appends a markdown table of a workload's <step>-<tool>.json
+#          results, one column per step, with the change of each step from
+#          the first.
+#
+# INPUTS: var   - the variable holding the report
+#         tool  - the workload, such as microbench
+#         title - what the numbers are
+#         ARGN  - the steps, the first of them the reference
+#
+# NOTES: The steps are expected to run the same cases, in the same order.
+#
+###############################################################################
+function(append_table var tool title)
+    set(summary "${${var}}")
+    list(GET ARGN 0 reference)
+    foreach(step ${ARGN})
+        if(NOT EXISTS "${REPORT_DIR}/${step}-${tool}.json")
+            return()
+        endif()
+        file(READ "${REPORT_DIR}/${step}-${tool}.json" json_${step})
+    endforeach()
+
+    string(APPEND summary "## ${tool} (${title})\n\n| case |")
+    foreach(step ${ARGN})
+        string(APPEND summary " ${step} |")
+    endforeach()
+    string(APPEND summary "\n|---|")
+    foreach(step ${ARGN})
+        string(APPEND summary "---:|")
+    endforeach()
+    string(APPEND summary "\n")
+
+    string(JSON count LENGTH "${json_${reference}}" benchmarks)
+    math(EXPR last "${count} - 1")
+    foreach(i RANGE ${last})
+        string(JSON name GET "${json_${reference}}" benchmarks ${i} name)
+        string(JSON before GET "${json_${reference}}" benchmarks ${i} ns_per_op)
+        to_thousandths(before_k "${before}")
+        string(APPEND summary "| ${name} | ${before_k_text} |")
+        foreach(step ${ARGN})
+            if(step STREQUAL reference)
+                continue()
+            endif()
+            string(JSON after GET "${json_${step}}" benchmarks ${i} ns_per_op)
+            to_thousandths(after_k "${after}")
+            if(before_k EQUAL 0)
+                string(APPEND summary " ${after_k_text} |")
+                continue()
+            endif()
+            # Percent change with one decimal, in integer arithmetic
+            math(EXPR change "(${after_k} * 1000 / ${before_k}) - 1000")
+            set(sign "")
+            if(change GREATER_EQUAL 0)
+                set(sign "+")
+            endif()
+            math(EXPR whole "${change} / 10")
+            math(EXPR tenth "${change} % 10")
+            if(tenth LESS 0)
+                math(EXPR tenth "-${tenth}")
+                if(whole EQUAL 0)
+                    set(sign "-")
+                endif()
+            endif()
+            string(APPEND summary " ${after_k_text} (${sign}${whole}.${tenth}%) |")
+        endforeach()
+        string(APPEND summary "\n")
+    endforeach()
+    string(APPEND summary "\n")
+
+    set(${var} "${summary}" PARENT_SCOPE)
+endfunction()
+
+
+###############################################################################
+# Function Name: summarize
+#
+# Purpose: Writes REPORT_DIR/summary.md: the microbench, jobbench and
+#          vmathbench cases of every step side by side, and the names of the
+#          other reports.
+#
+# INPUTS: ARGN - the steps, the first being the reference
+#
+###############################################################################
+function(summarize)
+    set(summary "# PGO workflow report\n\n")
+    string(APPEND summary "Configure arguments: ${CONFIG_ARGS}\n\n")
+
+    append_table(summary microbench "median ns per operation" ${ARGN})
+    append_table(summary jobbench "best ns per instance" ${ARGN})
+    append_table(summary vmathbench "best ns per element" ${ARGN})
+
+    string(APPEND summary "## Workload outputs\n\n")
+    file(GLOB reports RELATIVE "${REPORT_DIR}" "${REPORT_DIR}/*.txt")
+    list(SORT reports)
+    foreach(report ${reports})
+        string(APPEND summary "- ${report}\n")
+    endforeach()
+
+    file(WRITE "${REPORT_DIR}/summary.md" "${summary}")
+    message(STATUS "PGO workflow: report written to ${REPORT_DIR}/summary.md")
+endfunction()
+
+
+# 1. The reference build
+build_tree("${BUILD_DIR}/baseline" -DOGL_PGO=OFF)
+run_workloads("${BUILD_DIR}/baseline" before)
+
+# 2. Instrumented build and training; stale profiles would mix with the new
+file(REMOVE_RECURSE "${PROFILE_DIR}")
+file(MAKE_DIRECTORY "${PROFILE_DIR}")
+build_tree("${BUILD_DIR}/pgo" -DOGL_PGO=GENERATE -DOGL_BOLT=${BOLT})
+run_workloads("${BUILD_DIR}/pgo" training)
+
+# Clang writes raw profiles that are merged for the USE build
+file(GLOB raw_profiles "${PROFILE_DIR}/*.profraw")
+if(raw_profiles)
+    find_program(LLVM_PROFDATA llvm-profdata)
+    if(NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "PGO workflow: Clang profiles need llvm-profdata")
+    endif()
+    run_checked("${LLVM_PROFDATA}" merge -o "${PROFILE_DIR}/default.profdata" ${raw_profiles})
+endif()
+
+# 3. Rebuilt in the same directory, so GCC finds the profiles of each object
+build_tree("${BUILD_DIR}/pgo" -DOGL_PGO=USE -DOGL_BOLT=${BOLT})
+run_workloads("${BUILD_DIR}/pgo" after)
+
+# 4. Optionally, BOLT on top
+if(BOLT)
+    bolt_tools("${BUILD_DIR}/pgo")
+    run_workloads("${BUILD_DIR}/pgo" bolt SUFFIX .bolt)
+    summarize(before after bolt)
+else()
+    summarize(before after)
+endif()
@@ -0,0 +1,381 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: CommandBuffer.cpp
+//
+// Purpose: This file contains the definitions of the CommandBuffer and
+//          CommandRecorder classes.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <chrono>
+#include <string.h>
+#include "CommandBuffer.h"
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "Platform.h"
+
+enum
+{
+    CMD_USE_PROGRAM,
+    CMD_BIND_TEXTURE,
+    CMD_ENABLE,
+    CMD_DISABLE,
+    CMD_UNIFORM,
+    CMD_DRAW,
+    CMD_CALLBACK
+};
+
+// Every command starts with this header and is padded to COMMAND_ALIGNMENT
+struct CommandHeader
+{
+    unsigned int type;
+    unsigned int size;      // including the header
+};
+
+static const size_t COMMAND_ALIGNMENT = 8;
+
+struct ProgramCommand  { CommandHeader header; GLuint program; };
+struct TextureCommand  { CommandHeader header; GLuint unit; GLenum target; GLuint texture; };
+struct EnableCommand   { CommandHeader header; GLenum capability; };
+struct UniformCommand  { CommandHeader header; GLint location; GLenum type; unsigned char value[COMMAND_MAX_UNIFORM_SIZE]; };
+struct DrawCommand     { CommandHeader header; VBObject *object; unsigned int frame, instances, base_instance; };
+struct CallbackCommand { CommandHeader header; CommandCallbackFn fn; void *user; };
+
+static size_t UniformSize(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT:      case GL_INT:        return 4;
+    case GL_FLOAT_VEC2: case GL_INT_VEC2:   return 8;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3:   return 12;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4:   return 16;
+    case GL_FLOAT_MAT4:                     return 64;
+    default:                                return 0;
+    }
+}
+
+
+
+CommandBuffer::CommandBuffer(size_t capacity)
+    : m_data(capacity),
+      m_size(0),
+      m_commands(0),
+      m_grows(0)
+{
+}
+
+
+
+void CommandBuffer::Reset(void)
+{
+    m_size = 0;
+    m_commands = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Allocate
+//
+// Purpose: Appends a command and fills in its header.
+//
+// INPUTS: type - the CMD_* type
+//         size - the size of the command struct, header included
+//
+// OUTPUTS: The command, valid until the next Allocate.
+//
+// NOTES: The buffer doubles when full, which is the only allocation a
+//        recording makes; a buffer reused every frame stops growing after
+//        the first frames.
+//
+///////////////////////////////////////////////////////////////////////////////
+void *CommandBuffer::Allocate(unsigned int type, size_t size)
+{
+    size = (size + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+
+    if (m_size + size > m_data.size())
+    {
+        size_t capacity = m_data.size() ? m_data.size() * 2 : COMMAND_BUFFER_SIZE;
+        while (m_size + size > capacity)
+            capacity *= 2;
+        m_data.resize(capacity);
+        ++m_grows;
+    }
+
+    CommandHeader *header = (CommandHeader *)&m_data[m_size];
+    header->type = type;
+    header->size = (unsigned int)size;
+    m_size += size;
+    ++m_commands;
+
+    return header;
+}
+
+
+
+void CommandBuffer::UseProgram(GLuint program)
+{
+    ProgramCommand *command = (ProgramCommand *)Allocate(CMD_USE_PROGRAM, sizeof(ProgramCommand));
+    command->program = program;
+}
+
+
+
+void CommandBuffer::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    TextureCommand *command = (TextureCommand *)Allocate(CMD_BIND_TEXTURE, sizeof(TextureCommand));
+    command->unit = unit;
+    command->target = target;
+    command->texture = texture;
+}
+
+
+
+void CommandBuffer::Enable(GLenum capability)
+{
+    EnableCommand *command = (EnableCommand *)Allocate(CMD_ENABLE, sizeof(EnableCommand));
+    command->capability = capability;
+}
+
+
+
+void CommandBuffer::Disable(GLenum capability)
+{
+    EnableCommand *command = (EnableCommand *)Allocate(CMD_DISABLE, sizeof(EnableCommand));
+    command->capability = capability;
+}
+
+
+
+// Only the bytes the type needs are stored
+void CommandBuffer::Uniform(GLint location, GLenum type, const void *value)
+{
+    size_t size = UniformSize(type);
+    if (!size)
+        return;
+
+    size_t command_size = sizeof(UniformCommand) - COMMAND_MAX_UNIFORM_SIZE + size;
+    UniformCommand *command = (UniformCommand *)Allocate(CMD_UNIFORM, command_size);
+    command->location = location;
+    command->type = type;
+    memcpy(command->value, value, size);
+}
+
+
+
+void CommandBuffer::Draw(VBObject *object, unsigned int frame, unsigned int instances,
+                         unsigned int base_instance)
+{
+    DrawCommand *command = (DrawCommand *)Allocate(CMD_DRAW, sizeof(DrawCommand));
+    command->object = object;
+    command->frame = frame;
+    command->instances = instances;
+    command->base_instance = base_instance;
+}
+
+
+
+void CommandBuffer::Callback(CommandCallbackFn fn, void *user)
+{
+    CallbackCommand *command = (CallbackCommand *)Allocate(CMD_CALLBACK, sizeof(CallbackCommand));
+    command->fn = fn;
+    command->user = user;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Execute
+//
+// Purpose: Replays the commands. State goes through the GLStateCache, so
+//          commands that repeat the current state cost no GL call.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void CommandBuffer::Execute(void) const
+{
+    GL_CALL_SITE("CommandBuffer::Execute");
+    GLStateCache& state = GLStateCache::Current();
+    size_t offset = 0;
+
+    while (offset < m_size)
+    {
+        const CommandHeader *header = (const CommandHeader *)&m_data[offset];
+        offset += header->size;
+
+        switch (header->type)
+        {
+        case CMD_USE_PROGRAM:
+            state.UseProgram(((const ProgramCommand *)header)->program);
+            break;
+
+        case CMD_BIND_TEXTURE:
+        {
+            const TextureCommand *command = (const TextureCommand *)header;
+            state.BindTexture(command->unit, command->target, command->texture);
+            break;
+        }
+
+        case CMD_ENABLE:
+            state.Enable(((const EnableCommand *)header)->capability);
+            break;
+
+        case CMD_DISABLE:
+            state.Disable(((const EnableCommand *)header)->capability);
+            break;
+
+        case CMD_UNIFORM:
+        {
+            // Copy the value out rather than reading the bytes as floats
+            const UniformCommand *command = (const UniformCommand *)header;
+            union { GLfloat f[16]; GLint i[16]; } value;
+            memcpy(&value, command->value, UniformSize(command->type));
+            const GLfloat *f = value.f;
+            const GLint *i = value.i;
+
+            switch (command->type)
+            {
+            case GL_FLOAT:      glUniform1fv(command->location, 1, f); break;
+            case GL_FLOAT_VEC2: glUniform2fv(command->location, 1, f); break;
+            case GL_FLOAT_VEC3: glUniform3fv(command->location, 1, f); break;
+            case GL_FLOAT_VEC4: glUniform4fv(command->location, 1, f); break;
+            case GL_INT:        glUniform1iv(command->location, 1, i); break;
+            case GL_INT_VEC2:   glUniform2iv(command->location, 1, i); break;
+            case GL_INT_VEC3:   glUniform3iv(command->location, 1, i); break;
+            case GL_INT_VEC4:   glUniform4iv(command->location, 1, i); break;
+            case GL_FLOAT_MAT4: glUniformMatrix4fv(command->location, 1, GL_FALSE, f); break;
+            }
+            break;
+        }
+
+        case CMD_DRAW:
+        {
+            const DrawCommand *command = (const DrawCommand *)header;
+            command->object->Render(command->frame, command->instances, command->base_instance);
+            break;
+        }
+
+        case CMD_CALLBACK:
+        {
+            const CallbackCommand *command = (const CallbackCommand *)header;
+            command->fn(command->user);
+            break;
+        }
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: CommandRecorder
+//
+// Purpose: Creates the buffers.
+//
+// INPUTS: slices - the number of buffers; 0 picks one per thread of 'jobs'
+//         jobs   - the system the slices are recorded on, or NULL for
+//                  JobSystem::Shared()
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+CommandRecorder::CommandRecorder(unsigned int slices, JobSystem *jobs)
+    : m_jobs(jobs ? jobs : &JobSystem::Shared()),
+      m_count(0),
+      m_fn(0),
+      m_user(0)
+{
+    if (slices == 0)
+        slices = m_jobs->GetThreadCount();
+
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    for (unsigned int i = 0; i < slices; ++i)
+        m_buffers.push_back(new CommandBuffer);
+}
+
+
+
+CommandRecorder::~CommandRecorder(void)
+{
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+        delete m_buffers[i];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Record
+//
+// Purpose: Resets the buffers and records 'count' work items, one
+//          contiguous slice per buffer.
+//
+// INPUTS: count - the number of work items
+//         fn    - records a slice
+//         user  - passed to fn
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void CommandRecorder::Record(unsigned int count, CommandRecordFn fn, void *user)
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    m_count = count;
+    m_fn = fn;
+    m_user = user;
+
+    // One job per slice at most; the buffers are what keeps them apart
+    m_jobs->ParallelFor((unsigned int)m_buffers.size(), RecordSlices, this, 1);
+
+    m_stats.buffers = (unsigned int)m_buffers.size();
+    m_stats.commands = 0;
+    m_stats.bytes = 0;
+    m_stats.grows = 0;
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+    {
+        m_stats.commands += m_buffers[i]->GetCommandCount();
+        m_stats.bytes += m_buffers[i]->GetSize();
+        m_stats.grows += m_buffers[i]->GetGrowCount();
+    }
+    m_stats.record_ms = ElapsedMilliseconds(start);
+}
+
+
+
+void CommandRecorder::Execute(void)
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+        m_buffers[i]->Execute();
+
+    m_stats.execute_ms = ElapsedMilliseconds(start);
+}
+
+
+
+void CommandRecorder::RecordSlices(void *user, unsigned int first, unsigned int end)
+{
+    CommandRecorder *recorder = (CommandRecorder *)user;
+    for (unsigned int i = first; i < end; ++i)
+        recorder->RecordSlice(i);
+}
+
+
+
+void CommandRecorder::RecordSlice(unsigned int index)
+{
+    unsigned long long count = m_count;
+    unsigned int slices = (unsigned int)m_buffers.size();
+    unsigned int first = (unsigned int)(count * index / slices);
+    unsigned int end = (unsigned int)(count * (index + 1) / slices);
+
+    CommandBuffer& buffer = *m_buffers[index];
+    buffer.Reset();
+    if (first < end)
+        m_fn(m_user, buffer, first, end);
+}
@@ -0,0 +1,292 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: FrameCapture.cpp
+//
+// Purpose: This file contains the definition of the FrameCapture class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <iostream>
+#include <string.h>
+#include "FrameCapture.h"
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "GLSync.h"
+#include "Image.h"
+#include "Platform.h"
+#include "Profiler.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: FrameCapture
+//
+// Purpose: Creates the pixel pack buffers.
+//
+// INPUTS: width, height - the size of the framebuffer in pixels
+//         depth         - readbacks in flight
+//         jobs          - where the files are written, or NULL for
+//                         JobSystem::Shared()
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+FrameCapture::FrameCapture(GLsizei width, GLsizei height, unsigned int depth, JobSystem *jobs)
+    : m_width(width),
+      m_height(height),
+      m_size((GLsizeiptr)width * height * 4),
+      m_depth(depth),
+      m_jobs(jobs ? jobs : &JobSystem::Shared()),
+      m_next(0),
+      m_frames(0),
+      m_failed_writes(0),
+      m_read_total(0.0),
+      m_fence_wait_total(0.0),
+      m_map_total(0.0),
+      m_write_wait_total(0.0),
+      m_write_total(0.0)
+{
+    if (m_depth < 1)
+        m_depth = 1;
+    if (m_depth > FRAME_CAPTURE_MAX_DEPTH)
+    {
+#ifdef _DEBUG
+        std::cerr << "FrameCapture: depth " << depth << " clamped to "
+                  << FRAME_CAPTURE_MAX_DEPTH << std::endl;
+#endif /* DEBUG */
+        m_depth = FRAME_CAPTURE_MAX_DEPTH;
+    }
+
+    GLStateCache& state = GLStateCache::Current();
+    for (unsigned int i = 0; i < FRAME_CAPTURE_MAX_DEPTH; ++i)
+    {
+        Slot& slot = m_slots[i];
+        slot.owner = this;
+        slot.buffer = 0;
+        slot.fence = 0;
+        slot.writing = false;
+        slot.write_ms = 0.0;
+        slot.write_failed = false;
+
+        if (i < m_depth)
+        {
+            glGenBuffers(1, &slot.buffer);
+            state.BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, m_size, NULL, GL_STREAM_READ);
+        }
+    }
+    state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+
+FrameCapture::~FrameCapture(void)
+{
+    Flush();
+
+    for (unsigned int i = 0; i < m_depth; ++i)
+        GLStateCache::Current().DeleteBuffers(1, &m_slots[i].buffer);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Capture
+//
+// Purpose: Starts reading the framebuffer bound for reading into the next
+//          buffer, to be written to a file when it is finished.
+//
+// INPUTS: filename - the file, a PNG if it ends with ".png" and a PPM
+//                    otherwise; if empty, the frame is not written
+//
+// OUTPUTS: None.
+//
+// NOTES: The buffers are used in turn, so the one Capture needs is the
+//        oldest in flight, and waiting for it is the only stall.
+//
+///////////////////////////////////////////////////////////////////////////////
+void FrameCapture::Capture(const std::string& filename)
+{
+    PROFILE_ZONE("FrameCapture::Capture");
+    GL_CALL_SITE("FrameCapture::Capture");
+
+    Poll();
+
+    unsigned int index = m_next;
+    Slot& slot = m_slots[index];
+    m_next = (m_next + 1) % m_depth;
+
+    if (slot.fence)
+    {
+        Clock::time_point start = Clock::now();
+        WaitForFence(slot.fence);
+        m_fence_wait_total += ElapsedMilliseconds(start);
+
+        Retire(index);
+    }
+
+    // The buffer is idle, so the readback needs no synchronization with
+    // an earlier one
+    Clock::time_point start = Clock::now();
+    GLStateCache& state = GLStateCache::Current();
+    state.BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.filename = filename;
+    m_read_total += ElapsedMilliseconds(start);
+
+    ++m_frames;
+}
+
+
+
+void FrameCapture::Poll(void)
+{
+    for (unsigned int i = 0; i < m_depth; ++i)
+    {
+        if (m_slots[i].fence)
+        {
+            if (IsFenceSignaled(m_slots[i].fence))
+                Retire(i);
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Flush
+//
+// Purpose: Waits for every readback and file write.
+//
+// INPUTS: None.
+//
+// OUTPUTS: Returns false if a file could not be written, since the capture
+//          was created.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool FrameCapture::Flush(void)
+{
+    GL_CALL_SITE("FrameCapture::Flush");
+
+    // Oldest first, so the files are written in the order of the frames
+    for (unsigned int n = 0; n < m_depth; ++n)
+    {
+        unsigned int index = (m_next + n) % m_depth;
+        Slot& slot = m_slots[index];
+        if (slot.fence)
+        {
+            Clock::time_point start = Clock::now();
+            WaitForFence(slot.fence);
+            m_fence_wait_total += ElapsedMilliseconds(start);
+
+            Retire(index);
+        }
+    }
+
+    for (unsigned int i = 0; i < m_depth; ++i)
+        WaitForWrite(i);
+
+    return m_failed_writes == 0;
+}
+
+
+
+FRAME_CAPTURE_STATS FrameCapture::GetStats(void) const
+{
+    FRAME_CAPTURE_STATS stats;
+    double frames = m_frames ? (double)m_frames : 1.0;
+    double context_ms = m_read_total + m_fence_wait_total + m_map_total;
+
+    stats.frames = m_frames;
+    stats.bytes = m_frames * (unsigned long long)m_size;
+    stats.failed_writes = m_failed_writes;
+    stats.read_ms = m_read_total / frames;
+    stats.fence_wait_ms = m_fence_wait_total / frames;
+    stats.map_ms = m_map_total / frames;
+    stats.write_wait_ms = m_write_wait_total / frames;
+    stats.write_ms = m_write_total / frames;
+    stats.readback_mb_s = context_ms > 0.0 ? (double)stats.bytes / (context_ms * 1000.0) : 0.0;
+    return stats;
+}
+
+
+
+// Converts and writes the pixels of a slot, on a job thread
+void FrameCapture::WriteJob(void *user)
+{
+    Slot *slot = (Slot *)user;
+    Clock::time_point start = Clock::now();
+    IMAGE image;
+
+    ImageFromRGBA(&slot->pixels[0], (unsigned int)slot->owner->m_width, (unsigned int)slot->owner->m_height, image);
+    slot->write_failed = !WriteImage(slot->write_filename.c_str(), image);
+    slot->write_ms = ElapsedMilliseconds(start);
+}
+
+
+
+// Copies a finished readback out of its buffer and starts writing it
+void FrameCapture::Retire(unsigned int index)
+{
+    Slot& slot = m_slots[index];
+
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    // The pixels are reused for this readback, so the last write from
+    // them must be done
+    WaitForWrite(index);
+    slot.write_filename = slot.filename;
+
+    Clock::time_point start = Clock::now();
+    GLStateCache& state = GLStateCache::Current();
+    slot.pixels.resize((size_t)m_size);
+
+    state.BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_size, GL_MAP_READ_BIT);
+    if (data)
+    {
+        memcpy(&slot.pixels[0], data, (size_t)m_size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, m_size, &slot.pixels[0]);
+    }
+    state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_map_total += ElapsedMilliseconds(start);
+
+    if (!slot.write_filename.empty())
+    {
+        slot.writing = true;
+        m_jobs->Run(WriteJob, &slot, &slot.written);
+    }
+}
+
+
+
+// Waits for the write job of a slot, if it has one, and collects its
+// results
+void FrameCapture::WaitForWrite(unsigned int index)
+{
+    Slot& slot = m_slots[index];
+    if (!slot.writing)
+        return;
+
+    Clock::time_point start = Clock::now();
+    m_jobs->Wait(slot.written);
+    m_write_wait_total += ElapsedMilliseconds(start);
+
+    m_write_total += slot.write_ms;
+    if (slot.write_failed)
+    {
+#ifdef _DEBUG
+        std::cerr << "FrameCapture: unable to write " << slot.write_filename << std::endl;
+#endif /* DEBUG */
+        ++m_failed_writes;
+    }
+    slot.writing = false;
+}
@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: FramePipeline.cpp
+//
+// Purpose: This file contains the definition of the FramePipeline class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <iostream>
+#include <string.h>
+#include "FramePipeline.h"
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "GLSync.h"
+#include "Platform.h"
+#include "Profiler.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: FramePipeline
+//
+// Purpose: Creates the buffer and starts preparing frame 0.
+//
+// INPUTS: depth       - frames in flight
+//         upload_size - bytes uploaded per frame
+//         extra_size  - bytes per frame kept on the CPU
+//         prepare     - fills in a frame
+//         user        - passed to prepare
+//         jobs        - where prepare runs, or NULL for JobSystem::Shared()
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+FramePipeline::FramePipeline(unsigned int depth, size_t upload_size, size_t extra_size,
+                             FramePrepareFn prepare, void *user, JobSystem *jobs)
+    : m_depth(depth),
+      m_upload_size(upload_size),
+      m_extra_size(extra_size),
+      m_prepare(prepare),
+      m_user(user),
+      m_jobs(jobs ? jobs : &JobSystem::Shared()),
+      m_buffer(0),
+      m_prepare_ms(0),
+      m_prepare_frame(0),
+      m_frames(0),
+      m_frame_total(0.0),
+      m_prepare_wait_total(0.0),
+      m_fence_wait_total(0.0),
+      m_latency_total(0.0),
+      m_latency_count(0)
+{
+    if (m_depth < 1)
+        m_depth = 1;
+    if (m_depth > FRAME_PIPELINE_MAX_DEPTH)
+    {
+#ifdef _DEBUG
+        std::cerr << "FramePipeline: depth " << depth << " clamped to "
+                  << FRAME_PIPELINE_MAX_DEPTH << std::endl;
+#endif /* DEBUG */
+        m_depth = FRAME_PIPELINE_MAX_DEPTH;
+    }
+
+    m_stride = (GLsizeiptr)((upload_size + FRAME_PIPELINE_ALIGNMENT - 1) & ~(size_t)(FRAME_PIPELINE_ALIGNMENT - 1));
+
+    // One spare byte keeps the extra pointer valid when extra_size is 0
+    for (unsigned int i = 0; i < 2; ++i)
+        m_staging[i].resize(upload_size + extra_size + 1);
+
+    for (unsigned int i = 0; i < FRAME_PIPELINE_MAX_DEPTH; ++i)
+        m_fences[i] = 0;
+
+    memset(&m_frame, 0, sizeof(m_frame));
+
+    glGenBuffers(1, &m_buffer);
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_stride * m_depth, NULL, GL_STREAM_DRAW);
+
+    StartPrepare();
+}
+
+
+
+FramePipeline::~FramePipeline(void)
+{
+    m_jobs->Wait(m_prepared);
+
+    for (unsigned int i = 0; i < m_depth; ++i)
+    {
+        if (m_fences[i])
+            glDeleteSync(m_fences[i]);
+    }
+
+    GLStateCache::Current().DeleteBuffers(1, &m_buffer);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BeginFrame
+//
+// Purpose: Waits for the next frame to be prepared and for its buffer
+//          region to be free, uploads it, and starts preparing the frame
+//          after it.
+//
+// INPUTS: None.
+//
+// OUTPUTS: The frame, valid until the next BeginFrame.
+//
+// NOTES: The fences of the other regions are polled without waiting, so a
+//        frame's latency is measured at the first BeginFrame that sees it
+//        finished.
+//
+///////////////////////////////////////////////////////////////////////////////
+const PIPELINE_FRAME& FramePipeline::BeginFrame(void)
+{
+    PROFILE_ZONE("FramePipeline::BeginFrame");
+    GL_CALL_SITE("FramePipeline::BeginFrame");
+    Clock::time_point start = Clock::now();
+    if (m_frames)
+        m_frame_total += ElapsedMilliseconds(m_last_begin, start);
+    m_last_begin = start;
+
+    // The frame is prepared by the job started in the previous BeginFrame
+    m_jobs->Wait(m_prepared);
+    Clock::time_point prepared = Clock::now();
+    m_prepare_wait_total += ElapsedMilliseconds(start, prepared);
+
+    for (unsigned int i = 0; i < m_depth; ++i)
+    {
+        if (m_fences[i])
+        {
+            if (IsFenceSignaled(m_fences[i]))
+                Retire(i);
+        }
+    }
+
+    unsigned int region = (unsigned int)(m_prepare_frame % m_depth);
+    if (m_fences[region])
+    {
+        WaitForFence(m_fences[region]);
+        Retire(region);
+        m_fence_wait_total += ElapsedMilliseconds(prepared);
+    }
+
+    // The region is idle, so the map needs no synchronization and the old
+    // contents can be dropped
+    unsigned int slot = (unsigned int)(m_prepare_frame & 1);
+    GLintptr offset = (GLintptr)region * m_stride;
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_upload_size)
+    {
+        void *data = glMapBufferRange(GL_ARRAY_BUFFER, offset, (GLsizeiptr)m_upload_size,
+                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                      GL_MAP_UNSYNCHRONIZED_BIT);
+        if (data)
+        {
+            memcpy(data, &m_staging[slot][0], m_upload_size);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        else
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, offset, (GLsizeiptr)m_upload_size, &m_staging[slot][0]);
+        }
+    }
+
+    m_frame.number = m_prepare_frame;
+    m_frame.offset = offset;
+    m_frame.upload = &m_staging[slot][0];
+    m_frame.extra = &m_staging[slot][m_upload_size];
+    m_fence_start[region] = m_prepare_start[slot];
+
+    // Prepare the next frame into the other slot while this one is drawn
+    ++m_prepare_frame;
+    StartPrepare();
+
+    return m_frame;
+}
+
+
+
+void FramePipeline::EndFrame(void)
+{
+    unsigned int region = (unsigned int)(m_frame.number % m_depth);
+    m_fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++m_frames;
+}
+
+
+
+FRAME_PIPELINE_STATS FramePipeline::GetStats(void) const
+{
+    FRAME_PIPELINE_STATS stats;
+    double frames = m_frames ? (double)m_frames : 1.0;
+
+    stats.frames = m_frames;
+    stats.frame_ms = m_frames > 1 ? m_frame_total / (double)(m_frames - 1) : 0.0;
+    stats.prepare_wait_ms = m_prepare_wait_total / frames;
+    stats.fence_wait_ms = m_fence_wait_total / frames;
+    stats.latency_ms = m_latency_count ? m_latency_total / (double)m_latency_count : 0.0;
+    return stats;
+}
+
+
+
+// Starts the prepare job of the next frame. The time is read here, on the
+// context thread, rather than by the job, so it is ordered with whatever
+// the context thread did to the clock before (the capture mode fixes it)
+void FramePipeline::StartPrepare(void)
+{
+    m_prepare_ms = GetMilliseconds();
+    m_jobs->Run(PrepareJob, this, &m_prepared);
+}
+
+
+
+// Runs the prepare function for the next frame, on a job thread
+void FramePipeline::PrepareJob(void *user)
+{
+    FramePipeline *pipeline = (FramePipeline *)user;
+    unsigned int slot = (unsigned int)(pipeline->m_prepare_frame & 1);
+    unsigned char *data = &pipeline->m_staging[slot][0];
+
+    pipeline->m_prepare_start[slot] = Clock::now();
+    pipeline->m_prepare(pipeline->m_user, pipeline->m_prepare_frame, pipeline->m_prepare_ms,
+                        data, data + pipeline->m_upload_size);
+}
+
+
+
+// Records the latency of the frame that used 'region' and drops its fence
+void FramePipeline::Retire(unsigned int region)
+{
+    m_latency_total += ElapsedMilliseconds(m_fence_start[region]);
+    ++m_latency_count;
+
+    glDeleteSync(m_fences[region]);
+    m_fences[region] = 0;
+}
@@ -0,0 +1,498 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GLIntercept.cpp
+//
+// Purpose: This file contains the definition of the GLIntercept class and
+//          the wrappers it puts in place of the GLEW function pointers.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <string.h>
+#include <iomanip>
+#include "GLIntercept.h"
+
+// The name of calls made outside of a GL_CALL_SITE scope
+static const char OTHER_SITE[] = "(other)";
+
+bool GLIntercept::s_installed = false;
+const char *GLIntercept::s_site = NULL;
+
+static GL_CALL_REPORT s_current;
+static GL_CALL_REPORT s_last_frame;
+static GL_CALL_REPORT s_total;
+
+// The originals of the swapped pointers
+#define GL_INTERCEPT_ORIGINAL(name)     static decltype(__glew##name) s_##name = NULL
+
+GL_INTERCEPT_ORIGINAL(DrawArraysInstanced);
+GL_INTERCEPT_ORIGINAL(DrawElementsInstanced);
+GL_INTERCEPT_ORIGINAL(DrawArraysInstancedBaseInstance);
+GL_INTERCEPT_ORIGINAL(DrawElementsInstancedBaseInstance);
+
+GL_INTERCEPT_ORIGINAL(UseProgram);
+GL_INTERCEPT_ORIGINAL(BindVertexArray);
+GL_INTERCEPT_ORIGINAL(BindBuffer);
+GL_INTERCEPT_ORIGINAL(BindBufferBase);
+GL_INTERCEPT_ORIGINAL(BindBufferRange);
+GL_INTERCEPT_ORIGINAL(BindFramebuffer);
+GL_INTERCEPT_ORIGINAL(BindSampler);
+GL_INTERCEPT_ORIGINAL(ActiveTexture);
+GL_INTERCEPT_ORIGINAL(TexBuffer);
+GL_INTERCEPT_ORIGINAL(VertexAttribPointer);
+GL_INTERCEPT_ORIGINAL(PrimitiveRestartIndex);
+
+GL_INTERCEPT_ORIGINAL(Uniform1i);
+GL_INTERCEPT_ORIGINAL(Uniform1f);
+GL_INTERCEPT_ORIGINAL(Uniform1fv);
+GL_INTERCEPT_ORIGINAL(Uniform2fv);
+GL_INTERCEPT_ORIGINAL(Uniform3fv);
+GL_INTERCEPT_ORIGINAL(Uniform4fv);
+GL_INTERCEPT_ORIGINAL(Uniform1iv);
+GL_INTERCEPT_ORIGINAL(Uniform2iv);
+GL_INTERCEPT_ORIGINAL(Uniform3iv);
+GL_INTERCEPT_ORIGINAL(Uniform4iv);
+GL_INTERCEPT_ORIGINAL(UniformMatrix3fv);
+GL_INTERCEPT_ORIGINAL(UniformMatrix4fv);
+
+GL_INTERCEPT_ORIGINAL(BufferData);
+GL_INTERCEPT_ORIGINAL(BufferSubData);
+GL_INTERCEPT_ORIGINAL(CopyBufferSubData);
+GL_INTERCEPT_ORIGINAL(MapBuffer);
+GL_INTERCEPT_ORIGINAL(MapBufferRange);
+GL_INTERCEPT_ORIGINAL(FlushMappedBufferRange);
+GL_INTERCEPT_ORIGINAL(UnmapBuffer);
+
+#undef GL_INTERCEPT_ORIGINAL
+
+// Draws
+
+static void GLAPIENTRY WrapDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+{
+    GLIntercept::Count(GLCALL_DRAW, 0);
+    s_DrawArraysInstanced(mode, first, count, instances);
+}
+
+static void GLAPIENTRY WrapDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices,
+                                                 GLsizei instances)
+{
+    GLIntercept::Count(GLCALL_DRAW, 0);
+    s_DrawElementsInstanced(mode, count, type, indices, instances);
+}
+
+static void GLAPIENTRY WrapDrawArraysInstancedBaseInstance(GLenum mode, GLint first, GLsizei count,
+                                                           GLsizei instances, GLuint base_instance)
+{
+    GLIntercept::Count(GLCALL_DRAW, 0);
+    s_DrawArraysInstancedBaseInstance(mode, first, count, instances, base_instance);
+}
+
+static void GLAPIENTRY WrapDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type,
+                                                             const GLvoid *indices, GLsizei instances,
+                                                             GLuint base_instance)
+{
+    GLIntercept::Count(GLCALL_DRAW, 0);
+    s_DrawElementsInstancedBaseInstance(mode, count, type, indices, instances, base_instance);
+}
+
+// State changes
+
+static void GLAPIENTRY WrapUseProgram(GLuint program)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_UseProgram(program);
+}
+
+static void GLAPIENTRY WrapBindVertexArray(GLuint vao)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindVertexArray(vao);
+}
+
+static void GLAPIENTRY WrapBindBuffer(GLenum target, GLuint buffer)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindBuffer(target, buffer);
+}
+
+static void GLAPIENTRY WrapBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindBufferBase(target, index, buffer);
+}
+
+static void GLAPIENTRY WrapBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+                                           GLsizeiptr size)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindBufferRange(target, index, buffer, offset, size);
+}
+
+static void GLAPIENTRY WrapBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindFramebuffer(target, framebuffer);
+}
+
+static void GLAPIENTRY WrapBindSampler(GLuint unit, GLuint sampler)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_BindSampler(unit, sampler);
+}
+
+static void GLAPIENTRY WrapActiveTexture(GLenum texture)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_ActiveTexture(texture);
+}
+
+static void GLAPIENTRY WrapTexBuffer(GLenum target, GLenum format, GLuint buffer)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_TexBuffer(target, format, buffer);
+}
+
+static void GLAPIENTRY WrapVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                               GLsizei stride, const GLvoid *pointer)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_VertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+static void GLAPIENTRY WrapPrimitiveRestartIndex(GLuint index)
+{
+    GLIntercept::Count(GLCALL_STATE, 0);
+    s_PrimitiveRestartIndex(index);
+}
+
+// Uniforms
+
+static void GLAPIENTRY WrapUniform1i(GLint location, GLint v0)
+{
+    GLIntercept::Count(GLCALL_UNIFORM, 0);
+    s_Uniform1i(location, v0);
+}
+
+static void GLAPIENTRY WrapUniform1f(GLint location, GLfloat v0)
+{
+    GLIntercept::Count(GLCALL_UNIFORM, 0);
+    s_Uniform1f(location, v0);
+}
+
+#define GL_INTERCEPT_UNIFORM_V(name, type)                                          \
+    static void GLAPIENTRY Wrap##name(GLint location, GLsizei count, const type *value) \
+    {                                                                               \
+        GLIntercept::Count(GLCALL_UNIFORM, 0);                                      \
+        s_##name(location, count, value);                                           \
+    }
+
+GL_INTERCEPT_UNIFORM_V(Uniform1fv, GLfloat)
+GL_INTERCEPT_UNIFORM_V(Uniform2fv, GLfloat)
+GL_INTERCEPT_UNIFORM_V(Uniform3fv, GLfloat)
+GL_INTERCEPT_UNIFORM_V(Uniform4fv, GLfloat)
+GL_INTERCEPT_UNIFORM_V(Uniform1iv, GLint)
+GL_INTERCEPT_UNIFORM_V(Uniform2iv, GLint)
+GL_INTERCEPT_UNIFORM_V(Uniform3iv, GLint)
+GL_INTERCEPT_UNIFORM_V(Uniform4iv, GLint)
+
+#undef GL_INTERCEPT_UNIFORM_V
+
+static void GLAPIENTRY WrapUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    GLIntercept::Count(GLCALL_UNIFORM, 0);
+    s_UniformMatrix3fv(location, count, transpose, value);
+}
+
+static void GLAPIENTRY WrapUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    GLIntercept::Count(GLCALL_UNIFORM, 0);
+    s_UniformMatrix4fv(location, count, transpose, value);
+}
+
+// Buffer uploads and maps
+
+// Allocating without data (or orphaning) counts as an upload of 0 bytes
+static void GLAPIENTRY WrapBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+    GLIntercept::Count(GLCALL_UPLOAD, data ? (unsigned long long)size : 0);
+    s_BufferData(target, size, data, usage);
+}
+
+static void GLAPIENTRY WrapBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+    GLIntercept::Count(GLCALL_UPLOAD, (unsigned long long)size);
+    s_BufferSubData(target, offset, size, data);
+}
+
+// The copy happens on the GPU, so it is not an upload
+static void GLAPIENTRY WrapCopyBufferSubData(GLenum read_target, GLenum write_target, GLintptr read_offset,
+                                             GLintptr write_offset, GLsizeiptr size)
+{
+    GLIntercept::Count(GLCALL_OTHER, 0);
+    s_CopyBufferSubData(read_target, write_target, read_offset, write_offset, size);
+}
+
+static GLvoid * GLAPIENTRY WrapMapBuffer(GLenum target, GLenum access)
+{
+    GLint size = 0;
+    if (access != GL_READ_ONLY)
+        glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+
+    GLIntercept::Count(GLCALL_MAP, (unsigned long long)size);
+    return s_MapBuffer(target, access);
+}
+
+static GLvoid * GLAPIENTRY WrapMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    GLIntercept::Count(GLCALL_MAP, (access & GL_MAP_WRITE_BIT) ? (unsigned long long)length : 0);
+    return s_MapBufferRange(target, offset, length, access);
+}
+
+static void GLAPIENTRY WrapFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
+{
+    GLIntercept::Count(GLCALL_OTHER, 0);
+    s_FlushMappedBufferRange(target, offset, length);
+}
+
+static GLboolean GLAPIENTRY WrapUnmapBuffer(GLenum target)
+{
+    GLIntercept::Count(GLCALL_UNMAP, 0);
+    return s_UnmapBuffer(target);
+}
+
+// Swaps one pointer in either direction, if GLEW loaded it
+#define GL_INTERCEPT_SWAP(name)                 \
+    if (__glew##name)                           \
+    {                                           \
+        s_##name = __glew##name;                \
+        __glew##name = Wrap##name;              \
+    }
+
+#define GL_INTERCEPT_RESTORE(name)              \
+    if (s_##name)                               \
+    {                                           \
+        __glew##name = s_##name;                \
+        s_##name = NULL;                        \
+    }
+
+#define GL_INTERCEPT_ALL(action)                \
+    action(DrawArraysInstanced)                 \
+    action(DrawElementsInstanced)               \
+    action(DrawArraysInstancedBaseInstance)     \
+    action(DrawElementsInstancedBaseInstance)   \
+    action(UseProgram)                          \
+    action(BindVertexArray)                     \
+    action(BindBuffer)                          \
+    action(BindBufferBase)                      \
+    action(BindBufferRange)                     \
+    action(BindFramebuffer)                     \
+    action(BindSampler)                         \
+    action(ActiveTexture)                       \
+    action(TexBuffer)                           \
+    action(VertexAttribPointer)                 \
+    action(PrimitiveRestartIndex)               \
+    action(Uniform1i)                           \
+    action(Uniform1f)                           \
+    action(Uniform1fv)                          \
+    action(Uniform2fv)                          \
+    action(Uniform3fv)                          \
+    action(Uniform4fv)                          \
+    action(Uniform1iv)                          \
+    action(Uniform2iv)                          \
+    action(Uniform3iv)                          \
+    action(Uniform4iv)                          \
+    action(UniformMatrix3fv)                    \
+    action(UniformMatrix4fv)                    \
+    action(BufferData)                          \
+    action(BufferSubData)                       \
+    action(CopyBufferSubData)                   \
+    action(MapBuffer)                           \
+    action(MapBufferRange)                      \
+    action(FlushMappedBufferRange)              \
+    action(UnmapBuffer)
+
+static void AddCounts(GL_CALL_COUNTS& to, const GL_CALL_COUNTS& from)
+{
+    to.calls += from.calls;
+    to.draws += from.draws;
+    to.state_changes += from.state_changes;
+    to.uniforms += from.uniforms;
+    to.uploads += from.uploads;
+    to.upload_bytes += from.upload_bytes;
+    to.maps += from.maps;
+    to.map_bytes += from.map_bytes;
+    to.unmaps += from.unmaps;
+}
+
+// Site names are usually literals, so the pointer matches before the text
+static GL_CALL_COUNTS& SiteCounts(GL_CALL_REPORT& report, const char *site)
+{
+    for (size_t i = 0; i < report.sites.size(); ++i)
+    {
+        if (report.sites[i].site == site || strcmp(report.sites[i].site, site) == 0)
+            return report.sites[i].counts;
+    }
+
+    GL_CALL_SITE_COUNTS counts;
+    memset((void *)&counts, 0, sizeof(counts));
+    counts.site = site;
+    report.sites.push_back(counts);
+
+    return report.sites.back().counts;
+}
+
+static void AddReport(GL_CALL_REPORT& to, const GL_CALL_REPORT& from)
+{
+    AddCounts(to.total, from.total);
+    for (size_t i = 0; i < from.sites.size(); ++i)
+        AddCounts(SiteCounts(to, from.sites[i].site), from.sites[i].counts);
+}
+
+static void ClearReport(GL_CALL_REPORT& report)
+{
+    memset((void *)&report.total, 0, sizeof(report.total));
+    report.sites.clear();
+}
+
+
+
+bool GLIntercept::Install(void)
+{
+    if (s_installed)
+        return false;
+
+    GL_INTERCEPT_ALL(GL_INTERCEPT_SWAP)
+
+    ClearReport(s_current);
+    ClearReport(s_last_frame);
+    ClearReport(s_total);
+    s_current.frame = 0;
+    s_last_frame.frame = 0;
+    s_total.frame = 0;
+    s_installed = true;
+
+    return true;
+}
+
+
+
+void GLIntercept::Uninstall(void)
+{
+    if (!s_installed)
+        return;
+
+    GL_INTERCEPT_ALL(GL_INTERCEPT_RESTORE)
+    s_installed = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Count
+//
+// Purpose: Adds one call to the current frame, in total and for the current
+//          call site.
+//
+// INPUTS: kind  - one of the GLCALL_* kinds
+//         bytes - the bytes uploaded by a GLCALL_UPLOAD or mapped for
+//                 writing by a GLCALL_MAP, otherwise ignored
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void GLIntercept::Count(int kind, unsigned long long bytes)
+{
+    GL_CALL_COUNTS *counts[2] = { &s_current.total, &SiteCounts(s_current, s_site ? s_site : OTHER_SITE) };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        GL_CALL_COUNTS& c = *counts[i];
+        ++c.calls;
+
+        switch (kind)
+        {
+        case GLCALL_DRAW:
+            ++c.draws;
+            break;
+        case GLCALL_STATE:
+            ++c.state_changes;
+            break;
+        case GLCALL_UNIFORM:
+            ++c.uniforms;
+            break;
+        case GLCALL_UPLOAD:
+            ++c.uploads;
+            c.upload_bytes += bytes;
+            break;
+        case GLCALL_MAP:
+            ++c.maps;
+            c.map_bytes += bytes;
+            break;
+        case GLCALL_UNMAP:
+            ++c.unmaps;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+
+void GLIntercept::EndFrame(void)
+{
+    AddReport(s_total, s_current);
+    ++s_total.frame;
+
+    // Swapping keeps the site vectors' memory, so steady frames do not allocate
+    s_last_frame.sites.swap(s_current.sites);
+    s_last_frame.total = s_current.total;
+    s_last_frame.frame = s_current.frame;
+
+    ClearReport(s_current);
+    s_current.frame = s_total.frame;
+}
+
+
+
+const GL_CALL_REPORT& GLIntercept::GetFrameReport(void)
+{
+    return s_last_frame;
+}
+
+
+
+GL_CALL_REPORT GLIntercept::GetTotalReport(void)
+{
+    GL_CALL_REPORT report = s_total;
+    AddReport(report, s_current);
+    return report;
+}
+
+
+
+void GLIntercept::PrintReport(std::ostream& out, const GL_CALL_REPORT& report)
+{
+    std::ios::fmtflags flags = out.flags();
+
+    out << std::left << std::setw(32) << "site" << std::right
+        << std::setw(9) << "calls" << std::setw(9) << "draws"
+        << std::setw(9) << "state" << std::setw(9) << "uniform"
+        << std::setw(9) << "uploads" << std::setw(12) << "bytes"
+        << std::setw(9) << "maps" << std::setw(12) << "map bytes"
+        << std::setw(9) << "unmaps" << std::endl;
+
+    for (size_t i = 0; i <= report.sites.size(); ++i)
+    {
+        const char *site = i < report.sites.size() ? report.sites[i].site : "total";
+        const GL_CALL_COUNTS& c = i < report.sites.size() ? report.sites[i].counts : report.total;
+
+        out << std::left << std::setw(32) << site << std::right
+            << std::setw(9) << c.calls << std::setw(9) << c.draws
+            << std::setw(9) << c.state_changes << std::setw(9) << c.uniforms
+            << std::setw(9) << c.uploads << std::setw(12) << c.upload_bytes
+            << std::setw(9) << c.maps << std::setw(12) << c.map_bytes
+            << std::setw(9) << c.unmaps << std::endl;
+    }
+
+    out.flags(flags);
+}
@@ -0,0 +1,413 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GLStateCache.cpp
+//
+// Purpose: This file contains the definition of the GLStateCache class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <string.h>
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+
+// No GL object or enum has this value, so nothing matches it
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+
+
+GLStateCache::GLStateCache(void)
+{
+    Invalidate();
+    ResetStats();
+}
+
+
+
+GLStateCache& GLStateCache::Current(void)
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+
+
+void GLStateCache::Invalidate(void)
+{
+    m_program = UNKNOWN;
+    m_vao = UNKNOWN;
+    m_active_texture = UNKNOWN;
+    m_depth_func = UNKNOWN;
+    m_depth_mask = UNKNOWN;
+    m_cull_face = UNKNOWN;
+    m_front_face = UNKNOWN;
+    m_blend_source = UNKNOWN;
+    m_blend_destination = UNKNOWN;
+    m_restart_index = 0;
+    m_restart_index_known = false;
+    memset(m_buffers, 0xFF, sizeof(m_buffers));
+    memset(m_textures, 0xFF, sizeof(m_textures));
+    memset(m_capabilities, 0xFF, sizeof(m_capabilities));
+}
+
+
+
+void GLStateCache::ResetStats(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+
+
+void GLStateCache::UseProgram(GLuint program)
+{
+    if (Changed(GLSTATE_PROGRAM, m_program, program))
+        glUseProgram(program);
+}
+
+
+
+void GLStateCache::BindVertexArray(GLuint vao)
+{
+    if (Changed(GLSTATE_VERTEX_ARRAY, m_vao, vao))
+        glBindVertexArray(vao);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BindBuffer
+//
+// Purpose: Binds a buffer object to a target.
+//
+// INPUTS: target - the binding point
+//         buffer - the buffer object, or 0
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer)
+{
+    int index = BufferTarget(target);
+
+    if (index < 0)
+    {
+        ++m_stats.issued[GLSTATE_BUFFER];
+        ++m_stats.total_issued;
+        glBindBuffer(target, buffer);
+    }
+    else if (Changed(GLSTATE_BUFFER, m_buffers[index], buffer))
+    {
+        glBindBuffer(target, buffer);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BindTexture
+//
+// Purpose: Binds a texture to a target of a texture unit, selecting the
+//          unit first if needed.
+//
+// INPUTS: unit    - the texture unit, counted from 0
+//         target  - the texture target
+//         texture - the texture object, or 0
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    int index = TextureTarget(target);
+
+    if (index < 0 || unit >= GLSTATE_MAX_TEXTURE_UNITS)
+    {
+        ActiveTexture(unit);
+        ++m_stats.issued[GLSTATE_TEXTURE];
+        ++m_stats.total_issued;
+        GLIntercept::Note(GLCALL_STATE);
+        glBindTexture(target, texture);
+    }
+    else if (Changed(GLSTATE_TEXTURE, m_textures[unit][index], texture))
+    {
+        ActiveTexture(unit);
+        GLIntercept::Note(GLCALL_STATE);
+        glBindTexture(target, texture);
+    }
+}
+
+
+
+void GLStateCache::ActiveTexture(GLuint unit)
+{
+    if (Changed(GLSTATE_TEXTURE, m_active_texture, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+
+
+void GLStateCache::Enable(GLenum capability)
+{
+    SetEnabled(capability, true);
+}
+
+
+
+void GLStateCache::Disable(GLenum capability)
+{
+    SetEnabled(capability, false);
+}
+
+
+
+void GLStateCache::SetEnabled(GLenum capability, bool enabled)
+{
+    int index = Capability(capability);
+
+    if (index < 0)
+    {
+        ++m_stats.issued[GLSTATE_CAPABILITY];
+        ++m_stats.total_issued;
+    }
+    else if (!Changed(GLSTATE_CAPABILITY, m_capabilities[index], enabled ? 1 : 0))
+    {
+        return;
+    }
+
+    GLIntercept::Note(GLCALL_STATE);
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+
+
+void GLStateCache::DepthFunc(GLenum func)
+{
+    if (Changed(GLSTATE_FIXED_FUNCTION, m_depth_func, func))
+    {
+        GLIntercept::Note(GLCALL_STATE);
+        glDepthFunc(func);
+    }
+}
+
+
+
+void GLStateCache::DepthMask(GLboolean mask)
+{
+    if (Changed(GLSTATE_FIXED_FUNCTION, m_depth_mask, mask))
+    {
+        GLIntercept::Note(GLCALL_STATE);
+        glDepthMask(mask);
+    }
+}
+
+
+
+void GLStateCache::CullFace(GLenum mode)
+{
+    if (Changed(GLSTATE_FIXED_FUNCTION, m_cull_face, mode))
+    {
+        GLIntercept::Note(GLCALL_STATE);
+        glCullFace(mode);
+    }
+}
+
+
+
+void GLStateCache::FrontFace(GLenum mode)
+{
+    if (Changed(GLSTATE_FIXED_FUNCTION, m_front_face, mode))
+    {
+        GLIntercept::Note(GLCALL_STATE);
+        glFrontFace(mode);
+    }
+}
+
+
+
+// Counted as one call
+void GLStateCache::BlendFunc(GLenum source, GLenum destination)
+{
+    if (m_blend_source == source && m_blend_destination == destination)
+    {
+        ++m_stats.skipped[GLSTATE_FIXED_FUNCTION];
+        ++m_stats.total_skipped;
+        return;
+    }
+
+    ++m_stats.issued[GLSTATE_FIXED_FUNCTION];
+    ++m_stats.total_issued;
+    m_blend_source = source;
+    m_blend_destination = destination;
+    GLIntercept::Note(GLCALL_STATE);
+    glBlendFunc(source, destination);
+}
+
+
+
+void GLStateCache::PrimitiveRestartIndex(GLuint index)
+{
+    // 0xFFFFFFFF is a common restart index, so it cannot mean unknown here
+    if (m_restart_index_known && m_restart_index == index)
+    {
+        ++m_stats.skipped[GLSTATE_FIXED_FUNCTION];
+        ++m_stats.total_skipped;
+        return;
+    }
+
+    ++m_stats.issued[GLSTATE_FIXED_FUNCTION];
+    ++m_stats.total_issued;
+    m_restart_index = index;
+    m_restart_index_known = true;
+    glPrimitiveRestartIndex(index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: DeleteBuffers
+//
+// Purpose: Deletes buffer objects. GL unbinds a deleted buffer from every
+//          binding point of the current context, and so does the cache.
+//
+// INPUTS: count   - the number of names
+//         buffers - the names
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void GLStateCache::DeleteBuffers(GLsizei count, const GLuint *buffers)
+{
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        for (int j = 0; j < BUFFER_TARGET_COUNT && buffers[i]; ++j)
+        {
+            if (m_buffers[j] == buffers[i])
+                m_buffers[j] = 0;
+        }
+    }
+
+    glDeleteBuffers(count, buffers);
+}
+
+
+
+void GLStateCache::DeleteTextures(GLsizei count, const GLuint *textures)
+{
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        for (int unit = 0; unit < GLSTATE_MAX_TEXTURE_UNITS && textures[i]; ++unit)
+        {
+            for (int j = 0; j < TEXTURE_TARGET_COUNT; ++j)
+            {
+                if (m_textures[unit][j] == textures[i])
+                    m_textures[unit][j] = 0;
+            }
+        }
+    }
+
+    glDeleteTextures(count, textures);
+}
+
+
+
+void GLStateCache::DeleteVertexArrays(GLsizei count, const GLuint *arrays)
+{
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        if (arrays[i] && m_vao == arrays[i])
+            m_vao = 0;
+    }
+
+    glDeleteVertexArrays(count, arrays);
+}
+
+
+
+// A program in use is only flagged for deletion and stays current, but its
+// name may be reused once it is no longer in use, so forget it either way
+void GLStateCache::DeleteProgram(GLuint program)
+{
+    if (program && m_program == program)
+        m_program = UNKNOWN;
+
+    glDeleteProgram(program);
+}
+
+
+
+// Records a call; returns true if it has to be issued
+bool GLStateCache::Changed(unsigned int kind, GLuint& cached, GLuint value)
+{
+    if (cached == value)
+    {
+        ++m_stats.skipped[kind];
+        ++m_stats.total_skipped;
+        return false;
+    }
+
+    cached = value;
+    ++m_stats.issued[kind];
+    ++m_stats.total_issued;
+    return true;
+}
+
+
+
+int GLStateCache::BufferTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:           return 0;
+    case GL_COPY_READ_BUFFER:       return 1;
+    case GL_COPY_WRITE_BUFFER:      return 2;
+    case GL_PIXEL_PACK_BUFFER:      return 3;
+    case GL_PIXEL_UNPACK_BUFFER:    return 4;
+    case GL_TEXTURE_BUFFER:         return 5;
+    case GL_UNIFORM_BUFFER:         return 6;
+    case GL_DRAW_INDIRECT_BUFFER:   return 7;
+    default:                        return -1;
+    }
+}
+
+
+
+int GLStateCache::TextureTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_1D:                     return 0;
+    case GL_TEXTURE_2D:                     return 1;
+    case GL_TEXTURE_3D:                     return 2;
+    case GL_TEXTURE_1D_ARRAY:               return 3;
+    case GL_TEXTURE_2D_ARRAY:               return 4;
+    case GL_TEXTURE_RECTANGLE:              return 5;
+    case GL_TEXTURE_CUBE_MAP:               return 6;
+    case GL_TEXTURE_BUFFER:                 return 7;
+    case GL_TEXTURE_2D_MULTISAMPLE:         return 8;
+    case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:   return 9;
+    default:                                return -1;
+    }
+}
+
+
+
+int GLStateCache::Capability(GLenum capability)
+{
+    switch (capability)
+    {
+    case GL_DEPTH_TEST:             return 0;
+    case GL_CULL_FACE:              return 1;
+    case GL_BLEND:                  return 2;
+    case GL_STENCIL_TEST:           return 3;
+    case GL_SCISSOR_TEST:           return 4;
+    case GL_PRIMITIVE_RESTART:      return 5;
+    case GL_POLYGON_OFFSET_FILL:    return 6;
+    case GL_MULTISAMPLE:            return 7;
+    case GL_RASTERIZER_DISCARD:     return 8;
+    case GL_PROGRAM_POINT_SIZE:     return 9;
+    default:                        return -1;
+    }
+}
@@ -0,0 +1,383 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GPUArena.cpp
+//
+// Purpose: This file contains the definition of the GPUArena class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <iostream>
+#include "GLStateCache.h"
+#include "GPUArena.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: GPUArena
+//
+// Purpose: Creates an empty arena. Pages are created on demand.
+//
+// INPUTS: page_size - the size of each buffer object
+//         usage     - the usage hint for glBufferData
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+GPUArena::GPUArena(unsigned long long page_size, GLenum usage)
+    : m_page_size(page_size),
+      m_usage(usage),
+      m_defragmentations(0),
+      m_bytes_moved(0)
+{
+}
+
+
+
+GPUArena::~GPUArena(void)
+{
+    for (size_t i = 0; i < m_pages.size(); ++i)
+    {
+        if (m_pages[i])
+        {
+            GLStateCache::Current().DeleteBuffers(1, &m_pages[i]->buffer);
+            delete m_pages[i];
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Allocate
+//
+// Purpose: Allocates a range of buffer storage from the first page with a
+//          large enough free block, creating a page if there is none.
+//
+// INPUTS: size       - the number of bytes needed
+//         allocation - receives the buffer and offset
+//         relocate   - optional, called when Defragment moves the range
+//         user       - passed to relocate
+//
+// OUTPUTS: Returns false if no buffer object could be created, or the
+//          range could not be allocated from it.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool GPUArena::Allocate(unsigned long long size, GPU_ALLOCATION& allocation,
+                        GPUArenaRelocateFn relocate, void *user)
+{
+    unsigned long long offset = 0;
+    unsigned int block = TLSF_INVALID;
+    unsigned int index = 0;
+
+    for (; index < m_pages.size() && block == TLSF_INVALID; ++index)
+    {
+        if (m_pages[index])
+            block = m_pages[index]->allocator.Allocate(size, offset);
+    }
+
+    if (block == TLSF_INVALID)
+    {
+        unsigned long long capacity = size > m_page_size ? size : m_page_size;
+        capacity = (capacity + GPU_ARENA_GRANULARITY - 1) & ~(unsigned long long)(GPU_ARENA_GRANULARITY - 1);
+
+        GLuint buffer = CreateBuffer(capacity);
+        if (!buffer)
+            return false;
+
+        Page *page = new Page;
+        page->buffer = buffer;
+        page->allocator.Reset(capacity, GPU_ARENA_GRANULARITY);
+        page->requested = 0;
+
+        block = page->allocator.Allocate(size, offset);
+        if (block == TLSF_INVALID)
+        {
+#ifdef _DEBUG
+            std::cerr << "GPUArena: unable to allocate " << size << " bytes from a "
+                      << capacity << " byte page" << std::endl;
+#endif /* DEBUG */
+            GLStateCache::Current().DeleteBuffers(1, &page->buffer);
+            delete page;
+            return false;
+        }
+
+        // Reuse the slot of a deleted page
+        for (index = 0; index < m_pages.size() && m_pages[index]; ++index)
+            ;
+        if (index == m_pages.size())
+            m_pages.push_back(page);
+        else
+            m_pages[index] = page;
+
+        ++index;
+    }
+
+    Page *page = m_pages[--index];
+    if (page->owners.size() <= block)
+        page->owners.resize(block + 1);
+
+    Owner& owner = page->owners[block];
+    owner.relocate = relocate;
+    owner.user = user;
+    owner.size = size;
+    page->requested += size;
+
+    allocation.buffer = page->buffer;
+    allocation.page = index;
+    allocation.block = block;
+    allocation.offset = offset;
+    allocation.size = size;
+
+    return true;
+}
+
+
+
+void GPUArena::Free(const GPU_ALLOCATION& allocation)
+{
+    if (!allocation.buffer || allocation.page >= m_pages.size() || !m_pages[allocation.page])
+        return;
+
+    Page *page = m_pages[allocation.page];
+    page->allocator.Free(allocation.block);
+    page->requested -= page->owners[allocation.block].size;
+    page->owners[allocation.block].relocate = 0;
+
+    if (page->allocator.GetStats().allocations == 0)
+    {
+        GLStateCache::Current().DeleteBuffers(1, &page->buffer);
+        delete page;
+        m_pages[allocation.page] = NULL;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Defragment
+//
+// Purpose: Compacts every page whose fragmentation is above a threshold
+//          into a new buffer object and reports the moves.
+//
+// INPUTS: threshold - the fragmentation (0 to 1) that triggers compaction
+//
+// OUTPUTS: The number of pages compacted.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned int GPUArena::Defragment(float threshold)
+{
+    unsigned int compacted = 0;
+
+    for (unsigned int i = 0; i < m_pages.size(); ++i)
+    {
+        if (m_pages[i] && Fragmentation(m_pages[i]->allocator.GetStats()) > threshold)
+        {
+            if (Compact(i))
+                ++compacted;
+        }
+    }
+
+    return compacted;
+}
+
+
+
+GPU_ARENA_STATS GPUArena::GetStats(void) const
+{
+    GPU_ARENA_STATS stats;
+
+    stats.pages = 0;
+    stats.allocations = 0;
+    stats.free_blocks = 0;
+    stats.capacity = 0;
+    stats.used = 0;
+    stats.requested = 0;
+    stats.largest_free = 0;
+    stats.fragmentation = 0.0f;
+    stats.defragmentations = m_defragmentations;
+    stats.bytes_moved = m_bytes_moved;
+
+    for (size_t i = 0; i < m_pages.size(); ++i)
+    {
+        if (!m_pages[i])
+            continue;
+
+        TLSF_STATS page = m_pages[i]->allocator.GetStats();
+        ++stats.pages;
+        stats.allocations += page.allocations;
+        stats.free_blocks += page.free_blocks;
+        stats.capacity += page.capacity;
+        stats.used += page.used;
+        stats.requested += m_pages[i]->requested;
+        if (page.largest_free > stats.largest_free)
+            stats.largest_free = page.largest_free;
+
+        float fragmentation = Fragmentation(page);
+        if (fragmentation > stats.fragmentation)
+            stats.fragmentation = fragmentation;
+    }
+
+    stats.utilization = stats.capacity ? float(stats.requested) / float(stats.capacity) : 0.0f;
+
+    return stats;
+}
+
+
+
+// Creates a buffer object without disturbing the array or element array
+// bindings (the latter belongs to whatever vertex array is bound)
+GLuint GPUArena::CreateBuffer(unsigned long long size)
+{
+    GLuint buffer = 0;
+
+    glGenBuffers(1, &buffer);
+    GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, m_usage);
+    GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (glGetError() == GL_OUT_OF_MEMORY)
+    {
+#ifdef _DEBUG
+        std::cerr << "GPUArena: out of memory creating a " << size << " byte page" << std::endl;
+#endif /* DEBUG */
+        GLStateCache::Current().DeleteBuffers(1, &buffer);
+        return 0;
+    }
+
+    return buffer;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Compact
+//
+// Purpose: Copies the live ranges of a page, in address order, to the start
+//          of a new buffer object of the same size, then tells the owners.
+//
+// INPUTS: index - the page to compact
+//
+// OUTPUTS: Returns false, leaving the page as it was, if the new buffer
+//          object could not be created or the ranges did not fit it.
+//
+///////////////////////////////////////////////////////////////////////////////
+struct LiveRange
+{
+    unsigned int block;
+    unsigned long long offset;
+    unsigned long long size;
+};
+
+static void CollectRange(void *user, unsigned int block, unsigned long long offset, unsigned long long size)
+{
+    LiveRange range = { block, offset, size };
+    ((std::vector<LiveRange> *)user)->push_back(range);
+}
+
+bool GPUArena::Compact(unsigned int index)
+{
+    Page *page = m_pages[index];
+    unsigned long long capacity = page->allocator.GetCapacity();
+
+    GLuint buffer = CreateBuffer(capacity);
+    if (!buffer)
+        return false;
+
+    std::vector<LiveRange> ranges;
+    page->allocator.ForEachAllocation(CollectRange, &ranges);
+
+    TLSF allocator(capacity, GPU_ARENA_GRANULARITY);
+    std::vector<Owner> owners;
+
+    GLStateCache::Current().BindBuffer(GL_COPY_READ_BUFFER, page->buffer);
+    GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    // A fresh TLSF hands out ranges front to back, so the live ranges end
+    // up packed; neighbors that stay neighbors are copied together
+    std::vector<GPU_ALLOCATION> from(ranges.size()), to(ranges.size());
+    unsigned long long run_source = 0, run_dest = 0, run_size = 0;
+    unsigned long long moved = 0;
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        unsigned long long offset;
+        unsigned int block = allocator.Allocate(ranges[i].size, offset);
+        if (block == TLSF_INVALID)
+        {
+            // Cannot happen with ranges that fit the page before, but if it
+            // does the page is left as it was
+#ifdef _DEBUG
+            std::cerr << "GPUArena: unable to compact page " << index << std::endl;
+#endif /* DEBUG */
+            GLStateCache::Current().BindBuffer(GL_COPY_READ_BUFFER, 0);
+            GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            GLStateCache::Current().DeleteBuffers(1, &buffer);
+            return false;
+        }
+        if (owners.size() <= block)
+            owners.resize(block + 1);
+        owners[block] = page->owners[ranges[i].block];
+
+        if (run_size && run_source + run_size == ranges[i].offset && run_dest + run_size == offset)
+        {
+            run_size += ranges[i].size;
+        }
+        else
+        {
+            if (run_size)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                    (GLintptr)run_source, (GLintptr)run_dest, (GLsizeiptr)run_size);
+            run_source = ranges[i].offset;
+            run_dest = offset;
+            run_size = ranges[i].size;
+        }
+
+        const Owner& owner = owners[block];
+        from[i].buffer = page->buffer;
+        from[i].page = index;
+        from[i].block = ranges[i].block;
+        from[i].offset = ranges[i].offset;
+        from[i].size = owner.size;
+        to[i].buffer = buffer;
+        to[i].page = index;
+        to[i].block = block;
+        to[i].offset = offset;
+        to[i].size = owner.size;
+        moved += ranges[i].size;
+    }
+    if (run_size)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            (GLintptr)run_source, (GLintptr)run_dest, (GLsizeiptr)run_size);
+
+    GLStateCache::Current().BindBuffer(GL_COPY_READ_BUFFER, 0);
+    GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    GLuint old_buffer = page->buffer;
+    page->buffer = buffer;
+    page->allocator = allocator;
+    page->owners.swap(owners);
+    ++m_defragmentations;
+    m_bytes_moved += moved;
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        const Owner& owner = page->owners[to[i].block];
+        if (owner.relocate)
+            owner.relocate(owner.user, from[i], to[i]);
+    }
+
+    GLStateCache::Current().DeleteBuffers(1, &old_buffer);
+    return true;
+}
+
+
+
+// 0 when all free space is one block, approaching 1 as it splinters
+float GPUArena::Fragmentation(const TLSF_STATS& stats)
+{
+    unsigned long long free_bytes = stats.capacity - stats.used;
+    if (free_bytes == 0)
+        return 0.0f;
+
+    return 1.0f - float(stats.largest_free) / float(free_bytes);
+}
@@ -0,0 +1,852 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Image.cpp
+//
+// Purpose: This file contains the definition of the PPM and PNG readers and
+//          writers and of the image comparison.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include "Image.h"
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+// The longest stored deflate block
+static const size_t DEFLATE_STORED_MAX = 65535;
+
+// Images larger than this are taken to be corrupt headers
+static const unsigned long long IMAGE_MAX_PIXELS = 1ull << 28;
+
+// The largest YIQ distance between two 8-bit colors, which scales the
+// distances to 0 to 1
+static const double YIQ_MAX_DELTA = 35215.0;
+
+
+static unsigned int ReadBE32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static void AppendBE32(std::vector<unsigned char>& out, unsigned int value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+// Built before main, so that images can be written from job threads
+static struct CRC32_TABLE
+{
+    unsigned int entries[256];
+
+    CRC32_TABLE(void)
+    {
+        for (unsigned int n = 0; n < 256; n++)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+} crc32_table;
+
+static unsigned int Crc32(unsigned int crc, const unsigned char *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = crc32_table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static unsigned int Adler32(unsigned int adler, const unsigned char *data, size_t size)
+{
+    unsigned int a = adler & 0xFFFF, b = adler >> 16;
+
+    // 5552 bytes is the most that cannot overflow b before the modulo
+    while (size)
+    {
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        for (; n; n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Appends a PNG chunk: length, type, data and the CRC of type and data
+static void AppendChunk(std::vector<unsigned char>& out, const char *type,
+                        const unsigned char *data, size_t size)
+{
+    AppendBE32(out, (unsigned int)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if (size)
+        out.insert(out.end(), data, data + size);
+    AppendBE32(out, Crc32(0, &out[start], out.size() - start));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The inflate decoder, for reading PNG files written by other programs.
+// It follows RFC 1951 directly, decoding one Huffman code bit at a time;
+// golden images are small enough that speed does not matter, and every
+// length and distance is checked against the input and the output.
+///////////////////////////////////////////////////////////////////////////////
+
+#define INFLATE_MAX_BITS    15
+#define INFLATE_MAX_CODES   288
+
+struct INFLATE_STATE
+{
+    const unsigned char *       in;
+    size_t                      size;
+    size_t                      pos;
+    unsigned int                bits;
+    unsigned int                count;
+    std::vector<unsigned char> *out;
+    size_t                      limit;
+};
+
+struct INFLATE_HUFFMAN
+{
+    short counts[INFLATE_MAX_BITS + 1];     // codes of each length
+    short symbols[INFLATE_MAX_CODES];       // in canonical order
+};
+
+static bool InflateBits(INFLATE_STATE& s, unsigned int need, unsigned int& value)
+{
+    while (s.count < need)
+    {
+        if (s.pos == s.size)
+            return false;
+        s.bits |= (unsigned int)s.in[s.pos++] << s.count;
+        s.count += 8;
+    }
+    value = s.bits & ((1u << need) - 1);
+    s.bits >>= need;
+    s.count -= need;
+    return true;
+}
+
+// Builds a canonical code from its lengths. Incomplete codes are allowed,
+// as the deflate format allows them for a single distance code
+static bool InflateBuild(INFLATE_HUFFMAN& h, const unsigned char *lengths, unsigned int n)
+{
+    short offsets[INFLATE_MAX_BITS + 1];
+
+    memset(h.counts, 0, sizeof(h.counts));
+    for (unsigned int symbol = 0; symbol < n; symbol++)
+        h.counts[lengths[symbol]]++;
+
+    int left = 1;
+    for (int length = 1; length <= INFLATE_MAX_BITS; length++)
+    {
+        left = (left << 1) - h.counts[length];
+        if (left < 0)
+            return false;       // over-subscribed
+    }
+
+    offsets[1] = 0;
+    for (int length = 1; length < INFLATE_MAX_BITS; length++)
+        offsets[length + 1] = offsets[length] + h.counts[length];
+    for (unsigned int symbol = 0; symbol < n; symbol++)
+    {
+        if (lengths[symbol])
+            h.symbols[offsets[lengths[symbol]]++] = (short)symbol;
+    }
+    return true;
+}
+
+// Decodes one symbol, or returns -1
+static int InflateDecode(INFLATE_STATE& s, const INFLATE_HUFFMAN& h)
+{
+    int code = 0, first = 0, index = 0;
+
+    for (int length = 1; length <= INFLATE_MAX_BITS; length++)
+    {
+        unsigned int bit;
+        if (!InflateBits(s, 1, bit))
+            return -1;
+        code |= (int)bit;
+        int count = h.counts[length];
+        if (code - count < first)
+            return h.symbols[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static bool InflateStored(INFLATE_STATE& s)
+{
+    s.bits = 0;
+    s.count = 0;
+    if (s.size - s.pos < 4)
+        return false;
+
+    size_t length = s.in[s.pos] | ((size_t)s.in[s.pos + 1] << 8);
+    size_t check = s.in[s.pos + 2] | ((size_t)s.in[s.pos + 3] << 8);
+    s.pos += 4;
+    if (length != (~check & 0xFFFF) || s.size - s.pos < length || s.out->size() + length > s.limit)
+        return false;
+
+    s.out->insert(s.out->end(), s.in + s.pos, s.in + s.pos + length);
+    s.pos += length;
+    return true;
+}
+
+static bool InflateCodes(INFLATE_STATE& s, const INFLATE_HUFFMAN& lengths, const INFLATE_HUFFMAN& distances)
+{
+    static const unsigned short LENGTH_BASE[29] =
+    {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const unsigned char LENGTH_EXTRA[29] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const unsigned short DISTANCE_BASE[30] =
+    {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const unsigned char DISTANCE_EXTRA[30] =
+    {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    for (;;)
+    {
+        int symbol = InflateDecode(s, lengths);
+        if (symbol < 0)
+            return false;
+        if (symbol < 256)
+        {
+            if (s.out->size() == s.limit)
+                return false;
+            s.out->push_back((unsigned char)symbol);
+            continue;
+        }
+        if (symbol == 256)
+            return true;
+
+        symbol -= 257;
+        if (symbol >= 29)
+            return false;
+        unsigned int extra;
+        if (!InflateBits(s, LENGTH_EXTRA[symbol], extra))
+            return false;
+        size_t length = LENGTH_BASE[symbol] + extra;
+
+        symbol = InflateDecode(s, distances);
+        if (symbol < 0 || symbol >= 30 || !InflateBits(s, DISTANCE_EXTRA[symbol], extra))
+            return false;
+        size_t distance = DISTANCE_BASE[symbol] + extra;
+
+        size_t size = s.out->size();
+        if (distance > size || size + length > s.limit)
+            return false;
+        for (size_t i = 0; i < length; i++)
+            s.out->push_back((*s.out)[size - distance + i]);
+    }
+}
+
+static bool InflateFixed(INFLATE_STATE& s)
+{
+    static INFLATE_HUFFMAN lengths, distances;
+    static bool built = false;
+
+    if (!built)
+    {
+        unsigned char code_lengths[INFLATE_MAX_CODES];
+        unsigned int symbol = 0;
+        for (; symbol < 144; symbol++)
+            code_lengths[symbol] = 8;
+        for (; symbol < 256; symbol++)
+            code_lengths[symbol] = 9;
+        for (; symbol < 280; symbol++)
+            code_lengths[symbol] = 7;
+        for (; symbol < INFLATE_MAX_CODES; symbol++)
+            code_lengths[symbol] = 8;
+        InflateBuild(lengths, code_lengths, INFLATE_MAX_CODES);
+
+        for (symbol = 0; symbol < 30; symbol++)
+            code_lengths[symbol] = 5;
+        InflateBuild(distances, code_lengths, 30);
+        built = true;
+    }
+
+    return InflateCodes(s, lengths, distances);
+}
+
+static bool InflateDynamic(INFLATE_STATE& s)
+{
+    static const unsigned char ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    unsigned char code_lengths[INFLATE_MAX_CODES + 30];
+    INFLATE_HUFFMAN lengths, distances;
+    unsigned int nlen, ndist, ncode, value;
+
+    if (!InflateBits(s, 5, nlen) || !InflateBits(s, 5, ndist) || !InflateBits(s, 4, ncode))
+        return false;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30)
+        return false;
+
+    memset(code_lengths, 0, sizeof(code_lengths));
+    for (unsigned int i = 0; i < ncode; i++)
+    {
+        if (!InflateBits(s, 3, value))
+            return false;
+        code_lengths[ORDER[i]] = (unsigned char)value;
+    }
+    if (!InflateBuild(lengths, code_lengths, 19))
+        return false;
+
+    // The literal/length and distance code lengths, run-length coded
+    for (unsigned int i = 0; i < nlen + ndist;)
+    {
+        int symbol = InflateDecode(s, lengths);
+        if (symbol < 0)
+            return false;
+        if (symbol < 16)
+        {
+            code_lengths[i++] = (unsigned char)symbol;
+            continue;
+        }
+
+        unsigned char repeat = 0;
+        unsigned int times;
+        if (symbol == 16)
+        {
+            if (i == 0 || !InflateBits(s, 2, times))
+                return false;
+            repeat = code_lengths[i - 1];
+            times += 3;
+        }
+        else if (symbol == 17)
+        {
+            if (!InflateBits(s, 3, times))
+                return false;
+            times += 3;
+        }
+        else
+        {
+            if (!InflateBits(s, 7, times))
+                return false;
+            times += 11;
+        }
+        if (i + times > nlen + ndist)
+            return false;
+        while (times--)
+            code_lengths[i++] = repeat;
+    }
+
+    if (code_lengths[256] == 0 ||
+        !InflateBuild(lengths, code_lengths, nlen) ||
+        !InflateBuild(distances, code_lengths + nlen, ndist))
+        return false;
+
+    return InflateCodes(s, lengths, distances);
+}
+
+// Decompresses a zlib stream of at most 'limit' bytes
+static bool Inflate(const unsigned char *in, size_t size, std::vector<unsigned char>& out, size_t limit)
+{
+    if (size < 6 || (in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20))
+        return false;
+
+    INFLATE_STATE s;
+    s.in = in + 2;
+    s.size = size - 6;
+    s.pos = 0;
+    s.bits = 0;
+    s.count = 0;
+    s.out = &out;
+    s.limit = limit;
+
+    out.clear();
+    out.reserve(limit);
+
+    unsigned int last;
+    do
+    {
+        unsigned int type;
+        if (!InflateBits(s, 1, last) || !InflateBits(s, 2, type))
+            return false;
+
+        bool ok;
+        if (type == 0)
+            ok = InflateStored(s);
+        else if (type == 1)
+            ok = InflateFixed(s);
+        else if (type == 2)
+            ok = InflateDynamic(s);
+        else
+            ok = false;
+        if (!ok)
+            return false;
+    } while (!last);
+
+    return Adler32(1, out.empty() ? NULL : &out[0], out.size()) == ReadBE32(in + size - 4);
+}
+
+
+
+static unsigned char Paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+    int p = (int)a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+static bool ReadPNG(const std::vector<unsigned char>& file, IMAGE& image)
+{
+    unsigned int width = 0, height = 0, channels = 0;
+    std::vector<unsigned char> compressed;
+    size_t pos = sizeof(PNG_SIGNATURE);
+    bool header = false, end = false;
+
+    while (!end)
+    {
+        if (file.size() - pos < 12)
+            return false;
+        size_t length = ReadBE32(&file[pos]);
+        const unsigned char *type = &file[pos + 4];
+        const unsigned char *data = &file[pos + 8];
+        if (file.size() - pos - 12 < length ||
+            Crc32(0, type, length + 4) != ReadBE32(data + length))
+            return false;
+
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            if (length != 13)
+                return false;
+            width = ReadBE32(data);
+            height = ReadBE32(data + 4);
+
+            // 8-bit gray, RGB, gray and alpha, RGBA; no interlacing
+            static const unsigned int CHANNELS[7] = { 1, 0, 3, 0, 2, 0, 4 };
+            if (data[8] != 8 || data[9] > 6 || CHANNELS[data[9]] == 0 ||
+                data[10] != 0 || data[11] != 0 || data[12] != 0)
+            {
+#ifdef _DEBUG
+                std::cerr << "ReadImage: unsupported PNG: bit depth " << (int)data[8] << ", color type "
+                          << (int)data[9] << ", interlace " << (int)data[12] << std::endl;
+#endif /* DEBUG */
+                return false;
+            }
+            channels = CHANNELS[data[9]];
+            header = true;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            compressed.insert(compressed.end(), data, data + length);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            end = true;
+        }
+        pos += length + 12;
+    }
+
+    if (!header || width == 0 || height == 0 || (unsigned long long)width * height > IMAGE_MAX_PIXELS)
+        return false;
+
+    // Each row is a filter type byte and the row's pixels
+    size_t stride = (size_t)width * channels;
+    std::vector<unsigned char> raw;
+    if (compressed.empty() || !Inflate(&compressed[0], compressed.size(), raw, (stride + 1) * height) ||
+        raw.size() != (stride + 1) * height)
+        return false;
+
+    std::vector<unsigned char> previous(stride, 0), row(stride);
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 3);
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const unsigned char *filtered = &raw[y * (stride + 1)];
+        unsigned int filter = *filtered++;
+        for (size_t x = 0; x < stride; x++)
+        {
+            unsigned char a = x >= channels ? row[x - channels] : 0;
+            unsigned char b = previous[x];
+            unsigned char c = x >= channels ? previous[x - channels] : 0;
+            unsigned char predictor;
+            switch (filter)
+            {
+            case 0: predictor = 0; break;
+            case 1: predictor = a; break;
+            case 2: predictor = b; break;
+            case 3: predictor = (unsigned char)(((unsigned int)a + b) / 2); break;
+            case 4: predictor = Paeth(a, b, c); break;
+            default: return false;
+            }
+            row[x] = (unsigned char)(filtered[x] + predictor);
+        }
+
+        // Gray is copied to all three channels; alpha is dropped
+        unsigned char *dest = &image.pixels[(size_t)y * width * 3];
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const unsigned char *source = &row[(size_t)x * channels];
+            dest[x * 3 + 0] = source[0];
+            dest[x * 3 + 1] = channels >= 3 ? source[1] : source[0];
+            dest[x * 3 + 2] = channels >= 3 ? source[2] : source[0];
+        }
+        previous.swap(row);
+    }
+
+    return true;
+}
+
+// Reads a number of a PPM header, skipping whitespace and comments
+static bool ReadPPMNumber(const std::vector<unsigned char>& file, size_t& pos, unsigned int& value)
+{
+    for (;;)
+    {
+        if (pos == file.size())
+            return false;
+        if (file[pos] == '#')
+        {
+            while (pos < file.size() && file[pos] != '\n')
+                pos++;
+        }
+        else if (isspace(file[pos]))
+        {
+            pos++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    unsigned long long number = 0;
+    size_t start = pos;
+    while (pos < file.size() && isdigit(file[pos]) && number <= 0xFFFFFFFFull)
+        number = number * 10 + (file[pos++] - '0');
+    if (pos == start || number > 0xFFFFFFFFull)
+        return false;
+    value = (unsigned int)number;
+    return true;
+}
+
+static bool ReadPPM(const std::vector<unsigned char>& file, IMAGE& image)
+{
+    size_t pos = 2;
+    unsigned int width, height, max_value;
+
+    if (!ReadPPMNumber(file, pos, width) || !ReadPPMNumber(file, pos, height) ||
+        !ReadPPMNumber(file, pos, max_value) || pos == file.size() || !isspace(file[pos]))
+        return false;
+    pos++;
+
+    if (max_value != 255)
+    {
+#ifdef _DEBUG
+        std::cerr << "ReadImage: unsupported PPM maximum value " << max_value << std::endl;
+#endif /* DEBUG */
+        return false;
+    }
+    if (width == 0 || height == 0 || (unsigned long long)width * height > IMAGE_MAX_PIXELS ||
+        file.size() - pos < (size_t)width * height * 3)
+        return false;
+
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(file.begin() + pos, file.begin() + pos + (size_t)width * height * 3);
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ReadImage
+//
+// Purpose: Reads a PPM or a PNG file, telling them apart by their contents.
+//
+// INPUTS: filename - the file to read
+//         image    - receives the image
+//
+// OUTPUTS: Returns false if the file cannot be read or is not a supported
+//          PPM or PNG.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ReadImage(const char *filename, IMAGE& image)
+{
+    std::ifstream f(filename, std::ios::binary);
+    if (!f)
+    {
+#ifdef _DEBUG
+        std::cerr << "ReadImage: unable to open " << filename << std::endl;
+#endif /* DEBUG */
+        return false;
+    }
+
+    std::vector<unsigned char> file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    bool ok = false;
+    if (file.size() > sizeof(PNG_SIGNATURE) && memcmp(&file[0], PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0)
+        ok = ReadPNG(file, image);
+    else if (file.size() > 2 && file[0] == 'P' && file[1] == '6')
+        ok = ReadPPM(file, image);
+
+#ifdef _DEBUG
+    if (!ok)
+        std::cerr << "ReadImage: " << filename << " is not a valid PPM or PNG file" << std::endl;
+#endif /* DEBUG */
+    return ok;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteImage
+//
+// Purpose: Writes an image, as a PNG if the filename ends with ".png" and
+//          as a PPM otherwise.
+//
+// INPUTS: filename - the file to write
+//         image    - the image
+//
+// OUTPUTS: Returns false if the file cannot be written.
+//
+// NOTES: The PNG's deflate stream is made of stored blocks, each of up to
+//        64KB of rows with filter type 0.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool WriteImage(const char *filename, const IMAGE& image)
+{
+    size_t length = strlen(filename);
+    bool png = length >= 4 && (strcmp(filename + length - 4, ".png") == 0 ||
+                               strcmp(filename + length - 4, ".PNG") == 0);
+    size_t stride = (size_t)image.width * 3;
+    std::vector<unsigned char> out;
+
+    if (png)
+    {
+        std::vector<unsigned char> raw;
+        raw.reserve((stride + 1) * image.height);
+        for (unsigned int y = 0; y < image.height; y++)
+        {
+            raw.push_back(0);
+            raw.insert(raw.end(), image.pixels.begin() + y * stride, image.pixels.begin() + (y + 1) * stride);
+        }
+
+        std::vector<unsigned char> zlib;
+        size_t blocks = raw.size() / DEFLATE_STORED_MAX + 1;
+        zlib.reserve(raw.size() + blocks * 5 + 6);
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        size_t pos = 0;
+        do
+        {
+            size_t size = raw.size() - pos < DEFLATE_STORED_MAX ? raw.size() - pos : DEFLATE_STORED_MAX;
+            zlib.push_back(pos + size == raw.size() ? 1 : 0);
+            zlib.push_back((unsigned char)size);
+            zlib.push_back((unsigned char)(size >> 8));
+            zlib.push_back((unsigned char)~size);
+            zlib.push_back((unsigned char)(~size >> 8));
+            zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+            pos += size;
+        } while (pos < raw.size());
+        AppendBE32(zlib, Adler32(1, raw.empty() ? NULL : &raw[0], raw.size()));
+
+        std::vector<unsigned char> header;
+        AppendBE32(header, image.width);
+        AppendBE32(header, image.height);
+        header.push_back(8);        // bits per channel
+        header.push_back(2);        // RGB
+        header.push_back(0);        // deflate
+        header.push_back(0);        // adaptive filtering
+        header.push_back(0);        // not interlaced
+
+        out.reserve(zlib.size() + 64);
+        out.insert(out.end(), PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE));
+        AppendChunk(out, "IHDR", &header[0], header.size());
+        AppendChunk(out, "IDAT", &zlib[0], zlib.size());
+        AppendChunk(out, "IEND", NULL, 0);
+    }
+    else
+    {
+        char header[64];
+        int size = sprintf(header, "P6\n%u %u\n255\n", image.width, image.height);
+        out.reserve(size + image.pixels.size());
+        out.insert(out.end(), header, header + size);
+        out.insert(out.end(), image.pixels.begin(), image.pixels.end());
+    }
+
+    std::ofstream f(filename, std::ios::binary);
+    f.write((const char *)&out[0], (std::streamsize)out.size());
+    if (!f)
+    {
+#ifdef _DEBUG
+        std::cerr << "WriteImage: unable to write " << filename << std::endl;
+#endif /* DEBUG */
+        return false;
+    }
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ImageFromRGBA
+//
+// Purpose: Converts a framebuffer read by glReadPixels with GL_RGBA and
+//          GL_UNSIGNED_BYTE to an IMAGE.
+//
+// INPUTS: rgba   - the pixels, four bytes each, rows packed, bottom first
+//         width  - in pixels
+//         height - in pixels
+//         image  - receives the image
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageFromRGBA(const void *rgba, unsigned int width, unsigned int height, IMAGE& image)
+{
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 3);
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const unsigned char *source = (const unsigned char *)rgba + (size_t)(height - 1 - y) * width * 4;
+        unsigned char *dest = &image.pixels[(size_t)y * width * 3];
+        for (unsigned int x = 0; x < width; x++)
+        {
+            dest[0] = source[0];
+            dest[1] = source[1];
+            dest[2] = source[2];
+            source += 4;
+            dest += 3;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: CompareImages
+//
+// Purpose: Measures how far an image is from a golden image.
+//
+// INPUTS: golden    - the expected image
+//         image     - the image to check
+//         tolerance - what counts as a differing pixel
+//         diff      - if not NULL, receives an image of the differences
+//
+// OUTPUTS: The differences.
+//
+// NOTES: The YIQ weights and the distance are those of Kotsarenko and
+//        Ramos, "Measuring perceived color difference using YIQ NTSC
+//        transmission color space in mobile applications" (2010).
+//
+///////////////////////////////////////////////////////////////////////////////
+IMAGE_DIFFERENCE CompareImages(const IMAGE& golden, const IMAGE& image,
+                               const IMAGE_TOLERANCE& tolerance, IMAGE *diff)
+{
+    IMAGE_DIFFERENCE difference;
+    memset(&difference, 0, sizeof(difference));
+
+    difference.same_size = golden.width == image.width && golden.height == image.height &&
+                           golden.pixels.size() == (size_t)golden.width * golden.height * 3 &&
+                           image.pixels.size() == golden.pixels.size();
+    if (!difference.same_size)
+    {
+        difference.fraction = 1.0;
+        difference.max_distance = 1.0;
+        difference.mean_distance = 1.0;
+        return difference;
+    }
+
+    if (diff)
+    {
+        diff->width = golden.width;
+        diff->height = golden.height;
+        diff->pixels.resize(golden.pixels.size());
+    }
+
+    size_t pixels = (size_t)golden.width * golden.height;
+    double threshold = tolerance.threshold * tolerance.threshold * YIQ_MAX_DELTA;
+    double total_distance = 0.0, squared_error = 0.0;
+
+    for (size_t p = 0; p < pixels; p++)
+    {
+        const unsigned char *a = &golden.pixels[p * 3];
+        const unsigned char *b = &image.pixels[p * 3];
+        double dr = (double)a[0] - b[0], dg = (double)a[1] - b[1], db = (double)a[2] - b[2];
+
+        double y = dr * 0.29889531 + dg * 0.58662247 + db * 0.11448223;
+        double i = dr * 0.59597799 - dg * 0.27417610 - db * 0.32180189;
+        double q = dr * 0.21147017 - dg * 0.52261711 + db * 0.31114694;
+        double delta = 0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q;
+        double distance = sqrt(delta / YIQ_MAX_DELTA);
+
+        squared_error += dr * dr + dg * dg + db * db;
+        total_distance += distance;
+        if (distance > difference.max_distance)
+            difference.max_distance = distance;
+
+        bool differs = delta > threshold;
+        if (differs)
+            difference.differing++;
+
+        if (diff)
+        {
+            unsigned char *d = &diff->pixels[p * 3];
+            if (differs)
+            {
+                d[0] = 255;
+                d[1] = 0;
+                d[2] = 0;
+            }
+            else
+            {
+                // The golden image's brightness, faded towards white
+                unsigned char gray = (unsigned char)(255.0 - (255.0 - (a[0] * 0.299 + a[1] * 0.587 + a[2] * 0.114)) * 0.25);
+                d[0] = d[1] = d[2] = gray;
+            }
+        }
+    }
+
+    difference.fraction = pixels ? (double)difference.differing / (double)pixels : 0.0;
+    difference.mean_distance = pixels ? total_distance / (double)pixels : 0.0;
+    difference.psnr = squared_error > 0.0 ?
+                      10.0 * log10(255.0 * 255.0 * 3.0 * (double)pixels / squared_error) :
+                      std::numeric_limits<double>::infinity();
+    return difference;
+}
+
+
+
+bool ImagesMatch(const IMAGE_DIFFERENCE& difference, const IMAGE_TOLERANCE& tolerance)
+{
+    return difference.same_size && difference.fraction <= tolerance.max_fraction;
+}
@@ -0,0 +1,433 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: JobSystem.cpp
+//
+// Purpose: This file contains the definition of the JobSystem class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "JobSystem.h"
+
+#ifdef _MSC_VER
+#define JOB_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_THREAD_LOCAL __thread
+#endif
+
+// How many times an idle worker looks for work before it sleeps
+static const int JOB_SPIN_COUNT = 64;
+
+struct Job
+{
+    JobFn         fn;
+    void *        user;
+    ParallelForFn for_fn;       // set for a parallel for range
+    unsigned int  first;
+    unsigned int  end;
+    unsigned int  grain;
+    JobCounter *  counter;
+};
+
+// The system a worker thread belongs to, and its deque
+static JOB_THREAD_LOCAL JobSystem *t_system = 0;
+static JOB_THREAD_LOCAL int t_index = 0;
+
+
+
+JobSystem::JobSystem(unsigned int threads)
+    : m_queued(0),
+      m_sleeping(0),
+      m_quit(false),
+      m_jobs(0),
+      m_steals(0),
+      m_splits(0),
+      m_helped(0)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned int i = 0; i < threads; ++i)
+        m_queues.push_back(new WorkQueue);
+
+    // Deque 0 belongs to the threads that are not workers
+    for (unsigned int i = 1; i < threads; ++i)
+        m_workers.push_back(std::thread(&JobSystem::Worker, this, i));
+}
+
+
+
+JobSystem::~JobSystem(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_sleep_lock);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        m_workers[i].join();
+
+    for (size_t i = 0; i < m_queues.size(); ++i)
+    {
+        for (size_t j = 0; j < m_queues[i]->jobs.size(); ++j)
+            delete m_queues[i]->jobs[j];
+        delete m_queues[i];
+    }
+}
+
+
+
+JobSystem& JobSystem::Shared(void)
+{
+    static JobSystem system;
+    return system;
+}
+
+
+
+void JobSystem::Run(JobFn fn, void *user, JobCounter *counter, JobCounter *after)
+{
+    Job *job = new Job;
+    job->fn = fn;
+    job->user = user;
+    job->for_fn = 0;
+    job->first = 0;
+    job->end = 0;
+    job->grain = 0;
+    job->counter = counter;
+
+    if (counter)
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (after)
+    {
+        // Finish queues the waiting jobs under the same lock, so the job is
+        // either parked here before the counter is released or sees it done
+        std::lock_guard<std::mutex> guard(after->m_lock);
+        if (after->m_count.load(std::memory_order_acquire) != 0)
+        {
+            after->m_waiting.push_back(job);
+            return;
+        }
+    }
+
+    Push(job);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ParallelFor
+//
+// Purpose: Calls fn on ranges that together cover [0, count) and returns
+//          when all of them are done.
+//
+// INPUTS: count - the number of items
+//         fn    - processes a range
+//         user  - passed to fn
+//         grain - the smallest range worth a job; 0 picks one
+//
+// OUTPUTS: None.
+//
+// NOTES: The whole range is queued as one job and split by Execute as
+//        threads come looking for work, so the caller never creates more
+//        jobs than the other threads can take.
+//
+///////////////////////////////////////////////////////////////////////////////
+void JobSystem::ParallelFor(unsigned int count, ParallelForFn fn, void *user, unsigned int grain)
+{
+    if (count == 0)
+        return;
+
+    if (grain == 0)
+    {
+        grain = count / (GetThreadCount() * 16);
+        if (grain == 0)
+            grain = 1;
+    }
+
+    if (GetThreadCount() == 1 || count <= grain)
+    {
+        fn(user, 0, count);
+        return;
+    }
+
+    JobCounter counter;
+    Job *job = new Job;
+    job->fn = 0;
+    job->user = user;
+    job->for_fn = fn;
+    job->first = 0;
+    job->end = count;
+    job->grain = grain;
+    job->counter = &counter;
+    counter.m_count.store(1, std::memory_order_relaxed);
+
+    Push(job);
+    Wait(counter);
+}
+
+
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    int index = CurrentIndex();
+
+    while (!counter.IsDone())
+    {
+        Job *job = Take(index);
+        if (job)
+        {
+            Execute(job, index);
+            m_helped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // The last job may still be inside Finish, holding the counter's lock;
+    // wait for it to let go before the caller can destroy the counter
+    std::lock_guard<std::mutex> guard(counter.m_lock);
+}
+
+
+
+JOB_STATS JobSystem::GetStats(void) const
+{
+    JOB_STATS stats;
+    stats.jobs = m_jobs.load(std::memory_order_relaxed);
+    stats.steals = m_steals.load(std::memory_order_relaxed);
+    stats.splits = m_splits.load(std::memory_order_relaxed);
+    stats.helped = m_helped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+
+// Threads that are not workers of this system share deque 0
+int JobSystem::CurrentIndex(void) const
+{
+    return t_system == this ? t_index : 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Push
+//
+// Purpose: Queues a job at the back of the calling thread's deque and wakes
+//          a worker if any are asleep.
+//
+// INPUTS: job - the job
+//
+// OUTPUTS: None.
+//
+// NOTES: A worker going to sleep adds itself to m_sleeping before it checks
+//        m_queued, and Push adds to m_queued before it checks m_sleeping, so
+//        one of the two always sees the other and no wakeup is lost.
+//
+///////////////////////////////////////////////////////////////////////////////
+void JobSystem::Push(Job *job)
+{
+    WorkQueue& queue = *m_queues[CurrentIndex()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.jobs.push_back(job);
+    }
+
+    m_queued.fetch_add(1);
+    if (m_sleeping.load() > 0)
+    {
+        // Taking the lock makes sure a worker that has decided to sleep
+        // is already waiting when notified
+        {
+            std::lock_guard<std::mutex> guard(m_sleep_lock);
+        }
+        m_wake.notify_one();
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Take
+//
+// Purpose: Finds a job for a thread to run.
+//
+// INPUTS: index - the thread's deque
+//
+// OUTPUTS: The newest job of the thread's own deque, or else the oldest job
+//          of another deque, or NULL if nothing is queued.
+//
+///////////////////////////////////////////////////////////////////////////////
+Job *JobSystem::Take(int index)
+{
+    if (m_queued.load(std::memory_order_relaxed) == 0)
+        return NULL;
+
+    Job *job = NULL;
+    {
+        WorkQueue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.jobs.empty())
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+    }
+
+    int count = (int)m_queues.size();
+    for (int i = 1; !job && i < count; ++i)
+    {
+        WorkQueue& queue = *m_queues[(index + i) % count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.jobs.empty())
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (job)
+        m_queued.fetch_sub(1);
+
+    return job;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Execute
+//
+// Purpose: Runs a job, splitting a parallel for range first if other
+//          threads may want part of it, then finishes it.
+//
+// INPUTS: job   - the job, deleted here
+//         index - the deque of the calling thread
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void JobSystem::Execute(Job *job, int index)
+{
+    if (job->for_fn)
+    {
+        WorkQueue& queue = *m_queues[index];
+
+        while (job->end - job->first > job->grain)
+        {
+            bool empty;
+            {
+                std::lock_guard<std::mutex> guard(queue.lock);
+                empty = queue.jobs.empty();
+            }
+            if (!empty)
+                break;
+
+            unsigned int middle = job->first + (job->end - job->first) / 2;
+            Job *half = new Job(*job);
+            half->first = middle;
+            job->end = middle;
+
+            // The counter cannot reach 0 here, this job still holds it
+            job->counter->m_count.fetch_add(1, std::memory_order_relaxed);
+            Push(half);
+            m_splits.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        job->for_fn(job->user, job->first, job->end);
+    }
+    else
+    {
+        job->fn(job->user);
+    }
+
+    JobCounter *counter = job->counter;
+    delete job;
+    m_jobs.fetch_add(1, std::memory_order_relaxed);
+
+    Finish(counter);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Finish
+//
+// Purpose: Takes a finished job off its counter, and queues the jobs that
+//          were waiting for the counter if it is now done.
+//
+// INPUTS: counter - the counter, or NULL
+//
+// OUTPUTS: None.
+//
+// NOTES: Only a decrement that could be the last one takes the lock.
+//
+///////////////////////////////////////////////////////////////////////////////
+void JobSystem::Finish(JobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    int count = counter->m_count.load(std::memory_order_relaxed);
+    while (count > 1)
+    {
+        if (counter->m_count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    std::vector<Job *> ready;
+    {
+        std::lock_guard<std::mutex> guard(counter->m_lock);
+        if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->m_waiting);
+    }
+
+    for (size_t i = 0; i < ready.size(); ++i)
+        Push(ready[i]);
+}
+
+
+
+// Runs jobs until the system is destroyed, sleeping when there are none
+void JobSystem::Worker(unsigned int index)
+{
+    t_system = this;
+    t_index = (int)index;
+
+    int idle = 0;
+
+    for (;;)
+    {
+        Job *job = Take(index);
+        if (job)
+        {
+            Execute(job, index);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < JOB_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(m_sleep_lock);
+        if (m_quit)
+            return;
+
+        m_sleeping.fetch_add(1);
+        if (m_queued.load() == 0)
+            m_wake.wait(guard);
+        m_sleeping.fetch_sub(1);
+
+        if (m_quit)
+            return;
+        idle = 0;
+    }
+}
@@ -0,0 +1,371 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: MeshCache.cpp
+//
+// Purpose: This file contains the definition of the MeshCache class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include "MeshCache.h"
+
+// Files are hashed in blocks of this size
+static const size_t HASH_BLOCK_SIZE = 1024 * 1024;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: CanonicalPath
+//
+// Purpose: Resolves a file name to an absolute path without '.', '..' or
+//          (on POSIX systems) symbolic links.
+//
+// INPUTS: filename - the file name, possibly relative
+//         path     - receives the canonical path
+//
+// OUTPUTS: Returns false if the file does not exist.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool CanonicalPath(const char *filename, std::string& path)
+{
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (!_fullpath(buffer, filename, _MAX_PATH))
+        return false;
+    path = buffer;
+#else
+    char *resolved = realpath(filename, NULL);
+    if (!resolved)
+        return false;
+    path = resolved;
+    free(resolved);
+#endif
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: HashFile
+//
+// Purpose: Computes a 64-bit hash of the contents of a file, eight bytes
+//          at a time.
+//
+// INPUTS: filename - the file to hash
+//         hash     - receives the hash
+//
+// OUTPUTS: Returns false if the file could not be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool HashFile(const char *filename, unsigned long long& hash)
+{
+    std::ifstream f(filename, std::ios::binary);
+    if (!f)
+        return false;
+
+    std::vector<char> block(HASH_BLOCK_SIZE);
+    unsigned long long h = 0x9E3779B97F4A7C15ULL;
+
+    while (f)
+    {
+        f.read(&block[0], block.size());
+        size_t count = (size_t)f.gcount();
+        if (count == 0)
+            break;
+
+        // Pad the last word with zeros; the length is mixed in at the end
+        memset(&block[0] + count, 0, (8 - count % 8) % 8);
+        for (size_t i = 0; i < count; i += 8)
+        {
+            unsigned long long word;
+            memcpy(&word, &block[i], sizeof(word));
+            word *= 0xFF51AFD7ED558CCDULL;
+            word ^= word >> 32;
+            h = (h ^ word) * 0x100000001B3ULL;
+            h ^= h >> 29;
+        }
+        h ^= count;
+    }
+
+    if (f.bad())
+        return false;
+
+    hash = h;
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: MeshCache
+//
+// Purpose: Creates an empty cache.
+//
+// INPUTS: budget - the buffer storage, in bytes, that unused meshes may
+//                  keep resident
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+MeshCache::MeshCache(unsigned long long budget)
+    : m_budget(budget),
+      m_clock(0),
+      m_arena(NULL)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ~MeshCache
+//
+// Purpose: Frees every mesh, including ones still held.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+MeshCache::~MeshCache(void)
+{
+    for (std::map<VBObject *, Entry *>::iterator it = m_users.begin(); it != m_users.end(); ++it)
+        delete it->first;
+
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        delete m_entries[i];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Acquire
+//
+// Purpose: Returns a VBObject for a VBM file, loading the file only if no
+//          resident mesh has the same path or contents.
+//
+// INPUTS: filename       - the VBM or VBM2 file
+//         vertexIndex    - the location of the position attribute
+//         normalIndex    - the location of the normal attribute
+//         texCoord0Index - the location of the texture coordinate
+//         flags          - VBO_LOAD_* flags
+//
+// OUTPUTS: Returns NULL if the file could not be loaded.
+//
+// NOTES: A path is trusted as long as the size and modification time of
+//        the file are unchanged; otherwise the file is hashed again.
+//
+///////////////////////////////////////////////////////////////////////////////
+VBObject *MeshCache::Acquire(const char *filename, int vertexIndex, int normalIndex,
+                             int texCoord0Index, unsigned int flags)
+{
+    std::string path;
+    struct stat info;
+
+    if (!CanonicalPath(filename, path) || stat(path.c_str(), &info) != 0)
+    {
+#ifdef _DEBUG
+        std::cerr << "Unable to find mesh '" << filename << "'" << std::endl;
+#endif /* DEBUG */
+        return NULL;
+    }
+
+    unsigned long long file_size = (unsigned long long)info.st_size;
+    long long modified = (long long)info.st_mtime;
+    PathKey key(path, flags);
+    Entry *entry = NULL;
+
+    std::map<PathKey, PathInfo>::iterator known = m_paths.find(key);
+    if (known != m_paths.end() &&
+        known->second.file_size == file_size &&
+        known->second.modified == modified)
+    {
+        entry = known->second.entry;
+        ++m_stats.path_hits;
+    }
+    else
+    {
+        unsigned long long hash;
+        if (!HashFile(path.c_str(), hash))
+            return NULL;
+
+        entry = FindByContent(hash, file_size, flags);
+        if (entry)
+        {
+            ++m_stats.content_hits;
+        }
+        else
+        {
+            // The owner only holds the buffers; users get their own VAOs
+            entry = new Entry;
+            entry->owner.SetArena(m_arena);
+            if (!entry->owner.LoadFromVBM(path.c_str(), -1, -1, -1, flags))
+            {
+                delete entry;
+                return NULL;
+            }
+            entry->hash = hash;
+            entry->file_size = file_size;
+            entry->flags = flags;
+            entry->users = 0;
+            m_entries.push_back(entry);
+            ++m_stats.misses;
+        }
+
+        PathInfo& known_path = m_paths[key];
+        known_path.entry = entry;
+        known_path.file_size = file_size;
+        known_path.modified = modified;
+    }
+
+    VBObject *object = new VBObject;
+    object->Share(entry->owner, vertexIndex, normalIndex, texCoord0Index);
+    m_users[object] = entry;
+    ++entry->users;
+    entry->last_use = ++m_clock;
+
+    Evict(m_budget);
+
+    return object;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Release
+//
+// Purpose: Deletes a VBObject returned by Acquire.
+//
+// INPUTS: object - the object to release
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void MeshCache::Release(VBObject *object)
+{
+    std::map<VBObject *, Entry *>::iterator it = m_users.find(object);
+    if (it == m_users.end())
+        return;
+
+    Entry *entry = it->second;
+    m_users.erase(it);
+    delete object;
+
+    --entry->users;
+    entry->last_use = ++m_clock;
+
+    Evict(m_budget);
+}
+
+
+
+void MeshCache::SetBudget(unsigned long long budget)
+{
+    m_budget = budget;
+    Evict(m_budget);
+}
+
+
+
+void MeshCache::Purge(void)
+{
+    Evict(0);
+}
+
+
+
+MESH_CACHE_STATS MeshCache::GetStats(void) const
+{
+    MESH_CACHE_STATS stats = m_stats;
+
+    stats.meshes = (unsigned int)m_entries.size();
+    stats.users = (unsigned int)m_users.size();
+    stats.buffer_bytes = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        stats.buffer_bytes += m_entries[i]->owner.GetBufferSize();
+
+    return stats;
+}
+
+
+
+MeshCache::Entry *MeshCache::FindByContent(unsigned long long hash, unsigned long long file_size,
+                                           unsigned int flags)
+{
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        Entry *entry = m_entries[i];
+        if (entry->hash == hash && entry->file_size == file_size && entry->flags == flags)
+            return entry;
+    }
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Evict
+//
+// Purpose: Frees unused meshes, least recently used first, until the
+//          resident meshes fit the budget. Meshes in use are never freed,
+//          so the budget can be exceeded while they are held.
+//
+// INPUTS: budget - the number of bytes to fit into
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void MeshCache::Evict(unsigned long long budget)
+{
+    unsigned long long total = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        total += m_entries[i]->owner.GetBufferSize();
+
+    while (total > budget)
+    {
+        Entry *oldest = NULL;
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            Entry *entry = m_entries[i];
+            if (entry->users == 0 && (!oldest || entry->last_use < oldest->last_use))
+                oldest = entry;
+        }
+
+        if (!oldest)
+            break;
+
+        total -= oldest->owner.GetBufferSize();
+        Remove(oldest);
+        ++m_stats.evictions;
+    }
+}
+
+
+
+void MeshCache::Remove(Entry *entry)
+{
+    for (std::map<PathKey, PathInfo>::iterator it = m_paths.begin(); it != m_paths.end(); )
+    {
+        if (it->second.entry == entry)
+            m_paths.erase(it++);
+        else
+            ++it;
+    }
+
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (m_entries[i] == entry)
+        {
+            m_entries.erase(m_entries.begin() + i);
+            break;
+        }
+    }
+
+    delete entry;
+}
@@ -0,0 +1,392 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Profiler.cpp
+//
+// Purpose: This file contains the definition of the Profiler class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include "Profiler.h"
+
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+// Weight of the newest call in the moving average
+static const double AVERAGE_WEIGHT = 0.1;
+
+// One writer (the thread) and one reader (Collect); head and tail only grow
+struct ProfileThread
+{
+    unsigned int id;
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+    PROFILE_EVENT events[PROFILER_RING_SIZE];
+};
+
+struct GPUZone
+{
+    const char *name;
+    GLuint begin_query;
+    GLuint end_query;
+};
+
+typedef std::pair<std::string, bool> ZoneKey;
+
+// Rings are kept after their thread exits, so Collect can still drain them
+static std::mutex s_threads_lock;
+static std::vector<ProfileThread *> s_threads;
+static PROFILER_THREAD_LOCAL ProfileThread *t_thread = 0;
+static std::atomic<unsigned long long> s_dropped(0);
+
+// Used on the context thread only
+static std::vector<GLuint> s_free_queries;
+static std::deque<GPUZone> s_gpu_pending;
+static std::deque<PROFILE_EVENT> s_events;
+static std::map<ZoneKey, PROFILE_ZONE_STATS> s_stats;
+
+std::atomic<bool> Profiler::s_enabled(false);
+
+static ProfileThread *RegisterThread(void)
+{
+    ProfileThread *thread = new ProfileThread;
+    thread->head.store(0);
+    thread->tail.store(0);
+
+    std::lock_guard<std::mutex> guard(s_threads_lock);
+    s_threads.push_back(thread);
+    thread->id = (unsigned int)s_threads.size();
+    t_thread = thread;
+
+    return thread;
+}
+
+static GLuint TakeQuery(void)
+{
+    GLuint query;
+    if (s_free_queries.empty())
+    {
+        glGenQueries(1, &query);
+    }
+    else
+    {
+        query = s_free_queries.back();
+        s_free_queries.pop_back();
+    }
+    return query;
+}
+
+// Adds a zone to the history and to the statistics
+static void AddEvent(const PROFILE_EVENT& event)
+{
+    s_events.push_back(event);
+    if (s_events.size() > PROFILER_MAX_EVENTS)
+        s_events.pop_front();
+
+    bool gpu = event.thread == PROFILER_GPU_THREAD;
+    double ms = (double)(event.end_ns - event.begin_ns) / 1000000.0;
+    PROFILE_ZONE_STATS& stats = s_stats[ZoneKey(event.name, gpu)];
+
+    if (stats.calls == 0)
+    {
+        stats.name = event.name;
+        stats.gpu = gpu;
+        stats.average_ms = ms;
+        stats.min_ms = ms;
+        stats.max_ms = ms;
+    }
+    else
+    {
+        stats.average_ms += (ms - stats.average_ms) * AVERAGE_WEIGHT;
+        if (ms < stats.min_ms)
+            stats.min_ms = ms;
+        if (ms > stats.max_ms)
+            stats.max_ms = ms;
+    }
+    stats.last_ms = ms;
+    ++stats.calls;
+}
+
+// Zone names are identifiers in practice, but keep the JSON valid anyway
+static void WriteJSONString(std::ostream& out, const char *s)
+{
+    out << '"';
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            out << '\\' << *s;
+        else if ((unsigned char)*s >= 0x20)
+            out << *s;
+    }
+    out << '"';
+}
+
+
+
+void Profiler::SetEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+
+
+unsigned long long Profiler::Now(void)
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Record
+//
+// Purpose: Appends a finished CPU zone to the calling thread's ring.
+//
+// INPUTS: name     - the zone name, which must outlive the profiler
+//         begin_ns - Now() when the zone started
+//         end_ns   - Now() when it ended
+//
+// OUTPUTS: None.
+//
+// NOTES: The zone is dropped, and counted, if the ring is full because
+//        Collect has not been called for a while.
+//
+///////////////////////////////////////////////////////////////////////////////
+void Profiler::Record(const char *name, unsigned long long begin_ns, unsigned long long end_ns)
+{
+    ProfileThread *thread = t_thread ? t_thread : RegisterThread();
+
+    unsigned int head = thread->head.load(std::memory_order_relaxed);
+    if (head - thread->tail.load(std::memory_order_acquire) >= PROFILER_RING_SIZE)
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    PROFILE_EVENT& event = thread->events[head % PROFILER_RING_SIZE];
+    event.name = name;
+    event.begin_ns = begin_ns;
+    event.end_ns = end_ns;
+    event.thread = thread->id;
+
+    thread->head.store(head + 1, std::memory_order_release);
+}
+
+
+
+void Profiler::BeginGPU(const char *name, GLuint& begin_query)
+{
+    (void)name;
+    begin_query = TakeQuery();
+    glQueryCounter(begin_query, GL_TIMESTAMP);
+}
+
+
+
+void Profiler::EndGPU(const char *name, GLuint begin_query)
+{
+    GPUZone zone;
+    zone.name = name;
+    zone.begin_query = begin_query;
+    zone.end_query = TakeQuery();
+    glQueryCounter(zone.end_query, GL_TIMESTAMP);
+
+    s_gpu_pending.push_back(zone);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Collect
+//
+// Purpose: Drains the CPU rings, reads back the GPU zones whose queries are
+//          done, and adds both to the history and the statistics.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+// NOTES: GPU zones finish in the order they were issued, so reading stops
+//        at the first one that is not available yet. GPU times are moved
+//        onto the CPU time base with the difference between GL_TIMESTAMP
+//        and Now(), measured on each call.
+//
+///////////////////////////////////////////////////////////////////////////////
+void Profiler::Collect(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(s_threads_lock);
+        for (size_t i = 0; i < s_threads.size(); ++i)
+        {
+            ProfileThread *thread = s_threads[i];
+            unsigned int tail = thread->tail.load(std::memory_order_relaxed);
+            unsigned int head = thread->head.load(std::memory_order_acquire);
+
+            for (; tail != head; ++tail)
+                AddEvent(thread->events[tail % PROFILER_RING_SIZE]);
+
+            thread->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    if (s_gpu_pending.empty())
+        return;
+
+    GLint64 gpu_now;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    long long offset = (long long)Now() - (long long)gpu_now;
+
+    while (!s_gpu_pending.empty())
+    {
+        const GPUZone& zone = s_gpu_pending.front();
+
+        GLint available = 0;
+        glGetQueryObjectiv(zone.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(zone.begin_query, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(zone.end_query, GL_QUERY_RESULT, &end);
+
+        PROFILE_EVENT event;
+        event.name = zone.name;
+        event.begin_ns = (unsigned long long)((long long)begin + offset);
+        event.end_ns = (unsigned long long)((long long)end + offset);
+        event.thread = PROFILER_GPU_THREAD;
+        AddEvent(event);
+
+        s_free_queries.push_back(zone.begin_query);
+        s_free_queries.push_back(zone.end_query);
+        s_gpu_pending.pop_front();
+    }
+}
+
+
+
+void Profiler::GetStats(std::vector<PROFILE_ZONE_STATS>& stats)
+{
+    stats.clear();
+    for (std::map<ZoneKey, PROFILE_ZONE_STATS>::const_iterator it = s_stats.begin(); it != s_stats.end(); ++it)
+        stats.push_back(it->second);
+}
+
+
+
+void Profiler::PrintStats(std::ostream& out)
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << std::left << std::setw(32) << "zone" << std::right
+        << std::setw(5) << "on" << std::setw(10) << "calls"
+        << std::setw(10) << "last ms" << std::setw(10) << "avg ms"
+        << std::setw(10) << "min ms" << std::setw(10) << "max ms" << std::endl;
+
+    out << std::fixed << std::setprecision(3);
+    for (std::map<ZoneKey, PROFILE_ZONE_STATS>::const_iterator it = s_stats.begin(); it != s_stats.end(); ++it)
+    {
+        const PROFILE_ZONE_STATS& stats = it->second;
+        out << std::left << std::setw(32) << stats.name << std::right
+            << std::setw(5) << (stats.gpu ? "GPU" : "CPU") << std::setw(10) << stats.calls
+            << std::setw(10) << stats.last_ms << std::setw(10) << stats.average_ms
+            << std::setw(10) << stats.min_ms << std::setw(10) << stats.max_ms << std::endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteChromeTrace
+//
+// Purpose: Saves the history as complete ("X") events, one track per CPU
+//          thread and one for the GPU, with times relative to the oldest
+//          zone.
+//
+// INPUTS: filename - the file to write
+//
+// OUTPUTS: Returns false if the file could not be written.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool Profiler::WriteChromeTrace(const char *filename)
+{
+    std::ofstream out(filename);
+    if (!out)
+    {
+#ifdef _DEBUG
+        std::cerr << "Unable to write profile trace " << filename << std::endl;
+#endif /* DEBUG */
+        return false;
+    }
+
+    unsigned long long base = 0;
+    for (size_t i = 0; i < s_events.size(); ++i)
+    {
+        if (i == 0 || s_events[i].begin_ns < base)
+            base = s_events[i].begin_ns;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[" << std::endl;
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << PROFILER_GPU_THREAD
+        << ",\"args\":{\"name\":\"GPU\"}}";
+
+    for (size_t i = 0; i < s_events.size(); ++i)
+    {
+        const PROFILE_EVENT& event = s_events[i];
+        out << "," << std::endl << "{\"name\":";
+        WriteJSONString(out, event.name);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << (double)(event.begin_ns - base) / 1000.0
+            << ",\"dur\":" << (double)(event.end_ns - event.begin_ns) / 1000.0 << "}";
+    }
+
+    out << std::endl << "]}" << std::endl;
+
+    return !out.fail();
+}
+
+
+
+void Profiler::Reset(void)
+{
+    s_events.clear();
+    s_stats.clear();
+    s_dropped.store(0, std::memory_order_relaxed);
+}
+
+
+
+unsigned long long Profiler::GetDroppedCount(void)
+{
+    return s_dropped.load(std::memory_order_relaxed);
+}
+
+
+
+void Profiler::Shutdown(void)
+{
+    for (size_t i = 0; i < s_gpu_pending.size(); ++i)
+    {
+        s_free_queries.push_back(s_gpu_pending[i].begin_query);
+        s_free_queries.push_back(s_gpu_pending[i].end_query);
+    }
+    s_gpu_pending.clear();
+
+    if (!s_free_queries.empty())
+        glDeleteQueries((GLsizei)s_free_queries.size(), &s_free_queries[0]);
+    s_free_queries.clear();
+}
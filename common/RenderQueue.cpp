@@ -0,0 +1,244 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: RenderQueue.cpp
+//
+// Purpose: This file contains the definition of the RenderQueue class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <chrono>
+#include <string.h>
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "Platform.h"
+#include "RenderQueue.h"
+
+// Field widths of the sort key
+static const unsigned int STATE_BITS   = 4;
+static const unsigned int PROGRAM_BITS = 12;
+static const unsigned int TEXTURE_BITS = 12;
+static const unsigned int VAO_BITS     = 14;
+static const unsigned int DEPTH_BITS   = 21;
+
+static unsigned long long Field(unsigned long long value, unsigned int bits)
+{
+    return value & ((1ULL << bits) - 1);
+}
+
+
+
+RenderQueue::RenderQueue(void)
+    : m_sorted(true)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+
+
+void RenderQueue::InitItem(RENDER_ITEM& item, GLuint program, VBObject *object, unsigned int instances)
+{
+    memset(&item, 0, sizeof(item));
+    item.program = program;
+    item.object = object;
+    item.instances = instances;
+    item.state = RENDER_STATE_DEPTH_TEST | RENDER_STATE_DEPTH_WRITE;
+}
+
+
+
+void RenderQueue::Clear(void)
+{
+    m_items.clear();
+    m_keys.clear();
+    m_order.clear();
+    m_sorted = true;
+}
+
+
+
+void RenderQueue::Add(const RENDER_ITEM& item)
+{
+    m_order.push_back((unsigned int)m_items.size());
+    m_items.push_back(item);
+    m_keys.push_back(MakeKey(item));
+    m_sorted = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: MakeKey
+//
+// Purpose: Encodes the state an item needs into a sort key.
+//
+// INPUTS: item - the item
+//
+// OUTPUTS: The key; see RenderQueue.h for the layout.
+//
+// NOTES: The bits of a non-negative float sort like the float itself, so
+//        the top bits below the sign are a depth that needs no range.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long RenderQueue::MakeKey(const RENDER_ITEM& item)
+{
+    float depth = item.depth > 0.0f ? item.depth : 0.0f;
+    unsigned int depth_bits;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    unsigned long long quantized = depth_bits >> (31 - DEPTH_BITS);
+
+    unsigned long long material = Field(item.state, STATE_BITS);
+    material = (material << PROGRAM_BITS) | Field(item.program, PROGRAM_BITS);
+    material = (material << TEXTURE_BITS) | Field(item.textures[0], TEXTURE_BITS);
+    material = (material << VAO_BITS) | Field(item.object ? item.object->GetVertexArray() : 0, VAO_BITS);
+
+    if (item.state & RENDER_STATE_BLEND)
+    {
+        unsigned long long far_first = Field(~quantized, DEPTH_BITS);
+        return (1ULL << 63) | (far_first << 42) | material;
+    }
+
+    return (material << DEPTH_BITS) | quantized;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Sort
+//
+// Purpose: Orders the queued items by key with an LSD radix sort.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::Sort(void)
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    size_t count = m_keys.size();
+
+    if (!m_sorted && count > 1)
+    {
+        // One read of the keys builds the histograms of all eight passes
+        unsigned int histogram[8][256];
+        memset(histogram, 0, sizeof(histogram));
+        for (size_t i = 0; i < count; ++i)
+        {
+            unsigned long long key = m_keys[i];
+            for (unsigned int pass = 0; pass < 8; ++pass)
+                ++histogram[pass][(key >> (pass * 8)) & 0xFF];
+        }
+
+        m_key_scratch.resize(count);
+        m_order_scratch.resize(count);
+
+        for (unsigned int pass = 0; pass < 8; ++pass)
+        {
+            unsigned int shift = pass * 8;
+            unsigned int *buckets = histogram[pass];
+
+            // Every key has the same byte here; the pass would not move anything
+            if (buckets[(m_keys[0] >> shift) & 0xFF] == count)
+                continue;
+
+            unsigned int sum = 0;
+            for (unsigned int b = 0; b < 256; ++b)
+            {
+                unsigned int n = buckets[b];
+                buckets[b] = sum;
+                sum += n;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                unsigned int slot = buckets[(m_keys[i] >> shift) & 0xFF]++;
+                m_key_scratch[slot] = m_keys[i];
+                m_order_scratch[slot] = m_order[i];
+            }
+
+            m_keys.swap(m_key_scratch);
+            m_order.swap(m_order_scratch);
+        }
+    }
+
+    m_sorted = true;
+    m_stats.items = (unsigned int)count;
+    m_stats.sort_ms = ElapsedMilliseconds(start);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Submit
+//
+// Purpose: Sorts the queue if needed and draws every item, changing only
+//          the state that differs from the previous item.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::Submit(void)
+{
+    if (!m_sorted)
+        Sort();
+
+    GL_CALL_SITE("RenderQueue::Submit");
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    GLStateCache& state = GLStateCache::Current();
+    const RENDER_ITEM *previous = NULL;
+
+    m_stats.draws = 0;
+    m_stats.state_changes = 0;
+    m_stats.program_changes = 0;
+    m_stats.texture_changes = 0;
+    m_stats.vao_changes = 0;
+
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        const RENDER_ITEM& item = m_items[m_order[i]];
+
+        if (!previous || item.state != previous->state)
+        {
+            state.SetEnabled(GL_DEPTH_TEST, (item.state & RENDER_STATE_DEPTH_TEST) != 0);
+            state.DepthMask((item.state & RENDER_STATE_DEPTH_WRITE) ? GL_TRUE : GL_FALSE);
+            state.SetEnabled(GL_CULL_FACE, (item.state & RENDER_STATE_CULL) != 0);
+            state.SetEnabled(GL_BLEND, (item.state & RENDER_STATE_BLEND) != 0);
+            if (item.state & RENDER_STATE_BLEND)
+                state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            ++m_stats.state_changes;
+        }
+
+        if (!previous || item.program != previous->program)
+        {
+            state.UseProgram(item.program);
+            ++m_stats.program_changes;
+        }
+
+        for (unsigned int unit = 0; unit < RENDER_QUEUE_MAX_TEXTURES; ++unit)
+        {
+            if (item.textures[unit] &&
+                (!previous || item.textures[unit] != previous->textures[unit] ||
+                 item.texture_targets[unit] != previous->texture_targets[unit]))
+            {
+                state.BindTexture(unit, item.texture_targets[unit], item.textures[unit]);
+                ++m_stats.texture_changes;
+            }
+        }
+
+        if (item.setup)
+            item.setup(item.user, item);
+
+        if (!previous || item.object->GetVertexArray() != previous->object->GetVertexArray())
+            ++m_stats.vao_changes;
+
+        // Render binds the vertex array through the state cache
+        item.object->Render(item.frame, item.instances, item.first_instance);
+        ++m_stats.draws;
+
+        previous = &item;
+    }
+
+    m_stats.submit_ms = ElapsedMilliseconds(start);
+}
@@ -9,6 +9,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <iostream>
 #include <fstream>
+#include "Profiler.h"
 #include "ShaderUtil.h"
 
 
@@ -59,6 +60,7 @@ ShaderUtil::~ShaderUtil(void)
 ///////////////////////////////////////////////////////////////////////////////
 GLuint ShaderUtil::LoadShaders(const char *vertexSource, const char *fragmentSource)
 {
+    PROFILE_ZONE("ShaderUtil::LoadShaders");
     if (!vertexSource || !fragmentSource) return 0;
 
     GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
@@ -149,6 +151,7 @@ GLuint ShaderUtil::LoadShaders(const char *vertexSource, const char *fragmentSou
 ///////////////////////////////////////////////////////////////////////////////
 GLuint ShaderUtil::LoadShaders(ShaderInfo* shaders)
 {
+    PROFILE_ZONE("ShaderUtil::LoadShaders");
     if (!shaders) return 0;
 
     GLuint program = glCreateProgram();
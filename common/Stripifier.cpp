@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Stripifier.cpp
+//
+// Purpose: This file contains the definition of the triangle stripifier.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stddef.h>
+#include <unordered_map>
+#include "Stripifier.h"
+
+static const unsigned int NO_TRIANGLE = 0xFFFFFFFF;
+
+
+static unsigned long long EdgeKey(unsigned int from, unsigned int to)
+{
+    return ((unsigned long long)from << 32) | to;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Stripify
+//
+// Purpose: Converts an indexed triangle list into restart-separated triangle
+//          strips.
+//
+// INPUTS: indices       - the triangle list (3 indices per triangle)
+//         index_count   - the number of indices in the list
+//         restart_index - the value written between strips
+//         strip         - receives the strip indices
+//         stats         - optional, receives the comparison with the list
+//
+// OUTPUTS: Returns true if the strips need fewer indices than the list.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool Stripify(const unsigned int *indices, unsigned int index_count,
+              unsigned int restart_index, std::vector<unsigned int>& strip,
+              STRIP_STATS *stats)
+{
+    unsigned int triangle_count = index_count / 3;
+
+    strip.clear();
+    strip.reserve(index_count);
+
+    // Every directed edge of a consistently wound mesh belongs to a single
+    // triangle; the neighbor across edge (a, b) owns the edge (b, a).
+    std::unordered_map<unsigned long long, unsigned int> edges;
+    edges.reserve(triangle_count * 3);
+    for (unsigned int t = 0; t < triangle_count; ++t)
+    {
+        const unsigned int *v = &indices[t * 3];
+        edges.insert(std::make_pair(EdgeKey(v[0], v[1]), t));
+        edges.insert(std::make_pair(EdgeKey(v[1], v[2]), t));
+        edges.insert(std::make_pair(EdgeKey(v[2], v[0]), t));
+    }
+
+    std::vector<bool> used(triangle_count, false);
+    std::vector<unsigned int> candidates;
+    unsigned int cursor = 0;
+    unsigned int strip_count = 0;
+
+    for (;;)
+    {
+        // Prefer a neighbor of the last strip so its vertices are still in
+        // the cache, otherwise take the next unused triangle in list order.
+        unsigned int start = NO_TRIANGLE;
+        while (!candidates.empty() && start == NO_TRIANGLE)
+        {
+            if (!used[candidates.back()])
+                start = candidates.back();
+            candidates.pop_back();
+        }
+        while (start == NO_TRIANGLE && cursor < triangle_count)
+        {
+            if (!used[cursor])
+                start = cursor;
+            ++cursor;
+        }
+        if (start == NO_TRIANGLE)
+            break;
+        candidates.clear();
+
+        // Rotate the first triangle so the strip leaves through an edge
+        // that has an unused neighbor
+        const unsigned int *v = &indices[start * 3];
+        unsigned int rotation = 0;
+        for (unsigned int r = 0; r < 3; ++r)
+        {
+            std::unordered_map<unsigned long long, unsigned int>::const_iterator it =
+                edges.find(EdgeKey(v[(r + 2) % 3], v[(r + 1) % 3]));
+            if (it != edges.end() && !used[it->second])
+            {
+                rotation = r;
+                break;
+            }
+        }
+
+        if (strip_count)
+            strip.push_back(restart_index);
+        ++strip_count;
+
+        size_t first = strip.size();
+        strip.push_back(v[rotation]);
+        strip.push_back(v[(rotation + 1) % 3]);
+        strip.push_back(v[(rotation + 2) % 3]);
+        used[start] = true;
+
+        // Grow the strip. Triangle k of a strip is (s[k], s[k+1], s[k+2])
+        // when k is even and (s[k+1], s[k], s[k+2]) when k is odd, so the
+        // next triangle must own the matching directed edge.
+        for (;;)
+        {
+            size_t n = strip.size();
+            size_t k = n - 2 - first;
+            unsigned int a = strip[n - 2];
+            unsigned int b = strip[n - 1];
+            unsigned long long key = (k & 1) ? EdgeKey(b, a) : EdgeKey(a, b);
+
+            std::unordered_map<unsigned long long, unsigned int>::const_iterator it = edges.find(key);
+            if (it == edges.end() || used[it->second])
+                break;
+
+            unsigned int t = it->second;
+            const unsigned int *w = &indices[t * 3];
+            unsigned int third = w[0];
+            for (unsigned int i = 0; i < 3; ++i)
+            {
+                if (w[i] != a && w[i] != b)
+                    third = w[i];
+            }
+
+            strip.push_back(third);
+            used[t] = true;
+        }
+
+        // Remember the neighbors of this strip for the next one
+        for (size_t i = first; i + 1 < strip.size(); ++i)
+        {
+            std::unordered_map<unsigned long long, unsigned int>::const_iterator it =
+                edges.find(EdgeKey(strip[i + 1], strip[i]));
+            if (it != edges.end() && !used[it->second])
+                candidates.push_back(it->second);
+            it = edges.find(EdgeKey(strip[i], strip[i + 1]));
+            if (it != edges.end() && !used[it->second])
+                candidates.push_back(it->second);
+        }
+    }
+
+    if (stats)
+    {
+        stats->triangles = triangle_count;
+        stats->strips = strip_count;
+        stats->list_indices = triangle_count * 3;
+        stats->strip_indices = (unsigned int)strip.size();
+        stats->list_acmr = ComputeACMR(indices, triangle_count * 3, false, restart_index);
+        stats->strip_acmr = strip.empty() ? 0.0f :
+                            ComputeACMR(&strip[0], (unsigned int)strip.size(), true, restart_index);
+    }
+
+    return strip.size() < triangle_count * 3;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ComputeACMR
+//
+// Purpose: Simulates a FIFO post-transform vertex cache and returns the
+//          average number of cache misses per triangle.
+//
+// INPUTS: indices       - a triangle list, or strips when 'strips' is true
+//         index_count   - the number of indices
+//         strips        - true if indices are restart-separated strips
+//         restart_index - the restart index used by the strips
+//         cache_size    - the number of entries in the simulated cache
+//
+// OUTPUTS: The average cache miss ratio.
+//
+///////////////////////////////////////////////////////////////////////////////
+float ComputeACMR(const unsigned int *indices, unsigned int index_count,
+                  bool strips, unsigned int restart_index,
+                  unsigned int cache_size)
+{
+    std::vector<unsigned int> cache(cache_size, restart_index);
+    unsigned int head = 0;
+    unsigned int misses = 0;
+    unsigned int triangles = 0;
+    unsigned int run = 0;
+
+    for (unsigned int i = 0; i < index_count; ++i)
+    {
+        unsigned int index = indices[i];
+
+        if (strips && index == restart_index)
+        {
+            run = 0;
+            continue;
+        }
+
+        bool hit = false;
+        for (unsigned int c = 0; c < cache_size && !hit; ++c)
+            hit = cache[c] == index;
+
+        if (!hit)
+        {
+            cache[head] = index;
+            head = (head + 1) % cache_size;
+            ++misses;
+        }
+
+        ++run;
+        if (strips ? run >= 3 : run == 3)
+            ++triangles;
+        if (!strips && run == 3)
+            run = 0;
+    }
+
+    return triangles ? float(misses) / float(triangles) : 0.0f;
+}
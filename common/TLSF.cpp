@@ -0,0 +1,388 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: TLSF.cpp
+//
+// Purpose: This file contains the definition of the TLSF class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "TLSF.h"
+
+
+static unsigned int Log2(unsigned long long value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+static unsigned int LowestBit(unsigned long long value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: TLSF
+//
+// Purpose: Creates an allocator over [0, capacity).
+//
+// INPUTS: capacity    - the size of the managed range in bytes
+//         granularity - every offset and size is a multiple of this
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+TLSF::TLSF(unsigned long long capacity, unsigned int granularity)
+{
+    Reset(capacity, granularity);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Reset
+//
+// Purpose: Forgets every allocation and starts over with one free block
+//          covering the whole range (rounded down to the granularity).
+//
+// INPUTS: capacity    - the size of the managed range in bytes
+//         granularity - every offset and size is a multiple of this
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TLSF::Reset(unsigned long long capacity, unsigned int granularity)
+{
+    m_granularity = granularity ? granularity : 1;
+    m_granularity_log2 = Log2(m_granularity);
+    m_capacity = capacity & ~(unsigned long long)(m_granularity - 1);
+    m_fl_bitmap = 0;
+    memset(m_sl_bitmap, 0, sizeof(m_sl_bitmap));
+    memset(m_heads, 0xFF, sizeof(m_heads));
+    m_blocks.clear();
+    m_unused.clear();
+    m_used = 0;
+    m_allocations = 0;
+
+    // Block 0 always starts at offset 0; merges never delete it
+    unsigned int first = NewBlock();
+    Block& block = m_blocks[first];
+    block.offset = 0;
+    block.size = m_capacity;
+    block.free = true;
+    if (m_capacity)
+        InsertFree(first);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Allocate
+//
+// Purpose: Allocates a range.
+//
+// INPUTS: size   - the number of bytes needed
+//         offset - receives the start of the range
+//
+// OUTPUTS: A block handle for Free, or TLSF_INVALID if no free range is
+//          large enough.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned int TLSF::Allocate(unsigned long long size, unsigned long long& offset)
+{
+    unsigned long long units = (size + m_granularity - 1) >> m_granularity_log2;
+    if (units == 0)
+        units = 1;
+
+    unsigned int index = FindFree(units);
+    if (index == TLSF_INVALID)
+        return TLSF_INVALID;
+
+    RemoveFree(index);
+
+    // Give the tail back if it is at least one granule
+    unsigned long long bytes = units << m_granularity_log2;
+    if (m_blocks[index].size > bytes)
+    {
+        unsigned int rest = NewBlock();
+        Block& block = m_blocks[index];
+        Block& tail = m_blocks[rest];
+
+        tail.offset = block.offset + bytes;
+        tail.size = block.size - bytes;
+        tail.free = true;
+        tail.prev_physical = index;
+        tail.next_physical = block.next_physical;
+        if (block.next_physical != TLSF_INVALID)
+            m_blocks[block.next_physical].prev_physical = rest;
+        block.next_physical = rest;
+        block.size = bytes;
+
+        InsertFree(rest);
+    }
+
+    Block& block = m_blocks[index];
+    block.free = false;
+    m_used += block.size;
+    ++m_allocations;
+
+    offset = block.offset;
+    return index;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Free
+//
+// Purpose: Frees a range and merges it with free neighbors.
+//
+// INPUTS: block - a handle returned by Allocate
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TLSF::Free(unsigned int index)
+{
+    if (index >= m_blocks.size() || m_blocks[index].free)
+        return;
+
+    m_used -= m_blocks[index].size;
+    --m_allocations;
+    m_blocks[index].free = true;
+
+    // Merge with the following block
+    unsigned int next = m_blocks[index].next_physical;
+    if (next != TLSF_INVALID && m_blocks[next].free)
+    {
+        RemoveFree(next);
+        m_blocks[index].size += m_blocks[next].size;
+        m_blocks[index].next_physical = m_blocks[next].next_physical;
+        if (m_blocks[next].next_physical != TLSF_INVALID)
+            m_blocks[m_blocks[next].next_physical].prev_physical = index;
+        DeleteBlock(next);
+    }
+
+    // Merge into the preceding block
+    unsigned int prev = m_blocks[index].prev_physical;
+    if (prev != TLSF_INVALID && m_blocks[prev].free)
+    {
+        RemoveFree(prev);
+        m_blocks[prev].size += m_blocks[index].size;
+        m_blocks[prev].next_physical = m_blocks[index].next_physical;
+        if (m_blocks[index].next_physical != TLSF_INVALID)
+            m_blocks[m_blocks[index].next_physical].prev_physical = prev;
+        DeleteBlock(index);
+        index = prev;
+    }
+
+    InsertFree(index);
+}
+
+
+
+void TLSF::ForEachAllocation(void (*fn)(void *user, unsigned int block, unsigned long long offset,
+                                        unsigned long long size), void *user) const
+{
+    for (unsigned int i = 0; i != TLSF_INVALID && !m_blocks.empty(); i = m_blocks[i].next_physical)
+    {
+        if (!m_blocks[i].free)
+            fn(user, i, m_blocks[i].offset, m_blocks[i].size);
+    }
+}
+
+
+
+TLSF_STATS TLSF::GetStats(void) const
+{
+    TLSF_STATS stats;
+
+    stats.capacity = m_capacity;
+    stats.used = m_used;
+    stats.allocations = m_allocations;
+    stats.largest_free = 0;
+    stats.free_blocks = 0;
+
+    for (unsigned int i = 0; i != TLSF_INVALID && !m_blocks.empty(); i = m_blocks[i].next_physical)
+    {
+        if (m_blocks[i].free && m_blocks[i].size)
+        {
+            ++stats.free_blocks;
+            if (m_blocks[i].size > stats.largest_free)
+                stats.largest_free = m_blocks[i].size;
+        }
+    }
+
+    return stats;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Mapping
+//
+// Purpose: Maps a size in granules to its free list. Sizes below
+//          TLSF_SL_COUNT granules get a list each; above that, each power
+//          of two is split into TLSF_SL_COUNT equal ranges.
+//
+// INPUTS: units - the size in granules
+//         fl    - receives the first level index
+//         sl    - receives the second level index
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TLSF::Mapping(unsigned long long units, unsigned int& fl, unsigned int& sl) const
+{
+    if (units < TLSF_SL_COUNT)
+    {
+        fl = 0;
+        sl = (unsigned int)units;
+    }
+    else
+    {
+        unsigned int log2 = Log2(units);
+        fl = log2 - TLSF_SL_LOG2 + 1;
+        sl = (unsigned int)(units >> (log2 - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+    }
+}
+
+
+
+// Finds a free block of at least 'units' granules. The size is rounded up
+// to the next list boundary first, so any block in the chosen list fits.
+// If no list above holds a block, the list of the size itself is searched,
+// since a block there may still be large enough; otherwise a range that
+// fits exactly, such as a whole page, could never be allocated.
+unsigned int TLSF::FindFree(unsigned long long units)
+{
+    unsigned long long rounded = units;
+    if (units >= TLSF_SL_COUNT)
+        rounded += (1ULL << (Log2(units) - TLSF_SL_LOG2)) - 1;
+
+    unsigned int fl, sl;
+    Mapping(rounded, fl, sl);
+    if (fl < TLSF_FL_COUNT)
+    {
+        unsigned int sl_map = m_sl_bitmap[fl] & (~0u << sl);
+        if (!sl_map)
+        {
+            unsigned long long fl_map = fl + 1 < 64 ? m_fl_bitmap & (~0ULL << (fl + 1)) : 0;
+            if (fl_map)
+            {
+                fl = LowestBit(fl_map);
+                sl_map = m_sl_bitmap[fl];
+            }
+        }
+        if (sl_map)
+            return m_heads[fl][LowestBit(sl_map)];
+    }
+
+    if (rounded == units)
+        return TLSF_INVALID;
+
+    Mapping(units, fl, sl);
+    if (fl >= TLSF_FL_COUNT)
+        return TLSF_INVALID;
+
+    for (unsigned int index = m_heads[fl][sl]; index != TLSF_INVALID; index = m_blocks[index].next_free)
+    {
+        if ((m_blocks[index].size >> m_granularity_log2) >= units)
+            return index;
+    }
+    return TLSF_INVALID;
+}
+
+
+
+void TLSF::InsertFree(unsigned int index)
+{
+    unsigned int fl, sl;
+    Mapping(m_blocks[index].size >> m_granularity_log2, fl, sl);
+
+    Block& block = m_blocks[index];
+    block.prev_free = TLSF_INVALID;
+    block.next_free = m_heads[fl][sl];
+    if (block.next_free != TLSF_INVALID)
+        m_blocks[block.next_free].prev_free = index;
+    m_heads[fl][sl] = index;
+
+    m_fl_bitmap |= 1ULL << fl;
+    m_sl_bitmap[fl] |= 1u << sl;
+}
+
+
+
+void TLSF::RemoveFree(unsigned int index)
+{
+    unsigned int fl, sl;
+    Mapping(m_blocks[index].size >> m_granularity_log2, fl, sl);
+
+    Block& block = m_blocks[index];
+    if (block.prev_free != TLSF_INVALID)
+        m_blocks[block.prev_free].next_free = block.next_free;
+    else
+        m_heads[fl][sl] = block.next_free;
+    if (block.next_free != TLSF_INVALID)
+        m_blocks[block.next_free].prev_free = block.prev_free;
+
+    if (m_heads[fl][sl] == TLSF_INVALID)
+    {
+        m_sl_bitmap[fl] &= ~(1u << sl);
+        if (!m_sl_bitmap[fl])
+            m_fl_bitmap &= ~(1ULL << fl);
+    }
+}
+
+
+
+unsigned int TLSF::NewBlock(void)
+{
+    unsigned int index;
+    if (!m_unused.empty())
+    {
+        index = m_unused.back();
+        m_unused.pop_back();
+    }
+    else
+    {
+        index = (unsigned int)m_blocks.size();
+        m_blocks.push_back(Block());
+    }
+
+    Block& block = m_blocks[index];
+    block.offset = 0;
+    block.size = 0;
+    block.prev_physical = TLSF_INVALID;
+    block.next_physical = TLSF_INVALID;
+    block.prev_free = TLSF_INVALID;
+    block.next_free = TLSF_INVALID;
+    block.free = false;
+
+    return index;
+}
+
+
+
+void TLSF::DeleteBlock(unsigned int index)
+{
+    // Keep deleted slots out of Free() by marking them free
+    m_blocks[index].free = true;
+    m_blocks[index].size = 0;
+    m_unused.push_back(index);
+}
@@ -0,0 +1,580 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBAnimation.cpp
+//
+// Purpose: This file contains the definition of the VBAnimation class. The
+//          VBAnimation class plays back vertex-animated VBM files by
+//          streaming a sliding window of frames into a buffer object.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <cmath>
+#include <string.h>
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "VBAnimation.h"
+
+#define BUFFER_OFFSET(x)  ((const GLvoid*) (x))
+
+static const unsigned int NO_SLOT = 0xFFFFFFFF;
+
+
+static GLboolean Normalized(const VBM_ATTRIB_HEADER& attrib)
+{
+    return (attrib.flags & VBM_ATTRIB_NORMALIZED) ? GL_TRUE : GL_FALSE;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: VBAnimation
+//
+// Purpose: Initializes VBAnimation data at instantiation.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+VBAnimation::VBAnimation(void)
+    : m_frame_vertices(0),
+      m_slot_size(0),
+      m_window(0),
+      m_next_vertex_index(-1),
+      m_next_normal_index(-1),
+      m_vao(0),
+      m_frame_buffer(0),
+      m_index_buffer(0),
+      m_bound_slot0(NO_SLOT),
+      m_bound_slot1(NO_SLOT),
+      m_draw_count(0),
+      m_blend(0.0f),
+      m_stalls(0),
+      m_read_failure_count(0),
+      m_quit(false)
+{
+    m_header.num_frames = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ~VBAnimation
+//
+// Purpose: Stops the streaming thread and releases the GL objects.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+VBAnimation::~VBAnimation(void)
+{
+    Close();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Open
+//
+// Purpose: Reads the header tables of an animated VBM file, creates the
+//          resident frame window and starts the streaming thread.
+//
+// INPUTS: filename         - the VBM file to play back
+//         vertexIndex      - attribute location of the current position
+//         normalIndex      - attribute location of the current normal
+//         texCoord0Index   - attribute location of the texture coordinate
+//         nextVertexIndex  - attribute location of the next position
+//         nextNormalIndex  - attribute location of the next normal
+//         window           - the number of frames kept in GPU memory
+//
+// OUTPUTS: Returns false if the file could not be opened or does not
+//          contain any frames.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool VBAnimation::Open(const char *filename, int vertexIndex, int normalIndex,
+                       int texCoord0Index, int nextVertexIndex, int nextNormalIndex,
+                       unsigned int window)
+{
+    Close();
+
+    std::ifstream f(filename, std::ios::binary);
+
+    if (!f) return false;
+
+    f.seekg(0, f.end);
+    unsigned long long file_size = (unsigned long long)f.tellg();
+    f.seekg(0, f.beg);
+
+    // Validate the header tables before anything is allocated
+    VBM_LAYOUT layout;
+    std::vector<char> tables;
+
+    if (window == 0 || file_size < sizeof(VBM_HEADER) ||
+        !f.read((char *)&m_header, sizeof(VBM_HEADER)) ||
+        !ValidateVBMHeader(m_header, file_size, VBM_VALIDATE_VERTEX_FRAMES, &layout))
+    {
+        m_header.num_frames = 0;
+        return false;
+    }
+
+    tables.resize((size_t)layout.tables_size);
+    f.seekg(0, f.beg);
+    if (!f.read(&tables[0], tables.size()) || !ValidateVBMTables(&tables[0], &layout))
+    {
+        m_header.num_frames = 0;
+        return false;
+    }
+
+    m_attrib.resize(m_header.num_attribs);
+    memcpy(&m_attrib[0], &tables[m_header.size], m_header.num_attribs * sizeof(VBM_ATTRIB_HEADER));
+
+    m_frame.resize(m_header.num_frames);
+    memcpy(&m_frame[0], &tables[m_header.size + m_header.num_attribs * sizeof(VBM_ATTRIB_HEADER)],
+           m_header.num_frames * sizeof(VBM_FRAME_HEADER));
+
+    // Every slot is big enough to hold the largest frame
+    m_frame_vertices = 0;
+    for (unsigned int i = 0; i < m_header.num_frames; ++i)
+    {
+        if (m_frame[i].count > m_frame_vertices)
+            m_frame_vertices = m_frame[i].count;
+    }
+
+    // Work out where each attribute lives in a slot
+    m_slot_size = 0;
+    m_attrib_file_offset.resize(m_header.num_attribs);
+    m_attrib_stride.resize(m_header.num_attribs);
+    m_attrib_offset.resize(m_header.num_attribs);
+    m_attrib_location.resize(m_header.num_attribs);
+    for (unsigned int i = 0; i < m_header.num_attribs; ++i)
+    {
+        m_attrib_file_offset[i] = layout.attrib_offset[i];
+        m_attrib_stride[i] = layout.attrib_stride[i];
+        m_attrib_offset[i] = m_slot_size;
+        m_slot_size += layout.attrib_stride[i] * m_frame_vertices;
+
+        m_attrib_location[i] = (i == 0) ? vertexIndex :
+                               (i == 1) ? normalIndex :
+                               (i == 2) ? texCoord0Index : -1;
+    }
+
+    m_next_vertex_index = nextVertexIndex;
+    m_next_normal_index = nextNormalIndex;
+
+    // Short sequences fit entirely, so each frame simply gets its own slot
+    m_window = window < m_header.num_frames ? window : m_header.num_frames;
+
+    glGenVertexArrays(1, &m_vao);
+    GLStateCache::Current().BindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_frame_buffer);
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_frame_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)m_slot_size * m_window, NULL, GL_STREAM_DRAW);
+
+    for (unsigned int i = 0; i < m_header.num_attribs; ++i)
+    {
+        if (m_attrib_location[i] >= 0)
+            glEnableVertexAttribArray(m_attrib_location[i]);
+    }
+    if (m_next_vertex_index >= 0)
+        glEnableVertexAttribArray(m_next_vertex_index);
+    if (m_next_normal_index >= 0 && m_header.num_attribs > 1)
+        glEnableVertexAttribArray(m_next_normal_index);
+
+    // The topology is shared by every frame, so it is uploaded once
+    if (m_header.num_indices)
+    {
+        std::vector<char> indices((size_t)layout.index_data_size);
+
+        f.seekg(layout.index_data_offset, f.beg);
+        f.read(&indices[0], indices.size());
+
+        glGenBuffers(1, &m_index_buffer);
+        GLStateCache::Current().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), &indices[0], GL_STATIC_DRAW);
+    }
+
+    GLStateCache::Current().BindVertexArray(0);
+    f.close();
+
+    m_slots.resize(m_window);
+    for (unsigned int i = 0; i < m_window; ++i)
+    {
+        m_slots[i].frame = NO_SLOT;
+        m_slots[i].state = SLOT_EMPTY;
+        m_slots[i].staging = new char[m_slot_size];
+    }
+    m_read_failures.assign(m_header.num_frames, 0);
+    m_read_failure_count = 0;
+
+    m_filename = filename;
+    m_bound_slot0 = NO_SLOT;
+    m_bound_slot1 = NO_SLOT;
+    m_draw_count = 0;
+    m_blend = 0.0f;
+    m_stalls = 0;
+    m_quit = false;
+    m_streamer = std::thread(&VBAnimation::StreamFrames, this);
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Close
+//
+// Purpose: Stops the streaming thread and releases the GL objects.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void VBAnimation::Close(void)
+{
+    if (m_streamer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_streamer.join();
+    }
+
+    for (size_t i = 0; i < m_slots.size(); ++i)
+        delete [] m_slots[i].staging;
+    m_slots.clear();
+    m_requests.clear();
+
+    GLStateCache::Current().DeleteBuffers(1, &m_index_buffer);
+    m_index_buffer = 0;
+    GLStateCache::Current().DeleteBuffers(1, &m_frame_buffer);
+    m_frame_buffer = 0;
+    GLStateCache::Current().DeleteVertexArrays(1, &m_vao);
+    m_vao = 0;
+
+    m_header.num_frames = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Update
+//
+// Purpose: Moves the playback position, requests the frames that follow it,
+//          uploads frames that the streaming thread has finished reading and
+//          selects the keyframes to blend.
+//
+// INPUTS: time - the playback position measured in frames
+//
+// OUTPUTS: Returns false if a frame in the window could not be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool VBAnimation::Update(float time)
+{
+    if (m_header.num_frames == 0)
+        return true;
+
+    if (time < 0.0f)
+        time = 0.0f;
+
+    // Consecutive positions on the (unwrapped) time line always land in
+    // distinct slots, so the window never evicts a frame it still needs.
+    unsigned long long position = (unsigned long long)time;
+    unsigned int frame_count = m_header.num_frames;
+    unsigned int slot0 = (unsigned int)(position % m_window);
+    unsigned int slot1 = (unsigned int)((position + 1) % m_window);
+    float blend = time - floorf(time);
+
+    std::vector<unsigned int> staged;
+    bool failed = false;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        for (unsigned int i = 0; i < m_window; ++i)
+        {
+            unsigned int frame = (unsigned int)((position + i) % frame_count);
+            unsigned int index = (unsigned int)((position + i) % m_window);
+            Slot& slot = m_slots[index];
+
+            if (slot.frame != frame)
+            {
+                slot.frame = frame;
+                slot.state = SLOT_EMPTY;
+            }
+
+            // A failed read leaves the slot empty, so it is requested again
+            // until the frame has failed VBANIMATION_MAX_READS times
+            if (slot.state == SLOT_EMPTY)
+            {
+                if (m_read_failures[frame] < VBANIMATION_MAX_READS)
+                {
+                    slot.state = SLOT_PENDING;
+                    m_requests.push_back(index);
+                }
+                else
+                {
+                    slot.state = SLOT_FAILED;
+                }
+            }
+            else if (slot.state == SLOT_STAGED)
+            {
+                staged.push_back(index);
+            }
+
+            if (slot.state == SLOT_FAILED)
+                failed = true;
+        }
+    }
+    m_wake.notify_one();
+
+    // Upload whatever the streaming thread has finished. The streaming
+    // thread never touches a staged slot, so this happens outside the lock.
+    if (!staged.empty())
+    {
+        GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_frame_buffer);
+        for (size_t i = 0; i < staged.size(); ++i)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)staged[i] * m_slot_size,
+                            m_slot_size, m_slots[staged[i]].staging);
+        }
+    }
+
+    // The streaming thread writes the states, so they are read under the lock
+    bool key0_ready, key1_ready;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (size_t i = 0; i < staged.size(); ++i)
+            m_slots[staged[i]].state = SLOT_RESIDENT;
+
+        key0_ready = m_slots[slot0].state == SLOT_RESIDENT;
+        key1_ready = m_slots[slot1].state == SLOT_RESIDENT;
+    }
+
+    if (key0_ready && key1_ready)
+    {
+        BindKeyFrames(slot0, slot1);
+        m_blend = blend;
+    }
+    else if (key0_ready)
+    {
+        BindKeyFrames(slot0, slot0);
+        m_blend = 0.0f;
+        ++m_stalls;
+    }
+    else
+    {
+        // Keep showing the last keyframes rather than waiting for the disk
+        ++m_stalls;
+    }
+
+    return !failed;
+}
+
+
+
+unsigned int VBAnimation::GetReadFailureCount(void) const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_read_failure_count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Render
+//
+// Purpose: Draws the keyframes selected by the last call to Update.
+//
+// INPUTS: instances - the number of instances to draw, or 0 for a regular
+//                     draw
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void VBAnimation::Render(unsigned int instances)
+{
+    if (m_bound_slot0 == NO_SLOT)
+        return;
+
+    GL_CALL_SITE("VBAnimation::Render");
+    GLStateCache& state = GLStateCache::Current();
+    state.BindVertexArray(m_vao);
+    if (m_header.num_indices)
+    {
+        state.Disable(GL_PRIMITIVE_RESTART);
+
+        GLenum type = m_header.index_type == GL_UNSIGNED_SHORT ?
+                      GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        if (instances)
+            glDrawElementsInstanced(GL_TRIANGLES, m_header.num_indices, type,
+                                    BUFFER_OFFSET(0), instances);
+        else
+        {
+            GLIntercept::Note(GLCALL_DRAW);
+            glDrawElements(GL_TRIANGLES, m_header.num_indices, type, BUFFER_OFFSET(0));
+        }
+    }
+    else
+    {
+        if (instances)
+            glDrawArraysInstanced(GL_TRIANGLES, 0, m_draw_count, instances);
+        else
+        {
+            GLIntercept::Note(GLCALL_DRAW);
+            glDrawArrays(GL_TRIANGLES, 0, m_draw_count);
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BindKeyFrames
+//
+// Purpose: Points the current and next attribute arrays at two slots of the
+//          frame buffer.
+//
+// INPUTS: slot0 - the slot holding the current keyframe
+//         slot1 - the slot holding the next keyframe
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void VBAnimation::BindKeyFrames(unsigned int slot0, unsigned int slot1)
+{
+    m_draw_count = m_frame[m_slots[slot0].frame].count;
+
+    if (slot0 == m_bound_slot0 && slot1 == m_bound_slot1)
+        return;
+
+    GLStateCache::Current().BindVertexArray(m_vao);
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_frame_buffer);
+
+    GLintptr base0 = (GLintptr)slot0 * m_slot_size;
+    GLintptr base1 = (GLintptr)slot1 * m_slot_size;
+
+    for (unsigned int i = 0; i < m_header.num_attribs; ++i)
+    {
+        if (m_attrib_location[i] >= 0)
+            glVertexAttribPointer(m_attrib_location[i], m_attrib[i].components,
+                                  m_attrib[i].type, Normalized(m_attrib[i]), 0,
+                                  BUFFER_OFFSET(base0 + m_attrib_offset[i]));
+    }
+
+    if (m_next_vertex_index >= 0)
+        glVertexAttribPointer(m_next_vertex_index, m_attrib[0].components,
+                              m_attrib[0].type, Normalized(m_attrib[0]), 0,
+                              BUFFER_OFFSET(base1 + m_attrib_offset[0]));
+    if (m_next_normal_index >= 0 && m_header.num_attribs > 1)
+        glVertexAttribPointer(m_next_normal_index, m_attrib[1].components,
+                              m_attrib[1].type, Normalized(m_attrib[1]), 0,
+                              BUFFER_OFFSET(base1 + m_attrib_offset[1]));
+
+    m_bound_slot0 = slot0;
+    m_bound_slot1 = slot1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: StreamFrames
+//
+// Purpose: Body of the streaming thread. Reads requested frames from disk
+//          into the staging memory of their slots.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void VBAnimation::StreamFrames(void)
+{
+    std::ifstream f(m_filename.c_str(), std::ios::binary);
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    for (;;)
+    {
+        while (!m_quit && m_requests.empty())
+            m_wake.wait(guard);
+
+        if (m_quit)
+            break;
+
+        unsigned int index = m_requests.front();
+        m_requests.pop_front();
+
+        Slot& slot = m_slots[index];
+        if (slot.state != SLOT_PENDING)
+            continue;
+
+        unsigned int frame = slot.frame;
+        slot.state = SLOT_LOADING;
+
+        guard.unlock();
+        bool ok = ReadFrame(f, frame, slot.staging);
+        guard.lock();
+
+        if (!ok)
+        {
+            ++m_read_failure_count;
+            if (m_read_failures[frame] < VBANIMATION_MAX_READS)
+                ++m_read_failures[frame];
+        }
+
+        // Update may have retargeted the slot while we were reading; in
+        // that case the slot is pending again and already re-queued. A
+        // failed read leaves the slot empty, for Update to request again
+        // or give up on.
+        if (slot.state == SLOT_LOADING && slot.frame == frame)
+            slot.state = ok ? SLOT_STAGED : SLOT_EMPTY;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ReadFrame
+//
+// Purpose: Reads the vertices of one frame into a slot-sized block of
+//          memory.
+//
+// INPUTS: file  - the open VBM file
+//         frame - the frame to read
+//         dest  - the staging memory of the destination slot
+//
+// OUTPUTS: Returns false if the read failed.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool VBAnimation::ReadFrame(std::ifstream& file, unsigned int frame, char* dest)
+{
+    if (!file)
+    {
+        file.clear();
+        file.open(m_filename.c_str(), std::ios::binary);
+        if (!file) return false;
+    }
+
+    const VBM_FRAME_HEADER& header = m_frame[frame];
+
+    for (unsigned int i = 0; i < m_header.num_attribs; ++i)
+    {
+        unsigned int stride = m_attrib_stride[i];
+
+        file.seekg(m_attrib_file_offset[i] + (unsigned long long)header.first * stride, file.beg);
+        file.read(dest + m_attrib_offset[i], (std::streamsize)header.count * stride);
+    }
+
+    if (!file)
+    {
+        file.close();
+        return false;
+    }
+
+    return true;
+}
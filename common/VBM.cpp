@@ -0,0 +1,418 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBM.cpp
+//
+// Purpose: This file contains the validating VBM parser. The loaders call it
+//          before they allocate anything, so a truncated or corrupt file is
+//          rejected instead of causing an out-of-bounds read or a huge
+//          allocation.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include "VBM.h"
+
+// GL enumerants stored in VBM files. They are spelled out here so that the
+// parser (and the tools built on it) do not depend on the GL headers.
+static const unsigned int VBM_GL_BYTE                        = 0x1400;
+static const unsigned int VBM_GL_UNSIGNED_BYTE               = 0x1401;
+static const unsigned int VBM_GL_SHORT                       = 0x1402;
+static const unsigned int VBM_GL_UNSIGNED_SHORT              = 0x1403;
+static const unsigned int VBM_GL_INT                         = 0x1404;
+static const unsigned int VBM_GL_UNSIGNED_INT                = 0x1405;
+static const unsigned int VBM_GL_FLOAT                       = 0x1406;
+static const unsigned int VBM_GL_HALF_FLOAT                  = 0x140B;
+static const unsigned int VBM_GL_UNSIGNED_INT_2_10_10_10_REV = 0x8368;
+static const unsigned int VBM_GL_INT_2_10_10_10_REV          = 0x8D9F;
+
+
+static bool Fail(const char **error, const char *message)
+{
+    if (error) *error = message;
+    return false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: GetVBMTypeSize
+//
+// Purpose: Returns the size of one vertex of an attribute.
+//
+// INPUTS: type       - the GL type of the attribute
+//         components - the number of components per vertex
+//
+// OUTPUTS: Returns 0 if the combination is not supported.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned int GetVBMTypeSize(unsigned int type, unsigned int components)
+{
+    if (components < 1 || components > 4)
+        return 0;
+
+    switch (type)
+    {
+    case VBM_GL_BYTE:
+    case VBM_GL_UNSIGNED_BYTE:
+        return components;
+    case VBM_GL_SHORT:
+    case VBM_GL_UNSIGNED_SHORT:
+    case VBM_GL_HALF_FLOAT:
+        return components * 2;
+    case VBM_GL_INT:
+    case VBM_GL_UNSIGNED_INT:
+    case VBM_GL_FLOAT:
+        return components * 4;
+    case VBM_GL_INT_2_10_10_10_REV:
+    case VBM_GL_UNSIGNED_INT_2_10_10_10_REV:
+        return components == 4 ? 4 : 0;
+    }
+
+    return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBMHeader
+//
+// Purpose: Checks the fixed header of a VBM file against the length of the
+//          file and works out how many bytes of header tables follow it.
+//
+// INPUTS: header    - the first sizeof(VBM_HEADER) bytes of the file
+//         file_size - the length of the whole file in bytes
+//         options   - VBM_VALIDATE_* flags
+//         layout    - receives file_size and tables_size
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the header cannot describe a file of this size.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBMHeader(const VBM_HEADER& header, unsigned long long file_size,
+                       unsigned int options, VBM_LAYOUT *layout,
+                       const char **error)
+{
+    if (file_size < sizeof(VBM_HEADER))
+        return Fail(error, "file is smaller than the VBM header");
+
+    if (header.magic != VBM_MAGIC)
+        return Fail(error, "bad magic (expected SBM1)");
+
+    if (header.size < sizeof(VBM_HEADER) || header.size > file_size)
+        return Fail(error, "bad header size");
+
+    if (header.num_attribs == 0 || header.num_attribs > VBM_MAX_ATTRIBS)
+        return Fail(error, "bad attribute count");
+
+    if (header.num_frames == 0)
+        return Fail(error, "no frames");
+
+    if (header.num_indices &&
+        header.index_type != VBM_GL_UNSIGNED_SHORT &&
+        header.index_type != VBM_GL_UNSIGNED_INT)
+        return Fail(error, "bad index type");
+
+    // All arithmetic is done in 64 bits; the counts are 32 bits wide, so
+    // none of these products can overflow.
+    unsigned long long tables_size = (unsigned long long)header.size +
+        (unsigned long long)header.num_attribs * sizeof(VBM_ATTRIB_HEADER) +
+        (unsigned long long)header.num_frames * sizeof(VBM_FRAME_HEADER);
+
+    if (tables_size > file_size)
+        return Fail(error, "header tables reach past the end of the file");
+
+    memset(layout, 0, sizeof(VBM_LAYOUT));
+    layout->file_size = file_size;
+    layout->tables_size = tables_size;
+    layout->options = options;
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBMTables
+//
+// Purpose: Checks the attribute and frame headers in a single pass and
+//          computes the offset and size of every data section.
+//
+// INPUTS: tables - the first layout->tables_size bytes of the file
+//         layout - a layout filled in by ValidateVBMHeader, completed here
+//         error  - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if any section would reach past the end of the
+//          file or any header holds a value the loaders cannot handle.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBMTables(const void *tables, VBM_LAYOUT *layout,
+                       const char **error)
+{
+    const unsigned char *bytes = (const unsigned char *)tables;
+    VBM_HEADER header;
+
+    memcpy(&header, bytes, sizeof(VBM_HEADER));
+
+    const unsigned char *attribs = bytes + header.size;
+    const unsigned char *frames = attribs + header.num_attribs * sizeof(VBM_ATTRIB_HEADER);
+
+    unsigned long long offset = layout->tables_size;
+    layout->vertex_data_offset = offset;
+
+    for (unsigned int i = 0; i < header.num_attribs; ++i)
+    {
+        VBM_ATTRIB_HEADER attrib;
+        memcpy(&attrib, attribs + i * sizeof(VBM_ATTRIB_HEADER), sizeof(attrib));
+
+        if (memchr(attrib.name, 0, sizeof(attrib.name)) == NULL)
+            return Fail(error, "attribute name is not terminated");
+
+        unsigned int stride = GetVBMTypeSize(attrib.type, attrib.components);
+        if (stride == 0)
+            return Fail(error, "unsupported attribute type");
+
+        layout->attrib_offset[i] = offset;
+        layout->attrib_stride[i] = stride;
+        offset += (unsigned long long)stride * header.num_vertices;
+
+        if (offset > layout->file_size)
+            return Fail(error, "vertex data reaches past the end of the file");
+    }
+
+    layout->vertex_data_size = offset - layout->vertex_data_offset;
+
+    layout->index_data_offset = offset;
+    if (header.num_indices)
+    {
+        layout->index_size = header.index_type == VBM_GL_UNSIGNED_SHORT ? 2 : 4;
+        layout->index_data_size = (unsigned long long)header.num_indices * layout->index_size;
+
+        if (offset + layout->index_data_size > layout->file_size)
+            return Fail(error, "index data reaches past the end of the file");
+    }
+
+    bool vertex_frames = header.num_indices == 0 ||
+                         (layout->options & VBM_VALIDATE_VERTEX_FRAMES) != 0;
+    unsigned long long limit = vertex_frames ? header.num_vertices : header.num_indices;
+
+    for (unsigned int i = 0; i < header.num_frames; ++i)
+    {
+        VBM_FRAME_HEADER frame;
+        memcpy(&frame, frames + i * sizeof(VBM_FRAME_HEADER), sizeof(frame));
+
+        if ((unsigned long long)frame.first + frame.count > limit)
+            return Fail(error, "frame range is out of bounds");
+
+        unsigned int primitive = frame.flags & VBM_FRAME_PRIMITIVE_MASK;
+        if (primitive != VBM_FRAME_TRIANGLES &&
+            !(primitive == VBM_FRAME_TRIANGLE_STRIP && header.num_indices))
+            return Fail(error, "unsupported frame primitive");
+    }
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM
+//
+// Purpose: Validates a VBM file that is entirely in memory.
+//
+// INPUTS: data    - the file contents
+//         size    - the length of data in bytes
+//         options - VBM_VALIDATE_* flags
+//         layout  - receives the section offsets and sizes
+//         error   - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the file is malformed.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM(const void *data, size_t size, unsigned int options,
+                 VBM_LAYOUT *layout, const char **error)
+{
+    VBM_HEADER header;
+
+    if (data == NULL || size < sizeof(VBM_HEADER))
+        return Fail(error, "file is smaller than the VBM header");
+
+    memcpy(&header, data, sizeof(VBM_HEADER));
+
+    if (!ValidateVBMHeader(header, size, options, layout, error))
+        return false;
+
+    return ValidateVBMTables(data, layout, error);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Header
+//
+// Purpose: Checks the fixed header of a VBM2 file against the length of the
+//          file.
+//
+// INPUTS: header    - the first sizeof(VBM2_HEADER) bytes of the file
+//         file_size - the length of the whole file in bytes
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the chunk table does not fit in the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Header(const VBM2_HEADER& header, unsigned long long file_size,
+                        const char **error)
+{
+    if (file_size < sizeof(VBM2_HEADER))
+        return Fail(error, "file is smaller than the VBM2 header");
+
+    if (header.magic != VBM2_MAGIC)
+        return Fail(error, "bad magic (expected VBM2)");
+
+    if (header.version != VBM2_VERSION)
+        return Fail(error, "unsupported VBM2 version");
+
+    if (header.size < sizeof(VBM2_HEADER) || header.size > file_size)
+        return Fail(error, "bad header size");
+
+    if (header.num_chunks == 0)
+        return Fail(error, "no chunks");
+
+    unsigned long long table_size = (unsigned long long)header.num_chunks * sizeof(VBM2_CHUNK);
+    if (header.chunk_table_offset < header.size ||
+        header.chunk_table_offset > file_size ||
+        table_size > file_size - header.chunk_table_offset)
+        return Fail(error, "chunk table reaches past the end of the file");
+
+    if (header.image_size < sizeof(VBM_HEADER))
+        return Fail(error, "image is smaller than the VBM header");
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Chunks
+//
+// Purpose: Checks the chunk table of a VBM2 file.
+//
+// INPUTS: header    - a header accepted by ValidateVBM2Header
+//         chunks    - the header.num_chunks entries of the chunk table
+//         file_size - the length of the whole file in bytes
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if a chunk lies outside the file, is misaligned,
+//          uses an unknown codec or filter, claims to decode to more than
+//          its codec can produce, or the image chunks do not cover the
+//          image exactly once.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Chunks(const VBM2_HEADER& header, const VBM2_CHUNK *chunks,
+                        unsigned long long file_size, const char **error)
+{
+    unsigned long long image_end = 0;
+    bool image = true;
+
+    for (unsigned int i = 0; i < header.num_chunks; ++i)
+    {
+        const VBM2_CHUNK& chunk = chunks[i];
+
+        if (chunk.offset % VBM2_ALIGNMENT)
+            return Fail(error, "chunk is not aligned");
+
+        if (chunk.offset < header.size ||
+            chunk.offset > file_size ||
+            chunk.stored_size > file_size - chunk.offset)
+            return Fail(error, "chunk reaches past the end of the file");
+
+        if (chunk.raw_size == 0 || chunk.raw_size > VBM2_MAX_CHUNK_SIZE)
+            return Fail(error, "bad chunk size");
+
+        switch (chunk.codec)
+        {
+        case VBM2_CODEC_NONE:
+            if (chunk.stored_size != chunk.raw_size)
+                return Fail(error, "stored chunk size does not match");
+            break;
+        case VBM2_CODEC_LZ4:
+            // Otherwise a tiny file could declare an image of gigabytes,
+            // which the loader allocates before decoding anything
+            if (chunk.raw_size > VBM2_LZ4_MAX_RAW_SIZE(chunk.stored_size))
+                return Fail(error, "chunk expands more than LZ4 can");
+            break;
+        default:
+            return Fail(error, "unsupported chunk codec");
+        }
+
+        if (chunk.filter > VBM2_FILTER_DELTA)
+            return Fail(error, "unsupported chunk filter");
+
+        if (chunk.filter != VBM2_FILTER_NONE &&
+            (chunk.element_size == 0 || chunk.element_size > 16 ||
+             chunk.raw_size % chunk.element_size))
+            return Fail(error, "bad filter element size");
+
+        if (chunk.type == VBM2_CHUNK_IMAGE)
+        {
+            if (!image)
+                return Fail(error, "image chunk after data chunks");
+            if (chunk.raw_offset != image_end)
+                return Fail(error, "image chunks do not cover the image");
+            image_end += chunk.raw_size;
+            if (image_end > header.image_size)
+                return Fail(error, "image chunk reaches past the end of the image");
+        }
+        else
+        {
+            if (chunk.type != VBM2_CHUNK_BOUNDS && chunk.type != VBM2_CHUNK_MESHLETS)
+                return Fail(error, "unsupported chunk type");
+            image = false;
+        }
+    }
+
+    if (image_end != header.image_size)
+        return Fail(error, "image chunks do not cover the image");
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Image
+//
+// Purpose: Checks that the image chunks line up with the sections of the
+//          image, so each one can be decoded straight into its buffer.
+//
+// INPUTS: header - a validated VBM2 header
+//         chunks - the validated chunk table
+//         layout - the layout of the image, from ValidateVBMTables
+//         error  - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the first chunk is not exactly the header
+//          tables, a chunk straddles two sections or the image has trailing
+//          bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Image(const VBM2_HEADER& header, const VBM2_CHUNK *chunks,
+                       const VBM_LAYOUT& layout, const char **error)
+{
+    if (chunks[0].raw_size != layout.tables_size)
+        return Fail(error, "first chunk does not hold the header tables");
+
+    unsigned long long vertex_end = layout.vertex_data_offset + layout.vertex_data_size;
+    unsigned long long index_end = layout.index_data_offset + layout.index_data_size;
+
+    if (header.image_size != index_end)
+        return Fail(error, "image size does not match its sections");
+
+    for (unsigned int i = 1; i < header.num_chunks && chunks[i].type == VBM2_CHUNK_IMAGE; ++i)
+    {
+        unsigned long long first = chunks[i].raw_offset;
+        unsigned long long last = first + chunks[i].raw_size;
+
+        if (!(last <= vertex_end || first >= layout.index_data_offset))
+            return Fail(error, "chunk straddles the vertex and index data");
+    }
+
+    return true;
+}
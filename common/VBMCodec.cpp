@@ -0,0 +1,477 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBMCodec.cpp
+//
+// Purpose: This file contains the definition of the VBM2 chunk codecs.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include <atomic>
+#include <fstream>
+#include "JobSystem.h"
+#include "VBMCodec.h"
+
+// LZ4 block format limits: a match is at least 4 bytes, the last 5 bytes
+// are always literals and the last match starts at least 12 bytes before
+// the end of the block
+static const size_t LZ4_MIN_MATCH = 4;
+static const size_t LZ4_LAST_LITERALS = 5;
+static const size_t LZ4_MATCH_LIMIT = 12;
+static const size_t LZ4_MAX_OFFSET = 65535;
+static const unsigned int LZ4_HASH_BITS = 16;
+
+// Image chunks decoded by each job before another job is worth it
+static const unsigned int VBM2_CHUNKS_PER_JOB = 2;
+
+
+static unsigned int Read32(const unsigned char *p)
+{
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned int Hash32(unsigned int value)
+{
+    return (value * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static unsigned char *WriteLength(unsigned char *op, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4CompressBound
+//
+// Purpose: Returns the largest size LZ4Compress can produce for an input.
+//
+// INPUTS: size - the length of the input in bytes
+//
+// OUTPUTS: The worst case compressed size.
+//
+///////////////////////////////////////////////////////////////////////////////
+size_t LZ4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4Compress
+//
+// Purpose: Compresses a block into the LZ4 block format with a greedy
+//          single-probe hash table, the same trade-off as the reference
+//          fast compressor.
+//
+// INPUTS: src      - the data to compress
+//         size     - the length of src in bytes
+//         dst      - receives the compressed block
+//         capacity - the length of dst, at least LZ4CompressBound(size)
+//
+// OUTPUTS: The length of the compressed block, or 0 if dst is too small.
+//
+///////////////////////////////////////////////////////////////////////////////
+size_t LZ4Compress(const void *src, size_t size, void *dst, size_t capacity)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned char *oend = op + capacity;
+    size_t anchor = 0;
+
+    if (size > LZ4_MATCH_LIMIT)
+    {
+        std::vector<unsigned int> table((size_t)1 << LZ4_HASH_BITS, 0xFFFFFFFF);
+        size_t limit = size - LZ4_MATCH_LIMIT;
+        size_t match_end_limit = size - LZ4_LAST_LITERALS;
+        size_t i = 0;
+
+        while (i < limit)
+        {
+            unsigned int sequence = Read32(in + i);
+            unsigned int h = Hash32(sequence);
+            size_t candidate = table[h];
+            table[h] = (unsigned int)i;
+
+            if (candidate == 0xFFFFFFFF || i - candidate > LZ4_MAX_OFFSET ||
+                Read32(in + candidate) != sequence)
+            {
+                ++i;
+                continue;
+            }
+
+            size_t end = i + LZ4_MIN_MATCH;
+            while (end < match_end_limit && in[end] == in[candidate + end - i])
+                ++end;
+
+            size_t literals = i - anchor;
+            size_t match = end - i - LZ4_MIN_MATCH;
+            if ((size_t)(oend - op) < 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1)
+                return 0;
+
+            unsigned char *token = op++;
+            *token = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15));
+            if (literals >= 15)
+                op = WriteLength(op, literals - 15);
+            memcpy(op, in + anchor, literals);
+            op += literals;
+
+            size_t offset = i - candidate;
+            *op++ = (unsigned char)(offset & 0xFF);
+            *op++ = (unsigned char)(offset >> 8);
+            if (match >= 15)
+                op = WriteLength(op, match - 15);
+
+            i = anchor = end;
+        }
+    }
+
+    // The block always ends with a literal-only sequence
+    size_t literals = size - anchor;
+    if ((size_t)(oend - op) < 1 + literals / 255 + 1 + literals)
+        return 0;
+
+    *op++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        op = WriteLength(op, literals - 15);
+    memcpy(op, in + anchor, literals);
+    op += literals;
+
+    return (size_t)(op - (unsigned char *)dst);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4Decompress
+//
+// Purpose: Decompresses an LZ4 block. Every length and match offset is
+//          checked, so corrupt input cannot read or write out of bounds.
+//
+// INPUTS: src      - the compressed block
+//         size     - the length of src in bytes
+//         dst      - receives the data
+//         raw_size - the exact length of the decompressed data
+//
+// OUTPUTS: Returns false if the block is corrupt or does not decompress to
+//          exactly raw_size bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LZ4Decompress(const void *src, size_t size, void *dst, size_t raw_size)
+{
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + size;
+    unsigned char *out = (unsigned char *)dst;
+    size_t op = 0;
+
+    while (ip < iend)
+    {
+        unsigned int token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            unsigned int extra;
+            do
+            {
+                if (ip == iend)
+                    return false;
+                extra = *ip++;
+                literals += extra;
+            } while (extra == 255);
+        }
+
+        if (literals > (size_t)(iend - ip) || literals > raw_size - op)
+            return false;
+        memcpy(out + op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // The last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+
+        size_t match = token & 15;
+        if (match == 15)
+        {
+            unsigned int extra;
+            do
+            {
+                if (ip == iend)
+                    return false;
+                extra = *ip++;
+                match += extra;
+            } while (extra == 255);
+        }
+        match += LZ4_MIN_MATCH;
+
+        if (match > raw_size - op)
+            return false;
+
+        // Matches may overlap their own output, so copy forwards bytewise
+        // unless the source is far enough behind
+        const unsigned char *from = out + op - offset;
+        if (offset >= match)
+        {
+            memcpy(out + op, from, match);
+        }
+        else
+        {
+            for (size_t i = 0; i < match; ++i)
+                out[op + i] = from[i];
+        }
+        op += match;
+    }
+
+    return op == raw_size;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ApplyFilter / UndoFilter
+//
+// Purpose: The shuffle filter groups the first bytes of every element, then
+//          the second bytes, and so on; the exponents and high bytes of
+//          floats and indices then sit next to each other and repeat. The
+//          delta filter also replaces each shuffled byte with its difference
+//          from the previous byte of the same group.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void ApplyFilter(unsigned int filter, unsigned int element_size,
+                        const unsigned char *src, unsigned char *dst, size_t size)
+{
+    size_t count = size / element_size;
+
+    for (unsigned int b = 0; b < element_size; ++b)
+    {
+        unsigned char *plane = dst + b * count;
+        unsigned char previous = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            unsigned char value = src[i * element_size + b];
+            plane[i] = filter == VBM2_FILTER_DELTA ? (unsigned char)(value - previous) : value;
+            previous = value;
+        }
+    }
+}
+
+static void UndoFilter(unsigned int filter, unsigned int element_size,
+                       const unsigned char *src, unsigned char *dst, size_t size)
+{
+    size_t count = size / element_size;
+
+    for (unsigned int b = 0; b < element_size; ++b)
+    {
+        const unsigned char *plane = src + b * count;
+        unsigned char value = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            value = filter == VBM2_FILTER_DELTA ? (unsigned char)(value + plane[i]) : plane[i];
+            dst[i * element_size + b] = value;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: EncodeVBM2Chunk
+//
+// Purpose: Filters and compresses one chunk, keeping whichever filter gives
+//          the smallest result, or storing it as-is if nothing helps.
+//
+// INPUTS: chunk  - type, raw_offset, raw_size and element_size are set by
+//                  the caller; codec, filter and stored_size are filled in
+//         raw    - the chunk data
+//         stored - receives the bytes to write to the file
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void EncodeVBM2Chunk(VBM2_CHUNK& chunk, const void *raw, std::vector<unsigned char>& stored)
+{
+    size_t size = (size_t)chunk.raw_size;
+    std::vector<unsigned char> filtered(size);
+    std::vector<unsigned char> compressed(LZ4CompressBound(size));
+
+    // Start with the chunk stored as-is
+    stored.assign((const unsigned char *)raw, (const unsigned char *)raw + size);
+    chunk.codec = VBM2_CODEC_NONE;
+    chunk.filter = VBM2_FILTER_NONE;
+
+    bool filterable = chunk.element_size > 0 && chunk.element_size <= 16 &&
+                      size % chunk.element_size == 0;
+    unsigned int last_filter = filterable ? VBM2_FILTER_DELTA : VBM2_FILTER_NONE;
+
+    for (unsigned int filter = VBM2_FILTER_NONE; filter <= last_filter; ++filter)
+    {
+        const unsigned char *input = (const unsigned char *)raw;
+        if (filter != VBM2_FILTER_NONE)
+        {
+            ApplyFilter(filter, chunk.element_size, input, &filtered[0], size);
+            input = &filtered[0];
+        }
+
+        size_t length = LZ4Compress(input, size, &compressed[0], compressed.size());
+        if (length && length < stored.size())
+        {
+            stored.assign(compressed.begin(), compressed.begin() + length);
+            chunk.codec = VBM2_CODEC_LZ4;
+            chunk.filter = (unsigned short)filter;
+        }
+    }
+
+    chunk.stored_size = stored.size();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: DecodeVBM2Chunk
+//
+// Purpose: Decompresses one validated chunk and undoes its filter.
+//
+// INPUTS: chunk   - the chunk table entry
+//         stored  - the chunk.stored_size bytes read from the file
+//         raw     - receives chunk.raw_size bytes
+//         scratch - working memory, grown as needed
+//
+// OUTPUTS: Returns false if the chunk data is corrupt.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool DecodeVBM2Chunk(const VBM2_CHUNK& chunk, const void *stored, void *raw,
+                     std::vector<unsigned char>& scratch)
+{
+    size_t size = (size_t)chunk.raw_size;
+    unsigned char *target = (unsigned char *)raw;
+
+    if (chunk.filter != VBM2_FILTER_NONE)
+    {
+        if (scratch.size() < size)
+            scratch.resize(size);
+        target = &scratch[0];
+    }
+
+    if (chunk.codec == VBM2_CODEC_LZ4)
+    {
+        if (!LZ4Decompress(stored, (size_t)chunk.stored_size, target, size))
+            return false;
+    }
+    else
+    {
+        memcpy(target, stored, size);
+    }
+
+    if (chunk.filter != VBM2_FILTER_NONE)
+        UndoFilter(chunk.filter, chunk.element_size, target, (unsigned char *)raw, size);
+
+    return true;
+}
+
+
+
+// What the jobs of ReadVBM2Range share
+struct VBM2RangeRead
+{
+    const char *filename;
+    const VBM2_CHUNK *chunks;
+    const unsigned int *work;
+    unsigned long long offset;
+    void *dest;
+    std::atomic<bool> ok;
+};
+
+// Decodes work[first, end) through a file handle of its own, so only one
+// compressed chunk per job is held in memory
+static void ReadVBM2Chunks(void *user, unsigned int first, unsigned int end)
+{
+    VBM2RangeRead *read = (VBM2RangeRead *)user;
+    std::ifstream f(read->filename, std::ios::binary);
+    std::vector<unsigned char> stored;
+    std::vector<unsigned char> scratch;
+
+    if (!f)
+    {
+        read->ok = false;
+        return;
+    }
+
+    for (unsigned int n = first; n < end && read->ok; ++n)
+    {
+        const VBM2_CHUNK& chunk = read->chunks[read->work[n]];
+
+        stored.resize((size_t)chunk.stored_size);
+        f.seekg((std::streamoff)chunk.offset, f.beg);
+        if (!f.read((char *)stored.data(), (std::streamsize)stored.size()) ||
+            !DecodeVBM2Chunk(chunk, stored.data(),
+                             (unsigned char *)read->dest + (chunk.raw_offset - read->offset), scratch))
+        {
+            read->ok = false;
+            return;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ReadVBM2Range
+//
+// Purpose: Decodes every image chunk inside a range of the image, spreading
+//          the chunks over the threads of a JobSystem.
+//
+// INPUTS: filename   - the VBM2 file
+//         chunks     - the validated chunk table
+//         num_chunks - the number of entries in chunks
+//         offset     - the start of the range in the image
+//         size       - the length of the range
+//         dest       - receives the decoded range
+//         jobs       - the system to decode on, or NULL for
+//                      JobSystem::Shared()
+//
+// OUTPUTS: Returns false if a chunk could not be read or decoded.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ReadVBM2Range(const char *filename, const VBM2_CHUNK *chunks, unsigned int num_chunks,
+                   unsigned long long offset, unsigned long long size, void *dest,
+                   JobSystem *jobs)
+{
+    std::vector<unsigned int> work;
+    for (unsigned int i = 0; i < num_chunks && chunks[i].type == VBM2_CHUNK_IMAGE; ++i)
+    {
+        if (chunks[i].raw_offset >= offset &&
+            chunks[i].raw_offset + chunks[i].raw_size <= offset + size)
+            work.push_back(i);
+    }
+
+    if (work.empty())
+        return true;
+
+    VBM2RangeRead read;
+    read.filename = filename;
+    read.chunks = chunks;
+    read.work = &work[0];
+    read.offset = offset;
+    read.dest = dest;
+    read.ok = true;
+
+    if (!jobs)
+        jobs = &JobSystem::Shared();
+    jobs->ParallelFor((unsigned int)work.size(), ReadVBM2Chunks, &read, VBM2_CHUNKS_PER_JOB);
+
+    return read.ok;
+}
@@ -1,5 +1,13 @@
 #include <GL/glew.h>
 #include <fstream>
+#include <iostream>
+#include <string.h>
+#include <vector>
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "Profiler.h"
+#include "Stripifier.h"
+#include "VBMCodec.h"
 #include "VBObject.h"
 
 
@@ -7,10 +15,22 @@ VBObject::VBObject(void)
     : m_vao(0),
       m_attribute_buffer(0),
       m_index_buffer(0),
+      m_index_type(0),
+      m_index_size(0),
+      m_has_bounds(false),
+      m_shared(false),
+      m_buffer_size(0),
+      m_arena(0),
+      m_vertex_base(0),
+      m_index_base(0),
+      m_source(0),
       m_header(0),
       m_attrib(0),
       m_frame(0)
 {
+    memset(&m_vertex_alloc, 0, sizeof(m_vertex_alloc));
+    memset(&m_index_alloc, 0, sizeof(m_index_alloc));
+    m_locations[0] = m_locations[1] = m_locations[2] = -1;
 }
 
 
@@ -35,32 +55,319 @@ const char * VBObject::GetAttributeName(unsigned int index) const
     return index < m_header->num_attribs ? m_attrib[index].name : 0;
 }
 
+bool VBObject::GetBounds(VBM_BOUNDS& bounds) const
+{
+    if (m_has_bounds)
+        bounds = m_bounds;
+    return m_has_bounds;
+}
+
 void VBObject::BindVertexArray()
 {
-    glBindVertexArray(m_vao);
+    GLStateCache::Current().BindVertexArray(m_vao);
+}
+
+// Replaces every triangle list frame with restart-separated strips when
+// that needs fewer indices. Frames are repacked one after another.
+static void StripifyFrames(std::vector<GLuint>& indices, VBM_FRAME_HEADER *frames, unsigned int num_frames)
+{
+    std::vector<GLuint> packed;
+    std::vector<unsigned int> strip;
+
+    packed.reserve(indices.size());
+    for (unsigned int i = 0; i < num_frames; ++i)
+    {
+        VBM_FRAME_HEADER& frame = frames[i];
+        const GLuint *first = &indices[0] + frame.first;
+        STRIP_STATS stats;
+
+        frame.first = (unsigned int)packed.size();
+        if ((frame.flags & VBM_FRAME_PRIMITIVE_MASK) == VBM_FRAME_TRIANGLES &&
+            Stripify(first, frame.count, 0xFFFFFFFF, strip, &stats))
+        {
+#ifdef _DEBUG
+            std::cerr << "Frame " << i << ": " << stats.triangles << " triangles in "
+                      << stats.strips << " strips, " << stats.list_indices << " -> "
+                      << stats.strip_indices << " indices, ACMR " << stats.list_acmr
+                      << " -> " << stats.strip_acmr << std::endl;
+#endif /* DEBUG */
+            packed.insert(packed.end(), strip.begin(), strip.end());
+            frame.count = (unsigned int)strip.size();
+            frame.flags = (frame.flags & ~VBM_FRAME_PRIMITIVE_MASK) | VBM_FRAME_TRIANGLE_STRIP;
+        }
+        else
+        {
+            packed.insert(packed.end(), first, first + frame.count);
+        }
+    }
+
+    indices.swap(packed);
+}
+
+// Reads and validates the header tables of an SBM1 file.
+static bool ReadVBMTables(std::ifstream& f, unsigned long long file_size,
+                          std::vector<char>& tables, VBM_LAYOUT *layout, const char **error)
+{
+    VBM_HEADER header;
+
+    *error = "file is smaller than the VBM header";
+    if (file_size < sizeof(VBM_HEADER) ||
+        !f.read((char *)&header, sizeof(VBM_HEADER)) ||
+        !ValidateVBMHeader(header, file_size, 0, layout, error))
+        return false;
+
+    tables.resize((size_t)layout->tables_size);
+    f.seekg(0, f.beg);
+    return f.read(&tables[0], tables.size()) &&
+           ValidateVBMTables(&tables[0], layout, error);
+}
+
+// Reads and validates the chunk table of a VBM2 file and decodes its first
+// chunk, which holds the header tables of the SBM1 image. The layout then
+// describes the image rather than the file.
+static bool ReadVBM2Tables(std::ifstream& f, unsigned long long file_size,
+                           std::vector<VBM2_CHUNK>& chunks, std::vector<char>& tables,
+                           VBM_LAYOUT *layout, const char **error)
+{
+    VBM2_HEADER header;
+
+    *error = "file is smaller than the VBM2 header";
+    if (file_size < sizeof(VBM2_HEADER) ||
+        !f.read((char *)&header, sizeof(VBM2_HEADER)) ||
+        !ValidateVBM2Header(header, file_size, error))
+        return false;
+
+    chunks.resize(header.num_chunks);
+    f.seekg((std::streamoff)header.chunk_table_offset, f.beg);
+    if (!f.read((char *)&chunks[0], chunks.size() * sizeof(VBM2_CHUNK)) ||
+        !ValidateVBM2Chunks(header, &chunks[0], file_size, error))
+        return false;
+
+    const VBM2_CHUNK& first = chunks[0];
+    std::vector<char> stored((size_t)first.stored_size);
+    std::vector<unsigned char> scratch;
+
+    *error = "cannot decode the header tables";
+    tables.resize((size_t)first.raw_size);
+    f.seekg((std::streamoff)first.offset, f.beg);
+    if (first.raw_size < sizeof(VBM_HEADER) ||
+        !f.read(stored.data(), stored.size()) ||
+        !DecodeVBM2Chunk(first, stored.data(), &tables[0], scratch))
+        return false;
+
+    VBM_HEADER image;
+    memcpy(&image, &tables[0], sizeof(VBM_HEADER));
+    if (!ValidateVBMHeader(image, header.image_size, 0, layout, error))
+        return false;
+
+    *error = "first chunk does not hold the header tables";
+    return layout->tables_size == tables.size() &&
+           ValidateVBMTables(&tables[0], layout, error) &&
+           ValidateVBM2Image(header, &chunks[0], *layout, error);
+}
+
+// Reads a section of the SBM1 image: straight from an SBM1 file, or by
+// decoding the chunks of a VBM2 file in parallel.
+static bool ReadSection(std::ifstream& f, const char * filename, const std::vector<VBM2_CHUNK>& chunks,
+                        unsigned long long offset, unsigned long long size, void *dest)
+{
+    if (chunks.empty())
+    {
+        f.seekg((std::streamoff)offset, f.beg);
+        return (bool)f.read((char *)dest, (std::streamsize)size);
+    }
+
+    return ReadVBM2Range(filename, &chunks[0], (unsigned int)chunks.size(), offset, size, dest);
+}
+
+// Loads the optional bounds chunk of a VBM2 file.
+static bool ReadVBM2Bounds(std::ifstream& f, const std::vector<VBM2_CHUNK>& chunks, VBM_BOUNDS *bounds)
+{
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        const VBM2_CHUNK& chunk = chunks[i];
+        if (chunk.type != VBM2_CHUNK_BOUNDS || chunk.raw_size != sizeof(VBM_BOUNDS))
+            continue;
+
+        std::vector<char> stored((size_t)chunk.stored_size);
+        std::vector<unsigned char> scratch;
+        f.seekg((std::streamoff)chunk.offset, f.beg);
+        return f.read(stored.data(), stored.size()) &&
+               DecodeVBM2Chunk(chunk, stored.data(), bounds, scratch);
+    }
+
+    return false;
 }
 
-bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalIndex, int texCoord0Index)
+bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalIndex, int texCoord0Index, unsigned int flags)
 {
+    PROFILE_ZONE("VBObject::LoadFromVBM");
     std::ifstream f(filename, std::ios::binary);
 
     if (!f) return false;
 
+    Free();
+
+    f.seekg(0, f.end);
+    unsigned long long file_size = (unsigned long long)f.tellg();
+    f.seekg(0, f.beg);
+
+    unsigned int magic = 0;
+    f.read((char *)&magic, sizeof(magic));
+    f.clear();
+    f.seekg(0, f.beg);
+
+    // Nothing is allocated until every count in the header tables has been
+    // checked against the length of the file. For VBM2 files the layout
+    // describes the decoded image.
+    VBM_LAYOUT layout;
+    std::vector<char> tables;
+    std::vector<VBM2_CHUNK> chunks;
+    const char *error = 0;
+
+    bool valid = magic == VBM2_MAGIC ?
+                 ReadVBM2Tables(f, file_size, chunks, tables, &layout, &error) :
+                 ReadVBMTables(f, file_size, tables, &layout, &error);
+    if (!valid)
+    {
+#ifdef _DEBUG
+        std::cerr << "Invalid VBM file '" << filename << "': " << error << std::endl;
+#endif /* DEBUG */
+        return false;
+    }
+
+    VBM_HEADER header;
+    memcpy(&header, &tables[0], sizeof(VBM_HEADER));
+
+    m_has_bounds = !chunks.empty() && ReadVBM2Bounds(f, chunks, &m_bounds);
+
     m_header = new VBM_HEADER;
-    f.read((char *)m_header, sizeof(VBM_HEADER));
+    memcpy(m_header, &header, sizeof(VBM_HEADER));
 
     m_attrib = new VBM_ATTRIB_HEADER[m_header->num_attribs];
-    f.read((char *)m_attrib, m_header->num_attribs * sizeof(VBM_ATTRIB_HEADER));
+    memcpy(m_attrib, &tables[m_header->size], m_header->num_attribs * sizeof(VBM_ATTRIB_HEADER));
 
     m_frame = new VBM_FRAME_HEADER[m_header->num_frames];
-    f.read((char *)m_frame, m_header->num_frames * sizeof(VBM_FRAME_HEADER));
+    memcpy(m_frame, &tables[m_header->size + m_header->num_attribs * sizeof(VBM_ATTRIB_HEADER)],
+           m_header->num_frames * sizeof(VBM_FRAME_HEADER));
+
+    for (unsigned int i = 0; i < m_header->num_attribs; ++i)
+        m_attrib_offset[i] = layout.attrib_offset[i] - layout.vertex_data_offset;
 
     glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
-    glGenBuffers(1, &m_attribute_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_attribute_buffer);
+    GLStateCache::Current().BindVertexArray(m_vao);
+
+    // Data sections are read exactly where the layout says they are, so a
+    // header with a larger 'size' field is handled correctly.
+    bool read = CreateStorage(GL_ARRAY_BUFFER, layout.vertex_data_size, m_vertex_alloc,
+                              m_attribute_buffer, m_vertex_base);
+    if (read)
+    {
+        char *buf = (char *)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)m_vertex_base,
+                                             (GLsizeiptr)layout.vertex_data_size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        read = buf && ReadSection(f, filename, chunks, layout.vertex_data_offset, layout.vertex_data_size, buf);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        SetupAttributes(vertexIndex, normalIndex, texCoord0Index);
+    }
+
+    if (read && m_header->num_indices)
+    {
+        m_index_type = m_header->index_type;
+        m_index_size = layout.index_size;
+
+        if (flags & (VBO_LOAD_COMPACT_INDICES | VBO_LOAD_STRIPIFY))
+        {
+            // Work on 32-bit indices, whatever is stored in the file
+            std::vector<GLuint> indices(m_header->num_indices);
+            if (m_index_type == GL_UNSIGNED_SHORT)
+            {
+                std::vector<GLushort> stored(m_header->num_indices);
+                read = read && ReadSection(f, filename, chunks, layout.index_data_offset,
+                                           layout.index_data_size, &stored[0]);
+                for (unsigned int i = 0; i < m_header->num_indices; ++i)
+                    indices[i] = (stored[i] == 0xFFFF && m_header->num_vertices <= 0xFFFF) ?
+                                 0xFFFFFFFF : stored[i];
+            }
+            else
+            {
+                read = read && ReadSection(f, filename, chunks, layout.index_data_offset,
+                                           layout.index_data_size, &indices[0]);
+            }
+
+            if (flags & VBO_LOAD_STRIPIFY)
+                StripifyFrames(indices, m_frame, m_header->num_frames);
+
+            read = read && UploadIndices(indices, (flags & VBO_LOAD_COMPACT_INDICES) ||
+                                                  m_index_type == GL_UNSIGNED_SHORT);
+        }
+        else if (CreateStorage(GL_ELEMENT_ARRAY_BUFFER, layout.index_data_size, m_index_alloc,
+                               m_index_buffer, m_index_base))
+        {
+            char *buf = (char *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)m_index_base,
+                                                 (GLsizeiptr)layout.index_data_size,
+                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            read = buf && ReadSection(f, filename, chunks, layout.index_data_offset,
+                                      layout.index_data_size, buf);
+            glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        else
+        {
+            read = false;
+        }
+    }
+
+    f.close();
+    GLStateCache::Current().BindVertexArray(0);
+
+    m_buffer_size = layout.vertex_data_size + (unsigned long long)m_header->num_indices * m_index_size;
+
+    if (!read)
+    {
+#ifdef _DEBUG
+        std::cerr << "Cannot read VBM file '" << filename << "'" << std::endl;
+#endif /* DEBUG */
+        Free();
+        return false;
+    }
+
+    return true;
+}
+
+// Creates the storage for one buffer, either a buffer object of its own
+// or a range of an arena page, and binds it to 'target'.
+bool VBObject::CreateStorage(GLenum target, unsigned long long size, GPU_ALLOCATION& allocation,
+                             unsigned int& buffer, unsigned long long& base)
+{
+    if (m_arena)
+    {
+        if (!m_arena->Allocate(size, allocation, Relocate, this))
+            return false;
+        buffer = allocation.buffer;
+        base = allocation.offset;
+        GLStateCache::Current().BindBuffer(target, buffer);
+    }
+    else
+    {
+        glGenBuffers(1, &buffer);
+        GLStateCache::Current().BindBuffer(target, buffer);
+        glBufferData(target, (GLsizeiptr)size, NULL, GL_STATIC_DRAW);
+        base = 0;
+    }
+
+    return true;
+}
+
+// Points the attributes of the bound vertex array object at the vertex
+// buffer, remapping the first three attributes to the given locations.
+void VBObject::SetupAttributes(int vertexIndex, int normalIndex, int texCoord0Index)
+{
+    m_locations[0] = vertexIndex;
+    m_locations[1] = normalIndex;
+    m_locations[2] = texCoord0Index;
+
+    GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, m_attribute_buffer);
 
-    unsigned int total_data_size = 0;
     for (unsigned int i = 0; i < m_header->num_attribs; ++i) 
     {
         int attribIndex = i;
@@ -72,50 +379,191 @@ bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalInd
          else if(attribIndex == 2)
             attribIndex = texCoord0Index;
 
-        glVertexAttribPointer(attribIndex, m_attrib[i].components, m_attrib[i].type, GL_FALSE, 0, (GLvoid *)total_data_size);
+        if (attribIndex < 0)
+            continue;
+
+        GLboolean normalized = (m_attrib[i].flags & VBM_ATTRIB_NORMALIZED) ? GL_TRUE : GL_FALSE;
+        glVertexAttribPointer(attribIndex, m_attrib[i].components, m_attrib[i].type, normalized, 0,
+                              (GLvoid *)(GLintptr)(m_vertex_base + m_attrib_offset[i]));
         glEnableVertexAttribArray(attribIndex);
-        total_data_size += m_attrib[i].components * sizeof(GLfloat) * m_header->num_vertices;
     }
+}
+
+bool VBObject::Share(const VBObject& source, int vertexIndex, int normalIndex, int texCoord0Index)
+{
+    if (!source.m_header)
+        return false;
 
-    glBufferData(GL_ARRAY_BUFFER, total_data_size, NULL, GL_STATIC_DRAW);
-    char *buf = (char *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    f.read(buf, total_data_size);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    Free();
+
+    m_header = new VBM_HEADER;
+    memcpy(m_header, source.m_header, sizeof(VBM_HEADER));
+
+    m_attrib = new VBM_ATTRIB_HEADER[m_header->num_attribs];
+    memcpy(m_attrib, source.m_attrib, m_header->num_attribs * sizeof(VBM_ATTRIB_HEADER));
+
+    m_frame = new VBM_FRAME_HEADER[m_header->num_frames];
+    memcpy(m_frame, source.m_frame, m_header->num_frames * sizeof(VBM_FRAME_HEADER));
+
+    memcpy(m_attrib_offset, source.m_attrib_offset, sizeof(m_attrib_offset));
+    m_attribute_buffer = source.m_attribute_buffer;
+    m_index_buffer = source.m_index_buffer;
+    m_index_type = source.m_index_type;
+    m_index_size = source.m_index_size;
+    m_has_bounds = source.m_has_bounds;
+    m_bounds = source.m_bounds;
+    m_buffer_size = source.m_buffer_size;
+    m_vertex_base = source.m_vertex_base;
+    m_index_base = source.m_index_base;
+    m_shared = true;
+    m_source = &source;
+    source.m_sharers.push_back(this);
+
+    glGenVertexArrays(1, &m_vao);
+    GLStateCache::Current().BindVertexArray(m_vao);
+    SetupAttributes(vertexIndex, normalIndex, texCoord0Index);
+    if (m_index_buffer)
+        GLStateCache::Current().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    GLStateCache::Current().BindVertexArray(0);
 
-    if (m_header->num_indices) 
+    return true;
+}
+
+// Re-points the vertex array object after the arena has moved the storage.
+void VBObject::Rebind(void)
+{
+    GLStateCache::Current().BindVertexArray(m_vao);
+    SetupAttributes(m_locations[0], m_locations[1], m_locations[2]);
+    if (m_index_buffer)
+        GLStateCache::Current().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    GLStateCache::Current().BindVertexArray(0);
+}
+
+// Called by GPUArena::Defragment for each of the two ranges of an owner.
+void VBObject::Relocate(void *user, const GPU_ALLOCATION& from, const GPU_ALLOCATION& to)
+{
+    VBObject *self = (VBObject *)user;
+
+    if (from.buffer == self->m_vertex_alloc.buffer && from.block == self->m_vertex_alloc.block)
     {
-        glGenBuffers(1, &m_index_buffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
-        unsigned int element_size;
-        switch (m_header->index_type) 
+        self->m_vertex_alloc = to;
+        self->m_attribute_buffer = to.buffer;
+        self->m_vertex_base = to.offset;
+    }
+    else
+    {
+        self->m_index_alloc = to;
+        self->m_index_buffer = to.buffer;
+        self->m_index_base = to.offset;
+    }
+
+    self->Rebind();
+    for (size_t i = 0; i < self->m_sharers.size(); ++i)
+    {
+        VBObject *sharer = self->m_sharers[i];
+        sharer->m_attribute_buffer = self->m_attribute_buffer;
+        sharer->m_vertex_base = self->m_vertex_base;
+        sharer->m_index_buffer = self->m_index_buffer;
+        sharer->m_index_base = self->m_index_base;
+        sharer->Rebind();
+    }
+}
+
+// Uploads 32-bit indices to a new element array buffer, as 16-bit
+// indices if 'narrow' is set and every index fits below the 0xFFFF restart
+// index. 0xFFFFFFFF restart indices become 0xFFFF.
+bool VBObject::UploadIndices(const std::vector<GLuint>& indices, bool narrow)
+{
+    m_header->num_indices = (unsigned int)indices.size();
+
+    std::vector<GLushort> narrowed;
+    if (narrow && m_header->num_vertices < 0xFFFF)
+    {
+        narrowed.resize(indices.size());
+        for (size_t i = 0; i < indices.size() && narrow; ++i)
         {
-            case GL_UNSIGNED_SHORT:
-                element_size = sizeof(GLushort);
-                break;
-            default:
-                element_size = sizeof(GLuint);
-                break;
+            if (indices[i] == 0xFFFFFFFF)
+                narrowed[i] = 0xFFFF;
+            else if (indices[i] < 0xFFFF)
+                narrowed[i] = (GLushort)indices[i];
+            else
+                narrow = false;
         }
+    }
+    else
+    {
+        narrow = false;
+    }
 
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_header->num_indices * element_size, NULL, GL_STATIC_DRAW);
-        buf = (char *)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
-        f.read(buf, m_header->num_indices * element_size);
-        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    const void *data;
+    if (narrow)
+    {
+        m_index_type = GL_UNSIGNED_SHORT;
+        m_index_size = sizeof(GLushort);
+        data = &narrowed[0];
+    }
+    else
+    {
+        m_index_type = GL_UNSIGNED_INT;
+        m_index_size = sizeof(GLuint);
+        data = &indices[0];
     }
 
-    f.close();
-    glBindVertexArray(0);
+    unsigned long long size = (unsigned long long)indices.size() * m_index_size;
+    if (!CreateStorage(GL_ELEMENT_ARRAY_BUFFER, size, m_index_alloc, m_index_buffer, m_index_base))
+        return false;
 
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)m_index_base, (GLsizeiptr)size, data);
     return true;
 }
 
 bool VBObject::Free(void)
 {
-    glDeleteBuffers(1, &m_index_buffer);
+    // Shared buffers belong to the object they were shared from
+    if (m_shared)
+    {
+        if (m_source)
+        {
+            std::vector<VBObject *>& sharers = m_source->m_sharers;
+            for (size_t i = 0; i < sharers.size(); ++i)
+            {
+                if (sharers[i] == this)
+                {
+                    sharers.erase(sharers.begin() + i);
+                    break;
+                }
+            }
+        }
+    }
+    else
+    {
+        if (m_index_alloc.buffer)
+            m_arena->Free(m_index_alloc);
+        else
+            GLStateCache::Current().DeleteBuffers(1, &m_index_buffer);
+
+        if (m_vertex_alloc.buffer)
+            m_arena->Free(m_vertex_alloc);
+        else
+            GLStateCache::Current().DeleteBuffers(1, &m_attribute_buffer);
+
+        for (size_t i = 0; i < m_sharers.size(); ++i)
+            m_sharers[i]->m_source = NULL;
+        m_sharers.clear();
+    }
+    memset(&m_vertex_alloc, 0, sizeof(m_vertex_alloc));
+    memset(&m_index_alloc, 0, sizeof(m_index_alloc));
+    m_vertex_base = 0;
+    m_index_base = 0;
+    m_source = NULL;
     m_index_buffer = 0;
-    glDeleteBuffers(1, &m_attribute_buffer);
+    m_index_type = 0;
+    m_index_size = 0;
+    m_has_bounds = false;
+    m_shared = false;
+    m_buffer_size = 0;
     m_attribute_buffer = 0;
-    glDeleteVertexArrays(1, &m_vao);
+    GLStateCache::Current().DeleteVertexArrays(1, &m_vao);
     m_vao = 0;
 
     delete m_header;
@@ -130,34 +578,68 @@ bool VBObject::Free(void)
     return true;
 }
 
-void VBObject::Render(unsigned int frame_index, unsigned int instances)
+void VBObject::Render(unsigned int frame_index, unsigned int instances, unsigned int base_instance)
 {
     if (frame_index >= m_header->num_frames)
         return;
 
-    glBindVertexArray(m_vao);
-    if (instances) {
-        if (m_header->num_indices)
-            glDrawElementsInstanced(GL_TRIANGLES, 
-                                    m_frame[frame_index].count, 
-                                    GL_UNSIGNED_INT, 
-                                    (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)), 
+    PROFILE_ZONE("VBObject::Render");
+    PROFILE_GPU_ZONE("VBObject::Render");
+    GL_CALL_SITE("VBObject::Render");
+
+    const VBM_FRAME_HEADER& frame = m_frame[frame_index];
+    bool strip = (frame.flags & VBM_FRAME_PRIMITIVE_MASK) == VBM_FRAME_TRIANGLE_STRIP;
+    GLenum mode = strip ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+
+    // The vertex array stays bound; the state cache drops the bind if the
+    // next draw uses the same object
+    GLStateCache& state = GLStateCache::Current();
+    state.BindVertexArray(m_vao);
+    if (m_header->num_indices) {
+        // Strips are separated by the largest value of the index type
+        state.SetEnabled(GL_PRIMITIVE_RESTART, strip);
+        if (strip)
+            state.PrimitiveRestartIndex(m_index_type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+
+        GLvoid *offset = (GLvoid *)(size_t)(m_index_base + (unsigned long long)frame.first * m_index_size);
+
+        if (base_instance)
+            glDrawElementsInstancedBaseInstance(mode,
+                                                frame.count,
+                                                m_index_type,
+                                                offset,
+                                                instances,
+                                                base_instance);
+        else if (instances)
+            glDrawElementsInstanced(mode, 
+                                    frame.count, 
+                                    m_index_type, 
+                                    offset, 
                                     instances);
-        else
-            glDrawArraysInstanced(GL_TRIANGLES, 
-                                  m_frame[frame_index].first, 
-                                  m_frame[frame_index].count, 
-                                  instances);
+        else {
+            GLIntercept::Note(GLCALL_DRAW);
+            glDrawElements(mode, 
+                           frame.count, 
+                           m_index_type, 
+                           offset);
+        }
     } else {
-        if (m_header->num_indices)
-            glDrawElements(GL_TRIANGLES, 
-                           m_frame[frame_index].count, 
-                           GL_UNSIGNED_INT, 
-                           (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)));
-        else
-            glDrawArrays(GL_TRIANGLES, 
-                         m_frame[frame_index].first, 
-                         m_frame[frame_index].count);
+        if (base_instance)
+            glDrawArraysInstancedBaseInstance(mode,
+                                              frame.first,
+                                              frame.count,
+                                              instances,
+                                              base_instance);
+        else if (instances)
+            glDrawArraysInstanced(mode, 
+                                  frame.first, 
+                                  frame.count, 
+                                  instances);
+        else {
+            GLIntercept::Note(GLCALL_DRAW);
+            glDrawArrays(mode, 
+                         frame.first, 
+                         frame.count);
+        }
     }
-    glBindVertexArray(0);
 }
@@ -5,10 +5,34 @@
 // Purpose: This file contains the program entry point. We use GLEW and
 //          GLUT to set up the application framework. 
 //
+//          Every sample also has a capture mode, for checking that a change
+//          did not change what it draws. It fixes the clock the samples
+//          animate with, draws a number of frames into a single buffered
+//          window, saves them through a FrameCapture and optionally compares
+//          them with golden images, then exits:
+//
+//          sample --capture=DIR [--frames=N] [--frame-ms=MS] [--png]
+//                 [--golden=DIR] [--threshold=T] [--max-fraction=F]
+//
+//          Frame n is drawn at n * MS milliseconds (16 by default) and saved
+//          to DIR/frame_nnnn.ppm, or .png. With --golden each frame is
+//          compared with the file of the same name in the golden directory
+//          (see Image.h for the tolerance), a picture of the differences is
+//          saved to DIR/diff_nnnn.ppm, and the exit code is 1 if any frame
+//          differs. Golden images are only comparable between runs of the
+//          same GL implementation; llvmpipe makes a good reference.
+//
 ///////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
+#include <string>
 #include "GL/glew.h"
 #include "GL/freeglut.h"
+#include "FrameCapture.h"
+#include "Image.h"
+#include "Platform.h"
 
 #define ESC 0x1B
 
@@ -20,6 +44,21 @@ extern void reshape(int width, int height);
 extern void initialize();
 extern void finalize();
 
+// The options of the capture mode; directory is empty outside of it
+struct CAPTURE_OPTIONS
+{
+    std::string     directory;
+    std::string     golden;
+    unsigned int    frames;
+    unsigned int    frame_ms;
+    bool            png;
+    IMAGE_TOLERANCE tolerance;
+};
+
+static CAPTURE_OPTIONS capture_options;
+static FrameCapture *capture;
+static unsigned int capture_frame;
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -68,6 +107,164 @@ void idle()
 
 
 
+// The name of a captured frame, in the capture or golden directory
+static std::string capture_filename(const std::string& directory, const char *prefix,
+                                    unsigned int frame, const char *extension)
+{
+    char name[64];
+    sprintf(name, "%s_%04u%s", prefix, frame, extension);
+    return directory + "/" + name;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: compare_captures
+//
+// Purpose: Compares every captured frame with its golden image, saving a
+//          picture of the differences next to it.
+//
+// INPUTS: None.
+//
+// OUTPUTS: Returns false if a frame cannot be read or does not match.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool compare_captures()
+{
+    const char *extension = capture_options.png ? ".png" : ".ppm";
+    bool all_match = true;
+
+    for (unsigned int frame = 0; frame < capture_options.frames; frame++)
+    {
+        std::string name = capture_filename(capture_options.directory, "frame", frame, extension);
+        std::string golden_name = capture_filename(capture_options.golden, "frame", frame, extension);
+        IMAGE image, golden, diff;
+
+        if (!ReadImage(golden_name.c_str(), golden) || !ReadImage(name.c_str(), image))
+        {
+            std::cout << golden_name << ": unable to read the golden or the captured frame" << std::endl;
+            all_match = false;
+            continue;
+        }
+
+        IMAGE_DIFFERENCE difference = CompareImages(golden, image, capture_options.tolerance, &diff);
+        bool match = ImagesMatch(difference, capture_options.tolerance);
+        if (!difference.same_size)
+        {
+            std::cout << name << ": " << image.width << "x" << image.height << ", the golden image is "
+                      << golden.width << "x" << golden.height << std::endl;
+        }
+        else
+        {
+            std::cout << name << ": " << (match ? "match" : "DIFFERS") << ", " << difference.differing
+                      << " pixels differ (" << difference.fraction * 100.0 << "%), max distance "
+                      << difference.max_distance << ", PSNR " << difference.psnr << " dB" << std::endl;
+            WriteImage(capture_filename(capture_options.directory, "diff", frame, ".ppm").c_str(), diff);
+        }
+        all_match = all_match && match;
+    }
+
+    return all_match;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: capture_display
+//
+// Purpose: GLUT display callback of the capture mode. Draws the next frame
+//          at its fixed time and captures it; after the last frame, waits
+//          for the files, reports the readback cost, compares the frames
+//          with the golden images and exits.
+//
+// INPUTS: None.
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void capture_display()
+{
+    if (!capture)
+        capture = new FrameCapture(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+
+    FixedMilliseconds() = (long long)capture_frame * capture_options.frame_ms;
+    display();
+
+    // The window is single buffered, so the frame is still in the buffer
+    // glReadPixels reads by default
+    capture->Capture(capture_filename(capture_options.directory, "frame", capture_frame,
+                                      capture_options.png ? ".png" : ".ppm"));
+
+    if (++capture_frame < capture_options.frames)
+        return;
+
+    bool written = capture->Flush();
+    FRAME_CAPTURE_STATS stats = capture->GetStats();
+    delete capture;
+    capture = NULL;
+
+    std::cout << "captured " << stats.frames << " frames, " << stats.bytes / 1024 << " KB: "
+              << stats.read_ms + stats.fence_wait_ms + stats.map_ms << " ms per frame on the "
+              << "context thread (read " << stats.read_ms << ", fence wait " << stats.fence_wait_ms
+              << ", map " << stats.map_ms << "), " << stats.readback_mb_s << " MB/s; "
+              << stats.write_ms << " ms per frame writing files" << std::endl;
+
+    if (!written)
+        std::cout << "unable to write the frames to " << capture_options.directory << std::endl;
+
+    bool match = written && (capture_options.golden.empty() || compare_captures());
+
+    finalize();
+    exit(match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: parse_capture_options
+//
+// Purpose: Reads the capture mode's options from the command line.
+//
+// INPUTS: argc, argv - the command line, after glutInit took its options
+//
+// OUTPUTS: Returns false if an option is not recognized.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool parse_capture_options(int argc, char **argv)
+{
+    capture_options.frames = 1;
+    capture_options.frame_ms = 16;
+    capture_options.png = false;
+    capture_options.tolerance.threshold = IMAGE_DEFAULT_THRESHOLD;
+    capture_options.tolerance.max_fraction = IMAGE_DEFAULT_MAX_FRACTION;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (strncmp(arg, "--capture=", 10) == 0)
+            capture_options.directory = arg + 10;
+        else if (strncmp(arg, "--golden=", 9) == 0)
+            capture_options.golden = arg + 9;
+        else if (strncmp(arg, "--frames=", 9) == 0)
+            capture_options.frames = (unsigned int)atoi(arg + 9);
+        else if (strncmp(arg, "--frame-ms=", 11) == 0)
+            capture_options.frame_ms = (unsigned int)atoi(arg + 11);
+        else if (strcmp(arg, "--png") == 0)
+            capture_options.png = true;
+        else if (strncmp(arg, "--threshold=", 12) == 0)
+            capture_options.tolerance.threshold = atof(arg + 12);
+        else if (strncmp(arg, "--max-fraction=", 15) == 0)
+            capture_options.tolerance.max_fraction = atof(arg + 15);
+        else
+            return false;
+    }
+
+    return capture_options.frames > 0;
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Function Name: main
 //
@@ -77,14 +274,23 @@ void idle()
 // INPUTS: argc - contains the number of arguments
 //         argv - "argument vector", a one-dimensional array of strings
 //
-// OUTPUTS: Returns EXIT_FAILURE if there is trouble with GLEW, otherwise
-//          returns EXIT_SUCCESS.
+// OUTPUTS: Returns EXIT_FAILURE if there is trouble with GLEW or the
+//          command line, otherwise returns EXIT_SUCCESS. The capture mode
+//          exits with EXIT_FAILURE if a frame differs from its golden image.
 //
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char **argv)
 {
     glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
+    if (!parse_capture_options(argc, argv))
+    {
+        std::cerr << "usage: " << argv[0] << " [--capture=DIR [--frames=N] [--frame-ms=MS] [--png]"
+                  << " [--golden=DIR] [--threshold=T] [--max-fraction=F]]" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    bool capturing = !capture_options.directory.empty();
+
+    glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | (capturing ? GLUT_SINGLE : GLUT_DOUBLE));
     glutInitWindowSize(640, 480);
     //glutInitContextVersion(2, 1);
     //glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -99,11 +305,18 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    glutDisplayFunc(display);
+    glutDisplayFunc(capturing ? capture_display : display);
     glutKeyboardFunc(keyboard);
     glutIdleFunc(idle);
     glutReshapeFunc(reshape);
-    
+
+    // The clock is fixed before initialize, which may already start
+    // preparing frame 0 (a FramePipeline does). A pipelined sample reads
+    // the clock a frame ahead, so its frame N shows the time of frame N - 1,
+    // but the same in every run.
+    if (capturing)
+        FixedMilliseconds() = 0;
+
     initialize();
 
     glutMainLoop();
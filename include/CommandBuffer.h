@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: CommandBuffer.h
+//
+// Purpose: This file contains the declarations of the CommandBuffer and
+//          CommandRecorder classes, which let worker threads prepare the
+//          draws of a frame while GL calls stay on the thread that owns the
+//          context.
+//
+//          A CommandBuffer is a linear block of memory that draw, state and
+//          uniform commands are appended to. Recording never calls GL and
+//          does not allocate once the buffer has grown to the size a frame
+//          needs; Reset keeps the memory. Execute replays the commands on
+//          the context thread, through the GLStateCache.
+//
+//          A CommandRecorder owns one CommandBuffer per slice. Record splits
+//          a range of work items into contiguous slices, records the slices
+//          in parallel on a JobSystem, and Execute replays the buffers in
+//          slice order, so the result does not depend on thread scheduling.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __COMMANDBUFFER_H
+#define __COMMANDBUFFER_H
+
+#include <vector>
+#include "GL/glew.h"
+#include "JobSystem.h"
+#include "VBObject.h"
+
+#define COMMAND_BUFFER_SIZE     (64 * 1024)
+
+// Largest uniform a single command can carry (a mat4)
+#define COMMAND_MAX_UNIFORM_SIZE    64
+
+typedef void (*CommandCallbackFn)(void *user);
+
+struct COMMAND_STATS
+{
+    unsigned int       buffers;
+    unsigned int       commands;
+    unsigned long long bytes;
+    unsigned int       grows;       // times a buffer has had to grow, since it was created
+    double             record_ms;
+    double             execute_ms;
+};
+
+
+class CommandBuffer
+{
+public:
+    CommandBuffer(size_t capacity = COMMAND_BUFFER_SIZE);
+
+    // Forgets the commands but keeps the memory
+    void Reset(void);
+
+    void UseProgram(GLuint program);
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+    void Enable(GLenum capability);
+    void Disable(GLenum capability);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Uniform
+    //
+    // Purpose: Records a uniform update for the program in use when the
+    //          command is replayed. The value is copied.
+    //
+    // INPUTS: location - the uniform location; -1 is recorded and ignored
+    //         type     - GL_FLOAT, GL_FLOAT_VEC2/3/4, GL_INT, GL_INT_VEC2/3/4
+    //                    or GL_FLOAT_MAT4
+    //         value    - the value
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Uniform(GLint location, GLenum type, const void *value);
+    void Uniform1i(GLint location, GLint value) { Uniform(location, GL_INT, &value); }
+    void Uniform1f(GLint location, GLfloat value) { Uniform(location, GL_FLOAT, &value); }
+    void Uniform4fv(GLint location, const GLfloat *value) { Uniform(location, GL_FLOAT_VEC4, value); }
+    void UniformMatrix4fv(GLint location, const GLfloat *value) { Uniform(location, GL_FLOAT_MAT4, value); }
+
+    // Records object->Render(frame, instances, base_instance)
+    void Draw(VBObject *object, unsigned int frame = 0, unsigned int instances = 0,
+              unsigned int base_instance = 0);
+
+    // Records a call made on the context thread during Execute
+    void Callback(CommandCallbackFn fn, void *user);
+
+    // Replays the commands; must be called on the context thread
+    void Execute(void) const;
+
+    unsigned int GetCommandCount(void) const { return m_commands; }
+    size_t GetSize(void) const { return m_size; }
+    unsigned int GetGrowCount(void) const { return m_grows; }
+
+private:
+    void *Allocate(unsigned int type, size_t size);
+
+    std::vector<unsigned char> m_data;
+    size_t m_size;
+    unsigned int m_commands;
+    unsigned int m_grows;
+};
+
+
+// Records the commands for work items [first, end) into 'buffer'
+typedef void (*CommandRecordFn)(void *user, CommandBuffer& buffer, unsigned int first, unsigned int end);
+
+class CommandRecorder
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: CommandRecorder
+    //
+    // Purpose: Creates the buffers.
+    //
+    // INPUTS: slices - the number of buffers, i.e. how many slices the work
+    //                  is split into; 0 picks one per thread of 'jobs'
+    //         jobs   - the system the slices are recorded on, or NULL for
+    //                  JobSystem::Shared()
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    CommandRecorder(unsigned int slices = 0, JobSystem *jobs = NULL);
+    ~CommandRecorder(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Record
+    //
+    // Purpose: Resets the buffers and records 'count' work items, split
+    //          into one contiguous slice per buffer. Returns when every
+    //          slice is done; the calling thread records slices meanwhile.
+    //
+    // INPUTS: count - the number of work items
+    //         fn    - records a slice; called on job threads, so it must
+    //                 not call GL
+    //         user  - passed to fn
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Record(unsigned int count, CommandRecordFn fn, void *user);
+
+    // Replays every buffer in slice order on the context thread
+    void Execute(void);
+
+    unsigned int GetSliceCount(void) const { return (unsigned int)m_buffers.size(); }
+    const COMMAND_STATS& GetStats(void) const { return m_stats; }
+
+private:
+    CommandRecorder(const CommandRecorder&);
+    CommandRecorder& operator=(const CommandRecorder&);
+
+    static void RecordSlices(void *user, unsigned int first, unsigned int end);
+    void RecordSlice(unsigned int index);
+
+    JobSystem *m_jobs;
+    std::vector<CommandBuffer *> m_buffers;
+    unsigned int m_count;
+    CommandRecordFn m_fn;
+    void *m_user;
+    COMMAND_STATS m_stats;
+};
+
+#endif // __COMMANDBUFFER_H
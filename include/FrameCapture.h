@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: FrameCapture.h
+//
+// Purpose: This file contains the declaration of the FrameCapture class,
+//          which saves frames to PPM or PNG files without stalling the
+//          pipeline.
+//
+//          Capture issues glReadPixels into one of 'depth' pixel pack
+//          buffers and fences it, so the call returns as soon as the copy
+//          is queued rather than when the GPU has drawn the frame. A buffer
+//          is mapped once its fence has signaled, at a later Capture or
+//          Poll, and its pixels are encoded and written to the file by a
+//          job, off the context thread. Only when all the buffers are still
+//          in flight does Capture wait, for the oldest.
+//
+//          The statistics separate what capturing costs the context thread
+//          from what it costs in total, so a benchmark can tell how much of
+//          its frame time is the capture's. On a renderer that draws on the
+//          CPU, such as llvmpipe, there is no GPU work to overlap, and the
+//          copy through the buffer makes a capture slower than a plain
+//          glReadPixels; microbench's readback_sync and readback_pbo cases
+//          compare the two on the machine at hand.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __FRAMECAPTURE_H
+#define __FRAMECAPTURE_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "JobSystem.h"
+
+#define FRAME_CAPTURE_MAX_DEPTH     4
+
+// Averages over every captured frame, except the totals
+struct FRAME_CAPTURE_STATS
+{
+    unsigned long long frames;
+    unsigned long long bytes;           // read back in total
+    unsigned long long failed_writes;
+    double             read_ms;         // queueing glReadPixels and its fence
+    double             fence_wait_ms;   // waiting for a readback to finish
+    double             map_ms;          // mapping a buffer and copying it out
+    double             write_wait_ms;   // waiting for the previous write from a buffer
+    double             write_ms;        // encoding and writing the file, on a job thread
+    double             readback_mb_s;   // bytes over the context thread's time
+};
+
+
+class FrameCapture
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: FrameCapture
+    //
+    // Purpose: Creates the pixel pack buffers.
+    //
+    // INPUTS: width, height - the size of the framebuffer in pixels
+    //         depth         - readbacks in flight, 1 to
+    //                         FRAME_CAPTURE_MAX_DEPTH
+    //         jobs          - where the files are written, or NULL for
+    //                         JobSystem::Shared()
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: Must be called on the context thread.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    FrameCapture(GLsizei width, GLsizei height, unsigned int depth = 2, JobSystem *jobs = NULL);
+
+    // Flushes and deletes the buffers and fences
+    ~FrameCapture(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Capture
+    //
+    // Purpose: Starts reading the framebuffer bound for reading into the
+    //          next buffer, to be written to a file when it is finished.
+    //
+    // INPUTS: filename - the file, a PNG if it ends with ".png" and a PPM
+    //                    otherwise; if empty, the frame is read back but
+    //                    not written, to measure the readback alone
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: Call it after drawing the frame and before swapping, or after
+    //        drawing into a single buffered window. Leaves
+    //        GL_PIXEL_PACK_BUFFER unbound.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Capture(const std::string& filename);
+
+    // Writes the readbacks that have finished, without waiting
+    void Poll(void);
+
+    // Waits for every readback and file write; returns false if a file
+    // could not be written
+    bool Flush(void);
+
+    FRAME_CAPTURE_STATS GetStats(void) const;
+
+private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Slot
+    {
+        const FrameCapture *       owner;
+        GLuint                     buffer;
+        GLsync                     fence;
+        std::string                filename;        // of the readback in flight
+        std::string                write_filename;  // of the pixels being written
+        std::vector<unsigned char> pixels;          // copied out of the buffer, for the write job
+        JobCounter                 written;
+        bool                       writing;
+        double                     write_ms;
+        bool                       write_failed;
+    };
+
+    static void WriteJob(void *user);
+    void Retire(unsigned int slot);
+    void WaitForWrite(unsigned int slot);
+
+    GLsizei m_width;
+    GLsizei m_height;
+    GLsizeiptr m_size;
+    unsigned int m_depth;
+    JobSystem *m_jobs;
+    unsigned int m_next;
+    Slot m_slots[FRAME_CAPTURE_MAX_DEPTH];
+
+    unsigned long long m_frames;
+    unsigned long long m_failed_writes;
+    double m_read_total;
+    double m_fence_wait_total;
+    double m_map_total;
+    double m_write_wait_total;
+    double m_write_total;
+};
+
+#endif // __FRAMECAPTURE_H
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: FramePipeline.h
+//
+// Purpose: This file contains the declaration of the FramePipeline class,
+//          which overlaps the CPU work of the next frame with the GPU work
+//          of the current one.
+//
+//          The per-frame data (instance matrices, say) is prepared by a job
+//          on a JobSystem one frame ahead of the frame being drawn, then
+//          uploaded into one region of a buffer that holds 'depth' frames.
+//          Each region is protected by a fence, so a region is only written
+//          again once the GPU has finished the frame that read it, and the
+//          upload never has to wait for the driver to synchronize the whole
+//          buffer. With a depth of 1 the CPU waits for every frame; 2 and 3
+//          let the GPU run one or two frames behind.
+//
+//          A frame looks like:
+//
+//              const PIPELINE_FRAME& frame = pipeline.BeginFrame();
+//              ... draw, reading the upload at frame.offset ...
+//              pipeline.EndFrame();
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __FRAMEPIPELINE_H
+#define __FRAMEPIPELINE_H
+
+#include <chrono>
+#include <vector>
+#include "GL/glew.h"
+#include "JobSystem.h"
+
+#define FRAME_PIPELINE_MAX_DEPTH    4
+
+// Regions start on this boundary, which suits uniform and texture buffers
+#define FRAME_PIPELINE_ALIGNMENT    256
+
+// Prepares a frame on a job thread, so it must not call GL or read the
+// clock; 'milliseconds' is GetMilliseconds() read on the context thread
+// when the preparation started, so a fixed clock gives the same frames
+// every run. 'upload' is copied into the buffer; 'extra' stays on the CPU,
+// for values the draw code needs to agree with the upload (the time, the
+// camera)
+typedef void (*FramePrepareFn)(void *user, unsigned long long frame, unsigned int milliseconds,
+                               void *upload, void *extra);
+
+struct PIPELINE_FRAME
+{
+    unsigned long long number;
+    GLintptr           offset;      // where the upload is in GetBuffer()
+    const void *       upload;
+    const void *       extra;
+};
+
+// Averages over every frame since the pipeline was created
+struct FRAME_PIPELINE_STATS
+{
+    unsigned long long frames;
+    double             frame_ms;        // time between BeginFrame calls
+    double             prepare_wait_ms; // BeginFrame waiting for the prepare job
+    double             fence_wait_ms;   // BeginFrame waiting for the GPU
+    double             latency_ms;      // start of prepare to the GPU finishing the frame
+};
+
+
+class FramePipeline
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: FramePipeline
+    //
+    // Purpose: Creates the buffer and starts preparing frame 0.
+    //
+    // INPUTS: depth       - frames in flight, 1 to FRAME_PIPELINE_MAX_DEPTH
+    //         upload_size - bytes uploaded per frame
+    //         extra_size  - bytes per frame kept on the CPU, may be 0
+    //         prepare     - fills in a frame
+    //         user        - passed to prepare
+    //         jobs        - where prepare runs, or NULL for JobSystem::Shared()
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: Must be called on the context thread.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    FramePipeline(unsigned int depth, size_t upload_size, size_t extra_size,
+                  FramePrepareFn prepare, void *user, JobSystem *jobs = NULL);
+
+    // Waits for the prepare job and deletes the buffer and fences
+    ~FramePipeline(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: BeginFrame
+    //
+    // Purpose: Waits for the next frame to be prepared and for its buffer
+    //          region to be free, uploads it, and starts preparing the
+    //          frame after it.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: The frame, valid until the next BeginFrame.
+    //
+    // NOTES: Leaves the buffer bound to GL_ARRAY_BUFFER.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    const PIPELINE_FRAME& BeginFrame(void);
+
+    // Fences the region of the frame; call once its draws are issued
+    void EndFrame(void);
+
+    GLuint GetBuffer(void) const { return m_buffer; }
+    unsigned int GetDepth(void) const { return m_depth; }
+
+    FRAME_PIPELINE_STATS GetStats(void) const;
+
+private:
+    FramePipeline(const FramePipeline&);
+    FramePipeline& operator=(const FramePipeline&);
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    static void PrepareJob(void *user);
+    void StartPrepare(void);
+    void Retire(unsigned int region);
+
+    unsigned int m_depth;
+    size_t m_upload_size;
+    size_t m_extra_size;
+    GLsizeiptr m_stride;
+    FramePrepareFn m_prepare;
+    void *m_user;
+    JobSystem *m_jobs;
+    GLuint m_buffer;
+
+    // Two staging slots: one being drawn, one being prepared
+    std::vector<unsigned char> m_staging[2];
+    Clock::time_point m_prepare_start[2];
+    unsigned int m_prepare_ms;
+    unsigned long long m_prepare_frame;
+    JobCounter m_prepared;
+
+    GLsync m_fences[FRAME_PIPELINE_MAX_DEPTH];
+    Clock::time_point m_fence_start[FRAME_PIPELINE_MAX_DEPTH];
+
+    PIPELINE_FRAME m_frame;
+    unsigned long long m_frames;
+    Clock::time_point m_last_begin;
+
+    double m_frame_total;
+    double m_prepare_wait_total;
+    double m_fence_wait_total;
+    double m_latency_total;
+    unsigned long long m_latency_count;
+};
+
+#endif // __FRAMEPIPELINE_H
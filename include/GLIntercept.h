@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GLIntercept.h
+//
+// Purpose: This file contains the declaration of the GLIntercept class, an
+//          optional layer that counts the GL calls of each frame: draws,
+//          state changes, uniform updates, buffer uploads and the bytes they
+//          carry, maps and unmaps, in total and per call site.
+//
+//          Install replaces the GLEW function pointers of the calls it
+//          counts with wrappers that count and forward, so code calling GL
+//          needs no change and nothing is counted (or slowed down) until the
+//          layer is installed. The GL 1.1 entry points (glDrawArrays,
+//          glDrawElements, glEnable, glBindTexture, glDepthFunc, ...) are
+//          exported by the GL library itself rather than loaded by GLEW, so
+//          they cannot be swapped; the places in common/ that issue them
+//          (GLStateCache and VBObject::Render) report them with Note.
+//
+//          GL 1.1 calls made directly by the samples (glClear, glViewport,
+//          ...) are not counted.
+//
+//          Calls are attributed to the innermost GL_CALL_SITE scope, or to
+//          "(other)" outside of one. The layer is meant for the context
+//          thread only.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __GLINTERCEPT_H
+#define __GLINTERCEPT_H
+
+#include <ostream>
+#include <vector>
+#include "GL/glew.h"
+
+// What a call counts as
+#define GLCALL_OTHER    0
+#define GLCALL_DRAW     1
+#define GLCALL_STATE    2
+#define GLCALL_UNIFORM  3
+#define GLCALL_UPLOAD   4       // glBufferData, glBufferSubData, with their bytes
+#define GLCALL_MAP      5       // with the bytes mapped for writing
+#define GLCALL_UNMAP    6
+
+struct GL_CALL_COUNTS
+{
+    unsigned long long calls;           // every counted call
+    unsigned long long draws;
+    unsigned long long state_changes;
+    unsigned long long uniforms;
+    unsigned long long uploads;
+    unsigned long long upload_bytes;
+    unsigned long long maps;
+    unsigned long long map_bytes;       // ranges mapped for writing
+    unsigned long long unmaps;
+};
+
+struct GL_CALL_SITE_COUNTS
+{
+    const char *   site;
+    GL_CALL_COUNTS counts;
+};
+
+struct GL_CALL_REPORT
+{
+    unsigned long long               frame;     // frames ended before this one
+    GL_CALL_COUNTS                   total;
+    std::vector<GL_CALL_SITE_COUNTS> sites;     // in order of first call
+};
+
+
+class GLIntercept
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Install
+    //
+    // Purpose: Swaps the GLEW function pointers of the counted calls for
+    //          the wrappers.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: Returns false if it was already installed.
+    //
+    // NOTES: Call after glewInit, on the context thread. Pointers GLEW did
+    //        not load (functions the driver lacks) are left NULL.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    static bool Install(void);
+
+    // Puts the original pointers back
+    static void Uninstall(void);
+
+    static bool IsInstalled(void) { return s_installed; }
+
+    // Counts a call the layer cannot see, one of the GLCALL_* kinds
+    static void Note(int kind, unsigned long long bytes = 0)
+    {
+        if (s_installed)
+            Count(kind, bytes);
+    }
+
+    // Makes the counts so far the report of a frame and starts the next
+    static void EndFrame(void);
+
+    // The last frame ended
+    static const GL_CALL_REPORT& GetFrameReport(void);
+
+    // Every frame since Install, including the current one
+    static GL_CALL_REPORT GetTotalReport(void);
+
+    // Writes a report as a table, one row per site
+    static void PrintReport(std::ostream& out, const GL_CALL_REPORT& report);
+
+    static void Count(int kind, unsigned long long bytes);
+
+private:
+    friend class GLCallSite;
+
+    static bool s_installed;
+    static const char *s_site;
+};
+
+
+// Attributes the GL calls of the enclosing scope to 'site'
+class GLCallSite
+{
+public:
+    explicit GLCallSite(const char *site)
+        : m_previous(GLIntercept::s_site)
+    {
+        GLIntercept::s_site = site;
+    }
+
+    ~GLCallSite(void)
+    {
+        GLIntercept::s_site = m_previous;
+    }
+
+private:
+    GLCallSite(const GLCallSite&);
+    GLCallSite& operator=(const GLCallSite&);
+
+    const char *m_previous;
+};
+
+#define GL_CALL_SITE_CONCAT2(a, b)  a##b
+#define GL_CALL_SITE_CONCAT(a, b)   GL_CALL_SITE_CONCAT2(a, b)
+#define GL_CALL_SITE(name)          GLCallSite GL_CALL_SITE_CONCAT(gl_call_site_, __LINE__)(name)
+
+#endif // __GLINTERCEPT_H
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GLStateCache.h
+//
+// Purpose: This file contains the declaration of the GLStateCache class. The
+//          GLStateCache shadows the bindings and fixed-function state that
+//          the samples change every frame (program, vertex array, buffer and
+//          texture bindings, enables, depth and cull state) and drops calls
+//          that would set a value that is already current. Every call is
+//          counted as issued or skipped, so the savings can be measured.
+//
+//          The cache only knows about changes made through it. Code that
+//          changes the same state with plain GL calls, or that deletes
+//          objects without going through the Delete functions here, must
+//          call Invalidate() afterwards.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __GLSTATECACHE_H
+#define __GLSTATECACHE_H
+
+#include "GL/glew.h"
+
+// Kinds of state, for GL_STATE_STATS
+#define GLSTATE_PROGRAM         0
+#define GLSTATE_VERTEX_ARRAY    1
+#define GLSTATE_BUFFER          2
+#define GLSTATE_TEXTURE         3
+#define GLSTATE_CAPABILITY      4
+#define GLSTATE_FIXED_FUNCTION  5       // depth, cull, blend, restart index
+#define GLSTATE_KIND_COUNT      6
+
+#define GLSTATE_MAX_TEXTURE_UNITS   32
+
+struct GL_STATE_STATS
+{
+    unsigned long long issued[GLSTATE_KIND_COUNT];
+    unsigned long long skipped[GLSTATE_KIND_COUNT];
+    unsigned long long total_issued;
+    unsigned long long total_skipped;
+};
+
+
+class GLStateCache
+{
+public:
+    GLStateCache(void);
+
+    // The cache of the current context. The samples use one context on one
+    // thread, so there is a single instance.
+    static GLStateCache& Current(void);
+
+    // Forgets everything; the next call for each piece of state is issued
+    void Invalidate(void);
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vao);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: BindBuffer
+    //
+    // Purpose: Binds a buffer object to a target.
+    //
+    // INPUTS: target - the binding point
+    //         buffer - the buffer object, or 0
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: GL_ELEMENT_ARRAY_BUFFER is part of the vertex array object
+    //        state, so it is always issued.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void BindBuffer(GLenum target, GLuint buffer);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: BindTexture
+    //
+    // Purpose: Binds a texture to a target of a texture unit, selecting the
+    //          unit first if needed. The unit stays active afterwards.
+    //
+    // INPUTS: unit    - the texture unit, counted from 0
+    //         target  - the texture target
+    //         texture - the texture object, or 0
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+    void ActiveTexture(GLuint unit);
+
+    void Enable(GLenum capability);
+    void Disable(GLenum capability);
+    void SetEnabled(GLenum capability, bool enabled);
+
+    void DepthFunc(GLenum func);
+    void DepthMask(GLboolean mask);
+    void CullFace(GLenum mode);
+    void FrontFace(GLenum mode);
+    void PrimitiveRestartIndex(GLuint index);
+    void BlendFunc(GLenum source, GLenum destination);
+
+    // Delete objects and forget any binding of them, so that a new object
+    // that reuses the name is bound for real
+    void DeleteBuffers(GLsizei count, const GLuint *buffers);
+    void DeleteTextures(GLsizei count, const GLuint *textures);
+    void DeleteVertexArrays(GLsizei count, const GLuint *arrays);
+    void DeleteProgram(GLuint program);
+
+    const GL_STATE_STATS& GetStats(void) const { return m_stats; }
+    void ResetStats(void);
+
+private:
+    enum
+    {
+        BUFFER_TARGET_COUNT = 8,
+        TEXTURE_TARGET_COUNT = 10,
+        CAPABILITY_COUNT = 10
+    };
+
+    static int BufferTarget(GLenum target);
+    static int TextureTarget(GLenum target);
+    static int Capability(GLenum capability);
+
+    bool Changed(unsigned int kind, GLuint& cached, GLuint value);
+
+    GLuint m_program;
+    GLuint m_vao;
+    GLuint m_buffers[BUFFER_TARGET_COUNT];
+    GLuint m_active_texture;
+    GLuint m_textures[GLSTATE_MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+    GLuint m_capabilities[CAPABILITY_COUNT];
+    GLuint m_depth_func;
+    GLuint m_depth_mask;
+    GLuint m_cull_face;
+    GLuint m_front_face;
+    GLuint m_blend_source;
+    GLuint m_blend_destination;
+    GLuint m_restart_index;
+    bool m_restart_index_known;
+
+    GL_STATE_STATS m_stats;
+};
+
+#endif // __GLSTATECACHE_H
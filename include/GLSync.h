@@ -0,0 +1,37 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GLSync.h
+//
+// Purpose: Waiting on the fences that FramePipeline and FrameCapture put
+//          after the GL work they are about to reuse a buffer of.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __GLSYNC_H
+#define __GLSYNC_H
+
+#include "GL/glew.h"
+
+// How long a fence wait blocks before it tries again
+static const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+
+// Blocks until 'fence' has signaled, flushing the commands before it so
+// that it can
+inline void WaitForFence(GLsync fence)
+{
+    GLenum status;
+    do
+    {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    } while (status == GL_TIMEOUT_EXPIRED);
+}
+
+
+// Whether 'fence' has signaled, without waiting
+inline bool IsFenceSignaled(GLsync fence)
+{
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+#endif // __GLSYNC_H
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: GPUArena.h
+//
+// Purpose: This file contains the declaration of the GPUArena class. A
+//          GPUArena suballocates vertex and index storage from a few large
+//          buffer objects ("pages") with a TLSF allocator, so thousands of
+//          meshes need a handful of buffer objects instead of two each, and
+//          meshes in the same page can be drawn together.
+//
+//          Defragment() compacts the live ranges of fragmented pages into a
+//          new buffer object with glCopyBufferSubData. Whoever owns a range
+//          is told where it went through the callback given to Allocate, and
+//          must re-point its vertex arrays.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __GPUARENA_H
+#define __GPUARENA_H
+
+#include <vector>
+#include "GL/glew.h"
+#include "TLSF.h"
+
+#define GPU_ARENA_PAGE_SIZE     (64 * 1024 * 1024)
+#define GPU_ARENA_GRANULARITY   256
+
+struct GPU_ALLOCATION
+{
+    GLuint             buffer;      // 0 if nothing is allocated
+    unsigned int       page;
+    unsigned int       block;
+    unsigned long long offset;      // in bytes, within buffer
+    unsigned long long size;        // as requested
+};
+
+// Called after a range has moved; 'from' is no longer valid
+typedef void (*GPUArenaRelocateFn)(void *user, const GPU_ALLOCATION& from, const GPU_ALLOCATION& to);
+
+struct GPU_ARENA_STATS
+{
+    unsigned int       pages;           // buffer objects
+    unsigned int       allocations;
+    unsigned int       free_blocks;
+    unsigned long long capacity;        // bytes in all pages
+    unsigned long long used;            // bytes allocated, rounded to the granularity
+    unsigned long long requested;       // bytes asked for
+    unsigned long long largest_free;
+    float              utilization;     // requested / capacity
+    float              fragmentation;   // 1 - largest free block / free bytes, worst page
+    unsigned int       defragmentations;
+    unsigned long long bytes_moved;
+};
+
+
+class GPUArena
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: GPUArena
+    //
+    // Purpose: Creates an empty arena. Pages are created on demand.
+    //
+    // INPUTS: page_size - the size of each buffer object; larger requests
+    //                     get a page of their own
+    //         usage     - the usage hint for glBufferData
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    GPUArena(unsigned long long page_size = GPU_ARENA_PAGE_SIZE, GLenum usage = GL_STATIC_DRAW);
+
+    ~GPUArena(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Allocate
+    //
+    // Purpose: Allocates a range of buffer storage.
+    //
+    // INPUTS: size       - the number of bytes needed
+    //         allocation - receives the buffer and offset
+    //         relocate   - optional, called when Defragment moves the range
+    //         user       - passed to relocate
+    //
+    // OUTPUTS: Returns false if no buffer object could be created, or the
+    //          range could not be allocated from it.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    bool Allocate(unsigned long long size, GPU_ALLOCATION& allocation,
+                  GPUArenaRelocateFn relocate = 0, void *user = 0);
+
+    // Frees a range; pages left empty are deleted
+    void Free(const GPU_ALLOCATION& allocation);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Defragment
+    //
+    // Purpose: Compacts every page whose fragmentation is above a threshold
+    //          into a new buffer object and reports the moves.
+    //
+    // INPUTS: threshold - the fragmentation (0 to 1) that triggers compaction
+    //
+    // OUTPUTS: The number of pages compacted.
+    //
+    // NOTES: The copies are queued on the GL command stream, so nothing
+    //        waits for the GPU; the old buffers are deleted afterwards,
+    //        which GL defers until pending draws are done with them.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    unsigned int Defragment(float threshold = 0.25f);
+
+    GPU_ARENA_STATS GetStats(void) const;
+
+private:
+    struct Owner
+    {
+        GPUArenaRelocateFn relocate;
+        void *user;
+        unsigned long long size;
+    };
+
+    struct Page
+    {
+        GLuint buffer;
+        TLSF allocator;
+        std::vector<Owner> owners;      // indexed by TLSF block
+        unsigned long long requested;
+    };
+
+    GPUArena(const GPUArena&);
+    GPUArena& operator=(const GPUArena&);
+
+    GLuint CreateBuffer(unsigned long long size);
+    bool Compact(unsigned int index);
+    static float Fragmentation(const TLSF_STATS& stats);
+
+    unsigned long long m_page_size;
+    GLenum m_usage;
+    std::vector<Page *> m_pages;        // NULL where a page was deleted
+    unsigned int m_defragmentations;
+    unsigned long long m_bytes_moved;
+};
+
+#endif // __GPUARENA_H
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Image.h
+//
+// Purpose: This file contains the declaration of the image files used by
+//          frame capture and the golden image comparison: 8-bit RGB images
+//          read from and written to binary PPM (P6) and PNG files, and a
+//          perceptual comparison of two images. Like VBM.h it does not
+//          depend on GL.
+//
+//          PNG files are written with stored (uncompressed) deflate blocks,
+//          so writing one costs little more than writing a PPM; any 8-bit
+//          gray, RGB or RGBA PNG can be read, compressed or not.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+#include <stddef.h>
+#include <vector>
+
+// Rows run top to bottom, three bytes (R, G, B) per pixel
+struct IMAGE
+{
+    unsigned int               width;
+    unsigned int               height;
+    std::vector<unsigned char> pixels;
+};
+
+// What CompareImages tolerates. A pixel differs when the perceptual
+// distance of its colors, from 0 (equal) to 1 (the most different pair),
+// is above 'threshold'; the images match when no more than 'max_fraction'
+// of their pixels differ
+struct IMAGE_TOLERANCE
+{
+    double threshold;
+    double max_fraction;
+};
+
+struct IMAGE_DIFFERENCE
+{
+    bool               same_size;
+    unsigned long long differing;       // pixels above the threshold
+    double             fraction;        // differing / pixels
+    double             max_distance;
+    double             mean_distance;
+    double             psnr;            // dB over RGB; 0 when the sizes differ, inf when equal
+};
+
+// Used by the capture mode and the imgcompare tool unless they are told
+// otherwise: loose enough for rasterization differences at the edges of
+// triangles, tight enough to catch a moved or recolored object
+#define IMAGE_DEFAULT_THRESHOLD     0.1
+#define IMAGE_DEFAULT_MAX_FRACTION  0.001
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ReadImage
+//
+// Purpose: Reads a PPM or a PNG file, telling them apart by their contents.
+//
+// INPUTS: filename - the file to read
+//         image    - receives the image
+//
+// OUTPUTS: Returns false if the file cannot be read, is not a PPM or PNG,
+//          or uses a kind of PNG that is not supported (16-bit channels,
+//          palettes or interlacing).
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ReadImage(const char *filename, IMAGE& image);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteImage
+//
+// Purpose: Writes an image, as a PNG if the filename ends with ".png" and
+//          as a PPM otherwise.
+//
+// INPUTS: filename - the file to write
+//         image    - the image
+//
+// OUTPUTS: Returns false if the file cannot be written.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool WriteImage(const char *filename, const IMAGE& image);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ImageFromRGBA
+//
+// Purpose: Converts a framebuffer read by glReadPixels with GL_RGBA and
+//          GL_UNSIGNED_BYTE, whose rows run bottom to top, to an IMAGE.
+//
+// INPUTS: rgba   - the pixels, four bytes each, rows packed
+//         width  - in pixels
+//         height - in pixels
+//         image  - receives the image
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageFromRGBA(const void *rgba, unsigned int width, unsigned int height, IMAGE& image);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: CompareImages
+//
+// Purpose: Measures how far an image is from a golden image.
+//
+// INPUTS: golden    - the expected image
+//         image     - the image to check
+//         tolerance - what counts as a differing pixel
+//         diff      - if not NULL, receives an image of the differences:
+//                     the golden image faded, with differing pixels red
+//
+// OUTPUTS: The differences; ImagesMatch tells whether they are within the
+//          tolerance.
+//
+// NOTES: The distance of two colors is measured in YIQ, where brightness
+//        counts for more than hue, as the eye sees it.
+//
+///////////////////////////////////////////////////////////////////////////////
+IMAGE_DIFFERENCE CompareImages(const IMAGE& golden, const IMAGE& image,
+                               const IMAGE_TOLERANCE& tolerance, IMAGE *diff = NULL);
+
+// Whether a comparison is within the tolerance it was made with
+bool ImagesMatch(const IMAGE_DIFFERENCE& difference, const IMAGE_TOLERANCE& tolerance);
+
+#endif // __IMAGE_H
@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: JobSystem.h
+//
+// Purpose: This file contains the declaration of the JobSystem class, a
+//          work-stealing task scheduler shared by everything that wants to
+//          spread work over the cores (mesh loading, culling, instance
+//          updates, command recording) instead of each starting threads of
+//          its own.
+//
+//          Every thread of the system, including the one that created it,
+//          has a deque of jobs. A thread pushes and pops its own jobs at the
+//          back, so the work it queued last (and whose data is warmest in
+//          its cache) runs first; idle threads steal from the front of the
+//          other deques, which holds the oldest and usually largest jobs.
+//
+//          Completion is tracked with JobCounters: Run adds one to a counter
+//          and the job takes it away when it finishes. A job can be made to
+//          wait for another counter before it is queued, and Wait lets the
+//          waiting thread run queued jobs instead of blocking.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __JOBSYSTEM_H
+#define __JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*JobFn)(void *user);
+
+// Processes items [first, end)
+typedef void (*ParallelForFn)(void *user, unsigned int first, unsigned int end);
+
+struct Job;
+
+class JobCounter
+{
+public:
+    JobCounter(void) : m_count(0) {}
+
+    // True once every job counted by this counter has finished
+    bool IsDone(void) const { return m_count.load(std::memory_order_acquire) == 0; }
+
+private:
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+
+    friend class JobSystem;
+
+    std::atomic<int> m_count;
+    std::mutex m_lock;
+    std::vector<Job *> m_waiting;       // jobs queued once m_count reaches 0
+};
+
+struct JOB_STATS
+{
+    unsigned long long jobs;        // jobs run
+    unsigned long long steals;      // jobs taken from another thread's deque
+    unsigned long long splits;      // parallel for ranges split in two
+    unsigned long long helped;      // jobs run by a thread inside Wait
+};
+
+
+class JobSystem
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: JobSystem
+    //
+    // Purpose: Starts the worker threads.
+    //
+    // INPUTS: threads - the number of threads that run jobs, including the
+    //                   calling thread; 0 picks one per hardware thread
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: The calling thread only runs jobs while it is inside Wait or
+    //        ParallelFor.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    JobSystem(unsigned int threads = 0);
+
+    // Jobs still queued are dropped; Wait for them first
+    ~JobSystem(void);
+
+    // The system used by common/, created with one thread per core by the
+    // first call
+    static JobSystem& Shared(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Run
+    //
+    // Purpose: Queues fn(user).
+    //
+    // INPUTS: fn      - the job
+    //         user    - passed to fn
+    //         counter - incremented now and decremented when the job has
+    //                   finished, or NULL
+    //         after   - the job is not queued until this counter is done,
+    //                   or NULL
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: 'after' must not be reused for other jobs until the jobs that
+    //        wait on it have been queued, i.e. until it is done.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Run(JobFn fn, void *user, JobCounter *counter = NULL, JobCounter *after = NULL);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: ParallelFor
+    //
+    // Purpose: Calls fn on ranges that together cover [0, count) and returns
+    //          when all of them are done.
+    //
+    // INPUTS: count - the number of items
+    //         fn    - processes a range; called on any thread
+    //         user  - passed to fn
+    //         grain - the smallest range worth a job of its own; 0 picks one
+    //                 from the count and the number of threads
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: Ranges are split lazily. A thread that picks up a range larger
+    //        than the grain splits off the top half only if its own deque is
+    //        empty, i.e. when the half may be stolen by an idle thread; when
+    //        every thread is busy a range runs whole, so the number of jobs
+    //        adapts to how much parallelism there is.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void ParallelFor(unsigned int count, ParallelForFn fn, void *user, unsigned int grain = 0);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Wait
+    //
+    // Purpose: Returns once 'counter' is done, running queued jobs in the
+    //          meantime.
+    //
+    // INPUTS: counter - the counter
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: May be called from any thread, including from inside a job.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Wait(JobCounter& counter);
+
+    unsigned int GetThreadCount(void) const { return (unsigned int)m_queues.size(); }
+
+    // Counts since the system was created
+    JOB_STATS GetStats(void) const;
+
+private:
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<Job *> jobs;
+    };
+
+    int CurrentIndex(void) const;
+    void Push(Job *job);
+    Job *Take(int index);
+    void Execute(Job *job, int index);
+    void Finish(JobCounter *counter);
+    void Worker(unsigned int index);
+
+    std::vector<WorkQueue *> m_queues;
+    std::vector<std::thread> m_workers;
+
+    std::atomic<int> m_queued;
+    std::atomic<int> m_sleeping;
+    std::mutex m_sleep_lock;
+    std::condition_variable m_wake;
+    bool m_quit;
+
+    std::atomic<unsigned long long> m_jobs;
+    std::atomic<unsigned long long> m_steals;
+    std::atomic<unsigned long long> m_splits;
+    std::atomic<unsigned long long> m_helped;
+};
+
+#endif // __JOBSYSTEM_H
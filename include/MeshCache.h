@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: MeshCache.h
+//
+// Purpose: This file contains the declaration of the MeshCache class. The
+//          MeshCache loads every VBM file once and hands out VBObjects that
+//          share its buffers, so a mesh referenced from many places costs
+//          one upload. Files are identified by their canonical path and by a
+//          hash of their contents, so the same data reached through another
+//          path or copied to another file is shared as well.
+//
+//          Meshes nobody holds any more stay resident until the total buffer
+//          size exceeds the budget; then the least recently used ones are
+//          freed first.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __MESHCACHE_H
+#define __MESHCACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "VBObject.h"
+
+struct MESH_CACHE_STATS
+{
+    unsigned int       path_hits;       // found by canonical path, file not read
+    unsigned int       content_hits;    // found by content hash
+    unsigned int       misses;          // loaded and uploaded
+    unsigned int       evictions;
+    unsigned int       meshes;          // resident meshes
+    unsigned int       users;           // VBObjects handed out and not released
+    unsigned long long buffer_bytes;    // buffer storage of resident meshes
+};
+
+
+class MeshCache
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: MeshCache
+    //
+    // Purpose: Creates an empty cache.
+    //
+    // INPUTS: budget - the buffer storage, in bytes, that unused meshes may
+    //                  keep resident; 0 frees them as soon as they are
+    //                  released
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    MeshCache(unsigned long long budget = 256 * 1024 * 1024);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: ~MeshCache
+    //
+    // Purpose: Frees every mesh, including ones still held.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    ~MeshCache(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Acquire
+    //
+    // Purpose: Returns a VBObject for a VBM file, loading the file only if
+    //          no resident mesh has the same path or contents. Every call
+    //          returns a new VBObject with its own vertex array object, so
+    //          callers may add their own (instanced) attributes to it.
+    //
+    // INPUTS: filename       - the VBM or VBM2 file
+    //         vertexIndex    - the location of the position attribute
+    //         normalIndex    - the location of the normal attribute
+    //         texCoord0Index - the location of the texture coordinate
+    //         flags          - VBO_LOAD_* flags; meshes loaded with other
+    //                          flags are not shared
+    //
+    // OUTPUTS: Returns NULL if the file could not be loaded.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    VBObject *Acquire(const char *filename, int vertexIndex, int normalIndex,
+                      int texCoord0Index, unsigned int flags = 0);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Release
+    //
+    // Purpose: Deletes a VBObject returned by Acquire. The mesh stays
+    //          resident while it fits the budget.
+    //
+    // INPUTS: object - the object to release
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Release(VBObject *object);
+
+    // Changes the budget and evicts unused meshes until it is met
+    void SetBudget(unsigned long long budget);
+
+    // Frees every unused mesh
+    void Purge(void);
+
+    // Meshes loaded from now on take their storage from 'arena', which
+    // must outlive the cache
+    void SetArena(GPUArena *arena) { m_arena = arena; }
+
+    MESH_CACHE_STATS GetStats(void) const;
+
+private:
+    struct Entry
+    {
+        VBObject           owner;       // holds the buffers
+        unsigned long long hash;
+        unsigned long long file_size;
+        unsigned int       flags;
+        unsigned int       users;
+        unsigned long long last_use;
+    };
+
+    // What a canonical path (loaded with some flags) held when it was read
+    struct PathInfo
+    {
+        Entry *entry;
+        unsigned long long file_size;
+        long long modified;
+    };
+    typedef std::pair<std::string, unsigned int> PathKey;
+
+    MeshCache(const MeshCache&);
+    MeshCache& operator=(const MeshCache&);
+
+    Entry *FindByContent(unsigned long long hash, unsigned long long file_size, unsigned int flags);
+    void Evict(unsigned long long budget);
+    void Remove(Entry *entry);
+
+    unsigned long long m_budget;
+    unsigned long long m_clock;
+    GPUArena *m_arena;
+    std::vector<Entry *> m_entries;
+    std::map<PathKey, PathInfo> m_paths;
+    std::map<VBObject *, Entry *> m_users;
+    MESH_CACHE_STATS m_stats;
+};
+
+#endif // __MESHCACHE_H
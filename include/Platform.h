@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Platform.h
+//
+// Purpose: Small replacements for the Windows functions the samples were
+//          written against, so that they also build with GCC and Clang.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __PLATFORM_H
+#define __PLATFORM_H
+
+#include <atomic>
+#include <chrono>
+
+
+// The time GetMilliseconds returns instead of the clock's, or -1. The
+// capture mode of main.cpp sets it, so that every run draws the same
+// frames. A static in an inline function is shared by every file; it is
+// atomic so that reading it off the main thread is not a data race, though
+// only reads on the main thread are ordered with the frames
+inline std::atomic<long long>& FixedMilliseconds(void)
+{
+    static std::atomic<long long> milliseconds(-1);
+    return milliseconds;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: GetMilliseconds
+//
+// Purpose: Reads a monotonic millisecond counter, like GetTickCount.
+//
+// INPUTS: None.
+//
+// OUTPUTS: Returns the milliseconds since an arbitrary starting point,
+//          wrapping at 2^32, or FixedMilliseconds() if it is set.
+//
+// NOTES: The samples only use the low bits, to animate over a period of a
+//        few seconds.
+//
+///////////////////////////////////////////////////////////////////////////////
+static inline unsigned int GetMilliseconds(void)
+{
+    long long fixed = FixedMilliseconds().load(std::memory_order_relaxed);
+    if (fixed >= 0)
+        return (unsigned int)fixed;
+
+    return (unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+// The time from 'start' to 'end' in milliseconds, for the statistics of
+// common/
+static inline double ElapsedMilliseconds(std::chrono::high_resolution_clock::time_point start,
+                                         std::chrono::high_resolution_clock::time_point end =
+                                             std::chrono::high_resolution_clock::now())
+{
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+    return elapsed.count();
+}
+
+#endif // __PLATFORM_H
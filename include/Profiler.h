@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Profiler.h
+//
+// Purpose: This file contains the declaration of the Profiler class and the
+//          PROFILE_ZONE and PROFILE_GPU_ZONE macros, which measure where the
+//          time of a frame goes on the CPU threads and on the GPU.
+//
+//          A CPU zone is a scope: its begin and end times are taken with a
+//          steady clock and written, when the scope ends, to a ring buffer
+//          owned by the thread. Each ring has one writer (its thread) and
+//          one reader (Collect), so recording takes no lock.
+//
+//          A GPU zone brackets the GL commands of a scope with a pair of
+//          GL_TIMESTAMP queries from a pool. Collect reads back the pairs
+//          whose results are available and leaves the rest for a later
+//          frame, so reading them never stalls the pipeline.
+//
+//          Collect, called once per frame on the context thread, moves the
+//          zones into a history that WriteChromeTrace saves for
+//          chrome://tracing or Perfetto, and into per-zone statistics.
+//
+//          Recording is off until SetEnabled(true); a disabled zone costs a
+//          load and a branch. Defining PROFILER_DISABLED removes the zones.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+
+// CPU zones a thread can record between two Collect calls; more are dropped
+#define PROFILER_RING_SIZE      4096
+
+// Zones kept for WriteChromeTrace; the oldest are dropped first
+#define PROFILER_MAX_EVENTS     65536
+
+// The thread number of GPU zones
+#define PROFILER_GPU_THREAD     0
+
+struct PROFILE_EVENT
+{
+    const char *       name;        // must outlive the profiler, e.g. a literal
+    unsigned long long begin_ns;    // Profiler::Now() time base
+    unsigned long long end_ns;
+    unsigned int       thread;      // 1, 2, ... in order of first use, or PROFILER_GPU_THREAD
+};
+
+struct PROFILE_ZONE_STATS
+{
+    std::string        name;
+    bool               gpu;
+    unsigned long long calls;
+    double             last_ms;
+    double             average_ms;  // exponential moving average over the calls
+    double             min_ms;
+    double             max_ms;
+};
+
+
+class Profiler
+{
+public:
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled(void) { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds on the steady clock
+    static unsigned long long Now(void);
+
+    // Records a finished CPU zone on the calling thread's ring
+    static void Record(const char *name, unsigned long long begin_ns, unsigned long long end_ns);
+
+    // Issue the GL_TIMESTAMP queries of a GPU zone; context thread only
+    static void BeginGPU(const char *name, GLuint& begin_query);
+    static void EndGPU(const char *name, GLuint begin_query);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Collect
+    //
+    // Purpose: Drains the CPU rings, reads back the GPU zones whose queries
+    //          are done, and adds both to the history and the statistics.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: Call once per frame on the context thread.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    static void Collect(void);
+
+    // Statistics of every zone seen so far, sorted by name
+    static void GetStats(std::vector<PROFILE_ZONE_STATS>& stats);
+
+    // Writes the statistics as a table
+    static void PrintStats(std::ostream& out);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: WriteChromeTrace
+    //
+    // Purpose: Saves the history in the Chrome trace event format.
+    //
+    // INPUTS: filename - the file to write
+    //
+    // OUTPUTS: Returns false if the file could not be written.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    static bool WriteChromeTrace(const char *filename);
+
+    // Forgets the history and statistics; queries in flight are kept
+    static void Reset(void);
+
+    // Zones lost because a ring was full
+    static unsigned long long GetDroppedCount(void);
+
+    // Deletes the query pool; context thread only
+    static void Shutdown(void);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+
+// Measures the enclosing scope on the CPU
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name)
+        : m_name(name),
+          m_active(Profiler::IsEnabled()),
+          m_begin(m_active ? Profiler::Now() : 0)
+    {
+    }
+
+    ~ProfileZone(void)
+    {
+        if (m_active)
+            Profiler::Record(m_name, m_begin, Profiler::Now());
+    }
+
+private:
+    ProfileZone(const ProfileZone&);
+    ProfileZone& operator=(const ProfileZone&);
+
+    const char *m_name;
+    bool m_active;
+    unsigned long long m_begin;
+};
+
+
+// Measures the GL commands of the enclosing scope on the GPU
+class GPUProfileZone
+{
+public:
+    explicit GPUProfileZone(const char *name)
+        : m_name(name),
+          m_begin_query(0)
+    {
+        if (Profiler::IsEnabled())
+            Profiler::BeginGPU(m_name, m_begin_query);
+    }
+
+    ~GPUProfileZone(void)
+    {
+        if (m_begin_query)
+            Profiler::EndGPU(m_name, m_begin_query);
+    }
+
+private:
+    GPUProfileZone(const GPUProfileZone&);
+    GPUProfileZone& operator=(const GPUProfileZone&);
+
+    const char *m_name;
+    GLuint m_begin_query;
+};
+
+
+#define PROFILE_CONCAT2(a, b)   a##b
+#define PROFILE_CONCAT(a, b)    PROFILE_CONCAT2(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#else
+#define PROFILE_ZONE(name)      ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name)  GPUProfileZone PROFILE_CONCAT(gpu_profile_zone_, __LINE__)(name)
+#endif
+
+#endif // __PROFILER_H
@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: RenderQueue.h
+//
+// Purpose: This file contains the declaration of the RenderQueue class. A
+//          RenderQueue collects the draws of a frame, encodes the state each
+//          one needs into a 64-bit sort key, radix-sorts the keys and submits
+//          the draws in key order, so draws that share a program, textures
+//          and vertex array are issued together and each state change is
+//          made once.
+//
+//          Key layout, most significant bit first:
+//
+//          opaque:      0 | state:4 | program:12 | texture:12 | vao:14 | depth:21
+//          translucent: 1 | ~depth:21 | state:4 | program:12 | texture:12 | vao:14
+//
+//          Opaque draws are grouped by state and drawn front to back within a
+//          group; translucent (blended) draws come last, back to front. GL
+//          names are truncated to fit their fields. Two objects that share a
+//          field value are still drawn correctly, only not grouped as well.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __RENDERQUEUE_H
+#define __RENDERQUEUE_H
+
+#include <vector>
+#include "GL/glew.h"
+#include "VBObject.h"
+
+#define RENDER_QUEUE_MAX_TEXTURES   4
+
+// RENDER_ITEM state flags
+#define RENDER_STATE_DEPTH_TEST     0x1
+#define RENDER_STATE_DEPTH_WRITE    0x2
+#define RENDER_STATE_CULL           0x4
+#define RENDER_STATE_BLEND          0x8     // alpha blended, sorted back to front
+
+struct RENDER_ITEM;
+
+// Called after the program and textures of an item are bound, to set
+// per-draw uniforms
+typedef void (*RenderSetupFn)(void *user, const RENDER_ITEM& item);
+
+struct RENDER_ITEM
+{
+    GLuint         program;
+    VBObject *     object;
+    unsigned int   frame;                                   // VBM frame to draw
+    unsigned int   first_instance;                          // non-zero needs GL 4.2
+    unsigned int   instances;                               // 0 for a regular draw
+    GLenum         texture_targets[RENDER_QUEUE_MAX_TEXTURES];
+    GLuint         textures[RENDER_QUEUE_MAX_TEXTURES];     // 0 leaves the unit alone
+    unsigned int   state;                                   // RENDER_STATE_* flags
+    float          depth;                                   // view space distance, >= 0
+    RenderSetupFn  setup;
+    void *         user;
+};
+
+struct RENDER_QUEUE_STATS
+{
+    unsigned int items;
+    unsigned int draws;
+    unsigned int state_changes;
+    unsigned int program_changes;
+    unsigned int texture_changes;
+    unsigned int vao_changes;
+    double       sort_ms;
+    double       submit_ms;
+};
+
+
+class RenderQueue
+{
+public:
+    RenderQueue(void);
+
+    // Fills in an item with no textures, depth testing and writing on
+    static void InitItem(RENDER_ITEM& item, GLuint program, VBObject *object, unsigned int instances = 0);
+
+    // Forgets the items of the previous frame
+    void Clear(void);
+
+    // Queues a draw; the object must stay alive until Submit
+    void Add(const RENDER_ITEM& item);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Sort
+    //
+    // Purpose: Orders the queued items by key with an LSD radix sort, one
+    //          pass per byte. Passes over a byte that is equal in every key
+    //          are skipped, so a frame that uses few programs and objects
+    //          needs only a few passes.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Sort(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Submit
+    //
+    // Purpose: Sorts the queue if needed and draws every item, changing
+    //          only the state that differs from the previous item. State
+    //          goes through the GLStateCache.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    // NOTES: The queue is kept, so it can be submitted again (for another
+    //        view, say) until Clear is called.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Submit(void);
+
+    static unsigned long long MakeKey(const RENDER_ITEM& item);
+
+    unsigned int GetItemCount(void) const { return (unsigned int)m_items.size(); }
+
+    // Counts and timings of the last Sort and Submit
+    const RENDER_QUEUE_STATS& GetStats(void) const { return m_stats; }
+
+private:
+    std::vector<RENDER_ITEM> m_items;
+    std::vector<unsigned long long> m_keys;
+    std::vector<unsigned int> m_order;
+    std::vector<unsigned long long> m_key_scratch;
+    std::vector<unsigned int> m_order_scratch;
+    bool m_sorted;
+    RENDER_QUEUE_STATS m_stats;
+};
+
+#endif // __RENDERQUEUE_H
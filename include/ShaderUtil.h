@@ -93,7 +93,6 @@ public:
     ///////////////////////////////////////////////////////////////////////////
     GLuint LoadShaders(ShaderInfo* shaders);
 
-private:
     ///////////////////////////////////////////////////////////////////////////
     // Function Name: ReadShader
     //
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Stripifier.h
+//
+// Purpose: This file contains the declaration of the triangle stripifier. It
+//          turns an indexed triangle list into triangle strips separated by
+//          a primitive restart index, so that one glDrawElements call with
+//          GL_TRIANGLE_STRIP replaces the list (see Example 3.8).
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __STRIPIFIER_H
+#define __STRIPIFIER_H
+
+#include <vector>
+
+// Default size of the simulated post-transform vertex cache
+#define STRIP_CACHE_SIZE    16
+
+struct STRIP_STATS
+{
+    unsigned int triangles;
+    unsigned int strips;
+    unsigned int list_indices;      // indices needed as a triangle list
+    unsigned int strip_indices;     // indices needed as strips, restarts included
+    float        list_acmr;         // average cache misses per triangle (list)
+    float        strip_acmr;        // average cache misses per triangle (strips)
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: Stripify
+//
+// Purpose: Converts an indexed triangle list into restart-separated triangle
+//          strips. Strips are grown greedily across shared edges, keeping the
+//          winding of every triangle, and new strips are started next to the
+//          previous one so the vertex cache stays warm.
+//
+// INPUTS: indices       - the triangle list (3 indices per triangle)
+//         index_count   - the number of indices in the list
+//         restart_index - the value written between strips
+//         strip         - receives the strip indices
+//         stats         - optional, receives the comparison with the list
+//
+// OUTPUTS: Returns true if the strips need fewer indices than the list.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool Stripify(const unsigned int *indices, unsigned int index_count,
+              unsigned int restart_index, std::vector<unsigned int>& strip,
+              STRIP_STATS *stats = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ComputeACMR
+//
+// Purpose: Simulates a FIFO post-transform vertex cache and returns the
+//          average number of cache misses per triangle.
+//
+// INPUTS: indices       - a triangle list, or strips when 'strips' is true
+//         index_count   - the number of indices
+//         strips        - true if indices are restart-separated strips
+//         restart_index - the restart index used by the strips
+//         cache_size    - the number of entries in the simulated cache
+//
+// OUTPUTS: The average cache miss ratio (0.5 is ideal for large meshes, 3.0
+//          means nothing is ever reused).
+//
+///////////////////////////////////////////////////////////////////////////////
+float ComputeACMR(const unsigned int *indices, unsigned int index_count,
+                  bool strips, unsigned int restart_index,
+                  unsigned int cache_size = STRIP_CACHE_SIZE);
+
+#endif // __STRIPIFIER_H
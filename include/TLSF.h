@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: TLSF.h
+//
+// Purpose: This file contains the declaration of the TLSF class, a
+//          two-level segregated fit allocator (Masmano et al., 2004) that
+//          manages ranges of an address space it never touches. GPUArena
+//          uses it to suballocate buffer objects. Allocation and free are
+//          O(1): free blocks live in lists indexed by a power of two (first
+//          level) and a linear subdivision of it (second level), and two
+//          levels of bitmaps find a large enough list with a couple of bit
+//          scans.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __TLSF_H
+#define __TLSF_H
+
+#include <vector>
+
+#define TLSF_SL_LOG2        4                       // 16 second level lists
+#define TLSF_SL_COUNT       (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT       40                      // up to 2^40 granules
+#define TLSF_INVALID        0xFFFFFFFF
+
+struct TLSF_STATS
+{
+    unsigned long long capacity;
+    unsigned long long used;
+    unsigned long long largest_free;
+    unsigned int       allocations;
+    unsigned int       free_blocks;
+};
+
+
+class TLSF
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: TLSF
+    //
+    // Purpose: Creates an allocator over [0, capacity).
+    //
+    // INPUTS: capacity    - the size of the managed range in bytes
+    //         granularity - every offset and size is a multiple of this;
+    //                       must be a power of two
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    TLSF(unsigned long long capacity = 0, unsigned int granularity = 256);
+
+    // Forgets every allocation and starts over with a new range
+    void Reset(unsigned long long capacity, unsigned int granularity = 256);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Allocate
+    //
+    // Purpose: Allocates a range.
+    //
+    // INPUTS: size   - the number of bytes needed
+    //         offset - receives the start of the range
+    //
+    // OUTPUTS: A block handle for Free, or TLSF_INVALID if no free range is
+    //          large enough.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    unsigned int Allocate(unsigned long long size, unsigned long long& offset);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Free
+    //
+    // Purpose: Frees a range and merges it with free neighbors.
+    //
+    // INPUTS: block - a handle returned by Allocate
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Free(unsigned int block);
+
+    unsigned long long GetOffset(unsigned int block) const { return m_blocks[block].offset; }
+    unsigned long long GetSize(unsigned int block) const { return m_blocks[block].size; }
+    unsigned long long GetCapacity(void) const { return m_capacity; }
+    unsigned int GetGranularity(void) const { return m_granularity; }
+
+    // Calls fn(user, block, offset, size) for every allocation in address order
+    void ForEachAllocation(void (*fn)(void *user, unsigned int block, unsigned long long offset,
+                                      unsigned long long size), void *user) const;
+
+    TLSF_STATS GetStats(void) const;
+
+private:
+    struct Block
+    {
+        unsigned long long offset;
+        unsigned long long size;
+        unsigned int prev_physical;
+        unsigned int next_physical;
+        unsigned int prev_free;
+        unsigned int next_free;
+        bool free;
+    };
+
+    void Mapping(unsigned long long units, unsigned int& fl, unsigned int& sl) const;
+    unsigned int FindFree(unsigned long long units);
+    void InsertFree(unsigned int block);
+    void RemoveFree(unsigned int block);
+    unsigned int NewBlock(void);
+    void DeleteBlock(unsigned int block);
+
+    unsigned long long m_capacity;
+    unsigned int m_granularity;
+    unsigned int m_granularity_log2;
+    unsigned long long m_fl_bitmap;
+    unsigned int m_sl_bitmap[TLSF_FL_COUNT];
+    unsigned int m_heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    std::vector<Block> m_blocks;
+    std::vector<unsigned int> m_unused;     // recycled Block slots
+    unsigned long long m_used;
+    unsigned int m_allocations;
+};
+
+#endif // __TLSF_H
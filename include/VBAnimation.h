@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBAnimation.h
+//
+// Purpose: This file contains the declaration of the VBAnimation class. The
+//          VBAnimation class plays back vertex-animated VBM files. Only a
+//          sliding window of frames is kept in the buffer object, upcoming
+//          frames are read from disk on a background thread, and the vertex
+//          shader blends between the two current keyframes.
+//
+//          An animated VBM stores one keyframe per VBM_FRAME_HEADER. For
+//          each frame, 'first' and 'count' describe a range of vertices in
+//          the attribute arrays. If the file has indices, they describe one
+//          topology that is shared by every frame and index the vertices of
+//          a single frame.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __VBANIMATION_H
+#define __VBANIMATION_H
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VBM.h"
+
+// How many times a frame is read before it is given up as unreadable
+#define VBANIMATION_MAX_READS   3
+
+class VBAnimation
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: VBAnimation
+    //
+    // Purpose: Initializes VBAnimation data at instantiation.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    VBAnimation(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: ~VBAnimation
+    //
+    // Purpose: Stops the streaming thread and releases the GL objects.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    ~VBAnimation(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Open
+    //
+    // Purpose: Reads the header tables of an animated VBM file, creates the
+    //          resident frame window and starts the streaming thread.
+    //
+    // INPUTS: filename         - the VBM file to play back
+    //         vertexIndex      - attribute location of the current position
+    //         normalIndex      - attribute location of the current normal
+    //         texCoord0Index   - attribute location of the texture coordinate
+    //         nextVertexIndex  - attribute location of the next position
+    //         nextNormalIndex  - attribute location of the next normal
+    //         window           - the number of frames kept in GPU memory
+    //
+    // OUTPUTS: Returns false if the file could not be opened or does not
+    //          contain any frames.
+    //
+    // NOTES: Pass -1 for any location the shader does not use.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    bool Open(const char *filename, int vertexIndex, int normalIndex,
+              int texCoord0Index, int nextVertexIndex, int nextNormalIndex,
+              unsigned int window = 8);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Close
+    //
+    // Purpose: Stops the streaming thread and releases the GL objects.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Close(void);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Update
+    //
+    // Purpose: Moves the playback position, requests the frames that follow
+    //          it, uploads frames that the streaming thread has finished
+    //          reading and selects the keyframes to blend.
+    //
+    // INPUTS: time - the playback position measured in frames. It grows
+    //                without bound; playback loops over the frames.
+    //
+    // OUTPUTS: Returns false if a frame in the window could not be read
+    //          VBANIMATION_MAX_READS times. Such a frame is not requested
+    //          again, and playback stalls when it reaches it.
+    //
+    // NOTES: Must be called on the thread that owns the GL context. Update
+    //        never waits for the disk. If a keyframe is not resident yet,
+    //        the last resident keyframes stay bound and a stall is counted.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    bool Update(float time);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: Render
+    //
+    // Purpose: Draws the keyframes selected by the last call to Update.
+    //
+    // INPUTS: instances - the number of instances to draw, or 0 for a
+    //                     regular draw
+    //
+    // OUTPUTS: None.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    void Render(unsigned int instances = 0);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Function Name: GetBlend
+    //
+    // Purpose: Returns the weight of the next keyframe, to be passed to the
+    //          vertex shader.
+    //
+    // INPUTS: None.
+    //
+    // OUTPUTS: The blend factor in [0, 1).
+    //
+    ///////////////////////////////////////////////////////////////////////////
+    float GetBlend(void) const { return m_blend; }
+
+    unsigned int GetFrameCount(void) const { return m_header.num_frames; }
+    unsigned int GetWindowSize(void) const { return m_window; }
+    unsigned int GetStallCount(void) const { return m_stalls; }
+
+    // Reads that failed, counting every retry
+    unsigned int GetReadFailureCount(void) const;
+
+private:
+    enum SlotState
+    {
+        SLOT_EMPTY,
+        SLOT_PENDING,
+        SLOT_LOADING,
+        SLOT_STAGED,
+        SLOT_RESIDENT,
+        SLOT_FAILED         // the frame could not be read
+    };
+
+    struct Slot
+    {
+        unsigned int frame;
+        SlotState    state;
+        char*        staging;
+    };
+
+    void StreamFrames(void);
+    bool ReadFrame(std::ifstream& file, unsigned int frame, char* dest);
+    void BindKeyFrames(unsigned int slot0, unsigned int slot1);
+
+    std::string m_filename;
+    VBM_HEADER m_header;
+    std::vector<VBM_ATTRIB_HEADER> m_attrib;
+    std::vector<VBM_FRAME_HEADER> m_frame;
+    std::vector<unsigned long long> m_attrib_file_offset;
+    std::vector<unsigned int> m_attrib_stride;
+    std::vector<unsigned int> m_attrib_offset;   // offset inside a slot
+    std::vector<int> m_attrib_location;
+    unsigned int m_frame_vertices;
+    unsigned int m_slot_size;
+    unsigned int m_window;
+    int m_next_vertex_index;
+    int m_next_normal_index;
+
+    unsigned int m_vao;
+    unsigned int m_frame_buffer;
+    unsigned int m_index_buffer;
+
+    unsigned int m_bound_slot0;
+    unsigned int m_bound_slot1;
+    unsigned int m_draw_count;
+    float m_blend;
+    unsigned int m_stalls;
+
+    std::vector<Slot> m_slots;
+    std::vector<unsigned char> m_read_failures;     // per frame
+    unsigned int m_read_failure_count;
+    std::deque<unsigned int> m_requests;
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::thread m_streamer;
+    bool m_quit;
+};
+
+#endif // __VBANIMATION_H
@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBM.h
+//
+// Purpose: This file contains the on-disk layout of the VBM mesh format that
+//          is shared by VBObject and VBAnimation. A VBM file is a VBM_HEADER,
+//          followed by num_attribs VBM_ATTRIB_HEADERs, num_frames
+//          VBM_FRAME_HEADERs, the vertex data (one tightly packed array per
+//          attribute, in attribute order) and finally the index data.
+//
+//          VBM2 files store the same bytes (the "image" of an SBM1 file) in
+//          a chunked container: a VBM2_HEADER, then 64-byte aligned chunks,
+//          each compressed on its own so that they can be decoded in
+//          parallel, and finally a VBM2_CHUNK table describing where every
+//          chunk lives in the file and in the image. Chunks outside the
+//          image carry optional data such as bounds and meshlets.
+//
+//          It also declares the validating parser. Everything in a VBM file
+//          is counted by fields that come straight from disk, so nothing may
+//          be allocated or read until those counts have been checked against
+//          the length of the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __VBM_H
+#define __VBM_H
+
+#include <stddef.h>
+
+// "SBM1" read as a little-endian unsigned int
+#define VBM_MAGIC           0x314d4253
+
+// GL guarantees at least this many vertex attributes
+#define VBM_MAX_ATTRIBS     16
+
+// VBM_ATTRIB_HEADER.flags
+#define VBM_ATTRIB_NORMALIZED           0x00000001  // integer data maps to [0, 1] or [-1, 1]
+
+// VBM_FRAME_HEADER.flags: the low bits hold the primitive type of the frame.
+// Strip frames separate their strips with the primitive restart index (all
+// bits set for the index type), so they must be indexed.
+#define VBM_FRAME_PRIMITIVE_MASK        0x0000000F
+#define VBM_FRAME_TRIANGLES             0x00000000
+#define VBM_FRAME_TRIANGLE_STRIP        0x00000001
+
+// Options for ValidateVBMHeader / ValidateVBM
+#define VBM_VALIDATE_VERTEX_FRAMES  0x00000001  // frames are vertex ranges even when indexed
+
+// "VBM2" read as a little-endian unsigned int
+#define VBM2_MAGIC          0x324d4256
+#define VBM2_VERSION        1
+
+// Every chunk starts on a multiple of this many bytes
+#define VBM2_ALIGNMENT      64
+
+// Largest decoded chunk a loader has to accept
+#define VBM2_MAX_CHUNK_SIZE 0x04000000
+
+// The most an LZ4 block can expand: 255 bytes for each stored byte, plus
+// the literals that end the block
+#define VBM2_LZ4_MAX_RAW_SIZE(stored)   ((stored) * 255 + 16)
+
+// VBM2_CHUNK.type
+#define VBM2_CHUNK_IMAGE    0   // a range of the SBM1 image
+#define VBM2_CHUNK_BOUNDS   1   // one VBM_BOUNDS
+#define VBM2_CHUNK_MESHLETS 2   // an array of VBM_MESHLET
+
+// VBM2_CHUNK.codec
+#define VBM2_CODEC_NONE     0
+#define VBM2_CODEC_LZ4      1   // LZ4 block format
+
+// VBM2_CHUNK.filter, undone after decompression
+#define VBM2_FILTER_NONE    0
+#define VBM2_FILTER_SHUFFLE 1   // bytes grouped by their position in an element
+#define VBM2_FILTER_DELTA   2   // shuffled, then each byte minus the previous one
+
+struct VBM_HEADER
+{
+    unsigned int magic;
+    unsigned int size;
+    char name[64];
+    unsigned int num_attribs;
+    unsigned int num_frames;
+    unsigned int num_vertices;
+    unsigned int num_indices;
+    unsigned int index_type;
+};
+
+struct VBM_ATTRIB_HEADER
+{
+    char name[64];
+    unsigned int type;
+    unsigned int components;
+    unsigned int flags;
+};
+
+struct VBM_FRAME_HEADER
+{
+    unsigned int first;
+    unsigned int count;
+    unsigned int flags;
+};
+
+struct VBM2_HEADER
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;
+    unsigned int num_chunks;
+    unsigned long long chunk_table_offset;
+    unsigned long long image_size;      // size of the equivalent SBM1 file
+    unsigned int reserved[8];
+};
+
+// Image chunks come first, in image order, and cover the image without
+// gaps. The first one holds exactly the header tables.
+struct VBM2_CHUNK
+{
+    unsigned int type;
+    unsigned short codec;
+    unsigned short filter;
+    unsigned int element_size;          // bytes per element for the filter
+    unsigned int reserved;
+    unsigned long long raw_offset;      // position in the image
+    unsigned long long raw_size;
+    unsigned long long offset;          // position in the file
+    unsigned long long stored_size;
+};
+
+struct VBM_BOUNDS
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+};
+
+struct VBM_MESHLET
+{
+    unsigned int first_index;           // into the indices of frame 0
+    unsigned int triangle_count;
+    unsigned int vertex_count;          // unique vertices
+    float center[3];
+    float radius;
+};
+
+// Where everything lives in a validated file. All offsets are measured
+// from the start of the file.
+struct VBM_LAYOUT
+{
+    unsigned long long file_size;
+    unsigned long long tables_size;     // header + attribute and frame headers
+    unsigned long long attrib_offset[VBM_MAX_ATTRIBS];
+    unsigned int       attrib_stride[VBM_MAX_ATTRIBS];  // bytes per vertex
+    unsigned long long vertex_data_offset;
+    unsigned long long vertex_data_size;
+    unsigned long long index_data_offset;
+    unsigned long long index_data_size;
+    unsigned int       index_size;      // bytes per index
+    unsigned int       options;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBMHeader
+//
+// Purpose: Checks the fixed header of a VBM file against the length of the
+//          file and works out how many bytes of header tables follow it.
+//
+// INPUTS: header    - the first sizeof(VBM_HEADER) bytes of the file
+//         file_size - the length of the whole file in bytes
+//         options   - VBM_VALIDATE_* flags
+//         layout    - receives file_size and tables_size
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the header cannot describe a file of this size.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBMHeader(const VBM_HEADER& header, unsigned long long file_size,
+                       unsigned int options, VBM_LAYOUT *layout,
+                       const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBMTables
+//
+// Purpose: Checks the attribute and frame headers in a single pass and
+//          computes the offset and size of every data section.
+//
+// INPUTS: tables - the first layout->tables_size bytes of the file
+//         layout - a layout filled in by ValidateVBMHeader, completed here
+//         error  - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if any section would reach past the end of the
+//          file or any header holds a value the loaders cannot handle.
+//
+// NOTES: Index values are not checked; that requires the index data.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBMTables(const void *tables, VBM_LAYOUT *layout,
+                       const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM
+//
+// Purpose: Validates a VBM file that is entirely in memory.
+//
+// INPUTS: data    - the file contents
+//         size    - the length of data in bytes
+//         options - VBM_VALIDATE_* flags
+//         layout  - receives the section offsets and sizes
+//         error   - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the file is malformed.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM(const void *data, size_t size, unsigned int options,
+                 VBM_LAYOUT *layout, const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Header
+//
+// Purpose: Checks the fixed header of a VBM2 file against the length of the
+//          file.
+//
+// INPUTS: header    - the first sizeof(VBM2_HEADER) bytes of the file
+//         file_size - the length of the whole file in bytes
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the chunk table does not fit in the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Header(const VBM2_HEADER& header, unsigned long long file_size,
+                        const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Chunks
+//
+// Purpose: Checks the chunk table of a VBM2 file.
+//
+// INPUTS: header    - a header accepted by ValidateVBM2Header
+//         chunks    - the header.num_chunks entries of the chunk table
+//         file_size - the length of the whole file in bytes
+//         error     - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if a chunk lies outside the file, is misaligned,
+//          uses an unknown codec or filter, claims to decode to more than
+//          its codec can produce, or the image chunks do not cover the
+//          image exactly once.
+//
+// NOTES: Since no chunk can expand beyond what its codec allows, an
+//        accepted image is at most about 256 times the size of the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Chunks(const VBM2_HEADER& header, const VBM2_CHUNK *chunks,
+                        unsigned long long file_size, const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ValidateVBM2Image
+//
+// Purpose: Checks that the image chunks line up with the sections of the
+//          image, so each one can be decoded straight into its buffer.
+//
+// INPUTS: header - a validated VBM2 header
+//         chunks - the validated chunk table
+//         layout - the layout of the image, from ValidateVBMTables
+//         error  - optional, receives a description of the problem
+//
+// OUTPUTS: Returns false if the first chunk is not exactly the header
+//          tables, a chunk straddles two sections or the image has trailing
+//          bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ValidateVBM2Image(const VBM2_HEADER& header, const VBM2_CHUNK *chunks,
+                       const VBM_LAYOUT& layout, const char **error = 0);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: GetVBMTypeSize
+//
+// Purpose: Returns the size of one vertex of an attribute.
+//
+// INPUTS: type       - the GL type of the attribute
+//         components - the number of components per vertex
+//
+// OUTPUTS: Returns 0 if the combination is not supported.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned int GetVBMTypeSize(unsigned int type, unsigned int components);
+
+#endif // __VBM_H
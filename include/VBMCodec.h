@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBMCodec.h
+//
+// Purpose: This file contains the declaration of the chunk codecs used by
+//          VBM2 files: an LZ4 block format compressor and decompressor, and
+//          the byte shuffle and delta filters that make vertex and index
+//          arrays compress well. Like VBM.h it does not depend on GL.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __VBMCODEC_H
+#define __VBMCODEC_H
+
+#include <stddef.h>
+#include <vector>
+#include "VBM.h"
+
+class JobSystem;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4CompressBound
+//
+// Purpose: Returns the largest size LZ4Compress can produce for an input.
+//
+// INPUTS: size - the length of the input in bytes
+//
+// OUTPUTS: The worst case compressed size.
+//
+///////////////////////////////////////////////////////////////////////////////
+size_t LZ4CompressBound(size_t size);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4Compress
+//
+// Purpose: Compresses a block into the LZ4 block format.
+//
+// INPUTS: src      - the data to compress
+//         size     - the length of src in bytes
+//         dst      - receives the compressed block
+//         capacity - the length of dst, at least LZ4CompressBound(size)
+//
+// OUTPUTS: The length of the compressed block, or 0 if dst is too small.
+//
+///////////////////////////////////////////////////////////////////////////////
+size_t LZ4Compress(const void *src, size_t size, void *dst, size_t capacity);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: LZ4Decompress
+//
+// Purpose: Decompresses an LZ4 block. Every length and match offset is
+//          checked, so corrupt input cannot read or write out of bounds.
+//
+// INPUTS: src      - the compressed block
+//         size     - the length of src in bytes
+//         dst      - receives the data
+//         raw_size - the exact length of the decompressed data
+//
+// OUTPUTS: Returns false if the block is corrupt or does not decompress to
+//          exactly raw_size bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LZ4Decompress(const void *src, size_t size, void *dst, size_t raw_size);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: EncodeVBM2Chunk
+//
+// Purpose: Filters and compresses one chunk, keeping whichever filter gives
+//          the smallest result, or storing it as-is if nothing helps.
+//
+// INPUTS: chunk  - type, raw_offset, raw_size and element_size are set by
+//                  the caller; codec, filter and stored_size are filled in
+//         raw    - the chunk data
+//         stored - receives the bytes to write to the file
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void EncodeVBM2Chunk(VBM2_CHUNK& chunk, const void *raw, std::vector<unsigned char>& stored);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: DecodeVBM2Chunk
+//
+// Purpose: Decompresses one validated chunk and undoes its filter.
+//
+// INPUTS: chunk   - the chunk table entry
+//         stored  - the chunk.stored_size bytes read from the file
+//         raw     - receives chunk.raw_size bytes
+//         scratch - working memory, grown as needed
+//
+// OUTPUTS: Returns false if the chunk data is corrupt.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool DecodeVBM2Chunk(const VBM2_CHUNK& chunk, const void *stored, void *raw,
+                     std::vector<unsigned char>& scratch);
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ReadVBM2Range
+//
+// Purpose: Decodes every image chunk inside a range of the image, spreading
+//          the chunks over the threads of a JobSystem. Each job reads its
+//          chunks through its own file handle, so only one compressed chunk
+//          per job is held in memory.
+//
+// INPUTS: filename   - the VBM2 file
+//         chunks     - the validated chunk table
+//         num_chunks - the number of entries in chunks
+//         offset     - the start of the range in the image
+//         size       - the length of the range
+//         dest       - receives the decoded range
+//         jobs       - the system to decode on, or NULL for
+//                      JobSystem::Shared()
+//
+// OUTPUTS: Returns false if a chunk could not be read or decoded.
+//
+// NOTES: Chunks must lie entirely inside or outside the range, which
+//        ValidateVBM2Image guarantees for the vertex and index data.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ReadVBM2Range(const char *filename, const VBM2_CHUNK *chunks, unsigned int num_chunks,
+                   unsigned long long offset, unsigned long long size, void *dest,
+                   JobSystem *jobs = NULL);
+
+#endif // __VBMCODEC_H
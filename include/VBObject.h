@@ -1,54 +1,78 @@
 #ifndef __VBOBJECT_H
 #define __VBOBJECT_H
 
+#include <vector>
+#include "VBM.h"
+#include "GPUArena.h"
+
+// Flags for LoadFromVBM
+#define VBO_LOAD_COMPACT_INDICES    0x00000001  // store 32-bit indices as 16-bit when they fit
+#define VBO_LOAD_STRIPIFY           0x00000002  // convert triangle list frames to strips
+
 class VBObject
 {
 public:
     VBObject(void);
     ~VBObject(void);
 
-    bool LoadFromVBM(const char * filename, int vertexIndex, int normalIndex, int texCoord0Index);
-    void Render(unsigned int frame_index = 0, unsigned int instances = 0);
+    bool LoadFromVBM(const char * filename, int vertexIndex, int normalIndex, int texCoord0Index, unsigned int flags = 0);
+    // A non-zero base_instance needs GL 4.2 or ARB_base_instance
+    void Render(unsigned int frame_index = 0, unsigned int instances = 0, unsigned int base_instance = 0);
+
+    // Makes this object a view of the buffers of 'source' with its own
+    // vertex array object and attribute locations. 'source' must outlive
+    // this object; MeshCache takes care of that.
+    bool Share(const VBObject& source, int vertexIndex, int normalIndex, int texCoord0Index);
+
+    // Takes vertex and index storage from 'arena' on the next LoadFromVBM
+    // instead of creating buffers. The arena must outlive the object; when
+    // it moves the storage the vertex arrays (and those of every object
+    // sharing this one) are re-pointed.
+    void SetArena(GPUArena *arena) { m_arena = arena; }
     void BindVertexArray();
+    unsigned int GetVertexArray(void) const { return m_vao; }
 
     unsigned int GetVertexCount(unsigned int frame = 0);
     unsigned int GetAttributeCount(void) const;
     const char * GetAttributeName(unsigned int index) const;
+    unsigned int GetIndexType(void) const { return m_index_type; }
+
+    // Bounds are stored by vbmc in VBM2 files only
+    bool GetBounds(VBM_BOUNDS& bounds) const;
+
+    // Bytes of buffer storage owned (or shared) by this object
+    unsigned long long GetBufferSize(void) const { return m_buffer_size; }
 
 private:
 
     bool Free(void);
-
-    struct VBM_HEADER
-    {
-        unsigned int magic;
-        unsigned int size;
-        char name[64];
-        unsigned int num_attribs;
-        unsigned int num_frames;
-        unsigned int num_vertices;
-        unsigned int num_indices;
-        unsigned int index_type;
-    };
-
-    struct VBM_ATTRIB_HEADER
-    {
-        char name[64];
-        unsigned int type;
-        unsigned int components;
-        unsigned int flags;
-    };
-
-    struct VBM_FRAME_HEADER
-    {
-        unsigned int first;
-        unsigned int count;
-        unsigned int flags;
-    };
+    bool CreateStorage(GLenum target, unsigned long long size, GPU_ALLOCATION& allocation,
+                       unsigned int& buffer, unsigned long long& base);
+    bool UploadIndices(const std::vector<unsigned int>& indices, bool narrow);
+    void SetupAttributes(int vertexIndex, int normalIndex, int texCoord0Index);
+    void Rebind(void);
+    static void Relocate(void *user, const GPU_ALLOCATION& from, const GPU_ALLOCATION& to);
 
     unsigned int m_vao;
     unsigned int m_attribute_buffer;
     unsigned int m_index_buffer;
+    unsigned int m_index_type;
+    unsigned int m_index_size;
+    bool m_has_bounds;
+    VBM_BOUNDS m_bounds;
+    bool m_shared;
+    unsigned long long m_buffer_size;
+    unsigned long long m_attrib_offset[VBM_MAX_ATTRIBS];
+    int m_locations[3];
+
+    // Buffer offsets are 0 unless the storage comes from an arena
+    GPUArena * m_arena;
+    GPU_ALLOCATION m_vertex_alloc;
+    GPU_ALLOCATION m_index_alloc;
+    unsigned long long m_vertex_base;
+    unsigned long long m_index_base;
+    const VBObject * m_source;
+    mutable std::vector<VBObject *> m_sharers;
 
     VBM_HEADER * m_header;
     VBM_ATTRIB_HEADER * m_attrib;
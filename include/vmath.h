@@ -4,159 +4,450 @@
 
 #define _USE_MATH_DEFINES  1 // Include constants defined in math.h
 #include <math.h>
+#include <stddef.h>
+
+// SSE versions of the float inverses, unless VMATH_NO_SIMD is defined
+#if !defined(VMATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define VMATH_SSE   1
+#include <xmmintrin.h>
+#endif
+
+// The vectorized sincos needs SSE2 for its integer lanes, and takes eight
+// lanes at a time with AVX2
+#if defined(VMATH_SSE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VMATH_SSE2  1
+#include <emmintrin.h>
+#endif
+
+#if defined(VMATH_SSE2) && defined(__AVX2__)
+#define VMATH_AVX2  1
+#include <immintrin.h>
+#endif
+
+// With C++14 the constructors, arithmetic and the matrix builders
+// (identity, translate, scale, frustum) are constexpr, so tables of vectors
+// and matrices are built at compile time. Before that they are just inline.
+#if __cplusplus >= 201402L || (defined(_MSC_VER) && _MSC_VER >= 1910)
+#define VMATH_CONSTEXPR     constexpr
+#else
+#define VMATH_CONSTEXPR     inline
+#endif
+
+// Keeps rarely taken paths out of the loops that call them
+#if defined(_MSC_VER)
+#define VMATH_NOINLINE      __declspec(noinline)
+#elif defined(__GNUC__)
+#define VMATH_NOINLINE      __attribute__((noinline))
+#else
+#define VMATH_NOINLINE
+#endif
+
+// The default constructors leave the elements uninitialized, like built-in
+// types. Where the compiler supports it they are defaulted, which makes the
+// types trivial as well as trivially copyable.
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1800)
+#define VMATH_DEFAULT_CONSTRUCTOR(type)     type() = default;
+#else
+#define VMATH_DEFAULT_CONSTRUCTOR(type)     inline type() {}
+#endif
+
+// A vector is aligned to its size when that is 8 or 16 bytes, so a vec4 or
+// a column of a mat4 can be moved with one aligned SSE load or store
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define VMATH_ALIGNAS(n)    alignas(n)
+#else
+#define VMATH_ALIGNAS(n)
+#endif
 
 namespace vmath
 {
 
-template <typename T> 
-inline T radians(T angleInRadians)
+// Every function taking an angle in degrees converts it with radians()
+template <typename T>
+inline T radians(T angleInDegrees)
+{
+    return angleInDegrees * static_cast<T>(M_PI / 180.0);
+}
+
+template <typename T>
+inline T degrees(T angleInRadians)
 {
-	return angleInRadians * static_cast<T>(180.0/M_PI);
+    return angleInRadians * static_cast<T>(180.0 / M_PI);
 }
 
-template <const bool cond>
-class ensure
+// The precision tiers of the sincos kernels, as the largest absolute error
+// for angles up to SINCOS_RANGE radians:
+//   SINCOS_PRECISE - under 1e-7, like sinf and cosf
+//   SINCOS_FAST    - under 1.25e-5, with a shorter range reduction and
+//                    polynomials; plenty for animation
+enum sincos_precision
 {
-public:
-    inline ensure() { switch (false) { case false: case cond: break; } }
+    SINCOS_PRECISE,
+    SINCOS_FAST
 };
 
-template <typename T, const int len> class vecN;
+// Those bounds, indexed by sincos_precision; tools/trigbench fails when a
+// kernel exceeds them
+static const double SINCOS_MAX_ERROR[] = { 1.0e-7, 1.25e-5 };
 
-template <typename T, const int len>
-class vecN
+// Beyond this the range reduction is no longer exact, so larger angles,
+// infinities and NaNs are handed to sinf and cosf
+static const float SINCOS_RANGE = 8192.0f;
+
+// The lanes the sincos kernel runs on: one float, the fallback and the
+// tail of an array, then four (SSE2) and eight (AVX2)
+struct sincos_lanes1
 {
-public:
-    typedef class vecN<T,len> my_type;
+    typedef float real;
+    typedef int integer;
+
+    static inline real load(const float *p) { return *p; }
+    static inline void store(float *p, real v) { *p = v; }
+    static inline real set(float f) { return f; }
+    // A bit for each lane whose magnitude is above limit, or is NaN
+    static inline int beyond(real a, float limit) { return !(fabsf(a) <= limit) ? 1 : 0; }
+    static inline real add(real a, real b) { return a + b; }
+    static inline real sub(real a, real b) { return a - b; }
+    static inline real mul(real a, real b) { return a * b; }
+    // To nearest even, as cvtps2dq does; exact for |a| < 2^22. Beyond
+    // that, and for NaN, it gives 0 rather than overflow
+    static inline integer round(real a)
+    {
+        return fabsf(a) < 4194304.0f ? (integer)((a + 12582912.0f) - 12582912.0f) : 0;
+    }
+    static inline real convert(integer i) { return (real)i; }
+    static inline integer next(integer i) { return i + 1; }
 
-    // Default constructor does nothing, just like built-in types
-    inline vecN()
+    // Swaps a and b where q is odd
+    static inline void swap_odd(integer q, real& a, real& b)
+    {
+        if (q & 1)
+        {
+            real t = a;
+            a = b;
+            b = t;
+        }
+    }
+
+    // Negates v where bit 1 of q is set
+    static inline real negate_bit1(integer q, real v) { return (q & 2) ? -v : v; }
+};
+
+#ifdef VMATH_SSE2
+struct sincos_lanes4
+{
+    typedef __m128 real;
+    typedef __m128i integer;
+
+    static inline real load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void store(float *p, real v) { _mm_storeu_ps(p, v); }
+    static inline real set(float f) { return _mm_set1_ps(f); }
+    static inline int beyond(real a, float limit)
+    {
+        return _mm_movemask_ps(_mm_cmpnle_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), a), _mm_set1_ps(limit)));
+    }
+    static inline real add(real a, real b) { return _mm_add_ps(a, b); }
+    static inline real sub(real a, real b) { return _mm_sub_ps(a, b); }
+    static inline real mul(real a, real b) { return _mm_mul_ps(a, b); }
+    static inline integer round(real a) { return _mm_cvtps_epi32(a); }
+    static inline real convert(integer i) { return _mm_cvtepi32_ps(i); }
+    static inline integer next(integer i) { return _mm_add_epi32(i, _mm_set1_epi32(1)); }
+
+    static inline void swap_odd(integer q, real& a, real& b)
+    {
+        const integer one = _mm_set1_epi32(1);
+        const real odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+        const real t = a;
+        a = _mm_or_ps(_mm_and_ps(odd, b), _mm_andnot_ps(odd, a));
+        b = _mm_or_ps(_mm_and_ps(odd, t), _mm_andnot_ps(odd, b));
+    }
+
+    static inline real negate_bit1(integer q, real v)
     {
-        // Uninitialized variable
+        const integer sign = _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30);
+        return _mm_xor_ps(v, _mm_castsi128_ps(sign));
     }
+};
+#endif /* VMATH_SSE2 */
+
+#ifdef VMATH_AVX2
+struct sincos_lanes8
+{
+    typedef __m256 real;
+    typedef __m256i integer;
 
-    // Copy constructor
-    inline vecN(const vecN& that)
+    static inline real load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void store(float *p, real v) { _mm256_storeu_ps(p, v); }
+    static inline real set(float f) { return _mm256_set1_ps(f); }
+    static inline int beyond(real a, float limit)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a),
+                                                _mm256_set1_ps(limit), _CMP_NLE_UQ));
+    }
+    static inline real add(real a, real b) { return _mm256_add_ps(a, b); }
+    static inline real sub(real a, real b) { return _mm256_sub_ps(a, b); }
+    static inline real mul(real a, real b) { return _mm256_mul_ps(a, b); }
+    static inline integer round(real a) { return _mm256_cvtps_epi32(a); }
+    static inline real convert(integer i) { return _mm256_cvtepi32_ps(i); }
+    static inline integer next(integer i) { return _mm256_add_epi32(i, _mm256_set1_epi32(1)); }
+
+    static inline void swap_odd(integer q, real& a, real& b)
     {
-        assign(that);
+        const integer one = _mm256_set1_epi32(1);
+        const real odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+        const real t = a;
+        a = _mm256_blendv_ps(a, b, odd);
+        b = _mm256_blendv_ps(b, t, odd);
     }
 
-    // Construction from scalar
-    inline vecN(T s)
+    static inline real negate_bit1(integer q, real v)
     {
-        int n;
-        for (n = 0; n < len; n++)
+        const integer sign = _mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30);
+        return _mm256_xor_ps(v, _mm256_castsi256_ps(sign));
+    }
+};
+#endif /* VMATH_AVX2 */
+
+// The sines and cosines of one set of lanes of angles in radians. The angle
+// is reduced to r in [-pi/4, pi/4] plus a multiple q of pi/2, and the
+// polynomials for r are swapped and negated by quadrant; lanes beyond
+// SINCOS_RANGE are redone with sinf and cosf. The same operations run on
+// every lane type, but where the compiler contracts them into FMAs (with
+// -mfma, say) it may do so differently for each width, so results can
+// differ between widths by an ulp or so.
+static VMATH_NOINLINE inline void sincos_beyond(const float *x, float *s, float *c, int lanes)
+{
+    for (int i = 0; lanes >> i; i++)
+    {
+        if (lanes & (1 << i))
         {
-            data[n] = s;
+            s[i] = sinf(x[i]);
+            c[i] = cosf(x[i]);
         }
     }
+}
+
+template <typename L>
+static inline void sincos_kernel(const float *x, float *s, float *c, sincos_precision precision)
+{
+    typedef typename L::real real;
+    typedef typename L::integer integer;
 
-    // Assignment operator
-    inline vecN& operator=(const vecN& that)
+    const real v = L::load(x);
+    const int wide = L::beyond(v, SINCOS_RANGE);
+
+    const integer q = L::round(L::mul(v, L::set(0.636619772f)));    // 2 / pi
+    const real j = L::convert(q);
+    real sin_r, cos_r;
+
+    if (precision == SINCOS_FAST)
     {
-        assign(that);
-        return *this;
+        real r = L::sub(v, L::mul(j, L::set(1.5703125f)));
+        r = L::sub(r, L::mul(j, L::set(4.83826794897e-4f)));
+        const real r2 = L::mul(r, r);
+
+        sin_r = L::add(r, L::mul(L::mul(r, r2), L::add(L::set(-0.166628333f), L::mul(r2, L::set(8.15297881e-3f)))));
+        cos_r = L::add(L::set(1.0f), L::mul(r2, L::add(L::set(-0.499776267f), L::mul(r2, L::set(4.04888302e-2f)))));
+    }
+    else
+    {
+        // pi / 2 in three parts, so that j times each part is exact
+        real r = L::sub(v, L::mul(j, L::set(1.5703125f)));
+        r = L::sub(r, L::mul(j, L::set(4.837512969970703125e-4f)));
+        r = L::sub(r, L::mul(j, L::set(7.54978995489188216e-8f)));
+        const real r2 = L::mul(r, r);
+
+        real p = L::add(L::mul(L::set(-1.9515295891e-4f), r2), L::set(8.3321608736e-3f));
+        p = L::add(L::mul(p, r2), L::set(-1.6666654611e-1f));
+        sin_r = L::add(r, L::mul(L::mul(r, r2), p));
+
+        p = L::add(L::mul(L::set(2.443315711809948e-5f), r2), L::set(-1.388731625493765e-3f));
+        p = L::add(L::mul(p, r2), L::set(4.166664568298827e-2f));
+        cos_r = L::add(L::sub(L::set(1.0f), L::mul(r2, L::set(0.5f))), L::mul(L::mul(r2, r2), p));
+    }
+
+    // sin(r + q pi/2) is sin r, cos r, -sin r, -cos r for q = 0, 1, 2, 3, and
+    // cos(r + q pi/2) is the sine one quadrant on
+    L::swap_odd(q, sin_r, cos_r);
+    L::store(s, L::negate_bit1(q, sin_r));
+    L::store(c, L::negate_bit1(L::next(q), cos_r));
+
+    if (wide)
+        sincos_beyond(x, s, c, wide);
+}
+
+// The sines and cosines of 4, 8 or 16 angles in radians, in the widest
+// lanes available
+static inline void sincos4(const float *x, float *s, float *c, sincos_precision precision = SINCOS_PRECISE)
+{
+#ifdef VMATH_SSE2
+    sincos_kernel<sincos_lanes4>(x, s, c, precision);
+#else
+    for (int i = 0; i < 4; i++)
+        sincos_kernel<sincos_lanes1>(x + i, s + i, c + i, precision);
+#endif
+}
+
+static inline void sincos8(const float *x, float *s, float *c, sincos_precision precision = SINCOS_PRECISE)
+{
+#ifdef VMATH_AVX2
+    sincos_kernel<sincos_lanes8>(x, s, c, precision);
+#else
+    sincos4(x, s, c, precision);
+    sincos4(x + 4, s + 4, c + 4, precision);
+#endif
+}
+
+static inline void sincos16(const float *x, float *s, float *c, sincos_precision precision = SINCOS_PRECISE)
+{
+    sincos8(x, s, c, precision);
+    sincos8(x + 8, s + 8, c + 8, precision);
+}
+
+// Any number of angles in radians
+static inline void sincos_array(const float *x, float *s, float *c, size_t count,
+                                sincos_precision precision = SINCOS_PRECISE)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+        sincos16(x + i, s + i, c + i, precision);
+    for (; i + 4 <= count; i += 4)
+        sincos4(x + i, s + i, c + i, precision);
+    for (; i < count; i++)
+        sincos_kernel<sincos_lanes1>(x + i, s + i, c + i, precision);
+}
+
+template <typename T, const int len>
+struct vecN_alignment
+{
+    enum { size = sizeof(T) * len };
+    enum { value = (size == 8 || size == 16) ? int(size) : int(sizeof(T)) };
+};
+
+template <typename T, const int len> class vecN;
+
+// The vector and matrix types have no user-provided copy constructor,
+// assignment or destructor: they are trivially copyable and standard-layout,
+// so arrays of them can be memcpy'd into buffers and read back the same way.
+template <typename T, const int len>
+class VMATH_ALIGNAS((vecN_alignment<T,len>::value)) vecN
+{
+public:
+    typedef class vecN<T,len> my_type;
+
+    // Default constructor does nothing, just like built-in types
+    VMATH_DEFAULT_CONSTRUCTOR(vecN)
+
+    // Construction from scalar
+    VMATH_CONSTEXPR vecN(T s) : data()
+    {
+        for (int n = 0; n < len; n++)
+        {
+            data[n] = s;
+        }
     }
 
-    inline vecN operator+(const vecN& that) const
+    VMATH_CONSTEXPR vecN operator+(const vecN& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = data[n] + that.data[n];
         return result;
     }
 
-    inline vecN& operator+=(const vecN& that)
+    VMATH_CONSTEXPR vecN& operator+=(const vecN& that)
     {
-        return (*this = *this + that);
+        for (int n = 0; n < len; n++)
+            data[n] += that.data[n];
+        return *this;
     }
 
-    inline vecN operator-() const
+    VMATH_CONSTEXPR vecN operator-() const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = -data[n];
         return result;
     }
 
-    inline vecN operator-(const vecN& that) const
+    VMATH_CONSTEXPR vecN operator-(const vecN& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = data[n] - that.data[n];
         return result;
     }
 
-    inline vecN& operator-=(const vecN& that)
+    VMATH_CONSTEXPR vecN& operator-=(const vecN& that)
     {
-        return (*this = *this - that);
+        for (int n = 0; n < len; n++)
+            data[n] -= that.data[n];
+        return *this;
     }
 
-    inline vecN operator*(const vecN& that) const
+    VMATH_CONSTEXPR vecN operator*(const vecN& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = data[n] * that.data[n];
         return result;
     }
 
-    inline vecN& operator*=(const vecN& that)
+    VMATH_CONSTEXPR vecN& operator*=(const vecN& that)
     {
-        return (*this = *this * that);
+        for (int n = 0; n < len; n++)
+            data[n] *= that.data[n];
+        return *this;
     }
 
-    inline vecN operator*(const T& that) const
+    VMATH_CONSTEXPR vecN operator*(const T& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = data[n] * that;
         return result;
     }
 
-    inline vecN& operator*=(const T& that)
+    VMATH_CONSTEXPR vecN& operator*=(const T& that)
     {
-        assign(*this * that);
-
+        for (int n = 0; n < len; n++)
+            data[n] *= that;
         return *this;
     }
 
-    inline vecN operator/(const vecN& that) const
+    VMATH_CONSTEXPR vecN operator/(const vecN& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
-            result.data[n] = data[n] * that.data[n];
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
+            result.data[n] = data[n] / that.data[n];
         return result;
     }
 
-    inline vecN& operator/=(const vecN& that)
+    VMATH_CONSTEXPR vecN& operator/=(const vecN& that)
     {
-        assign(*this * that);
-
+        for (int n = 0; n < len; n++)
+            data[n] /= that.data[n];
         return *this;
     }
 
-    inline vecN operator/(const T& that) const
+    VMATH_CONSTEXPR vecN operator/(const T& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < len; n++)
+        my_type result(T(0));
+        for (int n = 0; n < len; n++)
             result.data[n] = data[n] / that;
         return result;
     }
 
-    inline vecN& operator/(const T& that)
+    VMATH_CONSTEXPR vecN& operator/=(const T& that)
     {
-        assign(*this / that);
+        for (int n = 0; n < len; n++)
+            data[n] /= that;
+        return *this;
     }
 
-    inline T& operator[](int n) { return data[n]; }
-    inline const T& operator[](int n) const { return data[n]; }
+    VMATH_CONSTEXPR T& operator[](int n) { return data[n]; }
+    VMATH_CONSTEXPR const T& operator[](int n) const { return data[n]; }
 
     inline static int size(void) { return len; }
 
@@ -164,13 +455,6 @@ public:
 
 protected:
     T data[len];
-
-    inline void assign(const vecN& that)
-    {
-        int n;
-        for (n = 0; n < len; n++)
-            data[n] = that.data[n];
-    }
 };
 
 template <typename T>
@@ -180,12 +464,13 @@ public:
     typedef vecN<T,2> base;
 
     // Uninitialized variable
-    inline Tvec2() {}
-    // Copy constructor
-    inline Tvec2(const base& v) : base(v) {}
+    VMATH_DEFAULT_CONSTRUCTOR(Tvec2)
+    // Conversion from the base vector
+    VMATH_CONSTEXPR Tvec2(const base& v) : base(v) {}
 
     // vec2(x, y);
-    inline Tvec2(T x, T y)
+    VMATH_CONSTEXPR Tvec2(T x, T y)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = y;
@@ -199,13 +484,14 @@ public:
     typedef vecN<T,3> base;
 
     // Uninitialized variable
-    inline Tvec3() {}
+    VMATH_DEFAULT_CONSTRUCTOR(Tvec3)
 
-    // Copy constructor
-    inline Tvec3(const base& v) : base(v) {}
+    // Conversion from the base vector
+    VMATH_CONSTEXPR Tvec3(const base& v) : base(v) {}
 
     // vec3(x, y, z);
-    inline Tvec3(T x, T y, T z)
+    VMATH_CONSTEXPR Tvec3(T x, T y, T z)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = y;
@@ -213,7 +499,8 @@ public:
     }
 
     // vec3(v, z);
-    inline Tvec3(const Tvec2<T>& v, T z)
+    VMATH_CONSTEXPR Tvec3(const Tvec2<T>& v, T z)
+        : base()
     {
         base::data[0] = v[0];
         base::data[1] = v[1];
@@ -221,7 +508,8 @@ public:
     }
 
     // vec3(x, v)
-    inline Tvec3(T x, const Tvec2<T>& v)
+    VMATH_CONSTEXPR Tvec3(T x, const Tvec2<T>& v)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = v[0];
@@ -236,13 +524,14 @@ public:
     typedef vecN<T,4> base;
 
     // Uninitialized variable
-    inline Tvec4() {}
+    VMATH_DEFAULT_CONSTRUCTOR(Tvec4)
 
-    // Copy constructor
-    inline Tvec4(const base& v) : base(v) {}
+    // Conversion from the base vector
+    VMATH_CONSTEXPR Tvec4(const base& v) : base(v) {}
 
     // vec4(x, y, z, w);
-    inline Tvec4(T x, T y, T z, T w)
+    VMATH_CONSTEXPR Tvec4(T x, T y, T z, T w)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = y;
@@ -251,7 +540,8 @@ public:
     }
 
     // vec4(v, z, w);
-    inline Tvec4(const Tvec2<T>& v, T z, T w)
+    VMATH_CONSTEXPR Tvec4(const Tvec2<T>& v, T z, T w)
+        : base()
     {
         base::data[0] = v[0];
         base::data[1] = v[1];
@@ -260,7 +550,8 @@ public:
     }
 
     // vec4(x, v, w);
-    inline Tvec4(T x, const Tvec2<T>& v, T w)
+    VMATH_CONSTEXPR Tvec4(T x, const Tvec2<T>& v, T w)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = v[0];
@@ -269,7 +560,8 @@ public:
     }
 
     // vec4(x, y, v);
-    inline Tvec4(T x, T y, const Tvec2<T>& v)
+    VMATH_CONSTEXPR Tvec4(T x, T y, const Tvec2<T>& v)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = y;
@@ -278,7 +570,8 @@ public:
     }
 
     // vec4(v1, v2);
-    inline Tvec4(const Tvec2<T>& u, const Tvec2<T>& v)
+    VMATH_CONSTEXPR Tvec4(const Tvec2<T>& u, const Tvec2<T>& v)
+        : base()
     {
         base::data[0] = u[0];
         base::data[1] = u[1];
@@ -287,7 +580,8 @@ public:
     }
 
     // vec4(v, w);
-    inline Tvec4(const Tvec3<T>& v, T w)
+    VMATH_CONSTEXPR Tvec4(const Tvec3<T>& v, T w)
+        : base()
     {
         base::data[0] = v[0];
         base::data[1] = v[1];
@@ -296,7 +590,8 @@ public:
     }
 
     // vec4(x, v);
-    inline Tvec4(T x, const Tvec3<T>& v)
+    VMATH_CONSTEXPR Tvec4(T x, const Tvec3<T>& v)
+        : base()
     {
         base::data[0] = x;
         base::data[1] = v[0];
@@ -321,35 +616,34 @@ typedef Tvec4<unsigned int> uvec4;
 typedef Tvec4<double> dvec4;
 
 template <typename T, int n>
-static inline const vecN<T,n> operator * (T x, const vecN<T,n>& v)
+static VMATH_CONSTEXPR const vecN<T,n> operator * (T x, const vecN<T,n>& v)
 {
     return v * x;
 }
 
 template <typename T>
-static inline const Tvec2<T> operator / (T x, const Tvec2<T>& v)
+static VMATH_CONSTEXPR const Tvec2<T> operator / (T x, const Tvec2<T>& v)
 {
     return Tvec2<T>(x / v[0], x / v[1]);
 }
 
 template <typename T>
-static inline const Tvec3<T> operator / (T x, const Tvec3<T>& v)
+static VMATH_CONSTEXPR const Tvec3<T> operator / (T x, const Tvec3<T>& v)
 {
     return Tvec3<T>(x / v[0], x / v[1], x / v[2]);
 }
 
 template <typename T>
-static inline const Tvec4<T> operator / (T x, const Tvec4<T>& v)
+static VMATH_CONSTEXPR const Tvec4<T> operator / (T x, const Tvec4<T>& v)
 {
     return Tvec4<T>(x / v[0], x / v[1], x / v[2], x / v[3]);
 }
 
 template <typename T, int len>
-static inline T dot(const vecN<T,len>& a, const vecN<T,len>& b)
+static VMATH_CONSTEXPR T dot(const vecN<T,len>& a, const vecN<T,len>& b)
 {
-    int n;
     T total = T(0);
-    for (n = 0; n < len; n++)
+    for (int n = 0; n < len; n++)
     {
         total += a[n] * b[n];
     }
@@ -357,7 +651,7 @@ static inline T dot(const vecN<T,len>& a, const vecN<T,len>& b)
 }
 
 template <typename T>
-static inline vecN<T,3> cross(const vecN<T,3>& a, const vecN<T,3>& b)
+static VMATH_CONSTEXPR vecN<T,3> cross(const vecN<T,3>& a, const vecN<T,3>& b)
 {
     return Tvec3<T>(a[1] * b[2] - b[1] * a[2],
                     a[2] * b[0] - b[2] * a[0],
@@ -389,6 +683,36 @@ static inline T distance(const vecN<T,len>& a, const vecN<T,len>& b)
     return length(b - a);
 }
 
+// a * b + c in one pass, without the temporary of a * b. Per element it is
+// the multiply-add the compiler can turn into an FMA.
+template <typename T, int len>
+static VMATH_CONSTEXPR vecN<T,len> mul_add(const vecN<T,len>& a, const vecN<T,len>& b, const vecN<T,len>& c)
+{
+    vecN<T,len> result(T(0));
+    for (int n = 0; n < len; n++)
+        result[n] = a[n] * b[n] + c[n];
+    return result;
+}
+
+template <typename T, int len>
+static VMATH_CONSTEXPR vecN<T,len> mul_add(const vecN<T,len>& a, T b, const vecN<T,len>& c)
+{
+    vecN<T,len> result(T(0));
+    for (int n = 0; n < len; n++)
+        result[n] = a[n] * b + c[n];
+    return result;
+}
+
+// a + (b - a) * t in one pass
+template <typename T, int len>
+static VMATH_CONSTEXPR vecN<T,len> lerp(const vecN<T,len>& a, const vecN<T,len>& b, T t)
+{
+    vecN<T,len> result(T(0));
+    for (int n = 0; n < len; n++)
+        result[n] = a[n] + (b[n] - a[n]) * t;
+    return result;
+}
+
 template <typename T, const int w, const int h>
 class matNM
 {
@@ -397,20 +721,11 @@ public:
     typedef class vecN<T,h> vector_type;
 
     // Default constructor does nothing, just like built-in types
-    inline matNM()
-    {
-        // Uninitialized variable
-    }
-
-    // Copy constructor
-    inline matNM(const matNM& that)
-    {
-        assign(that);
-    }
+    VMATH_DEFAULT_CONSTRUCTOR(matNM)
 
     // Construction from element type
     // explicit to prevent assignment from T
-    explicit inline matNM(T f)
+    explicit VMATH_CONSTEXPR matNM(T f) : data()
     {
         for (int n = 0; n < w; n++)
         {
@@ -419,7 +734,7 @@ public:
     }
 
     // Construction from vector
-    inline matNM(const vector_type& v)
+    VMATH_CONSTEXPR matNM(const vector_type& v) : data()
     {
         for (int n = 0; n < w; n++)
         {
@@ -427,85 +742,78 @@ public:
         }
     }
 
-    // Assignment operator
-    inline matNM& operator=(const my_type& that)
-    {
-        assign(that);
-        return *this;
-    }
-
-    inline matNM operator+(const my_type& that) const
+    VMATH_CONSTEXPR matNM operator+(const my_type& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < w; n++)
+        my_type result(T(0));
+        for (int n = 0; n < w; n++)
             result.data[n] = data[n] + that.data[n];
         return result;
     }
 
-    inline my_type& operator+=(const my_type& that)
+    VMATH_CONSTEXPR my_type& operator+=(const my_type& that)
     {
-        return (*this = *this + that);
+        for (int n = 0; n < w; n++)
+            data[n] += that.data[n];
+        return *this;
     }
 
-    inline my_type operator-(const my_type& that) const
+    VMATH_CONSTEXPR my_type operator-(const my_type& that) const
     {
-        my_type result;
-        int n;
-        for (n = 0; n < w; n++)
+        my_type result(T(0));
+        for (int n = 0; n < w; n++)
             result.data[n] = data[n] - that.data[n];
         return result;
     }
 
-    inline my_type& operator-=(const my_type& that)
+    VMATH_CONSTEXPR my_type& operator-=(const my_type& that)
     {
-        return (*this = *this - that);
+        for (int n = 0; n < w; n++)
+            data[n] -= that.data[n];
+        return *this;
     }
 
     // Matrix multiply.
     // TODO: This only works for square matrices. Need more template skill to make a non-square version.
-    inline my_type operator*(const my_type& that) const
+    VMATH_CONSTEXPR my_type operator*(const my_type& that) const
     {
-        ensure<w == h>();
+        static_assert(w == h, "matNM::operator* needs a square matrix");
 
-        my_type result(0);
+        my_type result(T(0));
 
+        // Each column of the result is a combination of the columns of
+        // this, accumulated in place
         for (int j = 0; j < w; j++)
         {
-            for (int i = 0; i < h; i++)
-            {
-                T sum(0);
+            vector_type& column = result.data[j];
 
-                for (int n = 0; n < w; n++)
-                {
-                    sum += data[n][i] * that[j][n];
-                }
-
-                result[j][i] = sum;
+            column = data[0] * that[j][0];
+            for (int n = 1; n < w; n++)
+            {
+                for (int i = 0; i < h; i++)
+                    column[i] += data[n][i] * that[j][n];
             }
         }
 
         return result;
     }
 
-    inline my_type& operator*=(const my_type& that)
+    VMATH_CONSTEXPR my_type& operator*=(const my_type& that)
     {
         return (*this = *this * that);
     }
 
-    inline vector_type& operator[](int n) { return data[n]; }
-    inline const vector_type& operator[](int n) const { return data[n]; }
+    VMATH_CONSTEXPR vector_type& operator[](int n) { return data[n]; }
+    VMATH_CONSTEXPR const vector_type& operator[](int n) const { return data[n]; }
     inline operator T*() { return &data[0][0]; }
     inline operator const T*() const { return &data[0][0]; }
 
-    inline matNM<T,h,w> transpose(void) const
+    VMATH_CONSTEXPR matNM<T,h,w> transpose(void) const
     {
-        matNM<T,h,w> result;
-        int x, y;
+        matNM<T,h,w> result(T(0));
 
-        for (y = 0; y < w; y++)
+        for (int y = 0; y < w; y++)
         {
-            for (x = 0; x < h; x++)
+            for (int x = 0; x < h; x++)
             {
                 result[x][y] = data[y][x];
             }
@@ -514,11 +822,11 @@ public:
         return result;
     }
 
-    static inline my_type identity()
+    static VMATH_CONSTEXPR my_type identity()
     {
-        ensure<w == h>();
+        static_assert(w == h, "matNM::identity needs a square matrix");
 
-        my_type result(0);
+        my_type result(T(0));
 
         for (int i = 0; i < w; i++)
         {
@@ -534,14 +842,6 @@ public:
 protected:
     // Column primary data (essentially, array of vectors)
     vecN<T,h> data[w];
-
-    // Assignment function - called from assignment operator and copy constructor.
-    inline void assign(const matNM& that)
-    {
-        int n;
-        for (n = 0; n < w; n++)
-            data[n] = that.data[n];
-    }
 };
 
 /*
@@ -582,14 +882,14 @@ public:
     typedef matNM<T,4,4> base;
     typedef Tmat4<T> my_type;
 
-    inline Tmat4() {}
-    inline Tmat4(const my_type& that) : base(that) {}
-    inline Tmat4(const base& that) : base(that) {}
-    inline Tmat4(const vecN<T,4>& v) : base(v) {}
-    inline Tmat4(const vecN<T,4>& v0,
-                 const vecN<T,4>& v1,
-                 const vecN<T,4>& v2,
-                 const vecN<T,4>& v3)
+    VMATH_DEFAULT_CONSTRUCTOR(Tmat4)
+    VMATH_CONSTEXPR Tmat4(const base& that) : base(that) {}
+    VMATH_CONSTEXPR Tmat4(const vecN<T,4>& v) : base(v) {}
+    VMATH_CONSTEXPR Tmat4(const vecN<T,4>& v0,
+                          const vecN<T,4>& v1,
+                          const vecN<T,4>& v2,
+                          const vecN<T,4>& v3)
+        : base()
     {
         base::data[0] = v0;
         base::data[1] = v1;
@@ -603,7 +903,38 @@ typedef Tmat4<int> imat4;
 typedef Tmat4<unsigned int> umat4;
 typedef Tmat4<double> dmat4;
 
-static inline mat4 frustum(float left, float right, float bottom, float top, float n, float f)
+template <typename T>
+class Tmat3 : public matNM<T,3,3>
+{
+public:
+    typedef matNM<T,3,3> base;
+    typedef Tmat3<T> my_type;
+
+    VMATH_DEFAULT_CONSTRUCTOR(Tmat3)
+    VMATH_CONSTEXPR Tmat3(const base& that) : base(that) {}
+    VMATH_CONSTEXPR Tmat3(const vecN<T,3>& v0,
+                          const vecN<T,3>& v1,
+                          const vecN<T,3>& v2)
+        : base()
+    {
+        base::data[0] = v0;
+        base::data[1] = v1;
+        base::data[2] = v2;
+    }
+
+    // The upper-left 3x3 of a mat4
+    explicit VMATH_CONSTEXPR Tmat3(const Tmat4<T>& m)
+        : base()
+    {
+        for (int n = 0; n < 3; n++)
+            base::data[n] = Tvec3<T>(m[n][0], m[n][1], m[n][2]);
+    }
+};
+
+typedef Tmat3<float> mat3;
+typedef Tmat3<double> dmat3;
+
+static VMATH_CONSTEXPR mat4 frustum(float left, float right, float bottom, float top, float n, float f)
 {
     mat4 result(mat4::identity());
 
@@ -647,11 +978,11 @@ static inline Tmat4<T> lookat(vecN<T,3> eye, vecN<T,3> center, vecN<T,3> up)
                                 Tvec4<T>(s[2], u[2], -f[2], T(0)),
                                 Tvec4<T>(T(0), T(0), T(0), T(1)));
 
-    return M * translate<T>(-eye);
+    return M * translate(-eye);
 }
 
 template <typename T>
-static inline Tmat4<T> translate(T x, T y, T z)
+static VMATH_CONSTEXPR Tmat4<T> translate(T x, T y, T z)
 {
     return Tmat4<T>(Tvec4<T>(1.0f, 0.0f, 0.0f, 0.0f),
                     Tvec4<T>(0.0f, 1.0f, 0.0f, 0.0f),
@@ -660,13 +991,13 @@ static inline Tmat4<T> translate(T x, T y, T z)
 }
 
 template <typename T>
-static inline Tmat4<T> translate(const vecN<T,3>& v)
+static VMATH_CONSTEXPR Tmat4<T> translate(const vecN<T,3>& v)
 {
     return translate(v[0], v[1], v[2]);
 }
 
 template <typename T>
-static inline Tmat4<T> scale(T x, T y, T z)
+static VMATH_CONSTEXPR Tmat4<T> scale(T x, T y, T z)
 {
     return Tmat4<T>(Tvec4<T>(x, 0.0f, 0.0f, 0.0f),
                     Tvec4<T>(0.0f, y, 0.0f, 0.0f),
@@ -675,13 +1006,13 @@ static inline Tmat4<T> scale(T x, T y, T z)
 }
 
 template <typename T>
-static inline Tmat4<T> scale(const Tvec4<T>& v)
+static VMATH_CONSTEXPR Tmat4<T> scale(const Tvec4<T>& v)
 {
     return scale(v[0], v[1], v[2]);
 }
 
 template <typename T>
-static inline Tmat4<T> scale(T x)
+static VMATH_CONSTEXPR Tmat4<T> scale(T x)
 {
     return Tmat4<T>(Tvec4<T>(x, 0.0f, 0.0f, 0.0f),
                     Tvec4<T>(0.0f, x, 0.0f, 0.0f),
@@ -689,18 +1020,16 @@ static inline Tmat4<T> scale(T x)
                     Tvec4<T>(0.0f, 0.0f, 0.0f, 1.0f));
 }
 
+// rotate() from the sine and cosine of its angle
 template <typename T>
-static inline Tmat4<T> rotate(T angle, T x, T y, T z)
+static inline Tmat4<T> rotate_sincos(T s, T c, T x, T y, T z)
 {
     Tmat4<T> result;
 
     const T x2 = x * x;
     const T y2 = y * y;
     const T z2 = z * z;
-    float rads = float(angle) * 0.0174532925f;
-    const float c = cosf(rads);
-    const float s = sinf(rads);
-    const float omc = 1.0f - c;
+    const T omc = T(1) - c;
 
     result[0] = Tvec4<T>(T(x2 * omc + c), T(y * x * omc + z * s), T(x * z * omc - y * s), T(0));
     result[1] = Tvec4<T>(T(x * y * omc - z * s), T(y2 * omc + c), T(y * z * omc + x * s), T(0));
@@ -710,12 +1039,874 @@ static inline Tmat4<T> rotate(T angle, T x, T y, T z)
     return result;
 }
 
+template <typename T>
+static inline Tmat4<T> rotate(T angle, T x, T y, T z)
+{
+    const float rads = radians(float(angle));
+    return rotate_sincos(T(sinf(rads)), T(cosf(rads)), x, y, z);
+}
+
 template <typename T>
 static inline Tmat4<T> rotate(T angle, const vecN<T,3>& v)
 {
     return rotate<T>(angle, v[0], v[1], v[2]);
 }
 
+// The sines and cosines of three angles in degrees, as rotate() computes them
+template <typename T>
+static inline void euler_sincos(T x, T y, T z, Tvec3<T>& s, Tvec3<T>& c)
+{
+    const float rx = radians(float(x));
+    const float ry = radians(float(y));
+    const float rz = radians(float(z));
+
+    s = Tvec3<T>(T(sinf(rx)), T(sinf(ry)), T(sinf(rz)));
+    c = Tvec3<T>(T(cosf(rx)), T(cosf(ry)), T(cosf(rz)));
+}
+
+// rotate(x, 1, 0, 0) * rotate(y, 0, 1, 0) * rotate(z, 0, 0, 1) *
+// translate(t), written out: three sin/cos pairs and a few products per
+// element, instead of three full rotations and three 4x4 products with
+// their 64-byte temporaries
+template <typename T>
+static inline Tmat4<T> euler_sincos_to_mat4(const vecN<T,3>& s, const vecN<T,3>& c, const vecN<T,3>& t)
+{
+    const Tvec3<T> c0(c[1] * c[2], c[0] * s[2] + s[0] * s[1] * c[2], s[0] * s[2] - c[0] * s[1] * c[2]);
+    const Tvec3<T> c1(-c[1] * s[2], c[0] * c[2] - s[0] * s[1] * s[2], s[0] * c[2] + c[0] * s[1] * s[2]);
+    const Tvec3<T> c2(s[1], -s[0] * c[1], c[0] * c[1]);
+
+    return Tmat4<T>(Tvec4<T>(c0, T(0)), Tvec4<T>(c1, T(0)), Tvec4<T>(c2, T(0)),
+                    Tvec4<T>(mul_add(c0, t[0], mul_add(c1, t[1], c2 * t[2])), T(1)));
+}
+
+template <typename T>
+static inline Tmat4<T> euler_to_mat4(T x, T y, T z, const vecN<T,3>& t = Tvec3<T>(T(0)))
+{
+    Tvec3<T> s, c;
+    euler_sincos(x, y, z, s, c);
+    return euler_sincos_to_mat4(s, c, t);
+}
+
+// The rows of an affine transform (the last row of its mat4 is always
+// 0, 0, 0, 1). Uploaded as is, it is a GLSL mat3x4 applied as
+// vec4(p, 1.0) * m. Products and inverses skip the constant row, and each
+// row of a product is three multiply-adds of whole vec4s.
+template <typename T>
+class Tmat3x4 : public matNM<T,3,4>
+{
+public:
+    typedef matNM<T,3,4> base;
+    typedef Tmat3x4<T> my_type;
+
+    VMATH_DEFAULT_CONSTRUCTOR(Tmat3x4)
+    VMATH_CONSTEXPR Tmat3x4(const base& that) : base(that) {}
+    VMATH_CONSTEXPR Tmat3x4(const vecN<T,4>& r0,
+                            const vecN<T,4>& r1,
+                            const vecN<T,4>& r2)
+        : base()
+    {
+        base::data[0] = r0;
+        base::data[1] = r1;
+        base::data[2] = r2;
+    }
+
+    // Drops the last row of an affine mat4
+    explicit VMATH_CONSTEXPR Tmat3x4(const Tmat4<T>& m)
+        : base()
+    {
+        for (int r = 0; r < 3; r++)
+            base::data[r] = Tvec4<T>(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+
+    VMATH_CONSTEXPR Tmat4<T> to_mat4(void) const
+    {
+        const my_type& m = *this;
+        return Tmat4<T>(Tvec4<T>(m[0][0], m[1][0], m[2][0], T(0)),
+                        Tvec4<T>(m[0][1], m[1][1], m[2][1], T(0)),
+                        Tvec4<T>(m[0][2], m[1][2], m[2][2], T(0)),
+                        Tvec4<T>(m[0][3], m[1][3], m[2][3], T(1)));
+    }
+
+    static VMATH_CONSTEXPR my_type identity()
+    {
+        return my_type(Tvec4<T>(T(1), T(0), T(0), T(0)),
+                       Tvec4<T>(T(0), T(1), T(0), T(0)),
+                       Tvec4<T>(T(0), T(0), T(1), T(0)));
+    }
+
+    // Applies 'that', then this, as the mat4 product would
+    inline my_type operator*(const my_type& that) const
+    {
+        my_type result;
+
+        for (int r = 0; r < 3; r++)
+        {
+            const vecN<T,4>& row = base::data[r];
+            result[r] = mul_add(that[0], row[0], mul_add(that[1], row[1], that[2] * row[2]));
+            result[r][3] += row[3];
+        }
+
+        return result;
+    }
+
+    inline my_type& operator*=(const my_type& that)
+    {
+        *this = *this * that;
+        return *this;
+    }
+};
+
+typedef Tmat3x4<float> mat3x4;
+typedef Tmat3x4<double> dmat3x4;
+
+template <typename T>
+static inline Tvec3<T> transform_point(const Tmat3x4<T>& m, const vecN<T,3>& p)
+{
+    return Tvec3<T>(m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+                    m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+                    m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+}
+
+// Like transform_point, without the translation
+template <typename T>
+static inline Tvec3<T> transform_vector(const Tmat3x4<T>& m, const vecN<T,3>& v)
+{
+    return Tvec3<T>(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+                    m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                    m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+}
+
+// euler_to_mat4 without the constant last row
+template <typename T>
+static inline Tmat3x4<T> euler_sincos_to_mat3x4(const vecN<T,3>& s, const vecN<T,3>& c, const vecN<T,3>& t)
+{
+    const Tvec3<T> r0(c[1] * c[2], -c[1] * s[2], s[1]);
+    const Tvec3<T> r1(c[0] * s[2] + s[0] * s[1] * c[2], c[0] * c[2] - s[0] * s[1] * s[2], -s[0] * c[1]);
+    const Tvec3<T> r2(s[0] * s[2] - c[0] * s[1] * c[2], s[0] * c[2] + c[0] * s[1] * s[2], c[0] * c[1]);
+
+    return Tmat3x4<T>(Tvec4<T>(r0, dot(r0, t)), Tvec4<T>(r1, dot(r1, t)), Tvec4<T>(r2, dot(r2, t)));
+}
+
+template <typename T>
+static inline Tmat3x4<T> euler_to_mat3x4(T x, T y, T z, const vecN<T,3>& t = Tvec3<T>(T(0)))
+{
+    Tvec3<T> s, c;
+    euler_sincos(x, y, z, s, c);
+    return euler_sincos_to_mat3x4(s, c, t);
+}
+
+// The inverse of an affine transform: the inverse of the 3x3 part, from its
+// adjugate, and the translation moved through it. A singular matrix gives
+// infinities, as a division by zero would.
+template <typename T>
+static inline Tmat3x4<T> inverse(const Tmat3x4<T>& m)
+{
+    // Rows of the adjugate of the 3x3 part
+    const Tvec3<T> a0(m[1][1] * m[2][2] - m[1][2] * m[2][1],
+                      m[0][2] * m[2][1] - m[0][1] * m[2][2],
+                      m[0][1] * m[1][2] - m[0][2] * m[1][1]);
+    const Tvec3<T> a1(m[1][2] * m[2][0] - m[1][0] * m[2][2],
+                      m[0][0] * m[2][2] - m[0][2] * m[2][0],
+                      m[0][2] * m[1][0] - m[0][0] * m[1][2]);
+    const Tvec3<T> a2(m[1][0] * m[2][1] - m[1][1] * m[2][0],
+                      m[0][1] * m[2][0] - m[0][0] * m[2][1],
+                      m[0][0] * m[1][1] - m[0][1] * m[1][0]);
+
+    const T inv_det = T(1) / (m[0][0] * a0[0] + m[1][0] * a0[1] + m[2][0] * a0[2]);
+    const Tvec3<T> t(m[0][3], m[1][3], m[2][3]);
+
+    return Tmat3x4<T>(Tvec4<T>(a0 * inv_det, -dot(a0, t) * inv_det),
+                      Tvec4<T>(a1 * inv_det, -dot(a1, t) * inv_det),
+                      Tvec4<T>(a2 * inv_det, -dot(a2, t) * inv_det));
+}
+
+// Transforms 'count' points from 'in' to 'out', which may be the same array
+template <typename T>
+static inline void transform_points(const Tmat3x4<T>& m, const Tvec3<T> *in, Tvec3<T> *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = transform_point(m, in[i]);
+}
+
+// Transforms 'count' normals by the inverse transpose of the 3x3 part, which
+// keeps them perpendicular to the surface under non-uniform scale, and
+// renormalizes them. 'in' and 'out' may be the same array.
+template <typename T>
+static inline void transform_normals(const Tmat3x4<T>& m, const Tvec3<T> *in, Tvec3<T> *out, size_t count)
+{
+    const Tmat3x4<T> inv = inverse(m);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Tvec3<T>& n = in[i];
+        out[i] = normalize(Tvec3<T>(inv[0][0] * n[0] + inv[1][0] * n[1] + inv[2][0] * n[2],
+                                    inv[0][1] * n[0] + inv[1][1] * n[1] + inv[2][1] * n[2],
+                                    inv[0][2] * n[0] + inv[1][2] * n[1] + inv[2][2] * n[2]));
+    }
+}
+
+template <typename T>
+static inline T determinant(const Tmat3<T>& m)
+{
+    return dot(m[0], cross(m[1], m[2]));
+}
+
+template <typename T>
+static inline T determinant(const Tmat4<T>& m)
+{
+    // Expanded along the first column, sharing the 2x2 minors of the
+    // last two columns
+    const T s0 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+    const T s1 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    const T s2 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+    const T s3 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    const T s4 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+    const T s5 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+    return m[0][0] * (m[1][1] * s0 - m[1][2] * s1 + m[1][3] * s2) -
+           m[0][1] * (m[1][0] * s0 - m[1][2] * s3 + m[1][3] * s4) +
+           m[0][2] * (m[1][0] * s1 - m[1][1] * s3 + m[1][3] * s5) -
+           m[0][3] * (m[1][0] * s2 - m[1][1] * s4 + m[1][2] * s5);
+}
+
+// The columns of the inverse transpose of a 3x3 matrix are the cross
+// products of its columns, over the determinant
+template <typename T>
+static inline Tmat3<T> inverse_transpose(const Tmat3<T>& m)
+{
+    const Tvec3<T> c0 = cross(m[1], m[2]);
+    const Tvec3<T> c1 = cross(m[2], m[0]);
+    const Tvec3<T> c2 = cross(m[0], m[1]);
+    const T inv_det = T(1) / dot(m[0], c0);
+    return Tmat3<T>(c0 * inv_det, c1 * inv_det, c2 * inv_det);
+}
+
+template <typename T>
+static inline Tmat3<T> inverse(const Tmat3<T>& m)
+{
+    return inverse_transpose(m).transpose();
+}
+
+// The general inverse, from the cofactors. A singular matrix gives
+// infinities, as a division by zero would.
+template <typename T>
+static inline Tmat4<T> inverse(const Tmat4<T>& m)
+{
+    const T *a = m;
+    Tmat4<T> result;
+    T *inv = result;
+
+    inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] +
+             a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] -
+             a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] +
+             a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] -
+              a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] -
+             a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] +
+             a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] -
+             a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] +
+              a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] +
+             a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+    inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] -
+             a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+    inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] +
+              a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+    inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] -
+              a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+    inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] -
+             a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+    inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] +
+             a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+    inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] -
+              a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+    inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] +
+              a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+    const T inv_det = T(1) / (a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12]);
+    for (int n = 0; n < 16; n++)
+        inv[n] *= inv_det;
+
+    return result;
+}
+
+template <typename T>
+static inline Tmat4<T> inverse_transpose(const Tmat4<T>& m)
+{
+    return inverse(m).transpose();
+}
+
+// The matrix that carries normals through m: the inverse transpose of its
+// upper-left 3x3, which keeps them perpendicular to the surface under
+// non-uniform scale. For a rotation it is the rotation itself.
+template <typename T>
+static inline Tmat3<T> normal_matrix(const Tmat4<T>& m)
+{
+    return inverse_transpose(Tmat3<T>(m));
+}
+
+template <typename T>
+static inline Tmat3<T> normal_matrix(const Tmat3x4<T>& m)
+{
+    const Tvec3<T> r0(m[0][0], m[0][1], m[0][2]);
+    const Tvec3<T> r1(m[1][0], m[1][1], m[1][2]);
+    const Tvec3<T> r2(m[2][0], m[2][1], m[2][2]);
+
+    // The rows of the 3x3 part are the columns of its transpose
+    return inverse_transpose(Tmat3<T>(r0, r1, r2)).transpose();
+}
+
+#ifdef VMATH_SSE
+
+// The x, y, z lanes of a x b; w is 0 whatever the inputs' w
+static inline __m128 cross_sse(__m128 a, __m128 b)
+{
+    const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// The sum of the four lanes, in every lane
+static inline __m128 sum_sse(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// 2x2 matrices in one register, row by row: a * b, adj(a) * b, a * adj(b)
+static inline __m128 mat2_mul_sse(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+                                 _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+static inline __m128 mat2_adj_mul_sse(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)),
+                                 _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+static inline __m128 mat2_mul_adj_sse(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+                                 _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// The general inverse by 2x2 blocks. The algorithm is written for rows;
+// given the columns it inverts the transpose, whose rows are the columns
+// of the inverse, so the layout works out.
+static inline Tmat4<float> inverse(const Tmat4<float>& m)
+{
+    const __m128 c0 = _mm_loadu_ps(&m[0][0]);
+    const __m128 c1 = _mm_loadu_ps(&m[1][0]);
+    const __m128 c2 = _mm_loadu_ps(&m[2][0]);
+    const __m128 c3 = _mm_loadu_ps(&m[3][0]);
+
+    const __m128 A = _mm_movelh_ps(c0, c1);
+    const __m128 B = _mm_movehl_ps(c1, c0);
+    const __m128 C = _mm_movelh_ps(c2, c3);
+    const __m128 D = _mm_movehl_ps(c3, c2);
+
+    // The determinants of A, B, C and D, one per lane
+    const __m128 det_sub = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                 _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+                                      _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)),
+                                                 _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+    const __m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+
+    const __m128 d_c = mat2_adj_mul_sse(D, C);
+    const __m128 a_b = mat2_adj_mul_sse(A, B);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, A), mat2_mul_sse(B, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, D), mat2_mul_sse(C, a_b));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, C), mat2_mul_adj_sse(D, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, B), mat2_mul_adj_sse(A, d_c));
+
+    // det = |A| |D| + |B| |C| - trace((adj(A) B) (adj(D) C))
+    const __m128 tr = sum_sse(_mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0))));
+    const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+    const __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+
+    x = _mm_mul_ps(x, inv_det);
+    y = _mm_mul_ps(y, inv_det);
+    z = _mm_mul_ps(z, inv_det);
+    w = _mm_mul_ps(w, inv_det);
+
+    Tmat4<float> result;
+    _mm_storeu_ps(&result[0][0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(&result[1][0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_storeu_ps(&result[2][0], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(&result[3][0], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return result;
+}
+
+// The affine inverse: the columns of the inverse 3x3 are the cross
+// products of the rows, and the translation is moved through them
+static inline Tmat3x4<float> inverse(const Tmat3x4<float>& m)
+{
+    const __m128 r0 = _mm_loadu_ps(&m[0][0]);
+    const __m128 r1 = _mm_loadu_ps(&m[1][0]);
+    const __m128 r2 = _mm_loadu_ps(&m[2][0]);
+
+    __m128 x = cross_sse(r1, r2);
+    __m128 y = cross_sse(r2, r0);
+    __m128 z = cross_sse(r0, r1);
+
+    // x has a 0 in w, so the translation in r0.w drops out of the dot
+    const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), sum_sse(_mm_mul_ps(r0, x)));
+    x = _mm_mul_ps(x, inv_det);
+    y = _mm_mul_ps(y, inv_det);
+    z = _mm_mul_ps(z, inv_det);
+
+    // -(inverse 3x3) * t, then transpose the four columns into rows
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3))),
+                                     _mm_mul_ps(y, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3)))),
+                          _mm_mul_ps(z, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+    t = _mm_sub_ps(_mm_setzero_ps(), t);
+    _MM_TRANSPOSE4_PS(x, y, z, t);
+
+    Tmat3x4<float> result;
+    _mm_storeu_ps(&result[0][0], x);
+    _mm_storeu_ps(&result[1][0], y);
+    _mm_storeu_ps(&result[2][0], z);
+    return result;
+}
+
+static inline Tmat3<float> normal_matrix(const Tmat4<float>& m)
+{
+    const __m128 c0 = _mm_loadu_ps(&m[0][0]);
+    const __m128 c1 = _mm_loadu_ps(&m[1][0]);
+    const __m128 c2 = _mm_loadu_ps(&m[2][0]);
+
+    const __m128 x = cross_sse(c1, c2);
+    const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), sum_sse(_mm_mul_ps(c0, x)));
+
+    float columns[3][4];
+    _mm_storeu_ps(columns[0], _mm_mul_ps(x, inv_det));
+    _mm_storeu_ps(columns[1], _mm_mul_ps(cross_sse(c2, c0), inv_det));
+    _mm_storeu_ps(columns[2], _mm_mul_ps(cross_sse(c0, c1), inv_det));
+
+    return Tmat3<float>(Tvec3<float>(columns[0][0], columns[0][1], columns[0][2]),
+                        Tvec3<float>(columns[1][0], columns[1][1], columns[1][2]),
+                        Tvec3<float>(columns[2][0], columns[2][1], columns[2][2]));
+}
+
+#endif /* VMATH_SSE */
+
+// A rotation quaternion: x, y, z are the vector part and w the scalar part.
+// The product is the Hamilton product, so a * b rotates by b, then by a,
+// like the matrices.
+template <typename T>
+class Tquat : public vecN<T,4>
+{
+public:
+    typedef vecN<T,4> base;
+    typedef Tquat<T> my_type;
+
+    VMATH_DEFAULT_CONSTRUCTOR(Tquat)
+    VMATH_CONSTEXPR Tquat(const base& v) : base(v) {}
+    VMATH_CONSTEXPR Tquat(T x, T y, T z, T w)
+        : base()
+    {
+        base::data[0] = x;
+        base::data[1] = y;
+        base::data[2] = z;
+        base::data[3] = w;
+    }
+    VMATH_CONSTEXPR Tquat(const vecN<T,3>& v, T w)
+        : base()
+    {
+        base::data[0] = v[0];
+        base::data[1] = v[1];
+        base::data[2] = v[2];
+        base::data[3] = w;
+    }
+
+    static VMATH_CONSTEXPR my_type identity()
+    {
+        return my_type(T(0), T(0), T(0), T(1));
+    }
+
+    // Each lane of the result is a sum of four products, so the compiler
+    // can keep the quaternion in one SIMD register
+    inline my_type operator*(const my_type& that) const
+    {
+        const my_type& a = *this;
+        return my_type(a[3] * that[0] + a[0] * that[3] + a[1] * that[2] - a[2] * that[1],
+                       a[3] * that[1] - a[0] * that[2] + a[1] * that[3] + a[2] * that[0],
+                       a[3] * that[2] + a[0] * that[1] - a[1] * that[0] + a[2] * that[3],
+                       a[3] * that[3] - a[0] * that[0] - a[1] * that[1] - a[2] * that[2]);
+    }
+
+    inline my_type& operator*=(const my_type& that)
+    {
+        *this = *this * that;
+        return *this;
+    }
+
+    inline my_type operator*(const T& that) const
+    {
+        return my_type(base::operator*(that));
+    }
+
+    inline Tvec3<T> vector(void) const
+    {
+        return Tvec3<T>(base::data[0], base::data[1], base::data[2]);
+    }
+};
+
+typedef Tquat<float> quat;
+typedef Tquat<double> dquat;
+
+// The rotation of 'angle' degrees about the unit axis (x, y, z), as rotate()
+template <typename T>
+static inline Tquat<T> quat_rotate(T angle, T x, T y, T z)
+{
+    const float half = radians(float(angle)) * 0.5f;
+    const T s = T(sinf(half));
+    return Tquat<T>(x * s, y * s, z * s, T(cosf(half)));
+}
+
+template <typename T>
+static inline Tquat<T> quat_rotate(T angle, const vecN<T,3>& v)
+{
+    return quat_rotate<T>(angle, v[0], v[1], v[2]);
+}
+
+// Batches of rotate(), quat_rotate(), euler_to_mat4() and euler_to_mat3x4(),
+// for arrays of angles in degrees. Their sines and cosines come from
+// sincos_array, up to SINCOS_BATCH elements at a time.
+static const size_t SINCOS_BATCH = 16;
+
+// The sines and cosines of 'count' (at most 3 * SINCOS_BATCH) angles in
+// degrees, each multiplied by 'scale' after its conversion to radians
+static inline void sincos_degrees(const float *angles, float *s, float *c, size_t count,
+                                  sincos_precision precision, float scale = 1.0f)
+{
+    float rads[3 * SINCOS_BATCH];
+
+    for (size_t k = 0; k < count; k++)
+        rads[k] = radians(angles[k]) * scale;
+    sincos_array(rads, s, c, count, precision);
+}
+
+static inline void rotate_array(const float *angles, const vec3& axis, mat4 *out, size_t count,
+                                sincos_precision precision = SINCOS_PRECISE)
+{
+    float s[SINCOS_BATCH], c[SINCOS_BATCH];
+
+    for (size_t i = 0; i < count; i += SINCOS_BATCH)
+    {
+        const size_t n = count - i < SINCOS_BATCH ? count - i : SINCOS_BATCH;
+
+        sincos_degrees(angles + i, s, c, n, precision);
+        for (size_t k = 0; k < n; k++)
+            out[i + k] = rotate_sincos(s[k], c[k], axis[0], axis[1], axis[2]);
+    }
+}
+
+static inline void quat_rotate_array(const float *angles, const vec3& axis, quat *out, size_t count,
+                                     sincos_precision precision = SINCOS_PRECISE)
+{
+    float s[SINCOS_BATCH], c[SINCOS_BATCH];
+
+    for (size_t i = 0; i < count; i += SINCOS_BATCH)
+    {
+        const size_t n = count - i < SINCOS_BATCH ? count - i : SINCOS_BATCH;
+
+        sincos_degrees(angles + i, s, c, n, precision, 0.5f);
+        for (size_t k = 0; k < n; k++)
+            out[i + k] = quat(axis * s[k], c[k]);
+    }
+}
+
+// The angles are (x, y, z) triples in degrees, as euler_to_mat4 takes them;
+// 'translations' may be NULL
+static inline void euler_to_mat4_array(const vec3 *angles, const vec3 *translations, mat4 *out, size_t count,
+                                       sincos_precision precision = SINCOS_PRECISE)
+{
+    vec3 s[SINCOS_BATCH], c[SINCOS_BATCH];
+
+    for (size_t i = 0; i < count; i += SINCOS_BATCH)
+    {
+        const size_t n = count - i < SINCOS_BATCH ? count - i : SINCOS_BATCH;
+
+        sincos_degrees(&angles[i][0], &s[0][0], &c[0][0], 3 * n, precision);
+        for (size_t k = 0; k < n; k++)
+            out[i + k] = euler_sincos_to_mat4(s[k], c[k], translations ? translations[i + k] : vec3(0.0f));
+    }
+}
+
+static inline void euler_to_mat3x4_array(const vec3 *angles, const vec3 *translations, mat3x4 *out, size_t count,
+                                         sincos_precision precision = SINCOS_PRECISE)
+{
+    vec3 s[SINCOS_BATCH], c[SINCOS_BATCH];
+
+    for (size_t i = 0; i < count; i += SINCOS_BATCH)
+    {
+        const size_t n = count - i < SINCOS_BATCH ? count - i : SINCOS_BATCH;
+
+        sincos_degrees(&angles[i][0], &s[0][0], &c[0][0], 3 * n, precision);
+        for (size_t k = 0; k < n; k++)
+            out[i + k] = euler_sincos_to_mat3x4(s[k], c[k], translations ? translations[i + k] : vec3(0.0f));
+    }
+}
+
+// The inverse of a unit quaternion
+template <typename T>
+static inline Tquat<T> conjugate(const Tquat<T>& q)
+{
+    return Tquat<T>(-q[0], -q[1], -q[2], q[3]);
+}
+
+// Rotates v by the unit quaternion q, without building the matrix
+template <typename T>
+static inline Tvec3<T> rotate(const Tquat<T>& q, const vecN<T,3>& v)
+{
+    const Tvec3<T> u = q.vector();
+    const Tvec3<T> t = cross(u, v) * T(2);
+    return v + t * q[3] + cross(u, t);
+}
+
+// Interpolates along the shorter arc and renormalizes. Cheaper than slerp
+// and close to it when a and b are near each other, as between key frames.
+template <typename T>
+static inline Tquat<T> nlerp(const Tquat<T>& a, const Tquat<T>& b, T t)
+{
+    const T sign = dot(a, b) < T(0) ? T(-1) : T(1);
+    return normalize(a * (T(1) - t) + b * (t * sign));
+}
+
+// Interpolates at constant angular speed along the shorter arc
+template <typename T>
+static inline Tquat<T> slerp(const Tquat<T>& a, const Tquat<T>& b, T t)
+{
+    T cos_theta = dot(a, b);
+    const T sign = cos_theta < T(0) ? T(-1) : T(1);
+    cos_theta *= sign;
+
+    // Nearly parallel: sin(theta) is too small to divide by
+    if (cos_theta > T(0.9995))
+        return nlerp(a, b, t);
+
+    const T theta = T(acos(cos_theta));
+    const T sin_theta = T(sin(theta));
+    const T wa = T(sin((T(1) - t) * theta)) / sin_theta;
+    const T wb = T(sin(t * theta)) / sin_theta * sign;
+    return Tquat<T>(a * wa + b * wb);
+}
+
+// The columns of the rotation matrix of a unit quaternion
+template <typename T>
+static inline void quat_axes(const Tquat<T>& q, Tvec3<T>& x, Tvec3<T>& y, Tvec3<T>& z)
+{
+    const T x2 = q[0] + q[0], y2 = q[1] + q[1], z2 = q[2] + q[2];
+    const T xx = q[0] * x2, yy = q[1] * y2, zz = q[2] * z2;
+    const T xy = q[0] * y2, xz = q[0] * z2, yz = q[1] * z2;
+    const T wx = q[3] * x2, wy = q[3] * y2, wz = q[3] * z2;
+
+    x = Tvec3<T>(T(1) - (yy + zz), xy + wz, xz - wy);
+    y = Tvec3<T>(xy - wz, T(1) - (xx + zz), yz + wx);
+    z = Tvec3<T>(xz + wy, yz - wx, T(1) - (xx + yy));
+}
+
+template <typename T>
+static inline Tmat4<T> to_mat4(const Tquat<T>& q)
+{
+    Tvec3<T> x, y, z;
+    quat_axes(q, x, y, z);
+    return Tmat4<T>(Tvec4<T>(x, T(0)), Tvec4<T>(y, T(0)), Tvec4<T>(z, T(0)),
+                    Tvec4<T>(T(0), T(0), T(0), T(1)));
+}
+
+template <typename T>
+static inline Tmat3x4<T> to_mat3x4(const Tquat<T>& q)
+{
+    Tvec3<T> x, y, z;
+    quat_axes(q, x, y, z);
+    return Tmat3x4<T>(Tvec4<T>(x[0], y[0], z[0], T(0)),
+                      Tvec4<T>(x[1], y[1], z[1], T(0)),
+                      Tvec4<T>(x[2], y[2], z[2], T(0)));
+}
+
+// A rigid transform (rotation, then translation) as a dual quaternion.
+// Blending dual quaternions does not shrink the mesh the way blending
+// matrices does, which makes them the usual choice for skinning.
+template <typename T>
+class Tdualquat
+{
+public:
+    typedef Tdualquat<T> my_type;
+
+    VMATH_DEFAULT_CONSTRUCTOR(Tdualquat)
+    VMATH_CONSTEXPR Tdualquat(const Tquat<T>& r, const Tquat<T>& d)
+        : real(r), dual(d)
+    {
+    }
+
+    // Rotates by 'rotation', then moves by 'translation'
+    inline Tdualquat(const Tquat<T>& rotation, const vecN<T,3>& translation)
+        : real(rotation), dual(Tquat<T>(translation, T(0)) * rotation * T(0.5))
+    {
+    }
+
+    static VMATH_CONSTEXPR my_type identity()
+    {
+        return my_type(Tquat<T>::identity(), Tquat<T>(T(0), T(0), T(0), T(0)));
+    }
+
+    // Applies 'that', then this
+    inline my_type operator*(const my_type& that) const
+    {
+        return my_type(real * that.real, Tquat<T>(real * that.dual + dual * that.real));
+    }
+
+    inline Tvec3<T> translation(void) const
+    {
+        return (dual * conjugate(real)).vector() * T(2);
+    }
+
+    Tquat<T> real;
+    Tquat<T> dual;
+};
+
+typedef Tdualquat<float> dualquat;
+typedef Tdualquat<double> ddualquat;
+
+template <typename T>
+static inline Tdualquat<T> normalize(const Tdualquat<T>& dq)
+{
+    const T scale = T(1) / length(dq.real);
+    return Tdualquat<T>(dq.real * scale, dq.dual * scale);
+}
+
+// Linear blend of two rigid transforms along the shorter arc, renormalized
+template <typename T>
+static inline Tdualquat<T> nlerp(const Tdualquat<T>& a, const Tdualquat<T>& b, T t)
+{
+    const T wb = dot(a.real, b.real) < T(0) ? -t : t;
+    const T wa = T(1) - t;
+    return normalize(Tdualquat<T>(Tquat<T>(a.real * wa + b.real * wb),
+                                  Tquat<T>(a.dual * wa + b.dual * wb)));
+}
+
+template <typename T>
+static inline Tvec3<T> transform_point(const Tdualquat<T>& dq, const vecN<T,3>& p)
+{
+    return rotate(dq.real, p) + dq.translation();
+}
+
+template <typename T>
+static inline Tmat4<T> to_mat4(const Tdualquat<T>& dq)
+{
+    Tmat4<T> result(to_mat4(dq.real));
+    result[3] = Tvec4<T>(dq.translation(), T(1));
+    return result;
+}
+
+template <typename T>
+static inline Tmat3x4<T> to_mat3x4(const Tdualquat<T>& dq)
+{
+    Tmat3x4<T> result(to_mat3x4(dq.real));
+    const Tvec3<T> t = dq.translation();
+    result[0][3] = t[0];
+    result[1][3] = t[1];
+    result[2][3] = t[2];
+    return result;
+}
+
+// Scale, then rotation, then translation, with a uniform scale. Two vec4s:
+// in float it is 32 bytes, half a mat4, and the vertex shader rebuilds the
+// matrix (see instancing_trs.vs.glsl).
+template <typename T>
+class Ttrs
+{
+public:
+    typedef Ttrs<T> my_type;
+
+    VMATH_DEFAULT_CONSTRUCTOR(Ttrs)
+    VMATH_CONSTEXPR Ttrs(const Tquat<T>& r, const vecN<T,3>& t, T s = T(1))
+        : rotation(r), translation(t), scale(s)
+    {
+    }
+
+    static VMATH_CONSTEXPR my_type identity()
+    {
+        return my_type(Tquat<T>::identity(), Tvec3<T>(T(0)), T(1));
+    }
+
+    // Applies 'that', then this. Exact, because the scale is uniform.
+    inline my_type operator*(const my_type& that) const
+    {
+        return my_type(rotation * that.rotation,
+                       translation + rotate(rotation, that.translation) * scale,
+                       scale * that.scale);
+    }
+
+    Tquat<T> rotation;
+    Tvec3<T> translation;
+    T scale;
+};
+
+typedef Ttrs<float> trs;
+typedef Ttrs<double> dtrs;
+
+template <typename T>
+static inline Tvec3<T> transform_point(const Ttrs<T>& x, const vecN<T,3>& p)
+{
+    return rotate(x.rotation, p) * x.scale + x.translation;
+}
+
+template <typename T>
+static inline Ttrs<T> nlerp(const Ttrs<T>& a, const Ttrs<T>& b, T t)
+{
+    return Ttrs<T>(nlerp(a.rotation, b.rotation, t),
+                   lerp(a.translation, b.translation, t),
+                   a.scale + (b.scale - a.scale) * t);
+}
+
+template <typename T>
+static inline Ttrs<T> slerp(const Ttrs<T>& a, const Ttrs<T>& b, T t)
+{
+    return Ttrs<T>(slerp(a.rotation, b.rotation, t),
+                   lerp(a.translation, b.translation, t),
+                   a.scale + (b.scale - a.scale) * t);
+}
+
+template <typename T>
+static inline Tmat4<T> to_mat4(const Ttrs<T>& x)
+{
+    Tvec3<T> ax, ay, az;
+    quat_axes(x.rotation, ax, ay, az);
+    return Tmat4<T>(Tvec4<T>(ax * x.scale, T(0)), Tvec4<T>(ay * x.scale, T(0)),
+                    Tvec4<T>(az * x.scale, T(0)), Tvec4<T>(x.translation, T(1)));
+}
+
+template <typename T>
+static inline Tmat3x4<T> to_mat3x4(const Ttrs<T>& x)
+{
+    Tvec3<T> ax, ay, az;
+    quat_axes(x.rotation, ax, ay, az);
+    ax = ax * x.scale;
+    ay = ay * x.scale;
+    az = az * x.scale;
+    return Tmat3x4<T>(Tvec4<T>(ax[0], ay[0], az[0], x.translation[0]),
+                      Tvec4<T>(ax[1], ay[1], az[1], x.translation[1]),
+                      Tvec4<T>(ax[2], ay[2], az[2], x.translation[2]));
+}
+
 #ifdef min
 #undef min
 #endif
@@ -0,0 +1,34 @@
+#version 330
+
+// The current keyframe...
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 normal;
+
+// ...and the next one. VBAnimation points these at the following frame.
+layout (location = 3) in vec4 next_position;
+layout (location = 4) in vec3 next_normal;
+
+// Weight of the next keyframe (VBAnimation::GetBlend)
+uniform float blend;
+
+uniform mat4 model_view_matrix;
+uniform mat4 projection_matrix;
+uniform vec4 color;
+
+// The output of the vertex shader (matched to the fragment shader)
+out VERTEX
+{
+    vec3    normal;
+    vec4    color;
+} vertex;
+
+void main(void)
+{
+    // Blend between the two keyframes on the GPU
+    vec4 p = mix(position, next_position, blend);
+    vec3 n = normalize(mix(normal, next_normal, blend));
+
+    gl_Position = projection_matrix * (model_view_matrix * p);
+    vertex.normal = mat3(model_view_matrix) * n;
+    vertex.color = color;
+}
@@ -12,6 +12,12 @@ layout (location = 2) in vec4 color;
 // this will actually sit in locations, 3, 4, 5, and 6.
 layout (location = 3) in mat4 model_matrix;
 
+// The per-instance normal matrix, the inverse transpose of the upper-left
+// 3x3 of model_matrix, computed on the CPU. Unlike mat3(model_matrix) it
+// keeps normals perpendicular to the surface under non-uniform scale. It
+// sits in locations 7, 8 and 9.
+layout (location = 7) in mat3 normal_matrix;
+
 // The view matrix and the projection matrix are constant across a draw
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
@@ -34,9 +40,9 @@ void main(void)
     // projection matrix.
     gl_Position = projection_matrix * (model_view_matrix * position);
 
-    // Transform the normal by the upper-left-3x3-submatrix of the
-    // model-view matrix
-    vertex.normal = mat3(model_view_matrix) * normal;
+    // Transform the normal by the normal matrix, then by the
+    // upper-left-3x3-submatrix of the view matrix, which is a rotation
+    vertex.normal = mat3(view_matrix) * (normal_matrix * normal);
 
     // Pass the per-instance color through to the fragment shader.
     vertex.color = color;
@@ -0,0 +1,47 @@
+#version 330
+
+// 'position' and 'normal' are regular vertex attributes
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 normal;
+
+// Color is a per-instance attribute
+layout (location = 2) in vec4 color;
+
+// The per-instance transformation, packed as vmath::mat3x4: the three rows
+// of the affine model matrix, whose last row is always (0, 0, 0, 1). A
+// mat3x4 has three vec4 columns, so it sits in locations 3, 4 and 5 and
+// takes 48 bytes per instance instead of 64.
+layout (location = 3) in mat3x4 model_rows;
+
+// The per-instance normal matrix, the inverse transpose of the 3x3 part of
+// the model matrix, computed on the CPU (locations 6, 7 and 8)
+layout (location = 6) in mat3 normal_matrix;
+
+// The view matrix and the projection matrix are constant across a draw
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+// The output of the vertex shader (matched to the fragment shader)
+out VERTEX
+{
+    vec3    normal;
+    vec4    color;
+} vertex;
+
+// Ok, go!
+void main(void)
+{
+    // Multiplying on the left dots the position with each row, which
+    // applies the model matrix without building it
+    vec4 world_position = vec4(position * model_rows, position.w);
+
+    // Transform by the view matrix, then by the projection matrix.
+    gl_Position = projection_matrix * (view_matrix * world_position);
+
+    // Transform the normal by the normal matrix, then by the
+    // upper-left-3x3-submatrix of the view matrix
+    vertex.normal = mat3(view_matrix) * (normal_matrix * normal);
+
+    // Pass the per-instance color through to the fragment shader.
+    vertex.color = color;
+}
@@ -0,0 +1,58 @@
+#version 330
+
+// 'position' and 'normal' are regular vertex attributes
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 normal;
+
+// Color is a per-instance attribute
+layout (location = 2) in vec4 color;
+
+// The view matrix and the projection matrix are constant across a draw
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+// These are the TBOs that hold per-instance colors and per-instance
+// model matrices
+uniform samplerBuffer color_tbo;
+uniform samplerBuffer model_matrix_tbo;
+
+// The output of the vertex shader (matched to the fragment shader)
+out VERTEX
+{
+    vec3    normal;
+    vec4    color;
+} vertex;
+
+// Ok, go!
+void main(void)
+{
+    // Use gl_InstanceID to obtain the instance color from the color TBO
+    vec4 color = texelFetch(color_tbo, gl_InstanceID);
+
+    // The model matrices are stored as vmath::mat3x4, the three rows of
+    // the affine matrix (its last row is always (0, 0, 0, 1)), so each
+    // instance takes three fetches and 48 bytes instead of four and 64.
+    vec4 row1 = texelFetch(model_matrix_tbo, gl_InstanceID * 3);
+    vec4 row2 = texelFetch(model_matrix_tbo, gl_InstanceID * 3 + 1);
+    vec4 row3 = texelFetch(model_matrix_tbo, gl_InstanceID * 3 + 2);
+
+    // Now assemble the rows into a matrix. The constructor takes columns,
+    // so the rows go in as a mat3x4 and come out transposed; mat4() fills
+    // in the last row from the identity.
+    mat4 model_matrix = mat4(transpose(mat3x4(row1, row2, row3)));
+
+    // Construct a model-view matrix from the uniform view matrix
+    // and the per-instance model matrix.
+    mat4 model_view_matrix = view_matrix * model_matrix;
+
+    // Transform position by the model-view matrix, then by the
+    // projection matrix.
+    gl_Position = projection_matrix * (model_view_matrix * position);
+
+    // Transform the normal by the upper-left-3x3-submatrix of the
+    // model-view matrix
+    vertex.normal = mat3(model_view_matrix) * normal;
+
+    // Pass the per-instance color through to the fragment shader.
+    vertex.color = color;
+}
@@ -0,0 +1,61 @@
+#version 330
+
+// 'position' and 'normal' are regular vertex attributes
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 normal;
+
+// Color is a per-instance attribute
+layout (location = 2) in vec4 color;
+
+// The per-instance transformation, packed as vmath::trs: a rotation
+// quaternion, then the translation with the uniform scale in w. That is
+// two locations (3 and 4) and 32 bytes per instance, half of a mat4.
+layout (location = 3) in vec4 model_rotation;
+layout (location = 4) in vec4 model_translation_scale;
+
+// The view matrix and the projection matrix are constant across a draw
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+// The output of the vertex shader (matched to the fragment shader)
+out VERTEX
+{
+    vec3    normal;
+    vec4    color;
+} vertex;
+
+// Builds the matrix that scales, rotates by the unit quaternion q, then
+// translates, as vmath::to_mat4(trs) does
+mat4 trs_to_mat4(vec4 q, vec4 ts)
+{
+    vec3 q2 = q.xyz + q.xyz;
+    vec3 qq = q.xyz * q2;
+    float xy = q.x * q2.y;
+    float xz = q.x * q2.z;
+    float yz = q.y * q2.z;
+    vec3 wq = q.w * q2;
+
+    return mat4(vec4(vec3(1.0 - (qq.y + qq.z), xy + wq.z, xz - wq.y) * ts.w, 0.0),
+                vec4(vec3(xy - wq.z, 1.0 - (qq.x + qq.z), yz + wq.x) * ts.w, 0.0),
+                vec4(vec3(xz + wq.y, yz - wq.x, 1.0 - (qq.x + qq.y)) * ts.w, 0.0),
+                vec4(ts.xyz, 1.0));
+}
+
+// Ok, go!
+void main(void)
+{
+    // Construct a model-view matrix from the uniform view matrix
+    // and the per-instance transformation.
+    mat4 model_view_matrix = view_matrix * trs_to_mat4(model_rotation, model_translation_scale);
+
+    // Transform position by the model-view matrix, then by the
+    // projection matrix.
+    gl_Position = projection_matrix * (model_view_matrix * position);
+
+    // Transform the normal by the upper-left-3x3-submatrix of the
+    // model-view matrix
+    vertex.normal = mat3(model_view_matrix) * normal;
+
+    // Pass the per-instance color through to the fragment shader.
+    vertex.color = color;
+}
@@ -0,0 +1,471 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: animbench.cpp
+//
+// Purpose: Plays a vertex-animated VBM through VBAnimation and checks it.
+//          The keyframes are made from media/armadillo_low.vbm, swayed
+//          further along a wave in each one, and written next to the
+//          program; vbmc writes levels of detail rather than keyframes.
+//
+//          It prints the frame time and stalls of a playback with the
+//          default window, paced at --fps, then checks that:
+//
+//          - every keyframe becomes resident,
+//          - a frame halfway between two keyframes, blended by
+//            shaders/animation.vs.glsl, matches the same mesh blended on
+//            the CPU and drawn as a single frame, and differs from the
+//            first keyframe,
+//          - a file truncated after it was opened is reported by Update,
+//            and its frames are read at most VBANIMATION_MAX_READS times.
+//
+//          The exit code is 0 when every check passes, 1 when one fails
+//          and 2 on errors. Run it from this directory, or point --root at
+//          the top of the tree. For example:
+//
+//          g++ -O2 -std=c++11 -I../../include -o animbench animbench.cpp
+//              ../../common/VBAnimation.cpp ../../common/VBM.cpp
+//              ../../common/GLStateCache.cpp ../../common/GLIntercept.cpp
+//              ../../common/ShaderUtil.cpp ../../common/Image.cpp
+//              ../../common/Profiler.cpp -lGLEW -lglut -lGL -lpthread
+//          ./animbench --keyframes=64 --frames=600 --fps=60
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GLStateCache.h"
+#include "Image.h"
+#include "ShaderUtil.h"
+#include "VBAnimation.h"
+#include "VBM.h"
+#include "vmath.h"
+using namespace vmath;
+
+#define FRAMEBUFFER_WIDTH   320
+#define FRAMEBUFFER_HEIGHT  240
+
+// The attribute locations of shaders/animation.vs.glsl
+#define POSITION_LOCATION       0
+#define NORMAL_LOCATION         1
+#define NEXT_POSITION_LOCATION  3
+#define NEXT_NORMAL_LOCATION    4
+
+static const char *const ANIMATION_FILE = "animbench_keyframes.vbm";
+static const char *const REFERENCE_FILE = "animbench_reference.vbm";
+static const char *const TRUNCATED_FILE = "animbench_truncated.vbm";
+
+// The mesh the keyframes are made from
+struct SOURCE_MESH
+{
+    std::vector<char> file;
+    VBM_LAYOUT layout;
+    const VBM_HEADER *header;
+    const VBM_ATTRIB_HEADER *attribs;
+};
+
+static GLuint program;
+static GLint blend_loc;
+static std::vector<unsigned char> pixels;
+
+
+static bool ReadFile(const std::string& filename, std::vector<char>& data)
+{
+    std::ifstream f(filename.c_str(), std::ios::binary);
+    data.assign((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    return !data.empty();
+}
+
+
+static bool LoadSource(const std::string& filename, SOURCE_MESH& mesh)
+{
+    if (!ReadFile(filename, mesh.file) ||
+        !ValidateVBM(&mesh.file[0], mesh.file.size(), VBM_VALIDATE_VERTEX_FRAMES, &mesh.layout))
+        return false;
+
+    mesh.header = (const VBM_HEADER *)&mesh.file[0];
+    mesh.attribs = (const VBM_ATTRIB_HEADER *)&mesh.file[mesh.header->size];
+
+    // The positions are swayed in place, so they must be plain floats
+    return mesh.attribs[0].type == GL_FLOAT && mesh.attribs[0].components >= 2;
+}
+
+
+// The positions of keyframe 'phase' (in turns): every vertex moved along
+// x by a wave that runs up the mesh
+static void Sway(const SOURCE_MESH& mesh, float phase, std::vector<float>& positions)
+{
+    const float *source = (const float *)&mesh.file[(size_t)mesh.layout.attrib_offset[0]];
+    unsigned int components = mesh.attribs[0].components;
+
+    positions.assign(source, source + (size_t)mesh.header->num_vertices * components);
+    for (unsigned int v = 0; v < mesh.header->num_vertices; ++v)
+    {
+        float *p = &positions[(size_t)v * components];
+        p[0] += 10.0f * sinf(2.0f * 3.14159265f * phase + 0.05f * p[1]);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteKeyframes
+//
+// Purpose: Writes an animated VBM with one keyframe per array of positions.
+//          The other attributes and the indices are the source's, repeated.
+//
+// INPUTS: filename  - the file to write
+//         mesh      - the source mesh
+//         keyframes - the positions of each keyframe
+//
+// OUTPUTS: Returns false if the file could not be written.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool WriteKeyframes(const char *filename, const SOURCE_MESH& mesh,
+                           const std::vector<std::vector<float> >& keyframes)
+{
+    unsigned int count = (unsigned int)keyframes.size();
+    unsigned int vertices = mesh.header->num_vertices;
+    VBM_HEADER header = *mesh.header;
+    std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+
+    header.size = sizeof(VBM_HEADER);
+    header.num_frames = count;
+    header.num_vertices = vertices * count;
+    f.write((const char *)&header, sizeof(header));
+    f.write((const char *)mesh.attribs, header.num_attribs * sizeof(VBM_ATTRIB_HEADER));
+
+    for (unsigned int k = 0; k < count; ++k)
+    {
+        VBM_FRAME_HEADER frame = { k * vertices, vertices, VBM_FRAME_TRIANGLES };
+        f.write((const char *)&frame, sizeof(frame));
+    }
+
+    for (unsigned int a = 0; a < header.num_attribs; ++a)
+    {
+        size_t size = (size_t)mesh.layout.attrib_stride[a] * vertices;
+        for (unsigned int k = 0; k < count; ++k)
+        {
+            if (a == 0)
+                f.write((const char *)&keyframes[k][0], size);
+            else
+                f.write(&mesh.file[(size_t)mesh.layout.attrib_offset[a]], size);
+        }
+    }
+
+    if (mesh.layout.index_data_size)
+        f.write(&mesh.file[(size_t)mesh.layout.index_data_offset], (std::streamsize)mesh.layout.index_data_size);
+
+    return f.good();
+}
+
+
+// Updates until both keyframes at 'time' are resident, as drawing frames
+// would; false if a read failed or it took more than a few seconds
+static bool Settle(VBAnimation& animation, float time)
+{
+    for (unsigned int i = 0; i < 5000; ++i)
+    {
+        unsigned int stalls = animation.GetStallCount();
+        if (!animation.Update(time))
+            return false;
+        if (animation.GetStallCount() == stalls)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+
+static void Draw(VBAnimation& animation)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glUniform1f(blend_loc, animation.GetBlend());
+    animation.Render();
+}
+
+
+static void Read(IMAGE& image)
+{
+    glReadPixels(0, 0, FRAMEBUFFER_WIDTH, FRAMEBUFFER_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    ImageFromRGBA(&pixels[0], FRAMEBUFFER_WIDTH, FRAMEBUFFER_HEIGHT, image);
+}
+
+
+static bool initialize(const std::string& root)
+{
+    std::string vs = root + "/shaders/animation.vs.glsl";
+    std::string fs = root + "/shaders/instancing.fs.glsl";
+    ShaderInfo shader_info[] =
+    {
+        { GL_VERTEX_SHADER, vs.c_str(), 0 },
+        { GL_FRAGMENT_SHADER, fs.c_str(), 0 },
+        { GL_NONE, NULL, 0 }
+    };
+    ShaderUtil su;
+    program = su.LoadShaders(shader_info);
+    if (!program)
+        return false;
+
+    // The hidden window's pixels are undefined, so everything is drawn
+    // into a framebuffer object
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, FRAMEBUFFER_WIDTH, FRAMEBUFFER_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, FRAMEBUFFER_WIDTH, FRAMEBUFFER_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        return false;
+    glViewport(0, 0, FRAMEBUFFER_WIDTH, FRAMEBUFFER_HEIGHT);
+    pixels.resize(FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT * 4);
+
+    GLStateCache& state = GLStateCache::Current();
+    state.UseProgram(program);
+    state.Enable(GL_DEPTH_TEST);
+    state.DepthFunc(GL_LEQUAL);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    mat4 model_view_matrix(translate(0.0f, -12.0f, -130.0f));
+    mat4 projection_matrix(frustum(-1.0f, 1.0f, -0.75f, 0.75f, 1.0f, 1000.0f));
+    glUniformMatrix4fv(glGetUniformLocation(program, "model_view_matrix"), 1, GL_FALSE, model_view_matrix);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection_matrix"), 1, GL_FALSE, projection_matrix);
+    glUniform4f(glGetUniformLocation(program, "color"), 0.8f, 0.6f, 0.4f, 1.0f);
+    blend_loc = glGetUniformLocation(program, "blend");
+
+    return true;
+}
+
+
+static bool Open(VBAnimation& animation, const char *filename, unsigned int window)
+{
+    return animation.Open(filename, POSITION_LOCATION, NORMAL_LOCATION, -1,
+                          NEXT_POSITION_LOCATION, NEXT_NORMAL_LOCATION, window);
+}
+
+
+// Plays 'frames' frames at half a keyframe per frame, paced at 'fps' as a
+// sample would be by the display, and prints how often the disk fell behind
+static void Play(const char *filename, unsigned int frames, unsigned int fps)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    VBAnimation animation;
+    if (!Open(animation, filename, 8))
+        return;
+
+    double draw_ms = 0.0;
+    Clock::time_point start = Clock::now();
+    for (unsigned int f = 0; f < frames; ++f)
+    {
+        Clock::time_point begin = Clock::now();
+        animation.Update(0.5f * float(f));
+        Draw(animation);
+        glFinish();
+        draw_ms += std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+        std::this_thread::sleep_until(start + std::chrono::microseconds(1000000ull * (f + 1) / fps));
+    }
+
+    printf("playback: %u frames at %u fps, window %u, %.3f ms per frame, %u stalls\n", frames, fps,
+           animation.GetWindowSize(), draw_ms / frames, animation.GetStallCount());
+}
+
+
+// Every keyframe becomes resident, and a blended frame matches the CPU blend
+static bool CheckBlend(const SOURCE_MESH& mesh, unsigned int keyframes)
+{
+    VBAnimation animation;
+    if (!Open(animation, ANIMATION_FILE, 8))
+    {
+        printf("FAILED: cannot open %s\n", ANIMATION_FILE);
+        return false;
+    }
+
+    for (unsigned int k = 0; k < keyframes; ++k)
+    {
+        if (!Settle(animation, float(k)))
+        {
+            printf("FAILED: keyframe %u never became resident\n", k);
+            return false;
+        }
+    }
+
+    IMAGE first, blended, expected;
+    bool ok = true;
+    if (!Settle(animation, float(keyframes)))
+        return false;
+    Draw(animation);
+    Read(first);
+
+    unsigned int checked[] = { 0, keyframes / 2, keyframes - 1 };
+    for (unsigned int i = 0; i < sizeof(checked) / sizeof(checked[0]); ++i)
+    {
+        unsigned int k = checked[i];
+        if (!Settle(animation, float(k) + 0.5f))
+        {
+            printf("FAILED: keyframe %u was not read again\n", k);
+            return false;
+        }
+        Draw(animation);
+        Read(blended);
+
+        // mix() on the CPU; after the last keyframe comes the first
+        std::vector<std::vector<float> > reference(1);
+        std::vector<float> a, b;
+        Sway(mesh, float(k) / float(keyframes), a);
+        Sway(mesh, float((k + 1) % keyframes) / float(keyframes), b);
+        reference[0].resize(a.size());
+        for (size_t n = 0; n < a.size(); ++n)
+            reference[0][n] = a[n] * 0.5f + b[n] * 0.5f;
+
+        VBAnimation single;
+        if (!WriteKeyframes(REFERENCE_FILE, mesh, reference) ||
+            !Open(single, REFERENCE_FILE, 1) || !Settle(single, 0.0f))
+        {
+            printf("FAILED: cannot draw %s\n", REFERENCE_FILE);
+            return false;
+        }
+        Draw(single);
+        Read(expected);
+
+        // The two blends round alike, so only a few edge pixels may differ
+        IMAGE_TOLERANCE tolerance = { IMAGE_DEFAULT_THRESHOLD, 0.0001 };
+        IMAGE_DIFFERENCE difference = CompareImages(expected, blended, tolerance);
+        bool moved = !ImagesMatch(CompareImages(first, blended, tolerance), tolerance);
+        printf("blend %5.1f: %llu of %u pixels differ from the CPU blend%s\n", float(k) + 0.5f,
+               difference.differing, FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT,
+               moved ? "" : ", but it matches keyframe 0");
+        if (!ImagesMatch(difference, tolerance) || !moved)
+            ok = false;
+    }
+
+    if (!ok)
+        printf("FAILED: the GPU blend does not match\n");
+    return ok;
+}
+
+
+// A file that cannot be read any more is reported, and not read forever
+static bool CheckReadFailures(unsigned int keyframes)
+{
+    std::vector<char> file;
+    if (!ReadFile(ANIMATION_FILE, file))
+        return false;
+    std::ofstream(TRUNCATED_FILE, std::ios::binary | std::ios::trunc).write(&file[0], file.size());
+
+    VBAnimation animation;
+    if (!Open(animation, TRUNCATED_FILE, 8))
+    {
+        printf("FAILED: cannot open %s\n", TRUNCATED_FILE);
+        return false;
+    }
+
+    // Keep the header tables only, so every read fails from now on
+    const VBM_HEADER *header = (const VBM_HEADER *)&file[0];
+    size_t tables = header->size + header->num_attribs * sizeof(VBM_ATTRIB_HEADER) +
+                    header->num_frames * sizeof(VBM_FRAME_HEADER);
+    std::ofstream(TRUNCATED_FILE, std::ios::binary | std::ios::trunc).write(&file[0], tables);
+
+    // Three loops, dwelling on each position until Update gives up on it
+    bool reported = false;
+    for (unsigned int position = 0; position < 3 * keyframes; ++position)
+    {
+        for (unsigned int i = 0; i < 2000; ++i)
+        {
+            if (!animation.Update(float(position)))
+            {
+                reported = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    unsigned int failures = animation.GetReadFailureCount();
+    animation.Close();
+    remove(TRUNCATED_FILE);
+
+    printf("truncated file: %u failed reads of %u keyframes, %s\n", failures, keyframes,
+           reported ? "reported" : "not reported");
+    if (!reported || failures == 0 || failures > keyframes * VBANIMATION_MAX_READS)
+    {
+        printf("FAILED: read failures are not reported or bounded\n");
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string root = "../..";
+    unsigned int keyframes = 32;
+    unsigned int frames = 120;
+    unsigned int fps = 60;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--root=", 7) == 0)
+            root = argv[i] + 7;
+        else if (strncmp(argv[i], "--keyframes=", 12) == 0)
+            keyframes = (unsigned int)atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+            frames = (unsigned int)atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--fps=", 6) == 0)
+            fps = (unsigned int)atoi(argv[i] + 6);
+        else
+        {
+            fprintf(stderr, "usage: animbench [--root=dir] [--keyframes=32] [--frames=120] [--fps=60]\n");
+            return 2;
+        }
+    }
+    if (keyframes < 2 || frames == 0 || fps == 0)
+        return 2;
+
+    SOURCE_MESH mesh;
+    std::vector<std::vector<float> > positions(keyframes);
+    if (!LoadSource(root + "/media/armadillo_low.vbm", mesh))
+    {
+        fprintf(stderr, "animbench: cannot read %s/media/armadillo_low.vbm\n", root.c_str());
+        return 2;
+    }
+    for (unsigned int k = 0; k < keyframes; ++k)
+        Sway(mesh, float(k) / float(keyframes), positions[k]);
+    if (!WriteKeyframes(ANIMATION_FILE, mesh, positions))
+    {
+        fprintf(stderr, "animbench: cannot write %s\n", ANIMATION_FILE);
+        return 2;
+    }
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGBA);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("animbench");
+    glutHideWindow();
+    if (glewInit() || !initialize(root))
+    {
+        fprintf(stderr, "animbench: GL initialization failed\n");
+        return 2;
+    }
+
+    printf("%u keyframes of %u vertices\n", keyframes, mesh.header->num_vertices);
+    Play(ANIMATION_FILE, frames, fps);
+    bool ok = CheckBlend(mesh, keyframes);
+    ok = CheckReadFailures(keyframes) && ok;
+
+    GLStateCache::Current().DeleteProgram(program);
+    remove(ANIMATION_FILE);
+    remove(REFERENCE_FILE);
+
+    return ok ? 0 : 1;
+}
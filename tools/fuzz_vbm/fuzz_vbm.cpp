@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: fuzz_vbm.cpp
+//
+// Purpose: libFuzzer target for the validating VBM parser and the VBM2
+//          container and chunk decoder. Build it with
+//          clang -fsanitize=fuzzer,address and seed the corpus with the files
+//          in media/, for example:
+//
+//          clang++ -g -O1 -fsanitize=fuzzer,address -I../../include \
+//                  fuzz_vbm.cpp ../../common/VBM.cpp \
+//                  ../../common/VBMCodec.cpp ../../common/JobSystem.cpp \
+//                  -o fuzz_vbm
+//          ./fuzz_vbm corpus/ ../../media/
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "VBMCodec.h"
+
+
+// Mirrors what VBObject does with a VBM2 file, reading from memory
+static void FuzzVBM2(const uint8_t *data, size_t size)
+{
+    VBM2_HEADER header;
+
+    if (size < sizeof(VBM2_HEADER))
+        return;
+    memcpy(&header, data, sizeof(header));
+    if (!ValidateVBM2Header(header, size))
+        return;
+
+    std::vector<VBM2_CHUNK> chunks(header.num_chunks);
+    memcpy(&chunks[0], data + header.chunk_table_offset, chunks.size() * sizeof(VBM2_CHUNK));
+    if (!ValidateVBM2Chunks(header, &chunks[0], size))
+        return;
+
+    // The loader allocates the image before decoding it, so an accepted
+    // image must be bounded by the input. The chunk table takes more than
+    // 16 bytes of the input per chunk, so 256 times the input covers the
+    // largest LZ4 expansion of every chunk.
+    if (header.image_size > (unsigned long long)size * 256)
+        abort();
+
+    std::vector<unsigned char> raw;
+    std::vector<unsigned char> scratch;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        raw.resize((size_t)chunks[i].raw_size);
+        if (!DecodeVBM2Chunk(chunks[i], data + chunks[i].offset, &raw[0], scratch))
+            continue;
+
+        if (i == 0 && raw.size() >= sizeof(VBM_HEADER))
+        {
+            VBM_HEADER image;
+            VBM_LAYOUT layout;
+            memcpy(&image, &raw[0], sizeof(image));
+            if (ValidateVBMHeader(image, header.image_size, 0, &layout) &&
+                layout.tables_size == raw.size() &&
+                ValidateVBMTables(&raw[0], &layout) &&
+                ValidateVBM2Image(header, &chunks[0], layout) &&
+                layout.vertex_data_size + layout.index_data_size > (unsigned long long)size * 256)
+                abort();
+        }
+    }
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    VBM_LAYOUT layout;
+
+    for (unsigned int options = 0; options <= VBM_VALIDATE_VERTEX_FRAMES; ++options)
+    {
+        if (!ValidateVBM(data, size, options, &layout))
+            continue;
+
+        // Anything the parser accepts must lie entirely inside the input
+        if (layout.tables_size > size ||
+            layout.vertex_data_offset + layout.vertex_data_size > size ||
+            layout.index_data_offset + layout.index_data_size > size)
+            abort();
+    }
+
+    FuzzVBM2(data, size);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: imgcompare.cpp
+//
+// Purpose: Compares an image with a golden image, the way the capture mode
+//          of the samples does, for frames captured elsewhere or golden
+//          images checked by hand. Reads PPM and PNG files. For example:
+//
+//          g++ -O2 -std=c++11 -I../../include -o imgcompare imgcompare.cpp
+//              ../../common/Image.cpp
+//          ./imgcompare golden/frame_0000.png capture/frame_0000.ppm diff.ppm
+//          ./imgcompare --threshold=0.05 --max-fraction=0 golden.ppm frame.ppm
+//
+//          prints the number of differing pixels, the largest and mean
+//          perceptual distances and the PSNR, and writes the differences
+//          to the third file if there is one. The exit code is 0 when the
+//          images match, 1 when they differ and 2 on errors.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Image.h"
+
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: imgcompare [--threshold=T] [--max-fraction=F] golden image [diff]\n"
+                    "  --threshold=T      perceptual distance above which a pixel differs, 0 to 1 (%g)\n"
+                    "  --max-fraction=F   fraction of differing pixels the images may have (%g)\n",
+            IMAGE_DEFAULT_THRESHOLD, IMAGE_DEFAULT_MAX_FRACTION);
+}
+
+
+int main(int argc, char **argv)
+{
+    IMAGE_TOLERANCE tolerance = { IMAGE_DEFAULT_THRESHOLD, IMAGE_DEFAULT_MAX_FRACTION };
+    const char *files[3] = { NULL, NULL, NULL };
+    int num_files = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--threshold=", 12) == 0)
+        {
+            tolerance.threshold = atof(argv[i] + 12);
+        }
+        else if (strncmp(argv[i], "--max-fraction=", 15) == 0)
+        {
+            tolerance.max_fraction = atof(argv[i] + 15);
+        }
+        else if (argv[i][0] != '-' && num_files < 3)
+        {
+            files[num_files++] = argv[i];
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if (num_files < 2)
+    {
+        Usage();
+        return 2;
+    }
+
+    IMAGE golden, image, diff;
+    if (!ReadImage(files[0], golden) || !ReadImage(files[1], image))
+    {
+        fprintf(stderr, "imgcompare: unable to read %s\n", ReadImage(files[0], golden) ? files[1] : files[0]);
+        return 2;
+    }
+
+    IMAGE_DIFFERENCE difference = CompareImages(golden, image, tolerance, files[2] ? &diff : NULL);
+    if (!difference.same_size)
+    {
+        printf("DIFFERS: %s is %ux%u, %s is %ux%u\n", files[0], golden.width, golden.height,
+               files[1], image.width, image.height);
+        return 1;
+    }
+
+    bool match = ImagesMatch(difference, tolerance);
+    printf("%s: %llu of %u pixels differ (%.4f%%), max distance %.4f, mean %.6f, PSNR %.2f dB\n",
+           match ? "match" : "DIFFERS", difference.differing, golden.width * golden.height,
+           difference.fraction * 100.0, difference.max_distance, difference.mean_distance, difference.psnr);
+
+    if (files[2] && !WriteImage(files[2], diff))
+    {
+        fprintf(stderr, "imgcompare: unable to write %s\n", files[2]);
+        return 2;
+    }
+
+    return match ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: jobbench.cpp
+//
+// Purpose: Measures how the JobSystem scales from 1 to N threads on the
+//          per-instance model matrices of the instancing sample, computed
+//          for many more instances than the sample draws. Every run is
+//          checked against a single-threaded reference. For example:
+//
+//          g++ -O2 -std=c++11 -I../../include -o jobbench jobbench.cpp
+//              ../../common/JobSystem.cpp -lpthread
+//          ./jobbench 1000000 20
+//
+//          prints the best time of 20 frames per thread count, the speedup
+//          over one thread and the job, steal and split counts. With
+//          --json=file the time per instance of each thread count is also
+//          written to a file in the format of microbench --json.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "JobSystem.h"
+#include "vmath.h"
+using namespace vmath;
+
+struct Frame
+{
+    mat4 *matrices;
+    float t;
+};
+
+
+// The transformation loop of instancing.cpp
+static void GenerateMatrices(void *user, unsigned int first, unsigned int end)
+{
+    Frame *frame = (Frame *)user;
+    float t = frame->t;
+
+    for (unsigned int n = first; n < end; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        frame->matrices[n] = euler_to_mat4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                                           vec3(10.0f + a, 40.0f + b, 50.0f + c));
+    }
+}
+
+
+static double Milliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// Writes the results as microbench --json does, one benchmark per thread
+// count
+static bool WriteJSON(const char *filename, const std::vector<unsigned int>& threads,
+                      const std::vector<double>& ns_per_instance)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        fprintf(f, "    { \"name\": \"threads %u\", \"ns_per_op\": %.3f }%s\n", threads[i], ns_per_instance[i],
+                i + 1 < threads.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+
+// 1, 2, 4, ... and then max_threads itself
+static unsigned int NextThreadCount(unsigned int threads, unsigned int max_threads)
+{
+    if (threads == max_threads)
+        return max_threads + 1;
+    return threads * 2 < max_threads ? threads * 2 : max_threads;
+}
+
+
+int main(int argc, char **argv)
+{
+    // The positional arguments are the count, frames and maximum threads;
+    // --json=file may come anywhere
+    const char *json = NULL;
+    std::vector<const char *> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--json=", 7) == 0)
+            json = argv[i] + 7;
+        else
+            args.push_back(argv[i]);
+    }
+
+    unsigned int count = args.size() > 0 ? (unsigned int)atoi(args[0]) : 1000000;
+    unsigned int frames = args.size() > 1 ? (unsigned int)atoi(args[1]) : 20;
+    unsigned int max_threads = args.size() > 2 ? (unsigned int)atoi(args[2]) : std::thread::hardware_concurrency();
+    if (count == 0 || frames == 0)
+        return 1;
+    if (max_threads == 0)
+        max_threads = 1;
+
+    std::vector<mat4> reference(count);
+    std::vector<mat4> matrices(count);
+    Frame frame;
+    frame.t = 0.25f;
+    frame.matrices = &reference[0];
+    GenerateMatrices(&frame, 0, count);
+
+    printf("%u instances, best of %u frames\n", count, frames);
+    printf("threads       ms  speedup      jobs    steals    splits\n");
+
+    double single = 0.0;
+    std::vector<unsigned int> thread_counts;
+    std::vector<double> ns_per_instance;
+    for (unsigned int threads = 1; threads <= max_threads; threads = NextThreadCount(threads, max_threads))
+    {
+        JobSystem jobs(threads);
+        frame.matrices = &matrices[0];
+        memset((void *)&matrices[0], 0, count * sizeof(mat4));
+
+        double best = 1e30;
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            jobs.ParallelFor(count, GenerateMatrices, &frame);
+            double ms = Milliseconds(start);
+            if (ms < best)
+                best = ms;
+        }
+
+        if (memcmp(&matrices[0], &reference[0], count * sizeof(mat4)) != 0)
+        {
+            printf("%7u  results differ from the single threaded reference\n", threads);
+            return 1;
+        }
+
+        if (threads == 1)
+            single = best;
+
+        JOB_STATS stats = jobs.GetStats();
+        printf("%7u %8.3f %8.2f %9llu %9llu %9llu\n", threads, best, single / best,
+               stats.jobs / frames, stats.steals / frames, stats.splits / frames);
+        thread_counts.push_back(threads);
+        ns_per_instance.push_back(best * 1.0e6 / count);
+    }
+
+    if (json && !WriteJSON(json, thread_counts, ns_per_instance))
+    {
+        fprintf(stderr, "jobbench: cannot write %s\n", json);
+        return 1;
+    }
+
+    return 0;
+}
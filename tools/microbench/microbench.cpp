@@ -0,0 +1,526 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: microbench.cpp
+//
+// Purpose: Microbenchmarks for vmath, the VBM parser and ShaderUtil, with
+//          results that can be stored and checked. Every case is timed in
+//          samples of at least --sample-ms milliseconds; the median time per
+//          operation is reported, and with --json written to a file like
+//          baseline.json. With --baseline the medians are compared to a
+//          stored file, and the program returns 1 when any case is slower
+//          than its baseline by more than --tolerance (0.25 by default), or
+//          a case in the baseline was not run, other than by --filter.
+//
+//          The cases that need a GL context (program_link, vbobject_load,
+//          and readback_sync and readback_pbo, which read a 640x480
+//          framebuffer with glReadPixels into memory and through a
+//          FrameCapture) only run with --gl, which opens a hidden GLUT
+//          window. Run it
+//          from this directory, or point --root at the top of the tree so
+//          the shaders and media are found. For example:
+//
+//          g++ -O2 -std=c++11 -I../../include -o microbench microbench.cpp
+//              ../../common/ShaderUtil.cpp ../../common/VBObject.cpp
+//              ../../common/VBM.cpp ../../common/VBMCodec.cpp
+//              ../../common/GLStateCache.cpp ../../common/GPUArena.cpp
+//              ../../common/TLSF.cpp ../../common/Stripifier.cpp
+//              ../../common/JobSystem.cpp ../../common/Profiler.cpp
+//              ../../common/GLIntercept.cpp ../../common/FrameCapture.cpp
+//              ../../common/Image.cpp -lGLEW -lglut -lGL -lpthread
+//          ./microbench --json=results.json
+//          ./microbench --gl --baseline=baseline.json
+//
+//          The stored baseline.json was measured on one machine; regenerate
+//          it with --json on the machine that runs the check.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "FrameCapture.h"
+#include "ShaderUtil.h"
+#include "VBM.h"
+#include "VBObject.h"
+#include "vmath.h"
+using namespace vmath;
+
+// What a case works on, set up once by main
+struct BENCH_DATA
+{
+    std::string root;
+    std::vector<mat4> a, b, out;
+    std::vector<vec3> angles, translations;
+    std::vector<char> vbm;
+    VBObject *object;
+    std::vector<unsigned char> pixels;
+    FrameCapture *capture;
+};
+
+// The framebuffer the readback cases read, the size of a sample's window
+#define READBACK_WIDTH  640
+#define READBACK_HEIGHT 480
+
+typedef void (*BenchFunction)(BENCH_DATA& data, size_t items);
+
+struct BENCH_CASE
+{
+    const char *name;
+    BenchFunction run;
+    size_t items;       // elements per operation, for the ns per item column
+    bool needs_gl;
+};
+
+struct BENCH_RESULT
+{
+    const char *name;
+    double ns_per_op;   // median of the samples
+    double min_ns;
+    size_t items;
+    unsigned long long iterations;
+};
+
+// Keeps the optimizer from discarding results
+static volatile float sink;
+
+
+static void BenchMat4Multiply(BENCH_DATA& data, size_t items)
+{
+    for (size_t n = 0; n < items; ++n)
+        data.out[n] = data.a[n] * data.b[n];
+    sink = data.out[items - 1][3][3];
+}
+
+
+static void BenchRotateTranslate(BENCH_DATA& data, size_t items)
+{
+    for (size_t n = 0; n < items; ++n)
+    {
+        const vec3& r = data.angles[n];
+        data.out[n] = rotate(r[0], 1.0f, 0.0f, 0.0f) *
+                      rotate(r[1], 0.0f, 1.0f, 0.0f) *
+                      rotate(r[2], 0.0f, 0.0f, 1.0f) *
+                      translate(data.translations[n]);
+    }
+    sink = data.out[items - 1][3][0];
+}
+
+
+// The instancing sample's per-frame work: the angles and translations of
+// every instance, then their matrices in batches
+static void BenchInstances(BENCH_DATA& data, size_t items)
+{
+    for (size_t n = 0; n < items; ++n)
+    {
+        float a = 50.0f * float(n % 1000) / 4.0f;
+        float b = 50.0f * float(n % 1000) / 5.0f;
+        float c = 50.0f * float(n % 1000) / 6.0f;
+
+        data.angles[n] = vec3(a + 90.0f, b + 90.0f, c + 90.0f);
+        data.translations[n] = vec3(10.0f + a, 40.0f + b, 50.0f + c);
+    }
+    euler_to_mat4_array(&data.angles[0], &data.translations[0], &data.out[0], items, SINCOS_FAST);
+    sink = data.out[items - 1][3][0];
+}
+
+
+// Validates a whole file and copies out its sections, as a loader would
+// before handing them to GL
+static bool ParseVBM(const char *file, size_t size)
+{
+    VBM_LAYOUT layout;
+    if (!ValidateVBM(file, size, 0, &layout))
+        return false;
+
+    std::vector<char> vertices(file + layout.vertex_data_offset,
+                               file + layout.vertex_data_offset + layout.vertex_data_size);
+    std::vector<char> indices(file + layout.index_data_offset,
+                              file + layout.index_data_offset + layout.index_data_size);
+    sink = float(vertices.size() + indices.size());
+
+    return true;
+}
+
+
+static void BenchVBMMemory(BENCH_DATA& data, size_t)
+{
+    ParseVBM(&data.vbm[0], data.vbm.size());
+}
+
+
+static void BenchVBMDisk(BENCH_DATA& data, size_t)
+{
+    std::ifstream f((data.root + "/media/armadillo_low.vbm").c_str(), std::ios::binary);
+    f.seekg(0, f.end);
+    std::vector<char> file((size_t)f.tellg());
+    f.seekg(0, f.beg);
+    f.read(&file[0], file.size());
+
+    ParseVBM(&file[0], file.size());
+}
+
+
+static void BenchReadShader(BENCH_DATA& data, size_t)
+{
+    ShaderUtil su;
+    const GLchar *source = su.ReadShader((data.root + "/shaders/instancing.vs.glsl").c_str());
+    sink = source ? float(source[0]) : 0.0f;
+    delete [] source;
+}
+
+
+static void BenchProgramLink(BENCH_DATA& data, size_t)
+{
+    std::string vs = data.root + "/shaders/instancing.vs.glsl";
+    std::string fs = data.root + "/shaders/instancing.fs.glsl";
+    ShaderInfo shader_info[] =
+    {
+        { GL_VERTEX_SHADER, vs.c_str(), 0 },
+        { GL_FRAGMENT_SHADER, fs.c_str(), 0 },
+        { GL_NONE, NULL, 0 }
+    };
+
+    ShaderUtil su;
+    GLuint program = su.LoadShaders(shader_info);
+    for (ShaderInfo *entry = shader_info; entry->type != GL_NONE; ++entry)
+        glDeleteShader(entry->shader);
+    glDeleteProgram(program);
+    glFinish();
+}
+
+
+static void BenchVBObjectLoad(BENCH_DATA& data, size_t)
+{
+    data.object->LoadFromVBM((data.root + "/media/armadillo_low.vbm").c_str(), 0, 1, -1);
+    glFinish();
+}
+
+
+// A readback that stalls until the GPU has finished, as a capture with
+// glReadPixels into memory would
+static void BenchReadbackSync(BENCH_DATA& data, size_t)
+{
+    glReadPixels(0, 0, READBACK_WIDTH, READBACK_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &data.pixels[0]);
+    sink = float(data.pixels[0]);
+}
+
+
+// The context thread's share of a FrameCapture readback, without the
+// file write
+static void BenchReadbackPBO(BENCH_DATA& data, size_t)
+{
+    data.capture->Capture(std::string());
+}
+
+
+static const BENCH_CASE CASES[] =
+{
+    { "mat4_multiply", BenchMat4Multiply, 1024, false },
+    { "rotate_translate", BenchRotateTranslate, 1024, false },
+    { "instances_1k", BenchInstances, 1000, false },
+    { "instances_100k", BenchInstances, 100000, false },
+    { "instances_1m", BenchInstances, 1000000, false },
+    { "vbm_parse_memory", BenchVBMMemory, 1, false },
+    { "vbm_parse_disk", BenchVBMDisk, 1, false },
+    { "read_shader", BenchReadShader, 1, false },
+    { "program_link", BenchProgramLink, 1, true },
+    { "vbobject_load", BenchVBObjectLoad, 1, true },
+    { "readback_sync", BenchReadbackSync, 1, true },
+    { "readback_pbo", BenchReadbackPBO, 1, true }
+};
+
+static const size_t CASE_COUNT = sizeof(CASES) / sizeof(CASES[0]);
+
+
+static double Nanoseconds(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// Doubles the iterations per sample until one sample takes sample_ms, then
+// takes 'samples' samples of that many
+static BENCH_RESULT RunCase(const BENCH_CASE& bench, BENCH_DATA& data, double sample_ms, unsigned int samples)
+{
+    unsigned long long iterations = 1;
+    for (;;)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (unsigned long long i = 0; i < iterations; ++i)
+            bench.run(data, bench.items);
+        if (Nanoseconds(start) >= sample_ms * 1.0e6 || iterations >= (1ull << 40))
+            break;
+        iterations *= 2;
+    }
+
+    std::vector<double> times(samples);
+    for (unsigned int s = 0; s < samples; ++s)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (unsigned long long i = 0; i < iterations; ++i)
+            bench.run(data, bench.items);
+        times[s] = Nanoseconds(start) / double(iterations);
+    }
+    std::sort(times.begin(), times.end());
+
+    BENCH_RESULT result;
+    result.name = bench.name;
+    result.ns_per_op = times[samples / 2];
+    result.min_ns = times[0];
+    result.items = bench.items;
+    result.iterations = iterations * samples;
+
+    return result;
+}
+
+
+static bool WriteJSON(const char *filename, const std::vector<BENCH_RESULT>& results)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        fprintf(f, "    { \"name\": \"%s\", \"ns_per_op\": %.1f, \"min_ns\": %.1f, \"items\": %u, \"iterations\": %llu }%s\n",
+                results[i].name, results[i].ns_per_op, results[i].min_ns, (unsigned int)results[i].items,
+                results[i].iterations, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+
+// Reads the name and ns_per_op of every case in a file written by WriteJSON
+static bool ReadBaseline(const char *filename, std::vector<std::pair<std::string, double> >& baseline)
+{
+    std::ifstream f(filename);
+    if (!f)
+        return false;
+
+    std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    size_t at = 0;
+    while ((at = text.find("\"name\"", at)) != std::string::npos)
+    {
+        size_t begin = text.find('"', text.find(':', at)) + 1;
+        size_t end = text.find('"', begin);
+        size_t value = text.find("\"ns_per_op\"", end);
+        if (begin == 0 || end == std::string::npos || value == std::string::npos)
+            return false;
+
+        baseline.push_back(std::make_pair(text.substr(begin, end - begin),
+                                          atof(text.c_str() + text.find(':', value) + 1)));
+        at = value;
+    }
+
+    return !baseline.empty();
+}
+
+
+static const char *Option(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0 ? arg + len : NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    BENCH_DATA data;
+    const char *json = NULL;
+    const char *baseline_file = NULL;
+    const char *filter = NULL;
+    double tolerance = 0.25;
+    double sample_ms = 20.0;
+    unsigned int samples = 9;
+    bool gl = false;
+    const char *value;
+
+    data.root = "../..";
+    data.object = NULL;
+    data.capture = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((value = Option(argv[i], "--json=")) != NULL)
+            json = value;
+        else if ((value = Option(argv[i], "--baseline=")) != NULL)
+            baseline_file = value;
+        else if ((value = Option(argv[i], "--tolerance=")) != NULL)
+            tolerance = atof(value);
+        else if ((value = Option(argv[i], "--filter=")) != NULL)
+            filter = value;
+        else if ((value = Option(argv[i], "--root=")) != NULL)
+            data.root = value;
+        else if ((value = Option(argv[i], "--sample-ms=")) != NULL)
+            sample_ms = atof(value);
+        else if ((value = Option(argv[i], "--samples=")) != NULL)
+            samples = (unsigned int)atoi(value);
+        else if (strcmp(argv[i], "--gl") == 0)
+            gl = true;
+        else
+        {
+            fprintf(stderr, "usage: microbench [--gl] [--filter=text] [--json=file] [--baseline=file]\n"
+                            "                  [--tolerance=0.25] [--root=dir] [--sample-ms=20] [--samples=9]\n");
+            return 2;
+        }
+    }
+    if (samples == 0 || sample_ms <= 0.0)
+        return 2;
+
+    // The largest case sets the sizes of the arrays
+    size_t max_items = 0;
+    for (size_t i = 0; i < CASE_COUNT; ++i)
+        max_items = std::max(max_items, CASES[i].items);
+
+    data.a.resize(max_items);
+    data.b.resize(max_items);
+    data.out.resize(max_items);
+    data.angles.resize(max_items);
+    data.translations.resize(max_items);
+    for (size_t n = 0; n < 1024; ++n)
+    {
+        data.a[n] = rotate(float(n), 0.0f, 0.6f, 0.8f) * translate(float(n), 1.0f, 2.0f);
+        data.b[n] = scale(1.0f + float(n % 7)) * rotate(float(n * 3), 1.0f, 0.0f, 0.0f);
+        data.angles[n] = vec3(float(n), float(n * 2), float(n * 3));
+        data.translations[n] = vec3(float(n), 40.0f, 50.0f);
+    }
+
+    std::ifstream vbm((data.root + "/media/armadillo_low.vbm").c_str(), std::ios::binary);
+    data.vbm.assign((std::istreambuf_iterator<char>(vbm)), std::istreambuf_iterator<char>());
+    VBM_LAYOUT layout;
+    if (data.vbm.empty() || !ValidateVBM(&data.vbm[0], data.vbm.size(), 0, &layout))
+    {
+        fprintf(stderr, "microbench: cannot read %s/media/armadillo_low.vbm\n", data.root.c_str());
+        return 2;
+    }
+
+    if (gl)
+    {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_RGBA);
+        glutInitWindowSize(64, 64);
+        glutCreateWindow("microbench");
+        glutHideWindow();
+        data.object = new VBObject;
+
+        // The GL cases time the successful paths only
+        std::string vs = data.root + "/shaders/instancing.vs.glsl";
+        std::string fs = data.root + "/shaders/instancing.fs.glsl";
+        ShaderInfo shader_info[] =
+        {
+            { GL_VERTEX_SHADER, vs.c_str(), 0 },
+            { GL_FRAGMENT_SHADER, fs.c_str(), 0 },
+            { GL_NONE, NULL, 0 }
+        };
+        ShaderUtil su;
+        if (glewInit() || !su.LoadShaders(shader_info) ||
+            !data.object->LoadFromVBM((data.root + "/media/armadillo_low.vbm").c_str(), 0, 1, -1))
+        {
+            fprintf(stderr, "microbench: GL initialization failed\n");
+            return 2;
+        }
+
+        // The hidden window's pixels are undefined, so the readback cases
+        // read a framebuffer object of their own
+        GLuint framebuffer, renderbuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(1, &renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, READBACK_WIDTH, READBACK_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+        glClearColor(0.25f, 0.5f, 0.75f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        data.pixels.resize(READBACK_WIDTH * READBACK_HEIGHT * 4);
+        data.capture = new FrameCapture(READBACK_WIDTH, READBACK_HEIGHT);
+    }
+
+    std::vector<BENCH_RESULT> results;
+    printf("case                    ns/op    ns/item      min ns  iterations\n");
+    for (size_t i = 0; i < CASE_COUNT; ++i)
+    {
+        if ((CASES[i].needs_gl && !gl) || (filter && !strstr(CASES[i].name, filter)))
+            continue;
+
+        BENCH_RESULT result = RunCase(CASES[i], data, sample_ms, samples);
+        printf("%-18s %12.1f %10.2f %11.1f  %10llu\n", result.name, result.ns_per_op,
+               result.ns_per_op / result.items, result.min_ns, result.iterations);
+        results.push_back(result);
+    }
+
+    delete data.capture;
+    delete data.object;
+
+    if (json && !WriteJSON(json, results))
+    {
+        fprintf(stderr, "microbench: cannot write %s\n", json);
+        return 2;
+    }
+
+    if (!baseline_file)
+        return 0;
+
+    std::vector<std::pair<std::string, double> > baseline;
+    if (!ReadBaseline(baseline_file, baseline))
+    {
+        fprintf(stderr, "microbench: cannot read baseline %s\n", baseline_file);
+        return 2;
+    }
+
+    // A case with no baseline is listed as new; a baseline case with no
+    // result fails the check, unless --filter left it out, so that the
+    // check cannot pass by not running a case
+    int regressions = 0;
+    int missing = 0;
+    printf("\ncase               baseline ns      ns/op   change\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        size_t b = 0;
+        while (b < baseline.size() && baseline[b].first != results[i].name)
+            ++b;
+        if (b == baseline.size())
+        {
+            printf("%-18s %11s %10.1f   (new)\n", results[i].name, "-", results[i].ns_per_op);
+            continue;
+        }
+
+        double change = results[i].ns_per_op / baseline[b].second - 1.0;
+        bool regressed = change > tolerance;
+        printf("%-18s %11.1f %10.1f %+7.1f%%%s\n", results[i].name, baseline[b].second, results[i].ns_per_op,
+               change * 100.0, regressed ? "  REGRESSION" : "");
+        regressions += regressed ? 1 : 0;
+    }
+
+    for (size_t b = 0; b < baseline.size(); ++b)
+    {
+        size_t i = 0;
+        while (i < results.size() && baseline[b].first != results[i].name)
+            ++i;
+        if (i < results.size() || (filter && !strstr(baseline[b].first.c_str(), filter)))
+            continue;
+
+        size_t k = 0;
+        while (k < CASE_COUNT && baseline[b].first != CASES[k].name)
+            ++k;
+        printf("%-18s %11.1f %10s   MISSING%s\n", baseline[b].first.c_str(), baseline[b].second, "-",
+               k == CASE_COUNT ? " (no such case)" : CASES[k].needs_gl && !gl ? " (needs --gl)" : "");
+        ++missing;
+    }
+
+    if (regressions)
+        printf("%d of %u cases slower than the baseline by more than %.0f%%\n", regressions,
+               (unsigned int)results.size(), tolerance * 100.0);
+    if (missing)
+        printf("%d baseline cases not run\n", missing);
+
+    return regressions || missing ? 1 : 0;
+}
@@ -0,0 +1,416 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: pipebench.cpp
+//
+// Purpose: Measures throughput and latency of the FramePipeline at 1 to
+//          FRAME_PIPELINE_MAX_DEPTH frames in flight. It draws the instancing
+//          sample's scene with many more instances, so that both the CPU
+//          side (the model matrices) and the GPU side of a frame take a
+//          noticeable time, and prints one line per depth, with the GL
+//          calls of its last frame. The third argument chooses how the
+//          instances are uploaded: "mat4" (the default), "trs" or
+//          "affine" (vmath::mat3x4).
+//
+//          With "commands" instead, each instance is a draw of its own,
+//          recorded with its model-view matrix by a CommandRecorder on 1,
+//          2, 4 and 8 threads and replayed on this one. It prints the
+//          record and execute times per thread count, and returns 1 if the
+//          last frame drawn from several threads' buffers is not identical
+//          to the one recorded on a single thread.
+//
+//          Run it from this directory so the shaders and media are found,
+//          for example:
+//
+//          g++ -O2 -std=c++11 -I../../include -o pipebench pipebench.cpp
+//              ../../common/FramePipeline.cpp ../../common/JobSystem.cpp
+//              ../../common/GLStateCache.cpp ../../common/RenderQueue.cpp
+//              ../../common/ShaderUtil.cpp ../../common/VBObject.cpp
+//              ../../common/VBM.cpp ../../common/VBMCodec.cpp
+//              ../../common/GPUArena.cpp ../../common/TLSF.cpp
+//              ../../common/Stripifier.cpp ../../common/Profiler.cpp
+//              ../../common/GLIntercept.cpp ../../common/CommandBuffer.cpp
+//              -lGLEW -lglut -lGL -lpthread
+//          ./pipebench 20000 300
+//          ./pipebench 20000 300 trs
+//          ./pipebench 20000 300 affine
+//          ./pipebench 3000 20 commands
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "CommandBuffer.h"
+#include "FramePipeline.h"
+#include "GLIntercept.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "ShaderUtil.h"
+#include "VBObject.h"
+#include "vmath.h"
+using namespace vmath;
+
+#define BUFFER_OFFSET(x)  ((const GLvoid*) (x))
+
+// How the instances' transformations are uploaded
+#define TRANSFORM_MAT4      0
+#define TRANSFORM_TRS       1
+#define TRANSFORM_AFFINE    2
+
+static const char *const TRANSFORM_NAMES[] = { "mat4", "trs", "affine" };
+static const char *const TRANSFORM_SHADERS[] =
+{
+    "../../shaders/instancing.vs.glsl",
+    "../../shaders/instancing_trs.vs.glsl",
+    "../../shaders/instancing_affine.vs.glsl"
+};
+static const char *const TRANSFORM_ATTRIBUTES[] = { "model_matrix", "model_rotation", "model_rows" };
+static const size_t TRANSFORM_SIZES[] = { sizeof(mat4), sizeof(trs), sizeof(mat3x4) };
+
+// The mat4 and affine shaders also take a per-instance normal matrix,
+// uploaded after all the transformations
+static const size_t NORMAL_MATRIX_SIZES[] = { sizeof(mat3), 0, sizeof(mat3) };
+
+static unsigned int instance_count;
+static int transform_mode;
+static size_t transform_size;
+static GLuint shader_prog;
+static GLint view_matrix_loc;
+static GLint projection_matrix_loc;
+static GLint color_loc;
+static GLint transform_loc;
+static GLint normal_matrix_loc;
+static GLuint color_buffer;
+static VBObject *object;
+
+
+// The transformation loop of the instancing sample, with the time taken
+// from the frame number so every depth draws the same frames
+static void prepare_frame(void *user, unsigned long long frame, unsigned int milliseconds,
+                          void *upload, void *extra)
+{
+    (void)user;
+    (void)milliseconds;
+    float t = float(frame % 1000) / 1000.0f;
+    mat4 *matrices = (mat4 *)upload;
+    trs *transforms = (trs *)upload;
+    mat3x4 *rows = (mat3x4 *)upload;
+    mat3 *normal_matrices = (mat3 *)((char *)upload + instance_count * transform_size);
+
+    std::vector<vec3> angles(instance_count), translations(instance_count);
+
+    for (unsigned int n = 0; n < instance_count; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        angles[n] = vec3(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f);
+        translations[n] = vec3(10.0f + a, 40.0f + b, 50.0f + c);
+    }
+
+    // The matrices use the precise sincos: with this many instances the
+    // translations are large enough for SINCOS_FAST to move edge pixels
+    if (transform_mode == TRANSFORM_TRS)
+    {
+        for (unsigned int n = 0; n < instance_count; ++n)
+        {
+            quat rotation = quat_rotate(angles[n][0], 1.0f, 0.0f, 0.0f) *
+                            quat_rotate(angles[n][1], 0.0f, 1.0f, 0.0f) *
+                            quat_rotate(angles[n][2], 0.0f, 0.0f, 1.0f);
+            transforms[n] = trs(rotation, rotate(rotation, translations[n]));
+        }
+    }
+    else if (transform_mode == TRANSFORM_AFFINE)
+    {
+        euler_to_mat3x4_array(&angles[0], &translations[0], rows, instance_count);
+        for (unsigned int n = 0; n < instance_count; ++n)
+            normal_matrices[n] = normal_matrix(rows[n]);
+    }
+    else
+    {
+        euler_to_mat4_array(&angles[0], &translations[0], matrices, instance_count);
+        for (unsigned int n = 0; n < instance_count; ++n)
+            normal_matrices[n] = normal_matrix(matrices[n]);
+    }
+
+    *(float *)extra = t;
+}
+
+
+static bool initialize(void)
+{
+    ShaderUtil su;
+
+    static ShaderInfo shader_info[] =
+    {
+        { GL_VERTEX_SHADER, NULL, 0 },
+        { GL_FRAGMENT_SHADER, "../../shaders/instancing.fs.glsl", 0 },
+        { GL_NONE, NULL, 0 }
+    };
+
+    shader_info[0].filename = TRANSFORM_SHADERS[transform_mode];
+    shader_prog = su.LoadShaders(shader_info);
+    if (!shader_prog)
+        return false;
+
+    view_matrix_loc = glGetUniformLocation(shader_prog, "view_matrix");
+    projection_matrix_loc = glGetUniformLocation(shader_prog, "projection_matrix");
+    color_loc = glGetAttribLocation(shader_prog, "color");
+    transform_loc = glGetAttribLocation(shader_prog, TRANSFORM_ATTRIBUTES[transform_mode]);
+    normal_matrix_loc = glGetAttribLocation(shader_prog, "normal_matrix");
+
+    object = new VBObject;
+    if (!object->LoadFromVBM("../../media/armadillo_low.vbm",
+                             glGetAttribLocation(shader_prog, "position"),
+                             glGetAttribLocation(shader_prog, "normal"), -1))
+        return false;
+
+    // Every instance is white; only the matrices change per frame
+    std::vector<vec4> colors(instance_count, vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+    GLStateCache& state = GLStateCache::Current();
+    object->BindVertexArray();
+    glGenBuffers(1, &color_buffer);
+    state.BindBuffer(GL_ARRAY_BUFFER, color_buffer);
+    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(vec4), &colors[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(color_loc, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(color_loc);
+    glVertexAttribDivisor(color_loc, 1);
+
+    for (size_t i = 0; i < transform_size / sizeof(vec4); i++)
+    {
+        glEnableVertexAttribArray(transform_loc + (GLuint)i);
+        glVertexAttribDivisor(transform_loc + (GLuint)i, 1);
+    }
+    for (GLuint i = 0; normal_matrix_loc >= 0 && i < 3; i++)
+    {
+        glEnableVertexAttribArray(normal_matrix_loc + i);
+        glVertexAttribDivisor(normal_matrix_loc + i, 1);
+    }
+
+    state.UseProgram(shader_prog);
+    state.Enable(GL_DEPTH_TEST);
+    state.DepthFunc(GL_LEQUAL);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    return true;
+}
+
+
+// One frame of the instancing sample, drawn through the pipeline
+static void draw(FramePipeline& pipeline)
+{
+    GLStateCache& state = GLStateCache::Current();
+    const PIPELINE_FRAME& frame = pipeline.BeginFrame();
+    float t = *(const float *)frame.extra;
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    state.BindVertexArray(object->GetVertexArray());
+    for (size_t i = 0; i < transform_size / sizeof(vec4); i++)
+    {
+        glVertexAttribPointer(transform_loc + (GLuint)i, 4, GL_FLOAT, GL_FALSE, (GLsizei)transform_size,
+                              BUFFER_OFFSET(frame.offset + sizeof(vec4) * i));
+    }
+    for (GLuint i = 0; normal_matrix_loc >= 0 && i < 3; i++)
+    {
+        glVertexAttribPointer(normal_matrix_loc + i, 3, GL_FLOAT, GL_FALSE, sizeof(mat3),
+                              BUFFER_OFFSET(frame.offset + instance_count * transform_size + sizeof(vec3) * i));
+    }
+
+    mat4 view_matrix(translate(0.0f, 0.0f, -1500.0f) * rotate(t * 360.0f * 2.0f, 0.0f, 1.0f, 0.0f));
+    mat4 projection_matrix(frustum(-1.0f, 1.0f, -0.75f, 0.75f, 1.0f, 5000.0f));
+    glUniformMatrix4fv(view_matrix_loc, 1, GL_FALSE, view_matrix);
+    glUniformMatrix4fv(projection_matrix_loc, 1, GL_FALSE, projection_matrix);
+
+    object->Render(0, instance_count);
+
+    pipeline.EndFrame();
+    glutSwapBuffers();
+    glutMainLoopEvent();
+    GLIntercept::EndFrame();
+}
+
+
+// The model-view matrices of the instancing scene's instances [first, end)
+// at time t, one draw each
+static void record_draws(void *user, CommandBuffer& buffer, unsigned int first, unsigned int end)
+{
+    float t = *(const float *)user;
+    mat4 view_matrix(translate(0.0f, 0.0f, -1500.0f) * rotate(t * 360.0f * 2.0f, 0.0f, 1.0f, 0.0f));
+
+    for (unsigned int n = first; n < end; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        mat4 model_matrix = euler_to_mat4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                                          vec3(10.0f + a, 40.0f + b, 50.0f + c));
+        buffer.UniformMatrix4fv(view_matrix_loc, view_matrix * model_matrix);
+        buffer.Draw(object);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: run_commands
+//
+// Purpose: Draws 'frames' frames of instance_count draws recorded on 1, 2,
+//          4 and 8 threads, and compares the last frame of each with the
+//          single-threaded one.
+//
+// INPUTS: frames - frames per thread count
+//
+// OUTPUTS: Returns false if a frame differs.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool run_commands(unsigned int frames)
+{
+    GLStateCache& state = GLStateCache::Current();
+
+    // The model matrix is in the view matrix, so the instanced attributes
+    // are replaced by constants: the identity and white
+    state.BindVertexArray(object->GetVertexArray());
+    glDisableVertexAttribArray(color_loc);
+    glVertexAttrib4f(color_loc, 1.0f, 1.0f, 1.0f, 1.0f);
+    for (GLuint i = 0; i < 4; i++)
+    {
+        glDisableVertexAttribArray(transform_loc + i);
+        glVertexAttrib4f(transform_loc + i, i == 0, i == 1, i == 2, i == 3);
+    }
+    for (GLuint i = 0; i < 3; i++)
+    {
+        glDisableVertexAttribArray(normal_matrix_loc + i);
+        glVertexAttrib3f(normal_matrix_loc + i, i == 0, i == 1, i == 2);
+    }
+
+    mat4 projection_matrix(frustum(-1.0f, 1.0f, -0.75f, 0.75f, 1.0f, 5000.0f));
+    glUniformMatrix4fv(projection_matrix_loc, 1, GL_FALSE, projection_matrix);
+
+    std::vector<unsigned char> reference(640 * 480 * 4), pixels(reference.size());
+    bool identical = true;
+
+    printf("%u draws, %u frames per thread count\n", instance_count, frames);
+    printf("threads  record ms  execute ms  frame ms  speedup  commands     KB  frame\n");
+
+    double single_record = 0.0;
+    for (unsigned int threads = 1; threads <= 8; threads *= 2)
+    {
+        JobSystem jobs(threads);
+        CommandRecorder recorder(0, &jobs);
+        double record_ms = 0.0, execute_ms = 0.0;
+
+        glFinish();
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            float t = float(f % 1000) / 1000.0f;
+
+            recorder.Record(instance_count, record_draws, &t);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            recorder.Execute();
+            record_ms += recorder.GetStats().record_ms;
+            execute_ms += recorder.GetStats().execute_ms;
+
+            if (f + 1 < frames)
+            {
+                glutSwapBuffers();
+                glutMainLoopEvent();
+            }
+        }
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        // The last frame is still in the back buffer
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, 640, 480, GL_RGBA, GL_UNSIGNED_BYTE, threads == 1 ? &reference[0] : &pixels[0]);
+        bool same = threads == 1 || memcmp(&reference[0], &pixels[0], pixels.size()) == 0;
+        identical = identical && same;
+        glutSwapBuffers();
+        glutMainLoopEvent();
+
+        if (threads == 1)
+            single_record = record_ms;
+        const COMMAND_STATS& stats = recorder.GetStats();
+        printf("%7u  %9.3f  %10.3f  %8.3f  %6.2fx  %8u  %5llu  %s\n", threads, record_ms / frames,
+               execute_ms / frames, elapsed.count() / frames, single_record / record_ms, stats.commands,
+               stats.bytes / 1024, threads == 1 ? "reference" : same ? "identical" : "DIFFERS");
+    }
+
+    return identical;
+}
+
+
+int main(int argc, char **argv)
+{
+    glutInit(&argc, argv);
+    instance_count = argc > 1 ? (unsigned int)atoi(argv[1]) : 20000;
+    unsigned int frames = argc > 2 ? (unsigned int)atoi(argv[2]) : 300;
+    bool commands = argc > 3 && strcmp(argv[3], "commands") == 0;
+    transform_mode = TRANSFORM_MAT4;
+    for (int i = 0; argc > 3 && i < 3; i++)
+    {
+        if (strcmp(argv[3], TRANSFORM_NAMES[i]) == 0)
+            transform_mode = i;
+    }
+    transform_size = TRANSFORM_SIZES[transform_mode];
+    if (instance_count == 0 || frames == 0)
+        return EXIT_FAILURE;
+
+    glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
+    glutInitWindowSize(640, 480);
+    glutCreateWindow("pipebench");
+
+    if (glewInit() || !initialize())
+    {
+        fprintf(stderr, "pipebench: initialization failed\n");
+        return EXIT_FAILURE;
+    }
+    GLIntercept::Install();
+
+    if (commands)
+    {
+        bool identical = run_commands(frames);
+
+        delete object;
+        GLStateCache::Current().DeleteBuffers(1, &color_buffer);
+        GLStateCache::Current().DeleteProgram(shader_prog);
+        GLIntercept::Uninstall();
+
+        return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    printf("%u instances as %s, %u frames per depth\n", instance_count, TRANSFORM_NAMES[transform_mode], frames);
+    printf("depth  frame ms     fps  latency ms  prepare wait  fence wait  calls  draws  map bytes\n");
+
+    for (unsigned int depth = 1; depth <= FRAME_PIPELINE_MAX_DEPTH; ++depth)
+    {
+        FramePipeline pipeline(depth, instance_count * (transform_size + NORMAL_MATRIX_SIZES[transform_mode]),
+                               sizeof(float), prepare_frame, NULL);
+        glFinish();
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (unsigned int f = 0; f < frames; ++f)
+            draw(pipeline);
+        glFinish();
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        FRAME_PIPELINE_STATS stats = pipeline.GetStats();
+        const GL_CALL_COUNTS& calls = GLIntercept::GetFrameReport().total;
+        printf("%5u  %8.3f %7.1f  %10.3f  %12.3f  %10.3f  %5llu  %5llu  %9llu\n", depth, stats.frame_ms,
+               frames / elapsed.count(), stats.latency_ms, stats.prepare_wait_ms, stats.fence_wait_ms,
+               calls.calls, calls.draws, calls.map_bytes);
+    }
+
+    delete object;
+    GLStateCache::Current().DeleteBuffers(1, &color_buffer);
+    GLStateCache::Current().DeleteProgram(shader_prog);
+    GLIntercept::Uninstall();
+
+    return EXIT_SUCCESS;
+}
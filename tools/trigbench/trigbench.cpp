@@ -0,0 +1,305 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: trigbench.cpp
+//
+// Purpose: Checks and times the vectorized sincos of vmath. The first table
+//          is the largest absolute error of sinf/cosf and of each precision
+//          tier and lane width against double precision sin and cos, over
+//          angles up to pi/4, pi, 100 pi, 1000 pi and 1e9, the last mostly
+//          beyond SINCOS_RANGE, where the kernels fall back to sinf and
+//          cosf. Every error of a tier must be within its bound in
+//          SINCOS_MAX_ERROR, or the program returns 1. The second table is
+//          the best time per angle of each of them, and of the batch
+//          rotation builders against their one-at-a-time forms. For
+//          example:
+//
+//          g++ -O2 -std=c++14 -I../../include -o trigbench trigbench.cpp
+//          ./trigbench 100000 50
+//
+//          Build it again with -mavx2 to time the eight-lane kernel, and
+//          with -DVMATH_NO_SIMD for the scalar fallback.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "vmath.h"
+using namespace vmath;
+
+static const char *const PRECISION_NAMES[] = { "precise", "fast" };
+
+
+void KernelLibm(const float *x, float *s, float *c, unsigned int count, sincos_precision)
+{
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        s[n] = sinf(x[n]);
+        c[n] = cosf(x[n]);
+    }
+}
+
+
+void KernelLanes1(const float *x, float *s, float *c, unsigned int count, sincos_precision precision)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        sincos_kernel<sincos_lanes1>(x + n, s + n, c + n, precision);
+}
+
+
+// The count is a multiple of 16, so these need no tails
+void KernelSincos4(const float *x, float *s, float *c, unsigned int count, sincos_precision precision)
+{
+    for (unsigned int n = 0; n < count; n += 4)
+        sincos4(x + n, s + n, c + n, precision);
+}
+
+
+void KernelSincos8(const float *x, float *s, float *c, unsigned int count, sincos_precision precision)
+{
+    for (unsigned int n = 0; n < count; n += 8)
+        sincos8(x + n, s + n, c + n, precision);
+}
+
+
+void KernelSincos16(const float *x, float *s, float *c, unsigned int count, sincos_precision precision)
+{
+    for (unsigned int n = 0; n < count; n += 16)
+        sincos16(x + n, s + n, c + n, precision);
+}
+
+
+void KernelRotateLoop(const float *angles, mat4 *out, unsigned int count, sincos_precision)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = rotate(angles[n], 0.0f, 0.6f, 0.8f);
+}
+
+
+void KernelRotateArray(const float *angles, mat4 *out, unsigned int count, sincos_precision precision)
+{
+    rotate_array(angles, vec3(0.0f, 0.6f, 0.8f), out, count, precision);
+}
+
+
+void KernelEulerLoop(const vec3 *angles, const vec3 *translations, mat4 *out, unsigned int count, sincos_precision)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = euler_to_mat4(angles[n][0], angles[n][1], angles[n][2], translations[n]);
+}
+
+
+void KernelEulerArray(const vec3 *angles, const vec3 *translations, mat4 *out, unsigned int count,
+                      sincos_precision precision)
+{
+    euler_to_mat4_array(angles, translations, out, count, precision);
+}
+
+
+typedef void (*SincosKernel)(const float *x, float *s, float *c, unsigned int count, sincos_precision precision);
+
+struct SINCOS_ROW
+{
+    const char *name;
+    SincosKernel kernel;
+    sincos_precision precision;
+};
+
+static const SINCOS_ROW SINCOS_ROWS[] =
+{
+    { "sinf/cosf", KernelLibm, SINCOS_PRECISE },
+    { "lanes1", KernelLanes1, SINCOS_PRECISE },
+    { "sincos4", KernelSincos4, SINCOS_PRECISE },
+    { "sincos8", KernelSincos8, SINCOS_PRECISE },
+    { "sincos16", KernelSincos16, SINCOS_PRECISE },
+    { "lanes1", KernelLanes1, SINCOS_FAST },
+    { "sincos4", KernelSincos4, SINCOS_FAST },
+    { "sincos8", KernelSincos8, SINCOS_FAST },
+    { "sincos16", KernelSincos16, SINCOS_FAST }
+};
+
+static const unsigned int SINCOS_ROW_COUNT = sizeof(SINCOS_ROWS) / sizeof(SINCOS_ROWS[0]);
+
+
+static double Milliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// The largest absolute error of a kernel's sines and cosines
+static double MaxError(const float *x, const float *s, const float *c, unsigned int count)
+{
+    double worst = 0.0;
+
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        double ds = fabs((double)s[n] - sin((double)x[n]));
+        double dc = fabs((double)c[n] - cos((double)x[n]));
+        if (ds > worst)
+            worst = ds;
+        if (dc > worst)
+            worst = dc;
+    }
+
+    return worst;
+}
+
+
+// The largest difference between two arrays of matrices, relative to the
+// magnitude of the reference
+static double MaxDifference(const mat4 *x, const mat4 *ref, unsigned int count)
+{
+    double worst = 0.0;
+
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            double r = ref[n][i / 4][i % 4];
+            double d = fabs((double)x[n][i / 4][i % 4] - r) / (1.0 + fabs(r));
+            if (d > worst)
+                worst = d;
+        }
+    }
+
+    return worst;
+}
+
+
+static void PrintPair(const char *name, sincos_precision precision, double loop_ms, double array_ms,
+                      unsigned int count, double difference)
+{
+    printf("%-14s %-8s %10.2f %10.2f %8.2fx  %10.3g\n", name, PRECISION_NAMES[precision],
+           loop_ms * 1.0e6 / count, array_ms * 1.0e6 / count, loop_ms / array_ms, difference);
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int count = argc > 1 ? (unsigned int)atoi(argv[1]) : 100000;
+    unsigned int runs = argc > 2 ? (unsigned int)atoi(argv[2]) : 50;
+    count = (count + 15) & ~15u;
+    if (count == 0 || runs == 0)
+        return 1;
+
+    std::vector<float> x(count), s(count), c(count), angles(count);
+    std::vector<vec3> euler_angles(count), translations(count);
+    std::vector<mat4> loop_mat4(count), array_mat4(count);
+
+#if defined(VMATH_AVX2)
+    printf("lanes: AVX2\n");
+#elif defined(VMATH_SSE2)
+    printf("lanes: SSE2\n");
+#else
+    printf("lanes: scalar\n");
+#endif
+
+    // Accuracy, over evenly spaced angles in each range
+    static const double RANGES[] = { M_PI / 4.0, M_PI, 100.0 * M_PI, 1000.0 * M_PI, 1.0e9 };
+    unsigned int failures = 0;
+    printf("\nmax abs error      tier         pi/4          pi      100 pi     1000 pi         1e9\n");
+    for (unsigned int k = 0; k < SINCOS_ROW_COUNT; ++k)
+    {
+        printf("%-18s %-8s", SINCOS_ROWS[k].name, SINCOS_ROWS[k].kernel == KernelLibm ? "libm" :
+               PRECISION_NAMES[SINCOS_ROWS[k].precision]);
+        for (int r = 0; r < 5; ++r)
+        {
+            for (unsigned int n = 0; n < count; ++n)
+                x[n] = float(RANGES[r] * (2.0 * n / (count - 1) - 1.0));
+            SINCOS_ROWS[k].kernel(&x[0], &s[0], &c[0], count, SINCOS_ROWS[k].precision);
+
+            // libm is what the tiers are measured against, so it has no bound
+            double error = MaxError(&x[0], &s[0], &c[0], count);
+            bool within = SINCOS_ROWS[k].kernel == KernelLibm ||
+                          error <= SINCOS_MAX_ERROR[SINCOS_ROWS[k].precision];
+            printf(" %10.3g%c", error, within ? ' ' : '!');
+            if (!within)
+                ++failures;
+        }
+        printf("\n");
+    }
+    if (failures)
+    {
+        printf("FAILED: %u errors (marked !) exceed the bounds of their tiers, %g and %g\n",
+               failures, SINCOS_MAX_ERROR[SINCOS_PRECISE], SINCOS_MAX_ERROR[SINCOS_FAST]);
+    }
+
+    // Throughput, over the instancing sample's angles
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        float a = 50.0f * float(n % 1000) / 4.0f;
+        float b = 50.0f * float(n % 1000) / 5.0f;
+        float d = 50.0f * float(n % 1000) / 6.0f;
+
+        x[n] = radians(a);
+        angles[n] = a;
+        euler_angles[n] = vec3(a, b, d);
+        translations[n] = vec3(10.0f + a, 40.0f + b, 50.0f + d);
+    }
+
+    std::vector<double> best(SINCOS_ROW_COUNT + 8, 1.0e30);
+    double difference[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    for (unsigned int r = 0; r < runs; ++r)
+    {
+        std::chrono::high_resolution_clock::time_point start;
+        std::vector<double> ms(best.size());
+
+        for (unsigned int k = 0; k < SINCOS_ROW_COUNT; ++k)
+        {
+            start = std::chrono::high_resolution_clock::now();
+            SINCOS_ROWS[k].kernel(&x[0], &s[0], &c[0], count, SINCOS_ROWS[k].precision);
+            ms[k] = Milliseconds(start);
+        }
+
+        for (int p = 0; p < 2; ++p)
+        {
+            size_t k = SINCOS_ROW_COUNT + 4 * p;
+
+            start = std::chrono::high_resolution_clock::now();
+            KernelRotateLoop(&angles[0], &loop_mat4[0], count, sincos_precision(p));
+            ms[k] = Milliseconds(start);
+
+            start = std::chrono::high_resolution_clock::now();
+            KernelRotateArray(&angles[0], &array_mat4[0], count, sincos_precision(p));
+            ms[k + 1] = Milliseconds(start);
+            difference[2 * p] = MaxDifference(&array_mat4[0], &loop_mat4[0], count);
+
+            start = std::chrono::high_resolution_clock::now();
+            KernelEulerLoop(&euler_angles[0], &translations[0], &loop_mat4[0], count, sincos_precision(p));
+            ms[k + 2] = Milliseconds(start);
+
+            start = std::chrono::high_resolution_clock::now();
+            KernelEulerArray(&euler_angles[0], &translations[0], &array_mat4[0], count, sincos_precision(p));
+            ms[k + 3] = Milliseconds(start);
+            difference[2 * p + 1] = MaxDifference(&array_mat4[0], &loop_mat4[0], count);
+        }
+
+        for (size_t k = 0; k < best.size(); ++k)
+        {
+            if (ms[k] < best[k])
+                best[k] = ms[k];
+        }
+    }
+
+    printf("\n%u angles, best of %u runs\n", count, runs);
+    printf("kernel             tier     ns/angle  speedup\n");
+    for (unsigned int k = 0; k < SINCOS_ROW_COUNT; ++k)
+    {
+        printf("%-18s %-8s %8.2f %7.2fx\n", SINCOS_ROWS[k].name, SINCOS_ROWS[k].kernel == KernelLibm ? "libm" :
+               PRECISION_NAMES[SINCOS_ROWS[k].precision], best[k] * 1.0e6 / count, best[0] / best[k]);
+    }
+
+    printf("\nbuilder        tier        loop ns   array ns  speedup    max diff\n");
+    for (int p = 0; p < 2; ++p)
+    {
+        size_t k = SINCOS_ROW_COUNT + 4 * p;
+        PrintPair("rotate", sincos_precision(p), best[k], best[k + 1], count, difference[2 * p]);
+        PrintPair("euler_to_mat4", sincos_precision(p), best[k + 2], best[k + 3], count, difference[2 * p + 1]);
+    }
+
+    return failures ? 1 : 0;
+}
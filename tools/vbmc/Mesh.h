@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: Mesh.h
+//
+// Purpose: This file contains the in-memory mesh used by the vbmc asset
+//          compiler, and the import, processing and export steps that turn
+//          OBJ and PLY files into VBM files that VBObject can upload as-is.
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __MESH_H
+#define __MESH_H
+
+#include <string>
+#include <vector>
+#include "VBM.h"
+
+
+struct Mesh
+{
+    std::vector<float> positions;           // 3 floats per vertex
+    std::vector<float> normals;             // 3 floats per vertex, or empty
+    std::vector<float> texcoords;           // 2 floats per vertex, or empty
+    std::vector<unsigned int> indices;      // triangle lists, one per frame
+    std::vector<VBM_FRAME_HEADER> frames;   // frame 0 is the full mesh, then LODs
+
+    unsigned int VertexCount(void) const { return (unsigned int)(positions.size() / 3); }
+};
+
+// Bounds and meshlets are stored as-is in VBM2 files
+typedef VBM_BOUNDS MeshBounds;
+typedef VBM_MESHLET Meshlet;
+
+struct ExportOptions
+{
+    bool quantize;      // half float positions/texcoords, 2_10_10_10 normals
+    bool strips;        // restart-separated strips where they save indices
+    bool vbm2;          // chunked, compressed VBM2 container
+    std::string name;   // stored in the VBM header
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Import (MeshImport.cpp). Both importers read the file a line or a record
+// at a time and never hold the file contents in memory. OBJ corners are
+// welded on their (v, vt, vn) triple while streaming.
+///////////////////////////////////////////////////////////////////////////////
+bool ImportOBJ(const char *filename, Mesh& mesh, std::string& error);
+bool ImportPLY(const char *filename, Mesh& mesh, std::string& error);
+bool ImportMesh(const char *filename, Mesh& mesh, std::string& error);
+
+///////////////////////////////////////////////////////////////////////////////
+// Processing (MeshOptimize.cpp)
+///////////////////////////////////////////////////////////////////////////////
+
+// Merges vertices whose attributes are bitwise identical. Returns the
+// number of vertices removed.
+unsigned int WeldVertices(Mesh& mesh);
+
+// Computes smooth, area-weighted vertex normals.
+void ComputeNormals(Mesh& mesh);
+
+// Reorders a triangle list in place for the post-transform vertex cache
+// (Forsyth's linear-speed algorithm).
+void OptimizeVertexCache(unsigned int *indices, unsigned int count, unsigned int vertex_count);
+
+// Renumbers vertices in the order the index buffer first uses them.
+void OptimizeVertexFetch(Mesh& mesh);
+
+// Appends a simplified copy of frame 0 as a new frame, using vertex
+// clustering on a grid with 'cells' cells along the largest axis.
+// Returns false if the level would not remove any triangles.
+bool BuildLOD(Mesh& mesh, unsigned int cells);
+
+// Splits frame 0 into meshlets of at most max_vertices vertices and
+// max_triangles triangles, in index order.
+void BuildMeshlets(const Mesh& mesh, unsigned int max_vertices,
+                   unsigned int max_triangles, std::vector<Meshlet>& meshlets);
+
+MeshBounds ComputeBounds(const Mesh& mesh);
+
+///////////////////////////////////////////////////////////////////////////////
+// Export (VBMWriter.cpp)
+///////////////////////////////////////////////////////////////////////////////
+// Writes an SBM1 file, or a VBM2 file that also stores the bounds and the
+// meshlets (which refer to the triangle list of frame 0 and are dropped if
+// that frame is written as strips).
+bool WriteVBM(const char *filename, const Mesh& mesh, const MeshBounds& bounds,
+              const std::vector<Meshlet>& meshlets, const ExportOptions& options,
+              unsigned long long *bytes_written, std::string& error);
+
+#endif // __MESH_H
@@ -0,0 +1,560 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: MeshImport.cpp
+//
+// Purpose: This file contains the streaming OBJ and PLY importers used by
+//          the vbmc asset compiler.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <unordered_map>
+#include "Mesh.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OBJ
+///////////////////////////////////////////////////////////////////////////////
+
+struct ObjCorner
+{
+    int v, vt, vn;
+
+    bool operator==(const ObjCorner& that) const
+    {
+        return v == that.v && vt == that.vt && vn == that.vn;
+    }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& c) const
+    {
+        return ((size_t)c.v * 73856093u) ^ ((size_t)c.vt * 19349663u) ^ ((size_t)c.vn * 83492791u);
+    }
+};
+
+
+// Resolves a 1-based (or negative, relative) OBJ reference. Returns -1 if
+// the reference is missing and -2 if it is out of range.
+static int ResolveObjIndex(const char *&p, size_t count)
+{
+    char *end;
+    long value = strtol(p, &end, 10);
+
+    if (end == p)
+        return -1;
+    p = end;
+
+    if (value < 0)
+        value += (long)count;
+    else
+        value -= 1;
+
+    return (value >= 0 && (size_t)value < count) ? (int)value : -2;
+}
+
+static const char *SkipSpace(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        ++p;
+    return p;
+}
+
+static const char *ParseFloats(const char *p, float *out, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        char *end;
+        out[i] = strtof(p, &end);
+        if (end == p)
+            out[i] = 0.0f;
+        p = end;
+    }
+    return p;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ImportOBJ
+//
+// Purpose: Reads a Wavefront OBJ file one line at a time. Polygons are fan
+//          triangulated and identical (v, vt, vn) corners share a vertex.
+//
+// INPUTS: filename - the OBJ file
+//         mesh     - receives the mesh as a single frame
+//         error    - receives a description of the problem
+//
+// OUTPUTS: Returns false if the file could not be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ImportOBJ(const char *filename, Mesh& mesh, std::string& error)
+{
+    std::ifstream f(filename, std::ios::binary);
+    if (!f)
+    {
+        error = "unable to open file";
+        return false;
+    }
+
+    std::vector<float> v, vt, vn;
+    std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> corners;
+    std::vector<unsigned int> polygon;
+    std::string line;
+    bool any_vt = false, any_vn = false;
+    unsigned long long line_number = 0;
+
+    mesh = Mesh();
+
+    while (std::getline(f, line))
+    {
+        ++line_number;
+        const char *p = SkipSpace(line.c_str());
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            float xyz[3];
+            ParseFloats(p + 2, xyz, 3);
+            v.insert(v.end(), xyz, xyz + 3);
+        }
+        else if (p[0] == 'v' && p[1] == 't')
+        {
+            float uv[2];
+            ParseFloats(p + 2, uv, 2);
+            vt.insert(vt.end(), uv, uv + 2);
+        }
+        else if (p[0] == 'v' && p[1] == 'n')
+        {
+            float n[3];
+            ParseFloats(p + 2, n, 3);
+            vn.insert(vn.end(), n, n + 3);
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            polygon.clear();
+            p = SkipSpace(p + 1);
+
+            while (*p && *p != '\r' && *p != '#')
+            {
+                ObjCorner c;
+                c.v = ResolveObjIndex(p, v.size() / 3);
+                c.vt = -1;
+                c.vn = -1;
+                if (*p == '/')
+                {
+                    ++p;
+                    if (*p != '/')
+                        c.vt = ResolveObjIndex(p, vt.size() / 2);
+                    if (*p == '/')
+                    {
+                        ++p;
+                        c.vn = ResolveObjIndex(p, vn.size() / 3);
+                    }
+                }
+
+                if (c.v < 0 || c.vt == -2 || c.vn == -2)
+                {
+                    error = "bad face reference on line " + std::to_string(line_number);
+                    return false;
+                }
+
+                std::pair<std::unordered_map<ObjCorner, unsigned int, ObjCornerHash>::iterator, bool> slot =
+                    corners.insert(std::make_pair(c, mesh.VertexCount()));
+                if (slot.second)
+                {
+                    mesh.positions.insert(mesh.positions.end(), &v[c.v * 3], &v[c.v * 3] + 3);
+
+                    if (c.vt >= 0)
+                    {
+                        mesh.texcoords.insert(mesh.texcoords.end(), &vt[c.vt * 2], &vt[c.vt * 2] + 2);
+                        any_vt = true;
+                    }
+                    else
+                    {
+                        mesh.texcoords.insert(mesh.texcoords.end(), 2, 0.0f);
+                    }
+
+                    if (c.vn >= 0)
+                    {
+                        mesh.normals.insert(mesh.normals.end(), &vn[c.vn * 3], &vn[c.vn * 3] + 3);
+                        any_vn = true;
+                    }
+                    else
+                    {
+                        mesh.normals.insert(mesh.normals.end(), 3, 0.0f);
+                    }
+                }
+                polygon.push_back(slot.first->second);
+
+                while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+                    ++p;
+                p = SkipSpace(p);
+            }
+
+            for (size_t i = 2; i < polygon.size(); ++i)
+            {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i - 1]);
+                mesh.indices.push_back(polygon[i]);
+            }
+        }
+    }
+
+    if (!any_vt)
+        mesh.texcoords.clear();
+    if (!any_vn)
+        mesh.normals.clear();
+
+    if (mesh.indices.empty())
+    {
+        error = "no faces";
+        return false;
+    }
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PLY
+///////////////////////////////////////////////////////////////////////////////
+
+enum PlyFormat
+{
+    PLY_ASCII,
+    PLY_BINARY_LE,
+    PLY_BINARY_BE
+};
+
+struct PlyProperty
+{
+    std::string name;
+    int type;           // size in bytes, negative for signed integers
+    bool is_float;
+    bool is_list;
+    int count_type;
+    bool count_is_float;
+};
+
+struct PlyElement
+{
+    std::string name;
+    unsigned long long count;
+    std::vector<PlyProperty> properties;
+};
+
+static bool ParsePlyType(const std::string& name, int& size, bool& is_float)
+{
+    is_float = false;
+    if (name == "char" || name == "int8")         size = -1;
+    else if (name == "uchar" || name == "uint8")  size = 1;
+    else if (name == "short" || name == "int16")  size = -2;
+    else if (name == "ushort" || name == "uint16") size = 2;
+    else if (name == "int" || name == "int32")    size = -4;
+    else if (name == "uint" || name == "uint32")  size = 4;
+    else if (name == "float" || name == "float32") { size = 4; is_float = true; }
+    else if (name == "double" || name == "float64") { size = 8; is_float = true; }
+    else return false;
+    return true;
+}
+
+static bool ReadPlyValue(std::istream& f, PlyFormat format, int type, bool is_float, double& value)
+{
+    if (format == PLY_ASCII)
+    {
+        f >> value;
+        return !f.fail();
+    }
+
+    unsigned char bytes[8];
+    int size = type < 0 ? -type : type;
+    if (!f.read((char *)bytes, size))
+        return false;
+
+    // Host order is assumed to be little-endian, like the VBM format itself
+    if (format == PLY_BINARY_BE)
+    {
+        for (int i = 0; i < size / 2; ++i)
+        {
+            unsigned char t = bytes[i];
+            bytes[i] = bytes[size - 1 - i];
+            bytes[size - 1 - i] = t;
+        }
+    }
+
+    if (is_float)
+    {
+        if (size == 4) { float x; memcpy(&x, bytes, 4); value = x; }
+        else           { double x; memcpy(&x, bytes, 8); value = x; }
+        return true;
+    }
+
+    switch (type)
+    {
+    case -1: value = (signed char)bytes[0]; break;
+    case 1:  value = bytes[0]; break;
+    case -2: { short x; memcpy(&x, bytes, 2); value = x; } break;
+    case 2:  { unsigned short x; memcpy(&x, bytes, 2); value = x; } break;
+    case -4: { int x; memcpy(&x, bytes, 4); value = x; } break;
+    default: { unsigned int x; memcpy(&x, bytes, 4); value = x; } break;
+    }
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ImportPLY
+//
+// Purpose: Reads an ASCII or binary PLY file one element at a time.
+//          Recognizes x/y/z, nx/ny/nz and u/v (or s/t, texture_u/texture_v)
+//          vertex properties and a vertex_indices (or vertex_index) face
+//          list. Polygons are fan triangulated.
+//
+// INPUTS: filename - the PLY file
+//         mesh     - receives the mesh as a single frame
+//         error    - receives a description of the problem
+//
+// OUTPUTS: Returns false if the file could not be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ImportPLY(const char *filename, Mesh& mesh, std::string& error)
+{
+    std::ifstream f(filename, std::ios::binary);
+    if (!f)
+    {
+        error = "unable to open file";
+        return false;
+    }
+
+    std::string line;
+    std::getline(f, line);
+    if (line.compare(0, 3, "ply") != 0)
+    {
+        error = "not a PLY file";
+        return false;
+    }
+
+    PlyFormat format = PLY_ASCII;
+    std::vector<PlyElement> elements;
+
+    while (std::getline(f, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        char word[64] = "", a[64] = "", b[64] = "", c[64] = "";
+        sscanf(line.c_str(), "%63s %63s %63s %63s", word, a, b, c);
+
+        if (!strcmp(word, "format"))
+        {
+            if (!strcmp(a, "binary_little_endian")) format = PLY_BINARY_LE;
+            else if (!strcmp(a, "binary_big_endian")) format = PLY_BINARY_BE;
+            else format = PLY_ASCII;
+        }
+        else if (!strcmp(word, "element"))
+        {
+            PlyElement e;
+            e.name = a;
+            e.count = strtoull(b, NULL, 10);
+            elements.push_back(e);
+        }
+        else if (!strcmp(word, "property") && !elements.empty())
+        {
+            PlyProperty p;
+            p.is_list = !strcmp(a, "list");
+            p.count_type = 0;
+            p.count_is_float = false;
+            if (p.is_list)
+            {
+                if (!ParsePlyType(b, p.count_type, p.count_is_float) ||
+                    !ParsePlyType(c, p.type, p.is_float))
+                {
+                    error = "unsupported property type";
+                    return false;
+                }
+                sscanf(line.c_str(), "%*s %*s %*s %*s %63s", word);
+                p.name = word;
+            }
+            else
+            {
+                if (!ParsePlyType(a, p.type, p.is_float))
+                {
+                    error = "unsupported property type";
+                    return false;
+                }
+                p.name = b;
+            }
+            elements.back().properties.push_back(p);
+        }
+        else if (!strcmp(word, "end_header"))
+        {
+            break;
+        }
+    }
+
+    mesh = Mesh();
+
+    std::vector<unsigned int> polygon;
+    unsigned long long vertex_count = 0;
+
+    for (size_t e = 0; e < elements.size(); ++e)
+    {
+        const PlyElement& element = elements[e];
+        bool is_vertex = element.name == "vertex";
+        bool is_face = element.name == "face";
+
+        // Map the properties we understand to attribute slots
+        std::vector<int> slot(element.properties.size(), -1);
+        bool has_normals = false, has_texcoords = false;
+        if (is_vertex)
+        {
+            static const char *names[8][3] =
+            {
+                { "x", 0, 0 }, { "y", 0, 0 }, { "z", 0, 0 },
+                { "nx", 0, 0 }, { "ny", 0, 0 }, { "nz", 0, 0 },
+                { "u", "s", "texture_u" }, { "v", "t", "texture_v" }
+            };
+
+            for (size_t p = 0; p < element.properties.size(); ++p)
+            {
+                for (int n = 0; n < 8; ++n)
+                {
+                    for (int k = 0; k < 3 && names[n][k]; ++k)
+                    {
+                        if (element.properties[p].name == names[n][k])
+                            slot[p] = n;
+                    }
+                }
+                has_normals |= slot[p] >= 3 && slot[p] <= 5;
+                has_texcoords |= slot[p] >= 6;
+            }
+
+            vertex_count = element.count;
+        }
+
+        for (unsigned long long i = 0; i < element.count; ++i)
+        {
+            float vertex[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+            for (size_t p = 0; p < element.properties.size(); ++p)
+            {
+                const PlyProperty& property = element.properties[p];
+                double value;
+
+                if (property.is_list)
+                {
+                    double count;
+                    if (!ReadPlyValue(f, format, property.count_type, property.count_is_float, count))
+                    {
+                        error = "unexpected end of file";
+                        return false;
+                    }
+
+                    polygon.clear();
+                    for (unsigned int k = 0; k < (unsigned int)count; ++k)
+                    {
+                        if (!ReadPlyValue(f, format, property.type, property.is_float, value))
+                        {
+                            error = "unexpected end of file";
+                            return false;
+                        }
+                        polygon.push_back((unsigned int)value);
+                    }
+
+                    if (is_face && (property.name == "vertex_indices" || property.name == "vertex_index"))
+                    {
+                        for (size_t k = 0; k < polygon.size(); ++k)
+                        {
+                            if (polygon[k] >= vertex_count)
+                            {
+                                error = "face references a missing vertex";
+                                return false;
+                            }
+                        }
+                        for (size_t k = 2; k < polygon.size(); ++k)
+                        {
+                            mesh.indices.push_back(polygon[0]);
+                            mesh.indices.push_back(polygon[k - 1]);
+                            mesh.indices.push_back(polygon[k]);
+                        }
+                    }
+                }
+                else
+                {
+                    if (!ReadPlyValue(f, format, property.type, property.is_float, value))
+                    {
+                        error = "unexpected end of file";
+                        return false;
+                    }
+                    if (slot[p] >= 0)
+                        vertex[slot[p]] = (float)value;
+                }
+            }
+
+            if (is_vertex)
+            {
+                mesh.positions.insert(mesh.positions.end(), vertex, vertex + 3);
+                if (has_normals)
+                    mesh.normals.insert(mesh.normals.end(), vertex + 3, vertex + 6);
+                if (has_texcoords)
+                    mesh.texcoords.insert(mesh.texcoords.end(), vertex + 6, vertex + 8);
+            }
+        }
+    }
+
+    if (mesh.indices.empty())
+    {
+        error = "no faces";
+        return false;
+    }
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ImportMesh
+//
+// Purpose: Picks the importer from the file extension.
+//
+// INPUTS: filename - an .obj or .ply file
+//         mesh     - receives the mesh as a single frame
+//         error    - receives a description of the problem
+//
+// OUTPUTS: Returns false if the file could not be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ImportMesh(const char *filename, Mesh& mesh, std::string& error)
+{
+    std::string name(filename);
+    std::string extension = name.size() > 4 ? name.substr(name.size() - 4) : "";
+
+    for (size_t i = 0; i < extension.size(); ++i)
+        extension[i] = (char)tolower(extension[i]);
+
+    bool ok;
+    if (extension == ".obj")
+        ok = ImportOBJ(filename, mesh, error);
+    else if (extension == ".ply")
+        ok = ImportPLY(filename, mesh, error);
+    else
+    {
+        error = "unknown file type (expected .obj or .ply)";
+        return false;
+    }
+
+    if (ok)
+    {
+        VBM_FRAME_HEADER frame = { 0, (unsigned int)mesh.indices.size(), VBM_FRAME_TRIANGLES };
+        mesh.frames.assign(1, frame);
+    }
+
+    return ok;
+}
@@ -0,0 +1,640 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: MeshOptimize.cpp
+//
+// Purpose: This file contains the mesh processing steps of the vbmc asset
+//          compiler: welding, normal generation, vertex cache and vertex
+//          fetch optimization, LOD generation, meshlets and bounds.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include "Mesh.h"
+
+static const unsigned int NO_VERTEX = 0xFFFFFFFF;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WeldVertices
+//
+// Purpose: Merges vertices whose attributes are bitwise identical.
+//
+// INPUTS: mesh - the mesh to weld
+//
+// OUTPUTS: Returns the number of vertices removed.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned int WeldVertices(Mesh& mesh)
+{
+    unsigned int vertex_count = mesh.VertexCount();
+    bool has_normals = !mesh.normals.empty();
+    bool has_texcoords = !mesh.texcoords.empty();
+
+    // Pack each vertex so it can be hashed and compared as one block
+    unsigned int stride = 3 + (has_normals ? 3 : 0) + (has_texcoords ? 2 : 0);
+    std::vector<float> packed((size_t)vertex_count * stride);
+    for (unsigned int i = 0; i < vertex_count; ++i)
+    {
+        float *v = &packed[(size_t)i * stride];
+        memcpy(v, &mesh.positions[i * 3], 3 * sizeof(float));
+        if (has_normals)
+            memcpy(v + 3, &mesh.normals[i * 3], 3 * sizeof(float));
+        if (has_texcoords)
+            memcpy(v + stride - 2, &mesh.texcoords[i * 2], 2 * sizeof(float));
+    }
+
+    // Open addressing hash table of vertex indices
+    size_t table_size = 1;
+    while (table_size < (size_t)vertex_count * 2)
+        table_size <<= 1;
+    std::vector<unsigned int> table(table_size, NO_VERTEX);
+    std::vector<unsigned int> remap(vertex_count);
+    unsigned int unique = 0;
+
+    for (unsigned int i = 0; i < vertex_count; ++i)
+    {
+        const unsigned char *bytes = (const unsigned char *)&packed[(size_t)i * stride];
+        unsigned long long hash = 14695981039346656037ULL;
+        for (unsigned int b = 0; b < stride * sizeof(float); ++b)
+            hash = (hash ^ bytes[b]) * 1099511628211ULL;
+
+        size_t slot = (size_t)hash & (table_size - 1);
+        for (;;)
+        {
+            unsigned int other = table[slot];
+            if (other == NO_VERTEX)
+            {
+                table[slot] = i;
+                remap[i] = unique;
+                if (unique != i)
+                    memcpy(&packed[(size_t)unique * stride], bytes, stride * sizeof(float));
+                ++unique;
+                break;
+            }
+            if (!memcmp(&packed[(size_t)remap[other] * stride], bytes, stride * sizeof(float)))
+            {
+                remap[i] = remap[other];
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    for (size_t i = 0; i < mesh.indices.size(); ++i)
+        mesh.indices[i] = remap[mesh.indices[i]];
+
+    mesh.positions.resize((size_t)unique * 3);
+    if (has_normals)
+        mesh.normals.resize((size_t)unique * 3);
+    if (has_texcoords)
+        mesh.texcoords.resize((size_t)unique * 2);
+    for (unsigned int i = 0; i < unique; ++i)
+    {
+        const float *v = &packed[(size_t)i * stride];
+        memcpy(&mesh.positions[i * 3], v, 3 * sizeof(float));
+        if (has_normals)
+            memcpy(&mesh.normals[i * 3], v + 3, 3 * sizeof(float));
+        if (has_texcoords)
+            memcpy(&mesh.texcoords[i * 2], v + stride - 2, 2 * sizeof(float));
+    }
+
+    return vertex_count - unique;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ComputeNormals
+//
+// Purpose: Computes smooth, area-weighted vertex normals from frame 0.
+//
+// INPUTS: mesh - the mesh to update
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ComputeNormals(Mesh& mesh)
+{
+    mesh.normals.assign(mesh.positions.size(), 0.0f);
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const float *a = &mesh.positions[mesh.indices[i] * 3];
+        const float *b = &mesh.positions[mesh.indices[i + 1] * 3];
+        const float *c = &mesh.positions[mesh.indices[i + 2] * 3];
+        float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+        // The cross product is twice the area, so larger faces weigh more
+        float n[3] = { e0[1] * e1[2] - e0[2] * e1[1],
+                       e0[2] * e1[0] - e0[0] * e1[2],
+                       e0[0] * e1[1] - e0[1] * e1[0] };
+
+        for (int k = 0; k < 3; ++k)
+        {
+            float *dest = &mesh.normals[mesh.indices[i + k] * 3];
+            dest[0] += n[0];
+            dest[1] += n[1];
+            dest[2] += n[2];
+        }
+    }
+
+    for (size_t i = 0; i < mesh.normals.size(); i += 3)
+    {
+        float *n = &mesh.normals[i];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+        else
+        {
+            n[2] = 1.0f;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex cache optimization, after Tom Forsyth, "Linear-Speed Vertex Cache
+// Optimisation" (2006).
+///////////////////////////////////////////////////////////////////////////////
+
+static const int FORSYTH_CACHE_SIZE = 32;
+static const int FORSYTH_MAX_VALENCE = 64;
+
+struct ForsythTables
+{
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[FORSYTH_MAX_VALENCE];
+
+    ForsythTables()
+    {
+        for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+        {
+            // The last triangle's vertices get a fixed score so that the
+            // optimizer does not simply keep re-using them
+            cache[i] = i < 3 ? 0.75f :
+                       powf(1.0f - float(i - 3) / float(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        for (int i = 0; i < FORSYTH_MAX_VALENCE; ++i)
+        {
+            // Boost vertices with few remaining triangles to avoid leaving
+            // lone triangles behind
+            valence[i] = i ? 2.0f / sqrtf(float(i)) : 0.0f;
+        }
+    }
+};
+
+static float VertexScore(const ForsythTables& tables, int cache_position, unsigned int remaining)
+{
+    if (remaining == 0)
+        return -1.0f;
+
+    float score = cache_position >= 0 ? tables.cache[cache_position] : 0.0f;
+    return score + tables.valence[remaining < (unsigned int)FORSYTH_MAX_VALENCE ?
+                                  remaining : FORSYTH_MAX_VALENCE - 1];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: OptimizeVertexCache
+//
+// Purpose: Reorders triangles for the post-transform vertex cache.
+//
+// INPUTS: indices      - a triangle list, reordered in place
+//         count        - the number of indices
+//         vertex_count - one more than the largest index
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void OptimizeVertexCache(unsigned int *indices, unsigned int count, unsigned int vertex_count)
+{
+    static const ForsythTables tables;
+    unsigned int triangle_count = count / 3;
+
+    if (triangle_count == 0)
+        return;
+
+    // Per-vertex lists of the triangles that still need to be emitted
+    std::vector<unsigned int> remaining(vertex_count, 0);
+    for (unsigned int i = 0; i < triangle_count * 3; ++i)
+        ++remaining[indices[i]];
+
+    std::vector<unsigned int> offset(vertex_count + 1, 0);
+    for (unsigned int v = 0; v < vertex_count; ++v)
+        offset[v + 1] = offset[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(triangle_count * 3);
+    std::vector<unsigned int> fill(offset.begin(), offset.end() - 1);
+    for (unsigned int t = 0; t < triangle_count; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (unsigned int v = 0; v < vertex_count; ++v)
+        vertex_score[v] = VertexScore(tables, -1, remaining[v]);
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    unsigned int best = 0;
+    for (unsigned int t = 0; t < triangle_count; ++t)
+    {
+        triangle_score[t] = vertex_score[indices[t * 3]] +
+                            vertex_score[indices[t * 3 + 1]] +
+                            vertex_score[indices[t * 3 + 2]];
+        if (triangle_score[t] > triangle_score[best])
+            best = t;
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(triangle_count * 3);
+
+    std::vector<unsigned int> cache, next_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    unsigned int cursor = 0;
+
+    for (unsigned int n = 0; n < triangle_count; ++n)
+    {
+        if (best == NO_VERTEX)
+        {
+            // Nothing in the cache touches a pending triangle; continue
+            // with the next one in the original order
+            while (emitted[cursor])
+                ++cursor;
+            best = cursor;
+        }
+
+        const unsigned int *tri = &indices[best * 3];
+        output.insert(output.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        // Remove the triangle from its vertices' lists
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = tri[k];
+            unsigned int *list = &adjacency[offset[v]];
+            for (unsigned int i = 0; i < remaining[v]; ++i)
+            {
+                if (list[i] == best)
+                {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        // The triangle's vertices move to the front of the LRU cache
+        next_cache.assign(tri, tri + 3);
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                next_cache.push_back(cache[i]);
+        }
+        cache.swap(next_cache);
+
+        // Rescore everything that was in the cache, including the vertices
+        // that just fell out of it, and pick the best neighboring triangle
+        best = NO_VERTEX;
+        float best_score = -1.0f;
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            unsigned int v = cache[i];
+            cache_position[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertex_score[v] = VertexScore(tables, cache_position[v], remaining[v]);
+        }
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            unsigned int v = cache[i];
+            const unsigned int *list = &adjacency[offset[v]];
+            for (unsigned int j = 0; j < remaining[v]; ++j)
+            {
+                unsigned int t = list[j];
+                triangle_score[t] = vertex_score[indices[t * 3]] +
+                                    vertex_score[indices[t * 3 + 1]] +
+                                    vertex_score[indices[t * 3 + 2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (cache.size() > (size_t)FORSYTH_CACHE_SIZE)
+            cache.resize(FORSYTH_CACHE_SIZE);
+    }
+
+    memcpy(indices, &output[0], output.size() * sizeof(unsigned int));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: OptimizeVertexFetch
+//
+// Purpose: Renumbers vertices in the order the index buffer first uses them
+//          so that vertex fetches walk memory forwards. Unreferenced
+//          vertices are dropped.
+//
+// INPUTS: mesh - the mesh to update (every frame is remapped)
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void OptimizeVertexFetch(Mesh& mesh)
+{
+    unsigned int vertex_count = mesh.VertexCount();
+    std::vector<unsigned int> remap(vertex_count, NO_VERTEX);
+    unsigned int next = 0;
+
+    for (size_t i = 0; i < mesh.indices.size(); ++i)
+    {
+        unsigned int& index = mesh.indices[i];
+        if (remap[index] == NO_VERTEX)
+            remap[index] = next++;
+        index = remap[index];
+    }
+
+    std::vector<float> positions((size_t)next * 3);
+    std::vector<float> normals(mesh.normals.empty() ? 0 : (size_t)next * 3);
+    std::vector<float> texcoords(mesh.texcoords.empty() ? 0 : (size_t)next * 2);
+
+    for (unsigned int v = 0; v < vertex_count; ++v)
+    {
+        unsigned int to = remap[v];
+        if (to == NO_VERTEX)
+            continue;
+
+        memcpy(&positions[to * 3], &mesh.positions[v * 3], 3 * sizeof(float));
+        if (!normals.empty())
+            memcpy(&normals[to * 3], &mesh.normals[v * 3], 3 * sizeof(float));
+        if (!texcoords.empty())
+            memcpy(&texcoords[to * 2], &mesh.texcoords[v * 2], 2 * sizeof(float));
+    }
+
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+    mesh.texcoords.swap(texcoords);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BuildLOD
+//
+// Purpose: Appends a simplified copy of frame 0 as a new frame. Vertices
+//          are clustered on a uniform grid; every cluster collapses onto the
+//          existing vertex nearest its centroid, so all levels share one
+//          vertex buffer.
+//
+// INPUTS: mesh  - the mesh to extend
+//         cells - the number of grid cells along the largest axis
+//
+// OUTPUTS: Returns false if the level would not remove any triangles.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool BuildLOD(Mesh& mesh, unsigned int cells)
+{
+    MeshBounds bounds = ComputeBounds(mesh);
+    float extent = 0.0f;
+    for (int k = 0; k < 3; ++k)
+        extent = std::max(extent, bounds.max[k] - bounds.min[k]);
+    if (extent <= 0.0f || cells == 0)
+        return false;
+
+    float cell_size = extent / float(cells);
+    const VBM_FRAME_HEADER& base = mesh.frames[0];
+    unsigned int vertex_count = mesh.VertexCount();
+
+    // Cluster the vertices used by frame 0 and accumulate centroids
+    std::vector<unsigned long long> cell_of(vertex_count, 0);
+    std::unordered_map<unsigned long long, unsigned int> cluster_of_cell;
+    std::vector<float> centroid;
+    std::vector<unsigned int> members;
+
+    for (unsigned int i = 0; i < base.count; ++i)
+    {
+        unsigned int v = mesh.indices[base.first + i];
+        const float *p = &mesh.positions[v * 3];
+        unsigned long long key = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned long long c = (unsigned long long)((p[k] - bounds.min[k]) / cell_size);
+            key = (key << 21) | (c & 0x1FFFFF);
+        }
+        cell_of[v] = key;
+
+        std::pair<std::unordered_map<unsigned long long, unsigned int>::iterator, bool> slot =
+            cluster_of_cell.insert(std::make_pair(key, (unsigned int)members.size()));
+        if (slot.second)
+        {
+            centroid.insert(centroid.end(), 3, 0.0f);
+            members.push_back(0);
+        }
+        // Every corner counts, so well-connected vertices pull harder
+        unsigned int cluster = slot.first->second;
+        for (int k = 0; k < 3; ++k)
+            centroid[cluster * 3 + k] += p[k];
+        ++members[cluster];
+    }
+
+    for (size_t c = 0; c < members.size(); ++c)
+    {
+        for (int k = 0; k < 3; ++k)
+            centroid[c * 3 + k] /= float(members[c]);
+    }
+
+    // Pick the representative of each cluster
+    std::vector<unsigned int> representative(members.size(), NO_VERTEX);
+    std::vector<float> best_distance(members.size(), 0.0f);
+    for (unsigned int i = 0; i < base.count; ++i)
+    {
+        unsigned int v = mesh.indices[base.first + i];
+        unsigned int cluster = cluster_of_cell[cell_of[v]];
+        const float *p = &mesh.positions[v * 3];
+        const float *c = &centroid[cluster * 3];
+        float d = (p[0] - c[0]) * (p[0] - c[0]) + (p[1] - c[1]) * (p[1] - c[1]) + (p[2] - c[2]) * (p[2] - c[2]);
+        if (representative[cluster] == NO_VERTEX || d < best_distance[cluster])
+        {
+            representative[cluster] = v;
+            best_distance[cluster] = d;
+        }
+    }
+
+    // Collapse the triangles and drop the ones that became degenerate
+    std::vector<unsigned int> lod;
+    for (unsigned int i = 0; i + 2 < base.count; i += 3)
+    {
+        unsigned int t[3];
+        for (int k = 0; k < 3; ++k)
+            t[k] = representative[cluster_of_cell[cell_of[mesh.indices[base.first + i + k]]]];
+
+        if (t[0] != t[1] && t[1] != t[2] && t[2] != t[0])
+            lod.insert(lod.end(), t, t + 3);
+    }
+
+    if (lod.empty() || lod.size() >= base.count)
+        return false;
+
+    OptimizeVertexCache(&lod[0], (unsigned int)lod.size(), vertex_count);
+
+    VBM_FRAME_HEADER frame = { (unsigned int)mesh.indices.size(), (unsigned int)lod.size(), VBM_FRAME_TRIANGLES };
+    mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+    mesh.frames.push_back(frame);
+
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: BuildMeshlets
+//
+// Purpose: Splits frame 0 into meshlets in index order. After vertex cache
+//          optimization consecutive triangles are spatially coherent, so
+//          the meshlets come out compact.
+//
+// INPUTS: mesh          - the mesh to split
+//         max_vertices  - the vertex limit of a meshlet
+//         max_triangles - the triangle limit of a meshlet
+//         meshlets      - receives the meshlets
+//
+// OUTPUTS: None.
+//
+///////////////////////////////////////////////////////////////////////////////
+void BuildMeshlets(const Mesh& mesh, unsigned int max_vertices,
+                   unsigned int max_triangles, std::vector<Meshlet>& meshlets)
+{
+    const VBM_FRAME_HEADER& base = mesh.frames[0];
+    std::vector<unsigned int> stamp(mesh.VertexCount(), NO_VERTEX);
+    std::vector<unsigned int> vertices;
+
+    meshlets.clear();
+
+    Meshlet current = { base.first, 0, 0, { 0, 0, 0 }, 0 };
+    unsigned int id = 0;
+
+    for (unsigned int i = 0; i + 2 < base.count; i += 3)
+    {
+        const unsigned int *t = &mesh.indices[base.first + i];
+        unsigned int added = 0;
+        for (int k = 0; k < 3; ++k)
+            added += stamp[t[k]] != id ? 1 : 0;
+
+        if (current.vertex_count + added > max_vertices || current.triangle_count == max_triangles)
+        {
+            meshlets.push_back(current);
+            current.first_index = base.first + i;
+            current.triangle_count = 0;
+            current.vertex_count = 0;
+            ++id;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (stamp[t[k]] != id)
+            {
+                stamp[t[k]] = id;
+                ++current.vertex_count;
+            }
+        }
+        ++current.triangle_count;
+    }
+    if (current.triangle_count)
+        meshlets.push_back(current);
+
+    // Bounding spheres, centered on each meshlet's bounding box
+    for (size_t m = 0; m < meshlets.size(); ++m)
+    {
+        Meshlet& meshlet = meshlets[m];
+        float lo[3] = { 1e30f, 1e30f, 1e30f };
+        float hi[3] = { -1e30f, -1e30f, -1e30f };
+        const unsigned int *t = &mesh.indices[meshlet.first_index];
+
+        for (unsigned int i = 0; i < meshlet.triangle_count * 3; ++i)
+        {
+            const float *p = &mesh.positions[t[i] * 3];
+            for (int k = 0; k < 3; ++k)
+            {
+                lo[k] = std::min(lo[k], p[k]);
+                hi[k] = std::max(hi[k], p[k]);
+            }
+        }
+
+        float radius2 = 0.0f;
+        for (int k = 0; k < 3; ++k)
+            meshlet.center[k] = 0.5f * (lo[k] + hi[k]);
+        for (unsigned int i = 0; i < meshlet.triangle_count * 3; ++i)
+        {
+            const float *p = &mesh.positions[t[i] * 3];
+            float d = (p[0] - meshlet.center[0]) * (p[0] - meshlet.center[0]) +
+                      (p[1] - meshlet.center[1]) * (p[1] - meshlet.center[1]) +
+                      (p[2] - meshlet.center[2]) * (p[2] - meshlet.center[2]);
+            radius2 = std::max(radius2, d);
+        }
+        meshlet.radius = sqrtf(radius2);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ComputeBounds
+//
+// Purpose: Computes the bounding box of all vertices and a bounding sphere
+//          centered on the box.
+//
+// INPUTS: mesh - the mesh to measure
+//
+// OUTPUTS: The bounds.
+//
+///////////////////////////////////////////////////////////////////////////////
+MeshBounds ComputeBounds(const Mesh& mesh)
+{
+    MeshBounds bounds;
+    unsigned int vertex_count = mesh.VertexCount();
+
+    for (int k = 0; k < 3; ++k)
+    {
+        bounds.min[k] = vertex_count ? 1e30f : 0.0f;
+        bounds.max[k] = vertex_count ? -1e30f : 0.0f;
+    }
+
+    for (unsigned int v = 0; v < vertex_count; ++v)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            bounds.min[k] = std::min(bounds.min[k], mesh.positions[v * 3 + k]);
+            bounds.max[k] = std::max(bounds.max[k], mesh.positions[v * 3 + k]);
+        }
+    }
+
+    float radius2 = 0.0f;
+    for (int k = 0; k < 3; ++k)
+        bounds.center[k] = 0.5f * (bounds.min[k] + bounds.max[k]);
+    for (unsigned int v = 0; v < vertex_count; ++v)
+    {
+        const float *p = &mesh.positions[v * 3];
+        float d = (p[0] - bounds.center[0]) * (p[0] - bounds.center[0]) +
+                  (p[1] - bounds.center[1]) * (p[1] - bounds.center[1]) +
+                  (p[2] - bounds.center[2]) * (p[2] - bounds.center[2]);
+        radius2 = std::max(radius2, d);
+    }
+    bounds.radius = sqrtf(radius2);
+
+    return bounds;
+}
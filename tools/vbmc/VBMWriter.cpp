@@ -0,0 +1,424 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: VBMWriter.cpp
+//
+// Purpose: This file contains the VBM writer of the vbmc asset compiler. The
+//          data is written exactly as VBObject uploads it, so loading the
+//          file needs no conversion at runtime.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "Mesh.h"
+#include "Stripifier.h"
+#include "VBMCodec.h"
+
+// GL enumerants, so the tool does not need GL headers
+static const unsigned int GL_UNSIGNED_SHORT_ = 0x1403;
+static const unsigned int GL_UNSIGNED_INT_ = 0x1405;
+static const unsigned int GL_FLOAT_ = 0x1406;
+static const unsigned int GL_HALF_FLOAT_ = 0x140B;
+static const unsigned int GL_INT_2_10_10_10_REV_ = 0x8D9F;
+
+// Raw size of a VBM2 chunk. Small enough that a mesh splits into many
+// chunks to decode in parallel, large enough for LZ4 to find matches.
+static const unsigned int VBM2_CHUNK_SIZE = 256 * 1024;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: FloatToHalf
+//
+// Purpose: Converts a float to an IEEE half, rounding to nearest even.
+//
+// INPUTS: value - the float to convert
+//
+// OUTPUTS: The half float bits.
+//
+///////////////////////////////////////////////////////////////////////////////
+static unsigned short FloatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    unsigned int sign = (bits >> 16) & 0x8000;
+    unsigned int magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000)
+    {
+        // Inf stays Inf, NaN stays NaN
+        return (unsigned short)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+    }
+    if (magnitude >= 0x477FF000)
+    {
+        // Too large, including values that round up past 65504
+        return (unsigned short)(sign | 0x7C00);
+    }
+    if (magnitude < 0x38800000)
+    {
+        // Denormal half (or zero): shift the mantissa with the implicit one
+        if (magnitude < 0x33000000)
+            return (unsigned short)sign;
+        unsigned int exponent = magnitude >> 23;
+        unsigned int mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        unsigned int shift = 126 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ((1u << shift) - 1);
+        unsigned int middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1)))
+            ++half;
+        return (unsigned short)(sign | half);
+    }
+
+    // Rebias the exponent and round the mantissa to 10 bits
+    unsigned int half = (magnitude - 0x38000000) >> 13;
+    unsigned int rest = magnitude & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        ++half;
+    return (unsigned short)(sign | half);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: PackNormal
+//
+// Purpose: Packs a unit vector as GL_INT_2_10_10_10_REV, normalized.
+//
+// INPUTS: n - the normal
+//
+// OUTPUTS: The packed normal, with w = 0.
+//
+///////////////////////////////////////////////////////////////////////////////
+static unsigned int PackNormal(const float *n)
+{
+    unsigned int packed = 0;
+
+    for (int k = 0; k < 3; ++k)
+    {
+        float c = n[k] < -1.0f ? -1.0f : (n[k] > 1.0f ? 1.0f : n[k]);
+        int value = (int)floorf(c * 511.0f + 0.5f);
+        packed |= ((unsigned int)value & 0x3FF) << (k * 10);
+    }
+
+    return packed;
+}
+
+
+
+static void SetName(char *dest, size_t size, const char *name)
+{
+    memset(dest, 0, size);
+    strncpy(dest, name, size - 1);
+}
+
+
+
+// A section of the image that is chunked with one filter element size
+struct ImageSection
+{
+    size_t offset;
+    size_t size;
+    unsigned int element_size;
+};
+
+template <typename T>
+static void Append(std::vector<unsigned char>& image, const T *data, size_t count)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    image.insert(image.end(), bytes, bytes + count * sizeof(T));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteVBM2
+//
+// Purpose: Writes an SBM1 image as a VBM2 file. Every section is split into
+//          chunks of at most VBM2_CHUNK_SIZE bytes, each filtered with the
+//          element size of its section and compressed on its own.
+//
+// INPUTS: f        - the file to write to
+//         image    - the SBM1 image
+//         sections - the sections of the image, in order
+//         bounds   - the bounds chunk
+//         meshlets - the meshlet chunk, skipped if empty
+//
+// OUTPUTS: Returns false if writing failed.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool WriteVBM2(FILE *f, const std::vector<unsigned char>& image,
+                      const std::vector<ImageSection>& sections,
+                      const MeshBounds& bounds, const std::vector<Meshlet>& meshlets)
+{
+    std::vector<VBM2_CHUNK> chunks;
+    std::vector<const unsigned char *> sources;
+
+    for (size_t s = 0; s < sections.size(); ++s)
+    {
+        const ImageSection& section = sections[s];
+        size_t limit = s == 0 ? section.size :
+                       VBM2_CHUNK_SIZE - VBM2_CHUNK_SIZE % section.element_size;
+
+        for (size_t offset = 0; offset < section.size; offset += limit)
+        {
+            VBM2_CHUNK chunk;
+            memset(&chunk, 0, sizeof(chunk));
+            chunk.type = VBM2_CHUNK_IMAGE;
+            chunk.element_size = section.element_size;
+            chunk.raw_offset = section.offset + offset;
+            chunk.raw_size = section.size - offset < limit ? section.size - offset : limit;
+            chunks.push_back(chunk);
+            sources.push_back(&image[0] + chunk.raw_offset);
+        }
+    }
+
+    VBM2_CHUNK extra;
+    memset(&extra, 0, sizeof(extra));
+    extra.type = VBM2_CHUNK_BOUNDS;
+    extra.element_size = sizeof(float);
+    extra.raw_size = sizeof(MeshBounds);
+    chunks.push_back(extra);
+    sources.push_back((const unsigned char *)&bounds);
+
+    if (!meshlets.empty())
+    {
+        extra.type = VBM2_CHUNK_MESHLETS;
+        extra.element_size = sizeof(Meshlet);
+        extra.raw_size = meshlets.size() * sizeof(Meshlet);
+        chunks.push_back(extra);
+        sources.push_back((const unsigned char *)&meshlets[0]);
+    }
+
+    VBM2_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.magic = VBM2_MAGIC;
+    header.version = VBM2_VERSION;
+    header.size = sizeof(VBM2_HEADER);
+    header.num_chunks = (unsigned int)chunks.size();
+    header.image_size = image.size();
+
+    // Chunks follow the header at aligned offsets; the table goes last
+    // because the stored sizes are only known after compression
+    static const unsigned char padding[VBM2_ALIGNMENT] = { 0 };
+    unsigned long long offset = sizeof(VBM2_HEADER);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    std::vector<unsigned char> stored;
+
+    for (size_t i = 0; i < chunks.size() && ok; ++i)
+    {
+        size_t pad = (size_t)((VBM2_ALIGNMENT - offset % VBM2_ALIGNMENT) % VBM2_ALIGNMENT);
+        ok = fwrite(padding, 1, pad, f) == pad;
+        offset += pad;
+
+        EncodeVBM2Chunk(chunks[i], sources[i], stored);
+        chunks[i].offset = offset;
+        ok = ok && fwrite(&stored[0], 1, stored.size(), f) == stored.size();
+        offset += stored.size();
+    }
+
+    header.chunk_table_offset = offset;
+    ok = ok && fwrite(&chunks[0], sizeof(VBM2_CHUNK), chunks.size(), f) == chunks.size();
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fseek(f, 0, SEEK_END) == 0;
+
+    return ok;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: WriteVBM
+//
+// Purpose: Writes a mesh as a VBM file. Attribute 0 is the position,
+//          attribute 1 the normal and attribute 2 the texture coordinate if
+//          the mesh has one, matching the locations used by the samples.
+//
+// INPUTS: filename      - the file to create
+//         mesh          - the mesh to write; every frame must be a list
+//         bounds        - the bounds of the mesh (VBM2 only)
+//         meshlets      - the meshlets of frame 0 (VBM2 only)
+//         options       - quantization, strips, container and mesh name
+//         bytes_written - optional, receives the size of the file
+//         error         - receives a description of any failure
+//
+// OUTPUTS: Returns false if the file could not be written.
+//
+// NOTES: Quantized files store positions as four half floats (w = 1 keeps
+//        every vertex 4-byte aligned), normals as normalized
+//        INT_2_10_10_10_REV and texture coordinates as two half floats.
+//        Indices are 16-bit whenever the vertex count leaves room for the
+//        restart index.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool WriteVBM(const char *filename, const Mesh& mesh, const MeshBounds& bounds,
+              const std::vector<Meshlet>& meshlets, const ExportOptions& options,
+              unsigned long long *bytes_written, std::string& error)
+{
+    unsigned int vertex_count = mesh.VertexCount();
+    bool narrow = vertex_count < 0xFFFF;
+    unsigned int restart_index = narrow ? 0xFFFF : 0xFFFFFFFF;
+
+    // Build the final index stream, converting frames to strips where that
+    // saves indices
+    std::vector<unsigned int> indices;
+    std::vector<VBM_FRAME_HEADER> frames(mesh.frames);
+    std::vector<unsigned int> strip;
+
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+        const VBM_FRAME_HEADER& source = mesh.frames[f];
+        VBM_FRAME_HEADER& frame = frames[f];
+        const unsigned int *list = source.count ? &mesh.indices[source.first] : 0;
+
+        frame.first = (unsigned int)indices.size();
+        if (options.strips && list &&
+            Stripify(list, source.count, restart_index, strip))
+        {
+            indices.insert(indices.end(), strip.begin(), strip.end());
+            frame.count = (unsigned int)strip.size();
+            frame.flags = VBM_FRAME_TRIANGLE_STRIP;
+        }
+        else
+        {
+            indices.insert(indices.end(), list, list + source.count);
+            frame.flags = VBM_FRAME_TRIANGLES;
+        }
+    }
+
+    // Headers
+    VBM_HEADER header;
+    VBM_ATTRIB_HEADER attribs[3];
+    unsigned int num_attribs = mesh.texcoords.empty() ? 2 : 3;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = VBM_MAGIC;
+    header.size = sizeof(VBM_HEADER);
+    SetName(header.name, sizeof(header.name), options.name.c_str());
+    header.num_attribs = num_attribs;
+    header.num_frames = (unsigned int)frames.size();
+    header.num_vertices = vertex_count;
+    header.num_indices = (unsigned int)indices.size();
+    header.index_type = narrow ? GL_UNSIGNED_SHORT_ : GL_UNSIGNED_INT_;
+
+    memset(attribs, 0, sizeof(attribs));
+    SetName(attribs[0].name, sizeof(attribs[0].name), "position");
+    SetName(attribs[1].name, sizeof(attribs[1].name), "normal");
+    SetName(attribs[2].name, sizeof(attribs[2].name), "map1");
+    if (options.quantize)
+    {
+        attribs[0].type = GL_HALF_FLOAT_;
+        attribs[0].components = 4;
+        attribs[1].type = GL_INT_2_10_10_10_REV_;
+        attribs[1].components = 4;
+        attribs[1].flags = VBM_ATTRIB_NORMALIZED;
+        attribs[2].type = GL_HALF_FLOAT_;
+        attribs[2].components = 2;
+    }
+    else
+    {
+        attribs[0].type = GL_FLOAT_;
+        attribs[0].components = 3;
+        attribs[1].type = GL_FLOAT_;
+        attribs[1].components = 3;
+        attribs[2].type = GL_FLOAT_;
+        attribs[2].components = 2;
+    }
+
+    // Assemble the SBM1 image, remembering where each section starts so
+    // that VBM2 chunks never straddle two of them
+    std::vector<unsigned char> image;
+    std::vector<ImageSection> sections;
+    ImageSection section;
+
+    Append(image, &header, 1);
+    Append(image, attribs, num_attribs);
+    Append(image, &frames[0], frames.size());
+    section.offset = 0;
+    section.size = image.size();
+    section.element_size = 0;
+    sections.push_back(section);
+
+    for (unsigned int a = 0; a < num_attribs; ++a)
+    {
+        section.offset = image.size();
+        section.element_size = GetVBMTypeSize(attribs[a].type, attribs[a].components);
+
+        if (!options.quantize)
+        {
+            const std::vector<float>& data = a == 0 ? mesh.positions : (a == 1 ? mesh.normals : mesh.texcoords);
+            Append(image, &data[0], data.size());
+        }
+        else if (a == 1)
+        {
+            std::vector<unsigned int> normals(vertex_count);
+            for (unsigned int v = 0; v < vertex_count; ++v)
+                normals[v] = PackNormal(&mesh.normals[v * 3]);
+            Append(image, &normals[0], normals.size());
+        }
+        else
+        {
+            unsigned int components = attribs[a].components;
+            const std::vector<float>& data = a == 0 ? mesh.positions : mesh.texcoords;
+            unsigned int stored = a == 0 ? 3 : 2;
+            std::vector<unsigned short> halves((size_t)vertex_count * components);
+            for (unsigned int v = 0; v < vertex_count; ++v)
+            {
+                for (unsigned int k = 0; k < components; ++k)
+                    halves[v * components + k] = FloatToHalf(k < stored ? data[v * stored + k] : 1.0f);
+            }
+            Append(image, &halves[0], halves.size());
+        }
+
+        section.size = image.size() - section.offset;
+        sections.push_back(section);
+    }
+
+    section.offset = image.size();
+    if (narrow)
+    {
+        std::vector<unsigned short> shorts(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            shorts[i] = (unsigned short)indices[i];
+        Append(image, &shorts[0], shorts.size());
+        section.element_size = sizeof(unsigned short);
+    }
+    else
+    {
+        Append(image, &indices[0], indices.size());
+        section.element_size = sizeof(unsigned int);
+    }
+    section.size = image.size() - section.offset;
+    sections.push_back(section);
+
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+    {
+        error = "cannot create file";
+        return false;
+    }
+
+    bool ok;
+    if (options.vbm2)
+    {
+        bool list = frames[0].flags == VBM_FRAME_TRIANGLES;
+        ok = WriteVBM2(f, image, sections, bounds, list ? meshlets : std::vector<Meshlet>());
+    }
+    else
+    {
+        ok = fwrite(&image[0], 1, image.size(), f) == image.size();
+    }
+
+    if (bytes_written)
+        *bytes_written = ok ? (unsigned long long)ftell(f) : 0;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok)
+    {
+        error = "write failed";
+        remove(filename);
+    }
+
+    return ok;
+}
@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: vbmc.cpp
+//
+// Purpose: Command line driver of the vbmc asset compiler. Converts OBJ and
+//          PLY files into VBM files that VBObject::LoadFromVBM uploads
+//          without any processing:
+//
+//          vbmc [options] input.obj|input.ply ...
+//
+//            -o file       output file (one input only)
+//            --outdir dir  directory for the outputs (default: next to input)
+//            -j n          number of files converted in parallel (default:
+//                          one per hardware thread)
+//            --quantize    half float positions/texcoords, packed normals
+//            --strip       store frames as restart-separated strips
+//            --lods n      append n levels of detail as extra frames
+//            --meshlets    build meshlets and report their statistics
+//            --vbm2        write a chunked, compressed VBM2 file
+//
+//          Build it with, for example:
+//
+//          g++ -std=c++11 -O2 -pthread -I../../include -o vbmc *.cpp
+//              ../../common/VBM.cpp ../../common/VBMCodec.cpp
+//              ../../common/Stripifier.cpp ../../common/JobSystem.cpp
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "Stripifier.h"
+
+#define MESHLET_MAX_VERTICES    64
+#define MESHLET_MAX_TRIANGLES   124
+
+struct Options
+{
+    std::string output;
+    std::string outdir;
+    unsigned int jobs;
+    unsigned int lods;
+    bool meshlets;
+    ExportOptions export_options;
+};
+
+// The files converted by one ParallelFor
+struct ConvertBatch
+{
+    const std::vector<std::string> *inputs;
+    const Options *options;
+    std::atomic<unsigned int> failures;
+};
+
+static std::mutex report_mutex;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: OutputName
+//
+// Purpose: Derives the output file name from the input file name.
+//
+// INPUTS: input   - the input file
+//         options - the command line options
+//
+// OUTPUTS: The name of the VBM file to write.
+//
+///////////////////////////////////////////////////////////////////////////////
+static std::string OutputName(const std::string& input, const Options& options)
+{
+    if (!options.output.empty())
+        return options.output;
+
+    size_t slash = input.find_last_of("/\\");
+    size_t dot = input.find_last_of('.');
+    std::string base = (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ?
+                       input.substr(0, dot) : input;
+
+    if (!options.outdir.empty())
+    {
+        base = base.substr(slash == std::string::npos ? 0 : slash + 1);
+        return options.outdir + "/" + base + ".vbm";
+    }
+
+    return base + ".vbm";
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Function Name: ConvertFile
+//
+// Purpose: Runs the whole pipeline on one file and prints a report.
+//
+// INPUTS: input   - the file to convert
+//         options - the command line options
+//
+// OUTPUTS: Returns false if the file could not be converted.
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool ConvertFile(const std::string& input, const Options& options)
+{
+    Mesh mesh;
+    std::string error;
+    std::string output = OutputName(input, options);
+
+    if (!ImportMesh(input.c_str(), mesh, error) || mesh.indices.empty())
+    {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        fprintf(stderr, "%s: %s\n", input.c_str(), error.empty() ? "no triangles" : error.c_str());
+        return false;
+    }
+
+    unsigned int imported = mesh.VertexCount();
+    unsigned int welded = WeldVertices(mesh);
+    bool generated_normals = mesh.normals.empty();
+    if (generated_normals)
+        ComputeNormals(mesh);
+
+    float acmr_before = ComputeACMR(&mesh.indices[0], (unsigned int)mesh.indices.size(), false, 0xFFFFFFFF);
+    OptimizeVertexCache(&mesh.indices[0], (unsigned int)mesh.indices.size(), mesh.VertexCount());
+    float acmr_after = ComputeACMR(&mesh.indices[0], (unsigned int)mesh.indices.size(), false, 0xFFFFFFFF);
+
+    // Each level halves the grid resolution; grids too fine to remove any
+    // triangles are skipped
+    unsigned int lods = 0;
+    for (unsigned int cells = 256; lods < options.lods && cells >= 4; cells /= 2)
+    {
+        if (BuildLOD(mesh, cells))
+            ++lods;
+    }
+
+    // Vertex fetch order last, as it renumbers every frame
+    OptimizeVertexFetch(mesh);
+
+    std::vector<Meshlet> meshlets;
+    if (options.meshlets)
+        BuildMeshlets(mesh, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, meshlets);
+
+    MeshBounds bounds = ComputeBounds(mesh);
+
+    ExportOptions export_options = options.export_options;
+    size_t slash = input.find_last_of("/\\");
+    export_options.name = input.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    unsigned long long bytes = 0;
+    if (!WriteVBM(output.c_str(), mesh, bounds, meshlets, export_options, &bytes, error))
+    {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        fprintf(stderr, "%s: %s: %s\n", input.c_str(), output.c_str(), error.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(report_mutex);
+    printf("%s -> %s (%llu bytes)\n", input.c_str(), output.c_str(), bytes);
+    printf("  vertices: %u imported, %u welded, %u written%s\n",
+           imported, welded, mesh.VertexCount(), generated_normals ? ", normals generated" : "");
+    printf("  triangles: %u, ACMR %.3f -> %.3f\n",
+           mesh.frames[0].count / 3, acmr_before, acmr_after);
+    for (size_t l = 1; l < mesh.frames.size(); ++l)
+        printf("  lod %u: %u triangles\n", (unsigned int)l, mesh.frames[l].count / 3);
+    printf("  bounds: (%g %g %g) - (%g %g %g), sphere radius %g\n",
+           bounds.min[0], bounds.min[1], bounds.min[2],
+           bounds.max[0], bounds.max[1], bounds.max[2], bounds.radius);
+    if (options.meshlets)
+    {
+        float vertices = 0.0f;
+        for (size_t m = 0; m < meshlets.size(); ++m)
+            vertices += float(meshlets[m].vertex_count);
+        printf("  meshlets: %u, %.1f vertices and %.1f triangles on average\n",
+               (unsigned int)meshlets.size(),
+               meshlets.empty() ? 0.0f : vertices / float(meshlets.size()),
+               meshlets.empty() ? 0.0f : float(mesh.frames[0].count / 3) / float(meshlets.size()));
+    }
+
+    return true;
+}
+
+
+
+// Files are independent, so a range of them is simply converted in order
+static void ConvertFiles(void *user, unsigned int first, unsigned int end)
+{
+    ConvertBatch *batch = (ConvertBatch *)user;
+
+    for (unsigned int i = first; i < end; ++i)
+    {
+        if (!ConvertFile((*batch->inputs)[i], *batch->options))
+            ++batch->failures;
+    }
+}
+
+
+
+static void Usage(void)
+{
+    fprintf(stderr,
+            "usage: vbmc [options] input.obj|input.ply ...\n"
+            "  -o file       output file (one input only)\n"
+            "  --outdir dir  directory for the outputs\n"
+            "  -j n          number of files converted in parallel\n"
+            "  --quantize    half float positions/texcoords, packed normals\n"
+            "  --strip       store frames as restart-separated strips\n"
+            "  --lods n      append n levels of detail as extra frames\n"
+            "  --meshlets    build meshlets and report their statistics\n"
+            "  --vbm2        write a chunked, compressed VBM2 file\n");
+}
+
+
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    std::vector<std::string> inputs;
+
+    options.jobs = 0;
+    options.lods = 0;
+    options.meshlets = false;
+    options.export_options.quantize = false;
+    options.export_options.strips = false;
+    options.export_options.vbm2 = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "-o" && has_value)
+            options.output = argv[++i];
+        else if (arg == "--outdir" && has_value)
+            options.outdir = argv[++i];
+        else if (arg == "-j" && has_value)
+            options.jobs = (unsigned int)atoi(argv[++i]);
+        else if (arg == "--lods" && has_value)
+            options.lods = (unsigned int)atoi(argv[++i]);
+        else if (arg == "--quantize")
+            options.export_options.quantize = true;
+        else if (arg == "--strip")
+            options.export_options.strips = true;
+        else if (arg == "--meshlets")
+            options.meshlets = true;
+        else if (arg == "--vbm2")
+            options.export_options.vbm2 = true;
+        else if (arg[0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (inputs.empty() || (!options.output.empty() && inputs.size() > 1))
+    {
+        Usage();
+        return 1;
+    }
+
+    // A grain of one file, so that idle threads steal single files
+    unsigned int threads = options.jobs ? options.jobs : 1;
+    if (threads > inputs.size())
+        threads = (unsigned int)inputs.size();
+
+    JobSystem jobs(threads);
+    ConvertBatch batch;
+    batch.inputs = &inputs;
+    batch.options = &options;
+    batch.failures = 0;
+    jobs.ParallelFor((unsigned int)inputs.size(), ConvertFiles, &batch, 1);
+
+    return batch.failures ? 1 : 0;
+}
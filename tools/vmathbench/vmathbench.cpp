@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// File Name: vmathbench.cpp
+//
+// Purpose: Compares the chained vmath expressions of the instancing sample
+//          with the fused functions that replace them: euler_to_mat4 and
+//          euler_to_mat3x4 against rotate() * rotate() * rotate() *
+//          translate(), and lerp and mul_add against the operator
+//          expressions. Each pair runs over the same inputs; the program
+//          prints the best time per element of each, and the largest
+//          difference between their results. For example:
+//
+//          g++ -O2 -std=c++14 -I../../include -o vmathbench vmathbench.cpp
+//          ./vmathbench 100000 50
+//
+//          With --json=file the times per element are also written to a
+//          file in the format of microbench --json.
+//
+//          The kernels are separate functions named Kernel*, so their code
+//          size can be compared with
+//
+//          nm -S --size-sort -C vmathbench | grep Kernel
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "vmath.h"
+using namespace vmath;
+
+
+// The matrix kernels are the transformation loop of instancing.cpp
+void KernelChainMat4(mat4 *out, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        out[n] = rotate(a + t * 360.0f, 1.0f, 0.0f, 0.0f) *
+                 rotate(b + t * 360.0f, 0.0f, 1.0f, 0.0f) *
+                 rotate(c + t * 360.0f, 0.0f, 0.0f, 1.0f) *
+                 translate(10.0f + a, 40.0f + b, 50.0f + c);
+    }
+}
+
+
+void KernelFusedMat4(mat4 *out, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        out[n] = euler_to_mat4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                               vec3(10.0f + a, 40.0f + b, 50.0f + c));
+    }
+}
+
+
+void KernelChainMat3x4(mat3x4 *out, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        out[n] = mat3x4(rotate(a + t * 360.0f, 1.0f, 0.0f, 0.0f)) *
+                 mat3x4(rotate(b + t * 360.0f, 0.0f, 1.0f, 0.0f)) *
+                 mat3x4(rotate(c + t * 360.0f, 0.0f, 0.0f, 1.0f)) *
+                 mat3x4(translate(10.0f + a, 40.0f + b, 50.0f + c));
+    }
+}
+
+
+void KernelFusedMat3x4(mat3x4 *out, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        float a = 50.0f * float(n) / 4.0f;
+        float b = 50.0f * float(n) / 5.0f;
+        float c = 50.0f * float(n) / 6.0f;
+
+        out[n] = euler_to_mat3x4(a + t * 360.0f, b + t * 360.0f, c + t * 360.0f,
+                                 vec3(10.0f + a, 40.0f + b, 50.0f + c));
+    }
+}
+
+
+void KernelChainLerp(vec4 *out, const vec4 *a, const vec4 *b, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = a[n] + (b[n] - a[n]) * t;
+}
+
+
+void KernelFusedLerp(vec4 *out, const vec4 *a, const vec4 *b, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = lerp(a[n], b[n], t);
+}
+
+
+void KernelChainMulAdd(vec4 *out, const vec4 *a, const vec4 *b, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = a[n] * b[n] + out[n] * t;
+}
+
+
+void KernelFusedMulAdd(vec4 *out, const vec4 *a, const vec4 *b, unsigned int count, float t)
+{
+    for (unsigned int n = 0; n < count; ++n)
+        out[n] = mul_add(a[n], b[n], out[n] * t);
+}
+
+
+static double Milliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// The largest difference between two arrays of floats, relative to the
+// magnitude of the reference
+static double MaxDifference(const float *x, const float *ref, size_t count)
+{
+    double worst = 0.0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        double d = fabs((double)x[i] - (double)ref[i]) / (1.0 + fabs((double)ref[i]));
+        if (d > worst)
+            worst = d;
+    }
+
+    return worst;
+}
+
+
+static void PrintPair(const char *name, double chain_ms, double fused_ms, unsigned int count, double difference)
+{
+    printf("%-10s %10.2f %10.2f %8.2fx  %10.3g\n", name, chain_ms * 1.0e6 / count, fused_ms * 1.0e6 / count,
+           chain_ms / fused_ms, difference);
+}
+
+
+// Writes the results as microbench --json does, a chain and a fused
+// benchmark per kernel
+static bool WriteJSON(const char *filename, const double *best, unsigned int count)
+{
+    static const char *const KERNELS[] = { "mat4", "mat3x4", "lerp", "mul_add" };
+
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (int k = 0; k < 8; ++k)
+    {
+        fprintf(f, "    { \"name\": \"%s %s\", \"ns_per_op\": %.3f }%s\n", KERNELS[k / 2],
+                k % 2 ? "fused" : "chain", best[k] * 1.0e6 / count, k < 7 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    // The positional arguments are the count and runs; --json=file may come
+    // anywhere
+    const char *json = NULL;
+    std::vector<const char *> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--json=", 7) == 0)
+            json = argv[i] + 7;
+        else
+            args.push_back(argv[i]);
+    }
+
+    unsigned int count = args.size() > 0 ? (unsigned int)atoi(args[0]) : 100000;
+    unsigned int runs = args.size() > 1 ? (unsigned int)atoi(args[1]) : 50;
+    if (count == 0 || runs == 0)
+        return 1;
+
+    std::vector<mat4> chain_mat4(count), fused_mat4(count);
+    std::vector<mat3x4> chain_mat3x4(count), fused_mat3x4(count);
+    std::vector<vec4> a(count), b(count), chain_vec4(count), fused_vec4(count);
+
+    for (unsigned int n = 0; n < count; ++n)
+    {
+        a[n] = vec4(float(n % 97), float(n % 89), float(n % 83), 1.0f) * 0.01f;
+        b[n] = vec4(float(n % 79), float(n % 73), float(n % 71), 2.0f) * 0.01f;
+    }
+
+    // Best of 'runs' for each kernel, interleaved so that both of a pair see
+    // the same machine state
+    double best[8];
+    double lerp_difference = 0.0;
+    for (int k = 0; k < 8; ++k)
+        best[k] = 1.0e30;
+
+    for (unsigned int r = 0; r < runs; ++r)
+    {
+        float t = float(r) / float(runs);
+        std::chrono::high_resolution_clock::time_point start;
+        double ms[8];
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelChainMat4(&chain_mat4[0], count, t);
+        ms[0] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelFusedMat4(&fused_mat4[0], count, t);
+        ms[1] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelChainMat3x4(&chain_mat3x4[0], count, t);
+        ms[2] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelFusedMat3x4(&fused_mat3x4[0], count, t);
+        ms[3] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelChainLerp(&chain_vec4[0], &a[0], &b[0], count, t);
+        ms[4] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelFusedLerp(&fused_vec4[0], &a[0], &b[0], count, t);
+        ms[5] = Milliseconds(start);
+        lerp_difference = MaxDifference(fused_vec4[0], chain_vec4[0], count * 4);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelChainMulAdd(&chain_vec4[0], &a[0], &b[0], count, t);
+        ms[6] = Milliseconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        KernelFusedMulAdd(&fused_vec4[0], &a[0], &b[0], count, t);
+        ms[7] = Milliseconds(start);
+
+        for (int k = 0; k < 8; ++k)
+        {
+            if (ms[k] < best[k])
+                best[k] = ms[k];
+        }
+    }
+
+    printf("%u elements, best of %u runs\n", count, runs);
+    printf("kernel      chain ns   fused ns  speedup  max diff\n");
+    PrintPair("mat4", best[0], best[1], count,
+              MaxDifference(fused_mat4[0], chain_mat4[0], count * 16));
+    PrintPair("mat3x4", best[2], best[3], count,
+              MaxDifference(fused_mat3x4[0], chain_mat3x4[0], count * 12));
+    PrintPair("lerp", best[4], best[5], count, lerp_difference);
+    PrintPair("mul_add", best[6], best[7], count,
+              MaxDifference(fused_vec4[0], chain_vec4[0], count * 4));
+
+    if (json && !WriteJSON(json, best, count))
+    {
+        fprintf(stderr, "vmathbench: cannot write %s\n", json);
+        return 1;
+    }
+
+    return 0;
+}